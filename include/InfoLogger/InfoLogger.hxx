@@ -30,6 +30,9 @@
 #include <atomic>
 #include <chrono>
 #include <vector>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
 
 // here are some macros to help including source code info in infologger messages
 // to be used to quickly specify "infoLoggerMessageOption" argument in some logging functions
@@ -41,6 +44,10 @@
 #define LOGERROR(level, errno) \
   InfoLogger::InfoLoggerMessageOption { InfoLogger::Severity::Error, level, errno, __FILE__, __LINE__ }
 
+// INFOLOGGER_MIN_LEVEL can be defined at build time (e.g. -DINFOLOGGER_MIN_LEVEL=11) to discard messages
+// with a level bigger than or equal to this value (e.g. Devel and Trace), as with InfoLogger::filterDiscardLevel().
+// Calls made with the InfoLoggerLog() macro (see InfoLoggerMacros.hxx) for such levels are then removed by the compiler.
+
 namespace AliceO2
 {
 namespace InfoLogger
@@ -137,6 +144,10 @@ class InfoLoggerContext final
 
   // ideas of other possible fields: thread id, exe name, ...
 
+  // identifier of the content, changed on each update (copies share it)
+  // it is used by InfoLogger to reuse the encoding of the context fields
+  unsigned long long version;
+
   friend class InfoLogger;
 };
 
@@ -325,6 +336,104 @@ class InfoLogger
   /// \return         0 on success, an error code otherwise (but never throw exceptions).
   int log(AutoMuteToken &token, const char* message, ...) __attribute__((format(printf, 3, 4)));
 
+  //////////////////////////
+  // deferred formatting
+  //////////////////////////
+
+  /// Description of the call site of a deferred message: its printf-like format.
+  /// It should be a static variable with a string literal format (see InfoLoggerLogDeferred() macro in InfoLoggerMacros.hxx).
+  /// It gets a process-wide identifier on first use.
+  struct DeferredFormat {
+    constexpr DeferredFormat(const char* vFormat) : format(vFormat), id(0) {}
+    const char* format;  ///< format of the message, as for printf()
+    std::atomic<int> id; ///< identifier of the format, 0 until first used
+  };
+
+  /// Arguments of a deferred message, copied in binary form.
+  /// Each argument is stored as a type tag followed by its value:
+  /// 'i' integer (8 bytes, sign-extended for signed types), 'd' floating point (8 bytes double), 'p' pointer (8 bytes),
+  /// 's' string (2 bytes length, characters, terminating NUL). A NULL string is stored as "(null)".
+  /// Strings are truncated to fit in the buffer, and arguments which do not fit anymore are dropped.
+  struct DeferredArgs {
+    static constexpr unsigned int maxSize = 1024; ///< size of buffer (same as the maximum length of a message)
+    unsigned int size = 0;                        ///< number of bytes used in data
+    bool isFull = false;                          ///< set when an argument was dropped
+    char data[maxSize];                           ///< the arguments
+
+    /// Append an argument. Only the types accepted by printf() can be used.
+    template <typename T>
+    void add(const T& value)
+    {
+      typedef typename std::decay<T>::type U;
+      if constexpr (std::is_same<U, char*>::value || std::is_same<U, const char*>::value) {
+        addString(value);
+      } else if constexpr (std::is_floating_point<U>::value) {
+        double v = (double)value;
+        addValue('d', &v);
+      } else if constexpr (std::is_integral<U>::value || std::is_enum<U>::value) {
+        uint64_t v = std::is_signed<U>::value ? (uint64_t)(int64_t)value : (uint64_t)value;
+        addValue('i', &v);
+      } else if constexpr (std::is_pointer<U>::value || std::is_null_pointer<U>::value) {
+        uint64_t v = (uint64_t)(uintptr_t)value;
+        addValue('p', &v);
+      } else {
+        static_assert(sizeof(U) == 0, "type not supported for deferred formatting");
+      }
+    }
+
+   private:
+    void addValue(char tag, const void* value)
+    {
+      if (isFull || (size + 9 > maxSize)) {
+        isFull = true;
+        return;
+      }
+      data[size] = tag;
+      memcpy(&data[size + 1], value, 8);
+      size += 9;
+    }
+    void addString(const char* s)
+    {
+      if (s == nullptr) {
+        s = "(null)";
+      }
+      if (isFull || (size + 4 > maxSize)) {
+        isFull = true;
+        return;
+      }
+      size_t maxLength = maxSize - size - 4;
+      if (maxLength > 65535) {
+        maxLength = 65535;
+      }
+      uint16_t length = (uint16_t)strnlen(s, maxLength);
+      data[size] = 's';
+      memcpy(&data[size + 1], &length, 2);
+      memcpy(&data[size + 3], s, length);
+      data[size + 3 + length] = 0;
+      size += 4 + length;
+    }
+  };
+
+  /// Log a message with deferred formatting: only the arguments are copied here, the text is built later,
+  /// in the background thread of asynchronous mode (outputMode=infoLoggerD:async), or by infoLoggerD (with option deferredExpansion=infoLoggerD).
+  /// In other modes, the text is built immediately, as for log().
+  /// The format should be a static descriptor, see InfoLoggerLogDeferred() macro which also checks format and arguments at compile time.
+  /// \return         0 on success, an error code otherwise (but never throw exceptions).
+  template <typename... Args>
+  int logDeferred(const InfoLoggerMessageOption& options, DeferredFormat& format, const Args&... args)
+  {
+    DeferredArgs deferredArgs;
+    (deferredArgs.add(args), ...);
+    return logDeferredV(options, format, deferredArgs);
+  }
+
+  /// Log a message with deferred formatting, with arguments already stored (see logDeferred()).
+  /// \return         0 on success, an error code otherwise (but never throw exceptions).
+  int logDeferredV(const InfoLoggerMessageOption& options, DeferredFormat& format, const DeferredArgs& args);
+
+  /// Compile-time check of the arguments of a deferred message against its format. Does nothing.
+  __attribute__((format(printf, 1, 2))) static void checkFormat(const char*, ...) {}
+
   //////////////////////////
   // iostream-like interface
   //////////////////////////
@@ -354,11 +463,34 @@ class InfoLogger
   /// Log a message using the << operator, like for std::cout.
   /// All messages must be ended with the InfoLogger::StreamOps::endm tag.
   /// Severity/options can be set at any point in the stream (before endm). Severity set to Info by default.
+  /// Nothing is converted when the message is discarded according to the options set so far (see isDiscarded()).
+  /// Messages are built separately by each thread, in a buffer reused from one message to the next.
+  /// Numbers are converted with std::to_chars (shortest representation for floating point values), strings are copied,
+  /// and other types are converted with boost::lexical_cast.
   template <typename T>
   InfoLogger& operator<<(const T& message)
   {
-    *this << boost::lexical_cast<std::string>(message);
-    return *this;
+    if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>) {
+      return streamAppend((const char*)&message, 1);
+    } else if constexpr (std::is_same_v<T, bool> || (std::is_integral_v<T> && std::is_signed_v<T>)) {
+      return streamAppend((long long)message);
+    } else if constexpr (std::is_integral_v<T>) {
+      return streamAppend((unsigned long long)message);
+    } else if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
+      return streamAppend(message);
+    } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+      const char* str = message;
+      return (str == nullptr) ? *this : streamAppend(str, strlen(str));
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+      std::string_view str(message);
+      return streamAppend(str.data(), str.length());
+    } else {
+      if (isStreamDiscarded()) {
+        return *this;
+      }
+      std::string str = boost::lexical_cast<std::string>(message);
+      return streamAppend(str.data(), str.length());
+    }
   }
 
 
@@ -367,6 +499,20 @@ class InfoLogger
   /// This allows an application to self-configure its verbosity.
   /// Messages are dropped immediately in the process, they do not reach infoLoggerD.
 
+  /// Check if a message with the given options is discarded by the local filters
+  /// (filterDiscardDebug(), filterDiscardLevel(), and INFOLOGGER_MIN_LEVEL when defined at build time).
+  /// This is a cheap check, to be done before building a message which would be dropped anyway (see InfoLoggerLog() macro).
+  /// Messages discarded to a file (see filterDiscardSetFile()) are not considered as discarded here.
+  bool isDiscarded(const InfoLoggerMessageOption& options) const
+  {
+#ifdef INFOLOGGER_MIN_LEVEL
+    if ((options.level != undefinedMessageOption.level) && (options.level >= INFOLOGGER_MIN_LEVEL)) {
+      return true;
+    }
+#endif
+    return isDiscardedByFilters(options);
+  }
+
   /// Select discarding of messages with DEBUG severity.
   /// parameter: 0 (default, debug messages kept) or 1 (debug messages discarded)
   void filterDiscardDebug(bool enable);
@@ -431,6 +577,16 @@ class InfoLogger
  private:
   class Impl;                   // private class for implementation
   std::unique_ptr<Impl> mPimpl; // handle to private class instance at runtime
+
+  bool isDiscardedByFilters(const InfoLoggerMessageOption& options) const; // check of the local filter settings, see isDiscarded()
+
+  // append to the message being built with << operator by the calling thread (nothing done if discarded)
+  InfoLogger& streamAppend(const char* text, size_t length);
+  InfoLogger& streamAppend(long long value);
+  InfoLogger& streamAppend(unsigned long long value);
+  InfoLogger& streamAppend(double value);
+  InfoLogger& streamAppend(float value);
+  bool isStreamDiscarded(); // set when the message being built with << operator by the calling thread is discarded
 };
 
 } // namespace InfoLogger
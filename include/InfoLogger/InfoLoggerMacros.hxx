@@ -125,6 +125,35 @@
 #define LogDebugTrace_(errno) AliceO2::InfoLogger::InfoLogger::InfoLoggerMessageOption { AliceO2::InfoLogger::InfoLogger::Severity::Debug, AliceO2::InfoLogger::InfoLogger::Level::Trace, errno, __FILE__, __LINE__ }
 
 
+// Log a message with the given logger and options (e.g. one of the macros above), if not discarded by the local filters.
+// Discarded messages only cost an inline check (see InfoLogger::isDiscarded()): the message is not formatted, and its arguments are not evaluated.
+// When INFOLOGGER_MIN_LEVEL is defined at build time, calls with a level bigger than or equal to it are removed by the compiler.
+// e.g. InfoLoggerLog(myLogger, LogDebugTrace, "value = %d", computeValue());
+#define InfoLoggerLog(logger, options, ...)                                                               \
+  do {                                                                                                    \
+    const AliceO2::InfoLogger::InfoLogger::InfoLoggerMessageOption infoLoggerLogOptions_ = options;       \
+    if (!(logger).isDiscarded(infoLoggerLogOptions_)) {                                                   \
+      (logger).log(infoLoggerLogOptions_, __VA_ARGS__);                                                   \
+    }                                                                                                     \
+  } while (0)
+
+// Same as InfoLoggerLog(), with deferred formatting (see InfoLogger::logDeferred()): the format must be a string literal,
+// only the arguments are copied by the caller, and the text is built later (e.g. by infoLoggerD).
+// Arguments are checked against the format at compile time, as for printf().
+// e.g. InfoLoggerLogDeferred(myLogger, LogInfoDevel, "event %d: %s, %.2f MB", eventId, eventName, eventSize);
+#define InfoLoggerLogDeferred(logger, options, format, ...)                                               \
+  do {                                                                                                    \
+    const AliceO2::InfoLogger::InfoLogger::InfoLoggerMessageOption infoLoggerLogOptions_ = options;       \
+    if (!(logger).isDiscarded(infoLoggerLogOptions_)) {                                                   \
+      static AliceO2::InfoLogger::InfoLogger::DeferredFormat infoLoggerLogFormat_(format);               \
+      if (0) {                                                                                            \
+        AliceO2::InfoLogger::InfoLogger::checkFormat(format, ##__VA_ARGS__);                             \
+      }                                                                                                   \
+      (logger).logDeferred(infoLoggerLogOptions_, infoLoggerLogFormat_, ##__VA_ARGS__);                  \
+    }                                                                                                     \
+  } while (0)
+
+
 #endif //INFOLOGGER_INFOLOGGERMACROS_HXX
 
 
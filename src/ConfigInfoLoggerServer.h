@@ -33,8 +33,11 @@ class ConfigInfoLoggerServer
   // settings for incoming messages
   int serverPortRx = INFOLOGGER_DEFAULT_SERVER_RX_PORT; // IP port number to receive incoming messages, where infoLoggerD clients connect
   int maxClientsRx = 3000;                              // maximum number of connected infoLoggerD clients
+  int rxNThreads = 1;                                   // number of threads receiving data from infoLoggerD clients
   int msgQueueLengthRx = 10000;                         // reception queue size
   std::string msgDumpFile = "";                         // a file to dump copy of all incoming messages
+  int decodeNThreads = 0;                               // number of threads decoding incoming messages (0: decoded by main thread)
+  int decodeQueueSize = 1000;                           // max number of incoming files being decoded
   
   // settings for database connection
   std::string dbHost = "localhost";  // database host name
@@ -44,12 +47,16 @@ class ConfigInfoLoggerServer
   int dbEnabled = 1;                 // flag to enable/disable db
   int dbNThreads = 1;                // number of insert threads
   int dbDispatchQueueSize = 10000;   // max number of messages buffered in memory before DB insert
+  int dbBatchMaxRows = 100;          // max number of rows inserted with a single query (1: one query per row)
+  int dbBatchMaxDelay = 100;         // max time (milliseconds) rows are kept before inserting an incomplete batch
 
   std::string dbReplica = "";        // path to a infologgerserver config file, from which the database settings are read and to which a copy of the messages will be stored
 
   // settings for infoBrowser clients
   int serverPortTx = INFOLOGGER_DEFAULT_SERVER_TX_PORT;
   int maxClientsTx = 100;
+  int txBufferSize = 4 * 1024 * 1024;  // max number of bytes of messages waiting to be sent to each client
+  std::string txOverflowPolicy = "gap"; // what to do with new messages when a client buffer is full: "drop" (oldest messages removed), "gap" (new ones discarded, and a warning inserted once possible) or "disconnect"
 
   // settings for infoLoggerStats clients
   int statsEnabled = 1; // flag to enable/disable feature
@@ -58,6 +65,19 @@ class ConfigInfoLoggerServer
   int statsPublishInterval = 5 ; // publish interval time (seconds)
   int statsResetInterval = 60; // size of the stats window (seconds)
   int statsHistory = 600; // backlog of stats kept and published (seconds)
+  std::string statsPublishMode = "delta"; // "delta": clients receive all windows once, and then only the counters changed. "full": all windows published each time.
+  std::string statsFormat = "tcl"; // format of published stats: "tcl" (Tcl lists) or "json" (JSON objects), one per line
+  int statsBufferSize = 16 * 1024 * 1024; // max number of bytes waiting to be sent to each client (slower clients are disconnected)
+  std::string statsSketchIndexes = "hostname-pid:100,hostname-pid-errsource-errline:100"; // indexes with approximate counts (bounded memory), as a comma-separated list of index:topK (number of most frequent keys published)
+  double statsSketchError = 0.001; // max over-estimation of approximate counts, relative to the number of messages counted in the index
+  int statsSketchDepth = 4; // number of hash functions for approximate counts (error bound exceeded with probability exp(-depth))
+
+  // settings for alerts
+  std::string alertsRulesFile = ""; // file with alert rules definitions (registerAlarm commands, as in o2-infologger-alert). Alerts disabled if empty.
+  int alertsPort = INFOLOGGER_DEFAULT_SERVER_ALERTS_PORT; // TCP/IP port number where alert events are published
+  int alertsMaxClients = 5; // max number of clients connections allowed
+  int alertsTimeout = 30; // time after which a firing alert is cleared, if not triggered again (seconds)
+  int alertsPublishInterval = 10; // publish interval time of alerts status (seconds)
 };
 
 #endif // SRC_CONFIGINFOLOGGERSERVER_H_
@@ -20,6 +20,8 @@
 
 #include "infoLoggerMessage.h"
 #include "InfoLoggerClient.h"
+#include "InfoLoggerClientAsync.h"
+#include "InfoLoggerDeferred.h"
 #include "infoLoggerUtils.h"
 #include "infoLoggerDefaults.h"
 
@@ -36,6 +38,8 @@
 #include <functional>
 #include <queue>
 #include <mutex>
+#include <list>
+#include <charconv>
 
 #include "InfoLoggerMessageHelper.h"
 #include "Common/LineBuffer.h"
@@ -205,9 +209,9 @@ class InfoLogger::Impl
     // initiate internal members
     magicTag = InfoLoggerMagicNumber;
     numberOfMessages = 0;
-    currentStreamMessage.clear();
-    currentStreamOptions = undefinedMessageOption;
-    currentStreamToken = nullptr;
+    static std::atomic<unsigned long long> lastStreamId(0);
+    streamId = ++lastStreamId;
+    streamOwner = std::make_shared<char>(0);
     client = nullptr;
 
     floodReset();
@@ -233,6 +237,27 @@ class InfoLogger::Impl
           verbose = atoi(it.second.c_str());
         } else if (it.first == "floodProtection") {
           flood_protection = atoi(it.second.c_str());
+        } else if (it.first == "asyncQueueSize") {
+          asyncQueueSize = atoi(it.second.c_str());
+          if (asyncQueueSize <= 0) {
+            throw __LINE__;
+          }
+        } else if (it.first == "asyncFullPolicy") {
+          if (it.second == "drop") {
+            asyncFullPolicy = InfoLoggerClientAsync::FullPolicy::drop;
+          } else if (it.second == "block") {
+            asyncFullPolicy = InfoLoggerClientAsync::FullPolicy::block;
+          } else {
+            throw __LINE__;
+          }
+        } else if (it.first == "deferredExpansion") {
+          if (it.second == "client") {
+            deferredExpansionInfoLoggerD = false;
+          } else if (it.second == "infoLoggerD") {
+            deferredExpansionInfoLoggerD = true;
+          } else {
+            throw __LINE__;
+          }
         } else {
           // unknown option
           printf("Unknown infoLogger option %s\n",it.first.c_str());
@@ -293,6 +318,15 @@ class InfoLogger::Impl
         client = new InfoLoggerClient;
         if (client != nullptr) {
           if (client->isOk()) {
+            if (currentMode.async) {
+              if (verbose) {
+                printf("Asynchronous mode, queue size %d, %s when full\n", asyncQueueSize, (asyncFullPolicy == InfoLoggerClientAsync::FullPolicy::block) ? "block" : "drop");
+              }
+              if ((verbose) && (deferredExpansionInfoLoggerD)) {
+                printf("Deferred messages expanded by infoLoggerD\n");
+              }
+              clientAsync = new InfoLoggerClientAsync(client, asyncQueueSize, asyncFullPolicy, deferredExpansionInfoLoggerD);
+            }
             break;
           }
         }
@@ -312,6 +346,10 @@ class InfoLogger::Impl
   ~Impl()
   {
     magicTag = 0;
+    // flush pending messages before closing connection
+    if (clientAsync != nullptr) {
+      delete clientAsync;
+    }
     if (client != nullptr) {
       delete client;
     }
@@ -321,14 +359,18 @@ class InfoLogger::Impl
   int pushMessage(InfoLogger::Severity severity, const char* msg); // todo: add extra "configurable" fields, e.g. line, etc
 
   // the noFlood parameter allows to send message even if in flood mode
-  int pushMessage(const InfoLoggerMessageOption& options, const InfoLoggerContext& context, const char* msg, bool noFlood=0);
+  // for a deferred message, msg is NULL and the format and arguments are given: the text is built only when needed
+  int pushMessage(const InfoLoggerMessageOption& options, const InfoLoggerContext& context, const char* msg, bool noFlood=0, InfoLogger::DeferredFormat* deferredFormat = nullptr, const InfoLogger::DeferredArgs* deferredArgs = nullptr);
+
+  // check if a message is discarded by the local filters, and not saved to file (so, that it does not need to be formatted)
+  bool isDiscarded(const InfoLoggerMessageOption& options);
 
   friend class InfoLogger; //< give access to this data from InfoLogger class
 
   // available options for output
   // stdout: write all messages to stdout (human-readable)
   // file: write messages to a file (human-readable)
-  // infoLoggerD: write messages to infoLoggerD
+  // infoLoggerD: write messages to infoLoggerD (infoLoggerD:async to send them from a separate thread)
   // raw: write messages to stdout (encoded as for infoLoggerD)
   // none: output disabled
   enum OutputMode { stdout,
@@ -339,8 +381,9 @@ class InfoLogger::Impl
                     none };
 
   struct OutputStream {
-    OutputMode mode;  // selected mode
-    std::string path; // optional path (eg for 'file' mode)
+    OutputMode mode;    // selected mode
+    std::string path;   // optional path (eg for 'file' mode)
+    bool async = false; // asynchronous output (for 'infoLoggerD' mode)
   };
 
   // convert a string to a member of the OutputMode enum
@@ -353,6 +396,7 @@ class InfoLogger::Impl
     }
     out.mode = OutputMode::none;
     out.path = "";
+    out.async = false;
     if (!strcmp(s, "stdout")) {
       out.mode = OutputMode::stdout;
     } else if (!strncmp(s, "file", 4)) {
@@ -364,6 +408,9 @@ class InfoLogger::Impl
       }
     } else if (!strcmp(s, "infoLoggerD")) {
       out.mode = OutputMode::infoLoggerD;
+    } else if (!strcmp(s, "infoLoggerD:async")) {
+      out.mode = OutputMode::infoLoggerD;
+      out.async = true;
     } else if (!strcmp(s, "raw")) {
       out.mode = OutputMode::raw;
     } else if (!strcmp(s, "debug")) {
@@ -410,15 +457,18 @@ class InfoLogger::Impl
   /// \return         0 on success, an error code otherwise (but never throw exceptions)..
   int logV(const InfoLoggerMessageOption& options, const InfoLoggerContext& context, const char* message, va_list ap) __attribute__((format(printf, 4, 0)));
 
+  /// log function with deferred formatting, see InfoLogger::logDeferred()
+  /// \return         0 on success, an error code otherwise (but never throw exceptions).
+  int logDeferred(const InfoLoggerMessageOption& options, InfoLogger::DeferredFormat& format, const InfoLogger::DeferredArgs& args);
+
   // main loop of collecting thread, reading incoming messages from a pipe and redirecting to infoLogger
   void redirectThreadLoop();
 
  protected:
   int magicTag;                                 //< A static tag used for handle validity cross-check
   int numberOfMessages;                         //< number of messages received by this object
-  std::string currentStreamMessage;             //< temporary variable to store message when concatenating << operations, until "endm" is received
-  InfoLoggerMessageOption currentStreamOptions; //< temporary variable to store message options when concatenating << operations, until "endm" is received
-  InfoLogger::AutoMuteToken *currentStreamToken;//< temporary variable to store AutoMuteToken when concatenating << operations, until "endm" is received
+  unsigned long long streamId;                  //< identifier of this object for the messages built with << operations, unique in the process (see InfoLoggerStreamBuilder)
+  std::shared_ptr<char> streamOwner;            //< referenced by the builders of messages built with << operations, so that they are released when this object is destroyed
 
   InfoLoggerContext currentContext;
 
@@ -426,7 +476,23 @@ class InfoLogger::Impl
   void refreshDefaultMsg();
   infoLog_msg_t defaultMsg; //< default log message (in particular, to complete optionnal fields)
 
+  // a context, with the corresponding message fields, prepared once for all messages using it
+  struct EncodedContext {
+    EncodedContext(const InfoLoggerContext& c) : context(c) {}
+    InfoLoggerContext context; //< copy of the context, owning the strings referenced by msg
+    infoLog_msg_t msg;         //< defaultMsg, updated from context
+    std::string encoded;       //< context fields encoded for infoLoggerD, see InfoLoggerMessageHelper::EncodeContext()
+  };
+  std::list<std::shared_ptr<EncodedContext>> encodedContexts; //< current context and last explicit contexts used, most recent first
+  const unsigned int encodedContextsMax = 8;                   //< number of contexts kept
+  std::mutex encodedContextsMutex;                             //< lock to access encodedContexts
+  std::shared_ptr<EncodedContext> getEncodedContext(const InfoLoggerContext& context); //< find context, or prepare it
+
   InfoLoggerClient* client = nullptr; //< entity to communicate with local infoLoggerD
+  InfoLoggerClientAsync* clientAsync = nullptr; //< when set, messages are sent to client from a separate thread
+  int asyncQueueSize = 1024; //< number of messages buffered in asynchronous mode
+  InfoLoggerClientAsync::FullPolicy asyncFullPolicy = InfoLoggerClientAsync::FullPolicy::drop; //< behavior when asynchronous queue full
+  bool deferredExpansionInfoLoggerD = false; //< when set, deferred messages are expanded by infoLoggerD (in asynchronous mode)
   SimpleLog stdLog;         //< object to output messages to stdout/file
 
   bool isRedirecting = false;                  // state of stdout/stderr redirection
@@ -571,10 +637,84 @@ void InfoLogger::Impl::refreshDefaultMsg()
   if (currentContext.userName.length() > 0) {
     InfoLoggerMessageHelperSetValue(defaultMsg, msgHelper.ix_username, String, currentContext.userName.c_str());
   }
+
+  // prepared contexts depend on defaultMsg
+  std::unique_lock<std::mutex> lock(encodedContextsMutex);
+  encodedContexts.clear();
+  lock.unlock();
+  getEncodedContext(currentContext);
+}
+
+std::shared_ptr<InfoLogger::Impl::EncodedContext> InfoLogger::Impl::getEncodedContext(const InfoLoggerContext& context)
+{
+  std::unique_lock<std::mutex> lock(encodedContextsMutex);
+  for (auto it = encodedContexts.begin(); it != encodedContexts.end(); ++it) {
+    if ((*it)->context.version == context.version) {
+      if (it != encodedContexts.begin()) {
+        encodedContexts.splice(encodedContexts.begin(), encodedContexts, it);
+      }
+      return encodedContexts.front();
+    }
+  }
+
+  std::shared_ptr<EncodedContext> ec = std::make_shared<EncodedContext>(context);
+  const InfoLoggerContext& c = ec->context;
+  ec->msg = defaultMsg;
+
+  // update message from context (set only non-empty fields - others left to what was set by default context)
+  if (c.facility.length() > 0) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_facility, String, c.facility.c_str());
+  }
+  if (c.role.length() > 0) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_rolename, String, c.role.c_str());
+  }
+  if (c.system.length() > 0) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_system, String, c.system.c_str());
+  }
+  if (c.detector.length() > 0) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_detector, String, c.detector.c_str());
+  }
+  if (c.partition.length() > 0) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_partition, String, c.partition.c_str());
+  }
+  if (c.run != -1) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_run, Int, c.run);
+  }
+  if (c.processId != -1) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_pid, Int, c.processId);
+  }
+  if (c.hostName.length() > 0) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_hostname, String, c.hostName.c_str());
+  }
+  if (c.userName.length() > 0) {
+    InfoLoggerMessageHelperSetValue(ec->msg, msgHelper.ix_username, String, c.userName.c_str());
+  }
+  ec->encoded = msgHelper.EncodeContext(&ec->msg);
+
+  if (encodedContexts.size() >= encodedContextsMax) {
+    encodedContexts.pop_back();
+  }
+  encodedContexts.push_front(ec);
+  return ec;
 }
 
 #define LOG_MAX_SIZE 1024
 
+// identifier of a deferred message format, unique in the process
+// it is set on first use (concurrent calls get the same result)
+static int getDeferredFormatId(InfoLogger::DeferredFormat& format)
+{
+  static std::atomic<int> lastId(0);
+  int id = format.id.load(std::memory_order_acquire);
+  if (id == 0) {
+    int newId = ++lastId;
+    if (format.id.compare_exchange_strong(id, newId)) {
+      id = newId;
+    }
+  }
+  return id;
+}
+
 int InfoLogger::Impl::pushMessage(InfoLogger::Severity severity, const char* messageBody)
 {
   InfoLoggerMessageOption options = undefinedMessageOption;
@@ -583,7 +723,16 @@ int InfoLogger::Impl::pushMessage(InfoLogger::Severity severity, const char* mes
   return pushMessage(options, currentContext, messageBody);
 }
 
-int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const InfoLoggerContext& context, const char* messageBody, bool noFlood)
+bool InfoLogger::Impl::isDiscarded(const InfoLoggerMessageOption& options)
+{
+  bool isDebug = (options.severity == InfoLogger::Severity::Debug);
+  if ((!(filterDiscardDebug && isDebug)) && ((filterDiscardLevel == undefinedMessageOption.level) || (options.level == undefinedMessageOption.level) || (options.level < filterDiscardLevel))) {
+    return false;
+  }
+  return (!filterDiscardFileEnabled) || (filterDiscardFileIgnoreDebug && isDebug);
+}
+
+int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const InfoLoggerContext& context, const char* messageBody, bool noFlood, InfoLogger::DeferredFormat* deferredFormat, const InfoLogger::DeferredArgs* deferredArgs)
 {
   bool discardMessage = 0;
 
@@ -600,7 +749,9 @@ int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const
     return 1;
   }
   
-  infoLog_msg_t msg = defaultMsg;
+  // default fields, updated from context
+  std::shared_ptr<EncodedContext> encodedContext = getEncodedContext(context);
+  infoLog_msg_t msg = encodedContext->msg;
 
   struct timeval tv;
   double now = 0;
@@ -611,8 +762,21 @@ int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const
 
   if (messageBody != NULL) {
     InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_message, String, messageBody);
+  } else if (deferredFormat != nullptr) {
+    msg.values[msgHelper.ix_message].isUndefined = 1;
   }
 
+  // text of a deferred message, built on first use
+  char deferredBody[LOG_MAX_SIZE];
+  auto getMessageBody = [&]() {
+    if ((messageBody == NULL) && (deferredFormat != nullptr)) {
+      InfoLoggerDeferred::format(deferredFormat->format, deferredArgs->data, deferredArgs->size, deferredBody, sizeof(deferredBody));
+      messageBody = deferredBody;
+      InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_message, String, messageBody);
+    }
+    return messageBody;
+  };
+
   // update message from options
   // todo: possibly add checks on parameters validity
 
@@ -642,38 +806,10 @@ int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const
     InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_errline, Int, options.sourceLine);
   }
 
-  // update message from context (set only non-empty fields - others left to what was set by default context)
-  if (context.facility.length() > 0) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_facility, String, context.facility.c_str());
-  }
-  if (context.role.length() > 0) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_rolename, String, context.role.c_str());
-  }
-  if (context.system.length() > 0) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_system, String, context.system.c_str());
-  }
-  if (context.detector.length() > 0) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_detector, String, context.detector.c_str());
-  }
-  if (context.partition.length() > 0) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_partition, String, context.partition.c_str());
-  }
-  if (context.run != -1) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_run, Int, context.run);
-  }
-  if (context.processId != -1) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_pid, Int, context.processId);
-  }
-  if (context.hostName.length() > 0) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_hostname, String, context.hostName.c_str());
-  }
-  if (context.userName.length() > 0) {
-    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_username, String, context.userName.c_str());
-  }
-
   // handling of messages to be discarded to file
   if (discardMessage) {
     char buffer[LOG_MAX_SIZE];
+    getMessageBody();
     msgHelper.MessageToText(&msg, buffer, sizeof(buffer), InfoLoggerMessageHelper::Format::Simple);
 
     if(options.severity == InfoLogger::Severity::Debug && filterDiscardFileIgnoreDebug) {
@@ -755,7 +891,7 @@ int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const
             floodMode = 2;
           } else {
             // log to flood file
-            fprintf(floodFile_fp, "%f\t%c\t%s\t%s\n", now, (char)options.severity, context.facility.c_str(), messageBody);
+            fprintf(floodFile_fp, "%f\t%c\t%s\t%s\n", now, (char)options.severity, context.facility.c_str(), getMessageBody());
             fflush(floodFile_fp);
             floodFile_msg++;
             return 0;
@@ -778,9 +914,21 @@ int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const
     }
   }
 
-  if (client != nullptr) {
+  // deferred message: text needed now, except in asynchronous mode
+  if (clientAsync == nullptr) {
+    getMessageBody();
+  }
+
+  if (clientAsync != nullptr) {
+    // fields are copied, encoding done in background
+    if (messageBody == NULL) {
+      clientAsync->push(msg, &encodedContext->encoded, deferredFormat->format, getDeferredFormatId(*deferredFormat), deferredArgs->data, deferredArgs->size);
+    } else {
+      clientAsync->push(msg, &encodedContext->encoded);
+    }
+  } else if (client != nullptr) {
     char buffer[LOG_MAX_SIZE];
-    msgHelper.MessageToText(&msg, buffer, sizeof(buffer), InfoLoggerMessageHelper::Format::Encoded);
+    msgHelper.EncodeWithContext(&msg, encodedContext->encoded.c_str(), encodedContext->encoded.length(), buffer, sizeof(buffer));
     client->send(buffer, strlen(buffer));
 
     // todo
@@ -810,7 +958,7 @@ int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const
   // raw output: infoLogger protocol to stdout
   if (currentMode.mode == OutputMode::raw) {
     char buffer[LOG_MAX_SIZE];
-    msgHelper.MessageToText(&msg, buffer, sizeof(buffer), InfoLoggerMessageHelper::Format::Encoded);
+    msgHelper.EncodeWithContext(&msg, encodedContext->encoded.c_str(), encodedContext->encoded.length(), buffer, sizeof(buffer));
     puts(buffer);
   }
 
@@ -837,7 +985,7 @@ int InfoLogger::Impl::pushMessage(const InfoLoggerMessageOption& options, const
 	  }
 	  summary += " - ";
 	}
-	summary += messageBody;
+	summary += getMessageBody();
         historyMessages.push(std::move(summary));
 	if (historyRotate && (historyMessagesToKeep > historyMessages.size())) {
 	  historyMessages.pop();
@@ -854,6 +1002,13 @@ int InfoLogger::Impl::logV(InfoLogger::Severity severity, const char* message, v
 
   // make sure this function never throw c++ exceptions, as logV is called from the C API wrapper
   try {
+    InfoLoggerMessageOption options = undefinedMessageOption;
+    options.severity = severity;
+    if (isDiscarded(options)) {
+      // no need to format the message
+      numberOfMessages++;
+      return 0;
+    }
     char buffer[1024] = "";
     vsnprintf(buffer, sizeof(buffer), message, ap);
     pushMessage(severity, buffer);
@@ -870,6 +1025,11 @@ int InfoLogger::Impl::logV(const InfoLoggerMessageOption& options, const InfoLog
 
   // make sure this function never throw c++ exceptions, as logV is called from the C API wrapper
   try {
+    if (isDiscarded(options)) {
+      // no need to format the message
+      numberOfMessages++;
+      return 0;
+    }
     char buffer[1024] = "";
     vsnprintf(buffer, sizeof(buffer), message, ap);
     pushMessage(options, context, buffer);
@@ -881,6 +1041,22 @@ int InfoLogger::Impl::logV(const InfoLoggerMessageOption& options, const InfoLog
   return 0;
 }
 
+int InfoLogger::Impl::logDeferred(const InfoLoggerMessageOption& options, InfoLogger::DeferredFormat& format, const InfoLogger::DeferredArgs& args)
+{
+  try {
+    if (isDiscarded(options)) {
+      numberOfMessages++;
+      return 0;
+    }
+    pushMessage(options, currentContext, nullptr, 0, &format, &args);
+    numberOfMessages++;
+  } catch (...) {
+    return __LINE__;
+  }
+
+  return 0;
+}
+
 InfoLogger::InfoLogger()
 {
   mPimpl = std::make_unique<InfoLogger::Impl>("");
@@ -897,8 +1073,12 @@ InfoLogger::InfoLogger(const std::string& options)
   }
 }
 
+static void releaseStreamBuilders(unsigned long long loggerId); // defined with the << operations
+
 InfoLogger::~InfoLogger()
 {
+  // release message left without endm by current thread, if any (those of other threads are released when their builder is looked up)
+  releaseStreamBuilders(mPimpl->streamId);
   // mPimpl is automatically destroyed
 }
 
@@ -1022,46 +1202,177 @@ int InfoLogger::log(const InfoLoggerMessageOption& options, const char* message,
   return err;
 }
 
-InfoLogger& InfoLogger::operator<<(const std::string& message)
+int InfoLogger::logDeferredV(const InfoLoggerMessageOption& options, DeferredFormat& format, const DeferredArgs& args)
+{
+  if (mPimpl->magicTag != InfoLoggerMagicNumber) {
+    return __LINE__;
+  }
+  return mPimpl->logDeferred(options, format, args);
+}
+
+// a message being built with << operations by a thread, for a given logger
+// Each thread has its own builders, so that messages built concurrently are not mixed.
+// The text buffer is kept from one message to the next, and the text is limited to what log() accepts,
+// so that no memory is allocated after the first message.
+struct InfoLoggerStreamBuilder {
+  unsigned long long loggerId = 0;             // logger using this builder (see InfoLogger::Impl::streamId), 0 if unused
+  std::string message;                         // text of the message
+  InfoLogger::InfoLoggerMessageOption options; // options of the message
+  InfoLogger::AutoMuteToken* token = nullptr;  // token of the message, if any
+  bool discarded = false;                      // set when the message is discarded with current options
+  std::weak_ptr<char> owner;                   // logger using this builder (see InfoLogger::Impl::streamOwner), expired when it is destroyed
+};
+
+static thread_local std::vector<InfoLoggerStreamBuilder> streamBuilders; // builders of current thread
+
+// maximum length of a message built with << operations (same as for log(), longer text is truncated)
+#define STREAM_MAX_SIZE (LOG_MAX_SIZE - 1)
+
+// release a builder, its buffer is kept
+static void releaseStreamBuilder(InfoLoggerStreamBuilder& b)
 {
-  // store data in internal variable
-  mPimpl->currentStreamMessage.append(message);
+  b.message.clear();
+  b.loggerId = 0;
+  b.owner.reset();
+}
+
+// release the builders of current thread for the given logger
+static void releaseStreamBuilders(unsigned long long loggerId)
+{
+  for (auto& b : streamBuilders) {
+    if (b.loggerId == loggerId) {
+      releaseStreamBuilder(b);
+    }
+  }
+}
+
+// get the builder of current thread for the given logger, or a new one
+static InfoLoggerStreamBuilder& getStreamBuilder(unsigned long long loggerId, const std::shared_ptr<char>& owner)
+{
+  InfoLoggerStreamBuilder* unused = nullptr;
+  for (auto& b : streamBuilders) {
+    if (b.loggerId == loggerId) {
+      return b;
+    }
+    if ((b.loggerId != 0) && (b.owner.expired())) {
+      // message left without endm by a logger destroyed since
+      releaseStreamBuilder(b);
+    }
+    if ((b.loggerId == 0) && (unused == nullptr)) {
+      unused = &b;
+    }
+  }
+  if (unused == nullptr) {
+    unused = &streamBuilders.emplace_back();
+  }
+  unused->loggerId = loggerId;
+  unused->owner = owner;
+  unused->message.reserve(STREAM_MAX_SIZE);
+  unused->options = InfoLogger::undefinedMessageOption;
+  unused->token = nullptr;
+  unused->discarded = false;
+  return *unused;
+}
+
+static void streamAppendText(InfoLoggerStreamBuilder& b, const char* text, size_t length)
+{
+  if ((b.discarded) || (b.message.length() >= STREAM_MAX_SIZE)) {
+    return;
+  }
+  b.message.append(text, std::min(length, STREAM_MAX_SIZE - b.message.length()));
+}
+
+template <typename T>
+static void streamAppendNumber(InfoLoggerStreamBuilder& b, T value)
+{
+  if (b.discarded) {
+    return;
+  }
+  char buffer[64];
+  auto r = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  if (r.ec == std::errc()) {
+    streamAppendText(b, buffer, r.ptr - buffer);
+  }
+}
+
+InfoLogger& InfoLogger::streamAppend(const char* text, size_t length)
+{
+  streamAppendText(getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner), text, length);
+  return *this;
+}
+
+InfoLogger& InfoLogger::streamAppend(long long value)
+{
+  streamAppendNumber(getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner), value);
+  return *this;
+}
+
+InfoLogger& InfoLogger::streamAppend(unsigned long long value)
+{
+  streamAppendNumber(getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner), value);
+  return *this;
+}
+
+InfoLogger& InfoLogger::streamAppend(double value)
+{
+  streamAppendNumber(getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner), value);
   return *this;
 }
 
+InfoLogger& InfoLogger::streamAppend(float value)
+{
+  streamAppendNumber(getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner), value);
+  return *this;
+}
+
+bool InfoLogger::isStreamDiscarded()
+{
+  return getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner).discarded;
+}
+
+InfoLogger& InfoLogger::operator<<(const std::string& message)
+{
+  return streamAppend(message.c_str(), message.length());
+}
+
 InfoLogger& InfoLogger::operator<<(InfoLogger::StreamOps op)
 {
   // process special commands received by << operator
 
   // end of message: flush current buffer in a single message
   if (op == endm) {
-    if (mPimpl->currentStreamToken != nullptr) {
-      log(*mPimpl->currentStreamToken, "%s", mPimpl->currentStreamMessage.c_str());
-    } else {
-      log(mPimpl->currentStreamOptions, "%s", mPimpl->currentStreamMessage.c_str());
+    InfoLoggerStreamBuilder& b = getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner);
+    if (b.token != nullptr) {
+      log(*b.token, "%s", b.message.c_str());
+    } else if (!b.discarded) {
+      log(b.options, "%s", b.message.c_str());
     }
-    mPimpl->currentStreamMessage.clear();
-    mPimpl->currentStreamOptions = undefinedMessageOption;
-    mPimpl->currentStreamToken = nullptr;
+    releaseStreamBuilder(b);
   }
   return *this;
 }
 
 InfoLogger& InfoLogger::operator<<(const InfoLogger::Severity severity)
 {
-  mPimpl->currentStreamOptions.severity = severity;
+  InfoLoggerStreamBuilder& b = getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner);
+  b.options.severity = severity;
+  b.discarded = (b.token == nullptr) && isDiscarded(b.options);
   return *this;
 }
 
 InfoLogger& InfoLogger::operator<<(const InfoLogger::InfoLoggerMessageOption options)
 {
-  mPimpl->currentStreamOptions = options;
+  InfoLoggerStreamBuilder& b = getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner);
+  b.options = options;
+  b.discarded = (b.token == nullptr) && isDiscarded(b.options);
   return *this;
 }
 
 InfoLogger& InfoLogger::operator<<(InfoLogger::AutoMuteToken * const token)
 {
-  mPimpl->currentStreamToken = token;
+  InfoLoggerStreamBuilder& b = getStreamBuilder(mPimpl->streamId, mPimpl->streamOwner);
+  b.token = token;
+  b.discarded = false;
   return *this;
 }
 
@@ -1269,6 +1580,10 @@ void InfoLogger::filterReset() {
   mPimpl->filterDiscardLevel = InfoLogger::undefinedMessageOption.level;
 }
 
+bool InfoLogger::isDiscardedByFilters(const InfoLoggerMessageOption& options) const {
+  return mPimpl->isDiscarded(options);
+}
+
 int InfoLogger::log(AutoMuteToken &limit, const char* message, ...) { 
   if (mPimpl->magicTag != InfoLoggerMagicNumber) {
     return __LINE__;
@@ -0,0 +1,1049 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerAlertRules.h"
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// comparison operators
+enum { OpEq,
+       OpNe,
+       OpLt,
+       OpLe,
+       OpGt,
+       OpGe,
+       OpStrEq,
+       OpStrNe };
+
+// names of the message fields in the rules, and corresponding field of the default protocol
+static const char* ruleFieldNames[][2] = {
+  { "Severity", "severity" },
+  { "Level", "level" },
+  { "Timestamp", "timestamp" },
+  { "Host", "hostname" },
+  { "Role", "rolename" },
+  { "Pid", "pid" },
+  { "Username", "username" },
+  { "System", "system" },
+  { "Facility", "facility" },
+  { "Detector", "detector" },
+  { "Partition", "partition" },
+  { "Run", "run" },
+  { "ErrCode", "errcode" },
+  { "srcLine", "errline" },
+  { "srcFile", "errsource" },
+  { "Message", "message" },
+  { nullptr, nullptr }
+};
+
+// returns field index in default protocol for a rule field name, or -1
+static int findRuleField(const std::string& name)
+{
+  for (int i = 0; ruleFieldNames[i][0] != nullptr; i++) {
+    if (name == ruleFieldNames[i][0]) {
+      return infoLog_msg_findField(ruleFieldNames[i][1]);
+    }
+  }
+  return infoLog_msg_findField(name.c_str());
+}
+
+// check if a string is a number, as Tcl would do for comparisons
+static bool parseNumber(const char* s, double& v)
+{
+  char* end = nullptr;
+  while ((*s == ' ') || (*s == '\t')) {
+    s++;
+  }
+  if (*s == 0) {
+    return false;
+  }
+  v = strtod(s, &end);
+  if (end == s) {
+    return false;
+  }
+  while ((*end == ' ') || (*end == '\t')) {
+    end++;
+  }
+  return (*end == 0);
+}
+
+// Tcl 'string match': * any sequence, ? any character, \x the character x
+// subject is [s, sEnd[, pattern is NUL-terminated
+static bool globMatch(const char* s, const char* sEnd, const char* p)
+{
+  const char* star = nullptr;  // position in pattern after last *
+  const char* retry = nullptr; // position in subject matched by last *
+  while (s < sEnd) {
+    if (*p == '*') {
+      star = ++p;
+      retry = s;
+      continue;
+    }
+    if (*p == '?') {
+      p++;
+      s++;
+      continue;
+    }
+    const char* q = p;
+    if ((*p == '\\') && (p[1] != 0)) {
+      q = p + 1;
+    }
+    if ((*q != 0) && (*q == *s)) {
+      p = q + 1;
+      s++;
+      continue;
+    }
+    if (star == nullptr) {
+      return false;
+    }
+    p = star;
+    s = ++retry;
+  }
+  while (*p == '*') {
+    p++;
+  }
+  return (*p == 0);
+}
+
+// longest substring without wildcard of a pattern
+static std::string globLongestLiteral(const std::string& pattern)
+{
+  std::string best, current;
+  for (size_t i = 0; i <= pattern.size(); i++) {
+    char c = (i < pattern.size()) ? pattern[i] : 0;
+    if ((c == '*') || (c == '?') || (c == 0)) {
+      if (current.size() > best.size()) {
+        best = current;
+      }
+      current.clear();
+      continue;
+    }
+    if ((c == '\\') && (i + 1 < pattern.size())) {
+      c = pattern[++i];
+    }
+    current += c;
+  }
+  return best;
+}
+
+// value of a field, as seen by the rules
+static const char* fieldString(const infoLog_msg_t* msg, int ix, char* buffer, size_t bufferSize)
+{
+  const infoLog_msgField_value_t& v = msg->values[ix];
+  if (v.isUndefined) {
+    return "";
+  }
+  switch (protocols[0].fields[ix].type) {
+    case infoLog_msgField_def_t::ILOG_TYPE_STRING:
+      return (v.value.vString != nullptr) ? v.value.vString : "";
+    case infoLog_msgField_def_t::ILOG_TYPE_INT:
+      snprintf(buffer, bufferSize, "%d", v.value.vInt);
+      return buffer;
+    case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
+      // time in seconds
+      snprintf(buffer, bufferSize, "%lld", (long long)floor(v.value.vDouble));
+      return buffer;
+    default:
+      break;
+  }
+  return "";
+}
+
+//////////////////////////////////////////////////
+// parser for rules file and rules expressions
+//////////////////////////////////////////////////
+
+class InfoLoggerAlertRulesParser
+{
+ public:
+  InfoLoggerAlertRulesParser(InfoLoggerAlertRules& r, const std::string& t) : rules(r), s(t) {}
+
+  // parse expression. Returns index of root node, or -1 on error (see error)
+  int parseExpression()
+  {
+    next();
+    int n = parseOr();
+    if ((n >= 0) && (tok.kind != Token::End)) {
+      setError("unexpected " + tok.text);
+      return -1;
+    }
+    return n;
+  }
+
+  // read a Tcl word from current position: "quoted", {braced} or bare
+  // substitutions are not done, except backslash escapes in quoted and bare words
+  // hasSubstitution is set if the word includes a (non-escaped) $ or [
+  static size_t readWord(const std::string& s, size_t pos, std::string& word, bool& hasSubstitution, bool& isQuoted, bool stopOnOperator)
+  {
+    word.clear();
+    hasSubstitution = false;
+    isQuoted = false;
+    if (pos >= s.size()) {
+      return pos;
+    }
+    if (s[pos] == '{') {
+      int depth = 1;
+      pos++;
+      while (pos < s.size()) {
+        char c = s[pos];
+        if ((c == '\\') && (pos + 1 < s.size())) {
+          if (s[pos + 1] == '\n') {
+            word += ' ';
+          } else {
+            word += c;
+            word += s[pos + 1];
+          }
+          pos += 2;
+          continue;
+        }
+        if (c == '{') {
+          depth++;
+        } else if (c == '}') {
+          if (--depth == 0) {
+            pos++;
+            break;
+          }
+        }
+        word += c;
+        pos++;
+      }
+      isQuoted = true;
+      return pos;
+    }
+    bool quoted = (s[pos] == '"');
+    if (quoted) {
+      pos++;
+      isQuoted = true;
+    }
+    while (pos < s.size()) {
+      char c = s[pos];
+      if (quoted && (c == '"')) {
+        pos++;
+        break;
+      }
+      if ((!quoted) && ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == ';'))) {
+        break;
+      }
+      if ((!quoted) && stopOnOperator && (c == '(') && (!word.empty()) && (word[0] == '$')) {
+        // array variable: $name(index)
+        size_t end = s.find(')', pos);
+        if (end != std::string::npos) {
+          word.append(s, pos, end + 1 - pos);
+          pos = end + 1;
+          break;
+        }
+      }
+      if ((!quoted) && stopOnOperator && (strchr("()[]!=<>&|", c) != nullptr)) {
+        break;
+      }
+      if ((c == '\\') && (pos + 1 < s.size())) {
+        char e = s[pos + 1];
+        switch (e) {
+          case 'n':
+            word += '\n';
+            break;
+          case 't':
+            word += '\t';
+            break;
+          case '\n':
+            word += ' ';
+            break;
+          default:
+            word += e;
+        }
+        pos += 2;
+        continue;
+      }
+      if ((c == '$') || (c == '[')) {
+        hasSubstitution = true;
+      }
+      word += c;
+      pos++;
+    }
+    return pos;
+  }
+
+  std::string error;
+
+ private:
+  struct Token {
+    enum Kind { End,
+                LParen,
+                RParen,
+                And,
+                Or,
+                Not,
+                Op,
+                Operand,
+                StringMatch,
+                Invalid } kind = End;
+    std::string text;    // as found in source, for error reporting
+    int op = 0;          // for Op
+    int field = -1;      // for Operand: field index, if a field reference
+    std::string value;   // for Operand: constant value. For StringMatch: pattern
+    int matchField = -1; // for StringMatch: field matched
+  };
+
+  InfoLoggerAlertRules& rules;
+  const std::string& s;
+  size_t pos = 0;
+  Token tok;
+
+  void setError(const std::string& e)
+  {
+    if (error.empty()) {
+      error = e;
+    }
+  }
+
+  // returns field index if word is a field reference $field(X), -1 if not, -2 if unknown field
+  static int fieldReference(const std::string& w)
+  {
+    const char* prefix = "$field(";
+    size_t len = strlen(prefix);
+    if ((w.size() <= len + 1) || (w.compare(0, len, prefix) != 0) || (w.back() != ')')) {
+      return -1;
+    }
+    int ix = findRuleField(w.substr(len, w.size() - len - 1));
+    return (ix >= 0) ? ix : -2;
+  }
+
+  // convert a word to an operand token. Returns false on error.
+  bool makeOperand(const std::string& w, bool hasSubstitution, Token& t)
+  {
+    t.kind = Token::Operand;
+    t.field = -1;
+    t.value = w;
+    if (hasSubstitution) {
+      t.field = fieldReference(w);
+      if (t.field == -2) {
+        setError("unknown field in " + w);
+        return false;
+      }
+      if (t.field < 0) {
+        setError("substitution not supported in " + w);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void next()
+  {
+    tok = Token();
+    while ((pos < s.size()) && (isspace((unsigned char)s[pos]) || ((s[pos] == '\\') && (pos + 1 < s.size()) && (s[pos + 1] == '\n')))) {
+      pos += (s[pos] == '\\') ? 2 : 1;
+    }
+    if (pos >= s.size()) {
+      tok.kind = Token::End;
+      tok.text = "end of expression";
+      return;
+    }
+    size_t start = pos;
+    char c = s[pos];
+    char c2 = (pos + 1 < s.size()) ? s[pos + 1] : 0;
+    auto setOp = [&](Token::Kind k, int op, int len) {
+      tok.kind = k;
+      tok.op = op;
+      pos += len;
+      tok.text = s.substr(start, len);
+    };
+    if (c == '(') {
+      setOp(Token::LParen, 0, 1);
+    } else if (c == ')') {
+      setOp(Token::RParen, 0, 1);
+    } else if ((c == '&') && (c2 == '&')) {
+      setOp(Token::And, 0, 2);
+    } else if ((c == '|') && (c2 == '|')) {
+      setOp(Token::Or, 0, 2);
+    } else if ((c == '=') && (c2 == '=')) {
+      setOp(Token::Op, OpEq, 2);
+    } else if ((c == '!') && (c2 == '=')) {
+      setOp(Token::Op, OpNe, 2);
+    } else if (c == '!') {
+      setOp(Token::Not, 0, 1);
+    } else if ((c == '<') && (c2 == '=')) {
+      setOp(Token::Op, OpLe, 2);
+    } else if ((c == '>') && (c2 == '=')) {
+      setOp(Token::Op, OpGe, 2);
+    } else if (c == '<') {
+      setOp(Token::Op, OpLt, 1);
+    } else if (c == '>') {
+      setOp(Token::Op, OpGt, 1);
+    } else if (c == '[') {
+      // command: only string match is supported
+      pos++;
+      std::vector<std::string> words;
+      std::vector<bool> subst;
+      for (;;) {
+        while ((pos < s.size()) && (isspace((unsigned char)s[pos]) || ((s[pos] == '\\') && (pos + 1 < s.size()) && (s[pos + 1] == '\n')))) {
+          pos++;
+        }
+        if ((pos >= s.size()) || (s[pos] == ']')) {
+          break;
+        }
+        std::string w;
+        bool hasSubstitution, isQuoted;
+        size_t p = readWord(s, pos, w, hasSubstitution, isQuoted, false);
+        if ((!isQuoted) && (!w.empty()) && (w.back() == ']')) {
+          // bare word followed by end of command
+          w.pop_back();
+          p--;
+        }
+        pos = p;
+        words.push_back(w);
+        subst.push_back(hasSubstitution);
+      }
+      tok.text = s.substr(start, pos - start + 1);
+      if (pos >= s.size()) {
+        tok.kind = Token::Invalid;
+        setError("missing ] in " + tok.text);
+        return;
+      }
+      pos++;
+      if ((words.size() != 4) || (words[0] != "string") || (words[1] != "match")) {
+        tok.kind = Token::Invalid;
+        setError("command not supported: " + tok.text);
+        return;
+      }
+      Token pattern, subject;
+      if ((!makeOperand(words[2], subst[2], pattern)) || (!makeOperand(words[3], subst[3], subject))) {
+        tok.kind = Token::Invalid;
+        return;
+      }
+      if ((pattern.field >= 0) || (subject.field < 0)) {
+        tok.kind = Token::Invalid;
+        setError("string match should compare a constant pattern to a field: " + tok.text);
+        return;
+      }
+      if (pattern.value.find('[') != std::string::npos) {
+        tok.kind = Token::Invalid;
+        setError("character sets not supported in pattern: " + tok.text);
+        return;
+      }
+      tok.kind = Token::StringMatch;
+      tok.value = pattern.value;
+      tok.matchField = subject.field;
+    } else {
+      std::string w;
+      bool hasSubstitution, isQuoted;
+      pos = readWord(s, pos, w, hasSubstitution, isQuoted, true);
+      tok.text = s.substr(start, pos - start);
+      if (pos == start) {
+        tok.kind = Token::Invalid;
+        setError("unexpected character " + tok.text);
+        pos++;
+        return;
+      }
+      if ((!isQuoted) && ((w == "eq") || (w == "ne"))) {
+        tok.kind = Token::Op;
+        tok.op = (w == "eq") ? OpStrEq : OpStrNe;
+        return;
+      }
+      if (!makeOperand(w, hasSubstitution, tok)) {
+        tok.kind = Token::Invalid;
+      }
+    }
+  }
+
+  int newNode(InfoLoggerAlertRules::Node::Type type)
+  {
+    InfoLoggerAlertRules::Node n;
+    n.type = type;
+    rules.nodes.push_back(n);
+    return (int)rules.nodes.size() - 1;
+  }
+
+  int parseOr()
+  {
+    int left = parseAnd();
+    while ((left >= 0) && (tok.kind == Token::Or)) {
+      next();
+      int right = parseAnd();
+      if (right < 0) {
+        return -1;
+      }
+      int n = newNode(InfoLoggerAlertRules::Node::Or);
+      rules.nodes[n].children = { left, right };
+      left = n;
+    }
+    return left;
+  }
+
+  int parseAnd()
+  {
+    int left = parseUnary();
+    while ((left >= 0) && (tok.kind == Token::And)) {
+      next();
+      int right = parseUnary();
+      if (right < 0) {
+        return -1;
+      }
+      int n = newNode(InfoLoggerAlertRules::Node::And);
+      rules.nodes[n].children = { left, right };
+      left = n;
+    }
+    return left;
+  }
+
+  int parseUnary()
+  {
+    if (tok.kind == Token::Not) {
+      next();
+      int child = parseUnary();
+      if (child < 0) {
+        return -1;
+      }
+      int n = newNode(InfoLoggerAlertRules::Node::Not);
+      rules.nodes[n].children = { child };
+      return n;
+    }
+    return parsePrimary();
+  }
+
+  int parsePrimary()
+  {
+    if (tok.kind == Token::LParen) {
+      next();
+      int n = parseOr();
+      if (n < 0) {
+        return -1;
+      }
+      if (tok.kind != Token::RParen) {
+        setError("missing ) before " + tok.text);
+        return -1;
+      }
+      next();
+      return n;
+    }
+    if (tok.kind == Token::StringMatch) {
+      int n = newNode(InfoLoggerAlertRules::Node::Match);
+      rules.nodes[n].field = tok.matchField;
+      rules.nodes[n].value = tok.value;
+      next();
+      return n;
+    }
+    if (tok.kind == Token::Operand) {
+      Token left = tok;
+      next();
+      if (tok.kind != Token::Op) {
+        setError("comparison operator expected after " + left.text);
+        return -1;
+      }
+      int op = tok.op;
+      next();
+      if (tok.kind != Token::Operand) {
+        setError("operand expected after " + left.text);
+        return -1;
+      }
+      Token right = tok;
+      next();
+      if ((left.field < 0) && (right.field >= 0)) {
+        // constant on the left: swap operands
+        std::swap(left, right);
+        const int mirror[] = { OpEq, OpNe, OpGt, OpGe, OpLt, OpLe, OpStrEq, OpStrNe };
+        op = mirror[op];
+      }
+      if ((left.field < 0) || (right.field >= 0)) {
+        setError("comparison should be between a field and a constant: " + left.text + " " + right.text);
+        return -1;
+      }
+      int n = newNode(InfoLoggerAlertRules::Node::Compare);
+      InfoLoggerAlertRules::Node& node = rules.nodes[n];
+      node.field = left.field;
+      node.op = op;
+      node.value = right.value;
+      node.isNumber = parseNumber(node.value.c_str(), node.number);
+      return n;
+    }
+    if (tok.kind != Token::Invalid) {
+      setError("unexpected " + tok.text);
+    }
+    return -1;
+  }
+};
+
+//////////////////////////////////////////////////
+// class InfoLoggerAlertRules
+//////////////////////////////////////////////////
+
+InfoLoggerAlertRules::InfoLoggerAlertRules()
+{
+  memset(charClass, 0, sizeof(charClass));
+}
+
+InfoLoggerAlertRules::~InfoLoggerAlertRules()
+{
+}
+
+int InfoLoggerAlertRules::loadFile(const std::string& path, std::vector<std::string>& errors)
+{
+  std::ifstream f(path);
+  if (!f.is_open()) {
+    errors.push_back("Failed to open " + path);
+    return -1;
+  }
+  std::stringstream content;
+  content << f.rdbuf();
+  return load(content.str(), errors);
+}
+
+int InfoLoggerAlertRules::compile(const std::string& test, int& root, std::string& error)
+{
+  size_t nNodes = nodes.size();
+  InfoLoggerAlertRulesParser p(*this, test);
+  root = p.parseExpression();
+  if (root < 0) {
+    nodes.resize(nNodes);
+    error = p.error;
+    return -1;
+  }
+  return 0;
+}
+
+// a necessary condition of a node to be true, as a list of triggers (one of them at least is met)
+// returns false if none could be found
+bool InfoLoggerAlertRules::getTriggers(int ix, std::vector<Trigger>& triggers)
+{
+  const Node& n = nodes[ix];
+  triggers.clear();
+  switch (n.type) {
+    case Node::Compare: {
+      if ((n.op != OpEq) && (n.op != OpStrEq)) {
+        return false;
+      }
+      if (n.value.empty()) {
+        // undefined fields are empty
+        return false;
+      }
+      auto type = protocols[0].fields[n.field].type;
+      if (n.field == ixMessage) {
+        if ((n.op == OpEq) && (n.isNumber)) {
+          return false;
+        }
+        triggers.push_back({ n.field, n.value });
+        return true;
+      }
+      if (type == infoLog_msgField_def_t::ILOG_TYPE_STRING) {
+        if ((n.op == OpEq) && (n.isNumber)) {
+          // numeric comparison, many strings possible
+          return false;
+        }
+        triggers.push_back({ n.field, n.value });
+        return true;
+      }
+      if ((type == infoLog_msgField_def_t::ILOG_TYPE_INT) && (n.op == OpEq) && (n.isNumber) && (n.number == floor(n.number)) && (fabs(n.number) < 2147483648.0)) {
+        triggers.push_back({ n.field, std::to_string((long long)n.number) });
+        return true;
+      }
+      return false;
+    }
+    case Node::Match: {
+      if (n.field == ixMessage) {
+        std::string l = globLongestLiteral(n.value);
+        if (l.empty()) {
+          return false;
+        }
+        triggers.push_back({ n.field, l });
+        return true;
+      }
+      if ((protocols[0].fields[n.field].type != infoLog_msgField_def_t::ILOG_TYPE_STRING) || (n.value.find_first_of("*?\\") != std::string::npos) || (n.value.empty())) {
+        return false;
+      }
+      triggers.push_back({ n.field, n.value });
+      return true;
+    }
+    case Node::Or: {
+      for (int c : n.children) {
+        std::vector<Trigger> t;
+        if (!getTriggers(c, t)) {
+          triggers.clear();
+          return false;
+        }
+        triggers.insert(triggers.end(), t.begin(), t.end());
+      }
+      return true;
+    }
+    case Node::And: {
+      // use the most selective operand
+      int bestScore = -1;
+      for (int c : n.children) {
+        std::vector<Trigger> t;
+        if (!getTriggers(c, t)) {
+          continue;
+        }
+        int score = 1000000;
+        for (const auto& tr : t) {
+          int s;
+          if (tr.field == ixMessage) {
+            s = 100 + (int)tr.value.size();
+          } else if ((strcmp(protocols[0].fields[tr.field].name, "severity") == 0) || (strcmp(protocols[0].fields[tr.field].name, "level") == 0)) {
+            s = 1;
+          } else {
+            s = 50;
+          }
+          score = std::min(score, s);
+        }
+        if (score > bestScore) {
+          bestScore = score;
+          triggers = t;
+        }
+      }
+      return (bestScore >= 0);
+    }
+    default:
+      break;
+  }
+  return false;
+}
+
+void InfoLoggerAlertRules::buildAutomaton()
+{
+  // character classes: one per character used in literals, 0 for others
+  memset(charClass, 0, sizeof(charClass));
+  nClasses = 1;
+  for (const auto& l : literals) {
+    for (unsigned char c : l) {
+      if (charClass[c] == 0) {
+        charClass[c] = nClasses++;
+      }
+    }
+  }
+
+  // trie of literals
+  delta.assign(nClasses, -1);
+  stateLiterals.assign(1, {});
+  for (int i = 0; i < (int)literals.size(); i++) {
+    int state = 0;
+    for (unsigned char c : literals[i]) {
+      int& t = delta[state * nClasses + charClass[c]];
+      if (t < 0) {
+        t = (int)stateLiterals.size();
+        stateLiterals.push_back({});
+        delta.resize(delta.size() + nClasses, -1);
+      }
+      state = delta[state * nClasses + charClass[c]];
+    }
+    stateLiterals[state].push_back(i);
+  }
+
+  // complete transitions with failure links, breadth first
+  int nStates = (int)stateLiterals.size();
+  std::vector<int> fail(nStates, 0);
+  outputLink.assign(nStates, -1);
+  std::deque<int> queue;
+  for (int c = 0; c < nClasses; c++) {
+    int t = delta[c];
+    if (t < 0) {
+      delta[c] = 0;
+    } else {
+      fail[t] = 0;
+      queue.push_back(t);
+    }
+  }
+  while (!queue.empty()) {
+    int s = queue.front();
+    queue.pop_front();
+    for (int c = 0; c < nClasses; c++) {
+      int t = delta[s * nClasses + c];
+      int f = delta[fail[s] * nClasses + c];
+      if (t < 0) {
+        delta[s * nClasses + c] = f;
+      } else {
+        fail[t] = f;
+        outputLink[t] = stateLiterals[f].empty() ? outputLink[f] : f;
+        queue.push_back(t);
+      }
+    }
+  }
+}
+
+int InfoLoggerAlertRules::load(const std::string& content, std::vector<std::string>& errors)
+{
+  rules.clear();
+  roots.clear();
+  nodes.clear();
+  alwaysEval.clear();
+  fieldIndex.clear();
+  indexedFields.clear();
+  literals.clear();
+  literalRules.clear();
+  ixMessage = infoLog_msg_findField("message");
+
+  // find registerAlarm commands
+  const char* command = "registerAlarm";
+  size_t commandLength = strlen(command);
+  int lineNumber = 0;
+  size_t pos = 0;
+  std::unordered_set<int> ids;
+  while (pos < content.size()) {
+    lineNumber++;
+    size_t eol = content.find('\n', pos);
+    if (eol == std::string::npos) {
+      eol = content.size();
+    }
+    size_t start = content.find_first_not_of(" \t", pos);
+    if ((start == std::string::npos) || (start >= eol) || (content.compare(start, commandLength, command) != 0) || ((start + commandLength < content.size()) && (!isspace((unsigned char)content[start + commandLength])) && (content[start + commandLength] != '\\'))) {
+      pos = eol + 1;
+      continue;
+    }
+
+    // read arguments, up to end of command
+    int commandLine = lineNumber;
+    std::vector<std::string> args;
+    pos = start + commandLength;
+    for (;;) {
+      while ((pos < content.size()) && ((content[pos] == ' ') || (content[pos] == '\t') || (content[pos] == '\r') || ((content[pos] == '\\') && (pos + 1 < content.size()) && (content[pos + 1] == '\n')))) {
+        if (content[pos] == '\\') {
+          pos++;
+          lineNumber++;
+        }
+        pos++;
+      }
+      if ((pos >= content.size()) || (content[pos] == '\n') || (content[pos] == ';')) {
+        break;
+      }
+      std::string w;
+      bool hasSubstitution, isQuoted;
+      size_t end = InfoLoggerAlertRulesParser::readWord(content, pos, w, hasSubstitution, isQuoted, false);
+      lineNumber += std::count(content.begin() + pos, content.begin() + end, '\n');
+      pos = end;
+      args.push_back(w);
+    }
+    pos++;
+
+    std::string where = "line " + std::to_string(commandLine) + ": ";
+    if (args.size() != 5) {
+      errors.push_back(where + "registerAlarm should have 5 arguments");
+      continue;
+    }
+    Rule r;
+    char* end = nullptr;
+    r.id = (int)strtol(args[0].c_str(), &end, 10);
+    if ((args[0].empty()) || (*end != 0)) {
+      errors.push_back(where + "invalid alarm id " + args[0]);
+      continue;
+    }
+    if (ids.count(r.id)) {
+      errors.push_back(where + "duplicate alarm id " + args[0]);
+      continue;
+    }
+    r.description = args[1];
+    r.doc = args[2];
+    r.test = args[3];
+    r.example = args[4];
+    int root;
+    std::string error;
+    if (compile(r.test, root, error)) {
+      errors.push_back(where + "alarm " + args[0] + ": " + error);
+      continue;
+    }
+    ids.insert(r.id);
+    rules.push_back(r);
+    roots.push_back(root);
+  }
+
+  // index rules
+  fieldIndex.resize(INFOLOG_FIELDS_MAX);
+  std::unordered_map<std::string, int> literalIds;
+  for (int i = 0; i < (int)rules.size(); i++) {
+    std::vector<Trigger> triggers;
+    if ((!getTriggers(roots[i], triggers)) || (triggers.empty())) {
+      alwaysEval.push_back(i);
+      continue;
+    }
+    for (const auto& t : triggers) {
+      std::vector<int>* l;
+      if (t.field == ixMessage) {
+        auto it = literalIds.find(t.value);
+        if (it == literalIds.end()) {
+          it = literalIds.emplace(t.value, (int)literals.size()).first;
+          literals.push_back(t.value);
+          literalRules.push_back({});
+        }
+        l = &literalRules[it->second];
+      } else {
+        if (std::find(indexedFields.begin(), indexedFields.end(), t.field) == indexedFields.end()) {
+          indexedFields.push_back(t.field);
+        }
+        l = &fieldIndex[t.field][t.value];
+      }
+      if ((l->empty()) || (l->back() != i)) {
+        l->push_back(i);
+      }
+    }
+  }
+  buildAutomaton();
+  ruleStamp.assign(rules.size(), 0);
+  literalStamp.assign(literals.size(), 0);
+  stamp = 0;
+
+  return (int)rules.size();
+}
+
+bool InfoLoggerAlertRules::evaluate(int ix, const infoLog_msg_t* msg, const char* line, size_t lineLength)
+{
+  const Node& n = nodes[ix];
+  switch (n.type) {
+    case Node::And:
+      for (int c : n.children) {
+        if (!evaluate(c, msg, line, lineLength)) {
+          return false;
+        }
+      }
+      return true;
+    case Node::Or:
+      for (int c : n.children) {
+        if (evaluate(c, msg, line, lineLength)) {
+          return true;
+        }
+      }
+      return false;
+    case Node::Not:
+      return !evaluate(n.children[0], msg, line, lineLength);
+    case Node::Match: {
+      if (n.field == ixMessage) {
+        return globMatch(line, line + lineLength, n.value.c_str());
+      }
+      char buffer[32];
+      const char* v = fieldString(msg, n.field, buffer, sizeof(buffer));
+      return globMatch(v, v + strlen(v), n.value.c_str());
+    }
+    case Node::Compare: {
+      char buffer[32];
+      const char* v = (n.field == ixMessage) ? line : fieldString(msg, n.field, buffer, sizeof(buffer));
+      int cmp;
+      double d;
+      if ((n.op != OpStrEq) && (n.op != OpStrNe) && (n.isNumber) && (parseNumber(v, d))) {
+        cmp = (d < n.number) ? -1 : ((d > n.number) ? 1 : 0);
+      } else {
+        cmp = strcmp(v, n.value.c_str());
+      }
+      switch (n.op) {
+        case OpEq:
+        case OpStrEq:
+          return cmp == 0;
+        case OpNe:
+        case OpStrNe:
+          return cmp != 0;
+        case OpLt:
+          return cmp < 0;
+        case OpLe:
+          return cmp <= 0;
+        case OpGt:
+          return cmp > 0;
+        case OpGe:
+          return cmp >= 0;
+      }
+      return false;
+    }
+  }
+  return false;
+}
+
+void InfoLoggerAlertRules::matchLine(const infoLog_msg_t* msg, const char* line, size_t lineLength, std::vector<int>& matched)
+{
+  if (!useIndex) {
+    for (int i = 0; i < (int)rules.size(); i++) {
+      if (evaluate(roots[i], msg, line, lineLength)) {
+        matched.push_back(i);
+      }
+    }
+    return;
+  }
+
+  // select candidate rules
+  if (++stamp == 0) {
+    std::fill(ruleStamp.begin(), ruleStamp.end(), 0);
+    std::fill(literalStamp.begin(), literalStamp.end(), 0);
+    stamp = 1;
+  }
+  candidates.clear();
+  auto addRules = [&](const std::vector<int>& l) {
+    for (int r : l) {
+      if (ruleStamp[r] != stamp) {
+        ruleStamp[r] = stamp;
+        candidates.push_back(r);
+      }
+    }
+  };
+  addRules(alwaysEval);
+  for (int f : indexedFields) {
+    if (msg->values[f].isUndefined) {
+      continue;
+    }
+    char buffer[32];
+    auto it = fieldIndex[f].find(fieldString(msg, f, buffer, sizeof(buffer)));
+    if (it != fieldIndex[f].end()) {
+      addRules(it->second);
+    }
+  }
+  if (!literals.empty()) {
+    int state = 0;
+    for (size_t i = 0; i < lineLength; i++) {
+      state = delta[state * nClasses + charClass[(unsigned char)line[i]]];
+      for (int t = stateLiterals[state].empty() ? outputLink[state] : state; t >= 0; t = outputLink[t]) {
+        for (int l : stateLiterals[t]) {
+          if (literalStamp[l] != stamp) {
+            literalStamp[l] = stamp;
+            addRules(literalRules[l]);
+          }
+        }
+      }
+    }
+  }
+
+  // evaluate them, in order
+  std::sort(candidates.begin(), candidates.end());
+  for (int r : candidates) {
+    if (evaluate(roots[r], msg, line, lineLength)) {
+      matched.push_back(r);
+    }
+  }
+}
+
+void InfoLoggerAlertRules::match(const infoLog_msg_t* msg, std::vector<int>& matched)
+{
+  if ((ixMessage < 0) || (rules.empty()) || (msg->values[ixMessage].isUndefined) || (msg->values[ixMessage].value.vString == nullptr)) {
+    return;
+  }
+  const char* m = msg->values[ixMessage].value.vString;
+  const char* sep = strchr(m, '\f');
+  if (sep == nullptr) {
+    // single line
+    if (*m != 0) {
+      matchLine(msg, m, strlen(m), matched);
+    }
+    return;
+  }
+  // test each line, NUL terminated
+  std::string line;
+  for (;;) {
+    line.assign(m, sep - m);
+    matchLine(msg, line.c_str(), line.size(), matched);
+    if (*sep == 0) {
+      break;
+    }
+    m = sep + 1;
+    sep = strchr(m, '\f');
+    if (sep == nullptr) {
+      sep = m + strlen(m);
+    }
+  }
+}
@@ -0,0 +1,131 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/*
+   a set of alert rules, evaluated on decoded messages (infoLog_msg_t)
+
+   Rules are loaded from the same definitions as o2-infologger-alert, i.e. Tcl commands:
+     registerAlarm id description doc test example
+   where test is a Tcl expression using the message fields $field(Name), with the subset of syntax used by the rules:
+     ("$field(Detector)" == "MFT")          comparison (==, !=, <, <=, >, >=, eq, ne) of a field and a constant
+     [string match "link *" "$field(Message)"]  glob-style pattern (* and ?) on a field
+     && || ! and parentheses
+   Other lines of the file are ignored. Rules using other constructs are rejected when loading.
+
+   Each rule is compiled once in a tree of predicates. To keep the evaluation time independent of the number of rules,
+   a necessary condition is extracted from each rule: either a substring of the message text (all of them are searched
+   at once, with an Aho-Corasick automaton), or a field value (looked up in a hash table). Only the rules for which
+   the condition is met are evaluated. The remaining rules (without such condition) are evaluated for each message.
+
+   As in o2-infologger-alert, a message with several lines (separated by \f) is tested line by line.
+*/
+
+#ifndef _INFOLOGGER_ALERT_RULES_H
+#define _INFOLOGGER_ALERT_RULES_H
+
+#include "infoLoggerMessage.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class InfoLoggerAlertRules
+{
+ public:
+  InfoLoggerAlertRules();
+  ~InfoLoggerAlertRules();
+
+  // definition of a rule
+  struct Rule {
+    int id;                  // alert id
+    std::string description; // short description
+    std::string doc;         // what to do when alert fires
+    std::string test;        // condition, as defined in source
+    std::string example;     // example time
+  };
+
+  // load rules from a file, or from a string with the file content. Previous rules are removed.
+  // Returns number of rules loaded, or -1 if file can not be read. Rules failing to compile are reported in errors, and skipped.
+  int loadFile(const std::string& path, std::vector<std::string>& errors);
+  int load(const std::string& content, std::vector<std::string>& errors);
+
+  // number of rules
+  int size() const { return (int)rules.size(); }
+
+  // access to a rule definition (index from 0 to size()-1)
+  const Rule& getRule(int ix) const { return rules[ix]; }
+
+  // evaluate rules on a message (using the default protocol, see infoLog_msg_convert())
+  // indexes of the rules matching are appended to matched (once per line of the message)
+  void match(const infoLog_msg_t* msg, std::vector<int>& matched);
+
+  // enable/disable candidate selection (when disabled, all rules are evaluated for all messages, for test purpose)
+  void setIndexing(bool enabled) { useIndex = enabled; }
+
+ private:
+  // a node of a compiled rule
+  struct Node {
+    enum Type { And,
+                Or,
+                Not,
+                Compare,
+                Match } type;
+    std::vector<int> children; // for And, Or, Not: index of operands in nodes
+    int field = -1;            // for Compare, Match: field index in default protocol
+    int op = 0;                // for Compare: operator
+    std::string value;         // for Compare: constant. For Match: pattern
+    bool isNumber = false;     // for Compare: set if constant is a number
+    double number = 0;         // for Compare: value of constant, if a number
+  };
+
+  // a necessary condition for a rule to be true
+  struct Trigger {
+    int field;         // field index
+    std::string value; // value of field (if not message), or substring of message
+  };
+
+  std::vector<Rule> rules;     // rules definitions
+  std::vector<int> roots;      // root node of each rule
+  std::vector<Node> nodes;     // nodes of all rules
+  std::vector<int> alwaysEval; // rules without trigger, evaluated for each message
+  bool useIndex = true;
+
+  // rules triggered by a field value, for each field
+  std::vector<std::unordered_map<std::string, std::vector<int>>> fieldIndex;
+  std::vector<int> indexedFields; // list of fields used in fieldIndex
+
+  // Aho-Corasick automaton for message substrings
+  std::vector<std::string> literals;           // substrings searched
+  std::vector<std::vector<int>> literalRules;  // rules triggered by each literal
+  std::vector<int> delta;                      // transitions: next state = delta[state * nClasses + class of character]
+  std::vector<std::vector<int>> stateLiterals; // for each state: literals ending here
+  std::vector<int> outputLink;                 // for each state: longest proper suffix state with literals, or -1
+  unsigned char charClass[256];                // class of each character (0: not in any literal)
+  int nClasses = 1;                            // number of character classes
+
+  // per-line state
+  std::vector<unsigned int> ruleStamp;    // last line for which rule was selected
+  std::vector<unsigned int> literalStamp; // last line in which literal was found
+  unsigned int stamp = 0;                 // current line
+  std::vector<int> candidates;            // rules to be evaluated for current line
+
+  int ixMessage = -1; // index of message field
+
+  int compile(const std::string& test, int& root, std::string& error);
+  bool getTriggers(int node, std::vector<Trigger>& triggers);
+  void buildAutomaton();
+  bool evaluate(int node, const infoLog_msg_t* msg, const char* line, size_t lineLength);
+  void matchLine(const infoLog_msg_t* msg, const char* line, size_t lineLength, std::vector<int>& matched);
+
+  friend class InfoLoggerAlertRulesParser;
+};
+
+// _INFOLOGGER_ALERT_RULES_H
+#endif
@@ -26,6 +26,7 @@
 #include <sys/un.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/poll.h>
 #include <string.h>
 
 #include <Common/SimpleLog.h>
@@ -39,6 +40,12 @@
 #endif
 const int sendFlags = MSG_NOSIGNAL;
 
+// timeout for infoLoggerD to reply to ring setup (milliseconds)
+#define RING_SETUP_TIMEOUT 1000
+
+// interval between checks of infoLoggerD connection, when writing to ring (microseconds)
+#define RING_CHECK_INTERVAL 100000
+
 //////////////////////////////////////////////////////
 // class ConfigInfoLoggerClient
 // stores configuration params for infologgerD clients
@@ -68,6 +75,7 @@ ConfigInfoLoggerClient::ConfigInfoLoggerClient(const char* configPath)
     config.getOptionalValue<std::string>(INFOLOGGER_CONFIG_SECTION_NAME_CLIENT ".logFile", logFile);
     config.getOptionalValue<double>(INFOLOGGER_CONFIG_SECTION_NAME_CLIENT ".reconnectTimeout", reconnectTimeout);
     config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_CLIENT ".maxMessagesBuffered", maxMessagesBuffered);
+    config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_CLIENT ".txRingSize", txRingSize);
   }
 }
 
@@ -83,6 +91,7 @@ void ConfigInfoLoggerClient::resetConfig()
   logFile = "/dev/null";
   reconnectTimeout = 5.0;
   maxMessagesBuffered = 1000;
+  txRingSize = 0;
 }
 
 //////////////////////////////////////////////////////
@@ -174,6 +183,11 @@ int InfoLoggerClient::connect() {
       throw __LINE__;
     }
 
+    // use shared memory ring if configured, socket otherwise
+    if (cfg.txRingSize > 0) {
+      setupRing();
+    }
+
     isInitialized = 1;
     if (isVerbose) log.info("Connected to infoLoggerD");
   }
@@ -187,7 +201,102 @@ int InfoLoggerClient::connect() {
   return 0;
 }
 
+int InfoLoggerClient::setupRing() {
+  if (ring.create(cfg.txRingSize, txSocket)) {
+    if (isVerbose) log.error("Failed to create shared memory ring: %s", strerror(errno));
+    return -1;
+  }
+
+  // send setup line, with the ring file descriptor attached
+  const char* line = InfoLoggerRing::getSetupLine();
+  struct iovec iov;
+  iov.iov_base = (void*)line;
+  iov.iov_len = strlen(line);
+  int fds[1] = { ring.getFd() };
+  union {
+    char buffer[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  bzero(&msg, sizeof(msg));
+  bzero(&control, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if (sendmsg(txSocket, &msg, sendFlags) != (int)iov.iov_len) {
+    if (isVerbose) log.error("Failed to send shared memory ring: %s", strerror(errno));
+    ring.release();
+    return -1;
+  }
+
+  // wait for reply: ring used or not (e.g. disabled, or infoLoggerD version without ring support)
+  struct pollfd pfd;
+  pfd.fd = txSocket;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  char reply = 0;
+  if ((poll(&pfd, 1, RING_SETUP_TIMEOUT) != 1) || (recv(txSocket, &reply, 1, 0) != 1) || (reply != '1')) {
+    if (isVerbose) log.info("Shared memory ring not accepted by infoLoggerD, using socket");
+    ring.release();
+    return -1;
+  }
+  if (isVerbose) log.info("Using shared memory ring (%u bytes)", ring.getSize());
+  ringCheckTimer.reset(RING_CHECK_INTERVAL);
+  return 0;
+}
+
+int InfoLoggerClient::write(const char* data, unsigned int dataSize) {
+  if (!ring.isOk()) {
+    return (::send(txSocket, data, dataSize, sendFlags) == (int)dataSize) ? 0 : -1;
+  }
+
+  // infoLoggerD does not write on the socket after ring setup, so socket events mean it closed the connection
+  auto isClosed = [&](int timeout) {
+    struct pollfd pfd;
+    pfd.fd = txSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int err = poll(&pfd, 1, timeout);
+    return ((err > 0) || ((err < 0) && (errno != EINTR)));
+  };
+
+  bool isWaiting = false;
+  while (dataSize) {
+    // data larger than ring is written in pieces
+    unsigned int chunkSize = (dataSize < ring.getSize()) ? dataSize : ring.getSize();
+    if (ring.write(data, chunkSize) == 0) {
+      data += chunkSize;
+      dataSize -= chunkSize;
+      // without a system call per message, a closed connection is only seen when checked
+      // (otherwise the ring of a stopped infoLoggerD would fill silently)
+      if (ringCheckTimer.isTimeout()) {
+        ringCheckTimer.reset(RING_CHECK_INTERVAL);
+        if (isClosed(0)) {
+          return -1;
+        }
+      }
+      continue;
+    }
+    // ring full: wait for infoLoggerD to read it
+    if (!isWaiting) {
+      ring.signal();
+      isWaiting = true;
+    }
+    if (isClosed(1)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
 void InfoLoggerClient::disconnect() {
+  ring.release();
   if (txSocket >= 0) {
     if (isVerbose) log.info("Closing transmission socket");
     close(txSocket);
@@ -234,8 +343,7 @@ int InfoLoggerClient::send(const char* message, unsigned int messageSize)
     reconnectThreadCleanup();
 
 
-    int bytesWritten = ::send(txSocket, message, messageSize, sendFlags);
-    if (bytesWritten == (int)messageSize) {
+    if (write(message, messageSize) == 0) {
       mutex.unlock();
       return 0;
     }
@@ -244,7 +352,7 @@ int InfoLoggerClient::send(const char* message, unsigned int messageSize)
     reconnectThreadStart();
   }
   if ((int)messageBuffer.size()<cfg.maxMessagesBuffered) {
-    messageBuffer.push(message);
+    messageBuffer.push(std::string(message, messageSize));
     if ((int)messageBuffer.size()==cfg.maxMessagesBuffered) {
       log.warning("Max buffer size reached, next messages will be lost until reconnect");
     }
@@ -253,6 +361,13 @@ int InfoLoggerClient::send(const char* message, unsigned int messageSize)
   return -1;
 }
 
+void InfoLoggerClient::addDefinition(const std::string& definition)
+{
+  mutex.lock();
+  definitions.push_back(definition);
+  mutex.unlock();
+}
+
 void InfoLoggerClient::reconnect() {
   for (;!reconnectAbort;) {    
     bool isOk = 0;
@@ -261,11 +376,18 @@ void InfoLoggerClient::reconnect() {
        if (connect() == 0) {
           isOk = 1;
           log.info("Reconnection successful");
+          for (const auto& d : definitions) {
+            if (write(d.c_str(), d.size()) != 0) {
+              log.info("Failed to send definitions, will reconnect");
+              disconnect();
+              isOk = 0;
+              break;
+            }
+          }
           int nFlushed = 0;
-          while(!messageBuffer.empty()) {
+          while (isOk && !messageBuffer.empty()) {
             size_t messageSize = messageBuffer.front().size();
-            int bytesWritten = ::send(txSocket, messageBuffer.front().c_str(), messageSize, sendFlags);
-            if (bytesWritten == (int)messageSize) {
+            if (write(messageBuffer.front().c_str(), messageSize) == 0) {
                messageBuffer.pop();
                nFlushed++;
             } else {
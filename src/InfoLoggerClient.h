@@ -11,9 +11,12 @@
 
 #include <Common/SimpleLog.h>
 #include <Common/Timer.h>
+#include "InfoLoggerRing.h"
 #include <queue>
 #include <mutex>
 #include <thread>
+#include <string>
+#include <vector>
 
 // class to communicate with local infoLoggerD process
 
@@ -30,6 +33,7 @@ class ConfigInfoLoggerClient
   std::string logFile; // log file for internal library logs
   double reconnectTimeout; // retry timeout for infoLoggerD reconnect (seconds)
   int maxMessagesBuffered; // max messages in buffer when reconnect pending
+  int txRingSize; // size of shared memory ring used to send messages to infoLoggerD (bytes). 0 to use the socket only.
 };
 
 class InfoLoggerClient
@@ -46,6 +50,10 @@ class InfoLoggerClient
   // returns 0 on success, an error code otherwise
   int send(const char* message, unsigned int messageSize);
 
+  // keep a line (already sent) to be sent again first after each reconnection to infoLoggerD
+  // this is used for the definitions of deferred messages formats, which infoLoggerD keeps per connection
+  void addDefinition(const std::string& definition);
+
  private:
   ConfigInfoLoggerClient cfg;
 
@@ -54,10 +62,15 @@ class InfoLoggerClient
   int isInitialized; // set to 1 when object initialized with success, 0 otherwise
   SimpleLog log;     // object for daemon logging, as defined in config
   int txSocket;      // socket to infoLoggerD. >=0 if set.
+  InfoLoggerRing ring; // shared memory ring to infoLoggerD, if set up on connect (otherwise data is sent on socket)
+  AliceO2::Common::Timer ringCheckTimer; // when using ring, infoLoggerD connection is checked periodically
+  int setupRing();     // create ring, and hand it over to infoLoggerD. returns 0 on success, or -1 (socket used).
+  int write(const char* data, unsigned int dataSize); // write data to infoLoggerD, on ring or socket. returns 0 on success, -1 on error.
   
   AliceO2::Common::Timer reconnectTimer; // try to reconnect
   bool reconnectNeeded; // set when need to reconnect after timeout
   std::queue<std::string> messageBuffer; // pending messages
+  std::vector<std::string> definitions; // lines sent again after reconnection
   std::mutex mutex; // lock for exclusive access to buffer
   std::unique_ptr<std::thread> reconnectThread; // thread trying to reconnect to infoLoggerD
   int reconnectAbort; // flag set to stop thread
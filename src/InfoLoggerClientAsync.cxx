@@ -0,0 +1,322 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerClientAsync.h"
+#include "InfoLoggerClient.h"
+#include "InfoLoggerDeferred.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <chrono>
+#include <string>
+
+// size of buffer used to group encoded messages before sending them
+#define ASYNC_BATCH_SIZE 65536
+
+// maximum size of an encoded message (same as for synchronous mode)
+#define ASYNC_MSG_MAX_SIZE 1024
+
+// interval between warnings about dropped messages (seconds)
+#define ASYNC_DROP_REPORT_INTERVAL 1.0
+
+// error code used to report dropped messages, see InfoLoggerErrorCodes.h
+#define ASYNC_DROP_ERROR_CODE 1103
+
+static double getTimeNow()
+{
+  struct timeval tv;
+  if (gettimeofday(&tv, NULL) == 0) {
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000;
+  }
+  return 0;
+}
+
+InfoLoggerClientAsync::InfoLoggerClientAsync(InfoLoggerClient* vClient, unsigned int queueSize, FullPolicy policy, bool vSendDeferred)
+{
+  if (vClient == nullptr) {
+    throw __LINE__;
+  }
+  client = vClient;
+  fullPolicy = policy;
+  sendDeferred = vSendDeferred;
+
+  uint64_t n = 2;
+  while (n < queueSize) {
+    n <<= 1;
+  }
+  slots = std::make_unique<Slot[]>(n);
+  slotsMask = n - 1;
+  for (uint64_t i = 0; i < n; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  enqueuePos = 0;
+  dequeuePos = 0;
+  droppedCount = 0;
+  sentCount = 0;
+
+  flusherIdle = false;
+  flusherShutdown = false;
+  flusherThread = std::make_unique<std::thread>(&InfoLoggerClientAsync::flusherLoop, this);
+}
+
+InfoLoggerClientAsync::~InfoLoggerClientAsync()
+{
+  flusherShutdown = true;
+  flusherWakeUp.notify_one();
+  if (flusherThread != nullptr) {
+    flusherThread->join();
+    flusherThread = nullptr;
+  }
+  // last call, in case something was pushed after thread exit
+  flush();
+  if (droppedCount.load() != droppedCountReported) {
+    fprintf(stderr, "infoLogger: %llu messages dropped (asynchronous queue full)\n", droppedCount.load() - droppedCountReported);
+  }
+}
+
+int InfoLoggerClientAsync::push(const infoLog_msg_t& msg, const std::string* encodedContext, const char* format, int formatId, const char* args, unsigned int argsSize)
+{
+  Slot* slot = nullptr;
+  uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+  // reserve a slot
+  for (;;) {
+    slot = &slots[pos & slotsMask];
+    uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+    int64_t diff = (int64_t)seq - (int64_t)pos;
+    if (diff == 0) {
+      // slot is free, try to take it
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // queue is full
+      if ((fullPolicy == FullPolicy::drop) || (flusherShutdown)) {
+        droppedCount++;
+        return -1;
+      }
+      if (flusherIdle.load(std::memory_order_relaxed)) {
+        flusherWakeUp.notify_one();
+      }
+      std::this_thread::yield();
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    } else {
+      // another producer took it
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  // copy fields, with strings stored in slot buffer
+  slot->msg = msg;
+  slot->msg.next = NULL;
+  slot->msg.data = NULL;
+  int dataUsed = 0;
+  slot->context = nullptr;
+  if ((encodedContext != nullptr) && (encodedContext->length() < slotDataSize / 2)) {
+    // encoded context copied as such, context string fields of msg not used
+    slot->contextLength = (int)encodedContext->length();
+    memcpy(slot->data, encodedContext->c_str(), slot->contextLength);
+    slot->context = slot->data;
+    dataUsed = slot->contextLength;
+  }
+  for (int i = 0; i < msg.protocol->numberOfFields; i++) {
+    if ((msg.protocol->fields[i].type != infoLog_msgField_def_t::ILOG_TYPE_STRING) || (msg.values[i].isUndefined)) {
+      continue;
+    }
+    if ((slot->context != nullptr) && (i >= msgHelper.ix_hostname) && (i <= msgHelper.ix_run)) {
+      slot->msg.values[i].isUndefined = 1;
+      continue;
+    }
+    const char* s = msg.values[i].value.vString;
+    if (s == nullptr) {
+      s = "";
+    }
+    int available = slotDataSize - dataUsed - 1;
+    if (available < 0) {
+      available = 0;
+      dataUsed = slotDataSize - 1;
+    }
+    int len = (int)strnlen(s, available);
+    char* dest = &slot->data[dataUsed];
+    memcpy(dest, s, len);
+    dest[len] = 0;
+    slot->msg.values[i].value.vString = dest;
+    slot->msg.values[i].length = len;
+    dataUsed += len + 1;
+  }
+
+  // deferred message: copy arguments, or build text now if they do not fit
+  slot->format = nullptr;
+  if (format != nullptr) {
+    if (dataUsed + argsSize <= (unsigned int)slotDataSize) {
+      memcpy(&slot->data[dataUsed], args, argsSize);
+      slot->format = format;
+      slot->formatId = formatId;
+      slot->args = &slot->data[dataUsed];
+      slot->argsSize = argsSize;
+    } else if (dataUsed < slotDataSize) {
+      char* dest = &slot->data[dataUsed];
+      int len = InfoLoggerDeferred::format(format, args, argsSize, dest, slotDataSize - dataUsed);
+      InfoLoggerMessageHelperSetValue(slot->msg, msgHelper.ix_message, String, dest);
+      slot->msg.values[msgHelper.ix_message].length = len;
+    }
+  }
+
+  // publish slot
+  slot->sequence.store(pos + 1, std::memory_order_release);
+
+  if (flusherIdle.load(std::memory_order_relaxed)) {
+    flusherWakeUp.notify_one();
+  }
+  return 0;
+}
+
+unsigned long long InfoLoggerClientAsync::getDroppedCount()
+{
+  return droppedCount.load();
+}
+
+unsigned long long InfoLoggerClientAsync::getSentCount()
+{
+  return sentCount.load();
+}
+
+int InfoLoggerClientAsync::flush()
+{
+  char batch[ASYNC_BATCH_SIZE];
+  int batchSize = 0;
+  int nMessages = 0;
+  int nMessagesInBatch = 0;
+
+  auto sendBatch = [&]() {
+    if (batchSize > 0) {
+      client->send(batch, batchSize);
+      sentCount += nMessagesInBatch;
+    }
+    batchSize = 0;
+    nMessagesInBatch = 0;
+  };
+
+  for (;;) {
+    Slot& slot = slots[dequeuePos & slotsMask];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+      // queue empty
+      break;
+    }
+
+    if (ASYNC_BATCH_SIZE - batchSize < ASYNC_MSG_MAX_SIZE) {
+      sendBatch();
+    }
+    // deferred message: send it as such when possible, otherwise build text
+    char text[ASYNC_MSG_MAX_SIZE];
+    if (slot.format != nullptr) {
+      bool isEncoded = false;
+      if (sendDeferred) {
+        if ((slot.formatId >= (int)formatsDefined.size()) || (!formatsDefined[slot.formatId])) {
+          // define format first, on the same connection
+          std::string definition = InfoLoggerDeferred::getDefinition(slot.formatId, slot.format);
+          if (definition.length() < ASYNC_MSG_MAX_SIZE) {
+            memcpy(&batch[batchSize], definition.c_str(), definition.length());
+            batchSize += definition.length();
+            client->addDefinition(definition);
+            if (slot.formatId >= (int)formatsDefined.size()) {
+              formatsDefined.resize(slot.formatId + 1);
+            }
+            formatsDefined[slot.formatId] = true;
+            if (ASYNC_BATCH_SIZE - batchSize < ASYNC_MSG_MAX_SIZE) {
+              sendBatch();
+            }
+          }
+        }
+        // arguments should leave space for other fields
+        if ((slot.formatId < (int)formatsDefined.size()) && (formatsDefined[slot.formatId])) {
+          isEncoded = (InfoLoggerDeferred::encode(slot.formatId, slot.args, slot.argsSize, text, ASYNC_MSG_MAX_SIZE / 2) == 0);
+        }
+      }
+      if (!isEncoded) {
+        InfoLoggerDeferred::format(slot.format, slot.args, slot.argsSize, text, sizeof(text));
+      }
+      InfoLoggerMessageHelperSetValue(slot.msg, msgHelper.ix_message, String, text);
+    }
+
+    if (encode(slot, &slot.msg, &batch[batchSize]) == 0) {
+      batchSize += strlen(&batch[batchSize]);
+      nMessagesInBatch++;
+    }
+    nMessages++;
+
+    // report dropped messages, with the context of the current one
+    if (droppedCount.load(std::memory_order_relaxed) != droppedCountReported) {
+      double now = getTimeNow();
+      if (now - droppedReportTime >= ASYNC_DROP_REPORT_INTERVAL) {
+        droppedReportTime = now;
+        sendBatch();
+        reportDropped(slot);
+      }
+    }
+
+    // release slot
+    slot.sequence.store(dequeuePos + slotsMask + 1, std::memory_order_release);
+    dequeuePos++;
+  }
+  sendBatch();
+
+  return nMessages;
+}
+
+void InfoLoggerClientAsync::reportDropped(Slot& slot)
+{
+  unsigned long long n = droppedCount.load();
+  std::string txt = "Asynchronous logging queue full - " + std::to_string(n - droppedCountReported) + " messages dropped";
+  droppedCountReported = n;
+
+  infoLog_msg_t msg = slot.msg;
+  static char str_severity[2] = { 'W', 0 };
+  InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_severity, String, str_severity);
+  InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_level, Int, 6);
+  InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_errcode, Int, ASYNC_DROP_ERROR_CODE);
+  InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_timestamp, Double, getTimeNow());
+  InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_message, String, txt.c_str());
+  msg.values[msgHelper.ix_errsource].isUndefined = 1;
+  msg.values[msgHelper.ix_errline].isUndefined = 1;
+
+  char buffer[ASYNC_MSG_MAX_SIZE];
+  if (encode(slot, &msg, buffer) == 0) {
+    client->send(buffer, strlen(buffer));
+  }
+}
+
+int InfoLoggerClientAsync::encode(Slot& slot, infoLog_msg_t* msg, char* buffer)
+{
+  if (slot.context != nullptr) {
+    return msgHelper.EncodeWithContext(msg, slot.context, slot.contextLength, buffer, ASYNC_MSG_MAX_SIZE);
+  }
+  return msgHelper.MessageToText(msg, buffer, ASYNC_MSG_MAX_SIZE, InfoLoggerMessageHelper::Format::Encoded);
+}
+
+void InfoLoggerClientAsync::flusherLoop()
+{
+  for (;;) {
+    if (flush() > 0) {
+      continue;
+    }
+    if (flusherShutdown) {
+      break;
+    }
+    // nothing to do, wait for producers
+    // timeout in case a notification is missed
+    std::unique_lock<std::mutex> lock(flusherMutex);
+    flusherIdle = true;
+    flusherWakeUp.wait_for(lock, std::chrono::milliseconds(10));
+    flusherIdle = false;
+  }
+}
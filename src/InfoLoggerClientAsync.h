@@ -0,0 +1,107 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#ifndef _INFOLOGGER_CLIENT_ASYNC_H
+#define _INFOLOGGER_CLIENT_ASYNC_H
+
+#include "InfoLoggerMessageHelper.h"
+#include "infoLoggerMessage.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+class InfoLoggerClient;
+
+// class to send messages to local infoLoggerD asynchronously
+// Messages fields are copied by the calling thread(s) to a bounded lock-free queue (multiple producers, single consumer).
+// A background thread encodes them and sends them in batches with the underlying InfoLoggerClient.
+// This keeps the callers away from the socket, which may block when infoLoggerD is slow.
+// The context fields can be given already encoded (see InfoLoggerMessageHelper::EncodeContext()), they are then copied as such.
+// Messages with deferred formatting (see InfoLoggerDeferred) are queued with their arguments, and their text is built
+// by the background thread, or by infoLoggerD when sendDeferred is set.
+
+class InfoLoggerClientAsync
+{
+ public:
+  // what to do when queue is full
+  enum FullPolicy { drop,    // message is discarded, and counted in dropped messages
+                    block }; // caller waits until space available
+
+  // the client object is not owned, it should stay valid until this object is destroyed
+  // queueSize is rounded up to the next power of 2
+  // when sendDeferred is set, deferred messages are sent with the identifier of their format and their arguments, to be expanded by infoLoggerD
+  InfoLoggerClientAsync(InfoLoggerClient* client, unsigned int queueSize, FullPolicy policy, bool sendDeferred = false);
+
+  // pending messages are flushed before returning
+  ~InfoLoggerClientAsync();
+
+  // copy message to the queue. Can be called concurrently from different threads.
+  // returns 0 on success, -1 if message was dropped
+  // when encodedContext is given, it is used instead of the context fields of msg
+  // for a deferred message, the format (static string) with its identifier and the arguments are given, and the message field should be undefined
+  int push(const infoLog_msg_t& msg, const std::string* encodedContext = nullptr, const char* format = nullptr, int formatId = 0, const char* args = nullptr, unsigned int argsSize = 0);
+
+  unsigned long long getDroppedCount(); // number of messages dropped because queue full
+  unsigned long long getSentCount();    // number of messages sent to infoLoggerD
+
+ private:
+  static const int slotDataSize = 1024; // space available to store string fields of a message
+
+  // a queue element
+  struct Slot {
+    std::atomic<uint64_t> sequence; // sequence number, to synchronize producers and consumer
+    infoLog_msg_t msg;              // message, with string fields pointing to data[]
+    char data[slotDataSize];        // storage for the message string fields
+    const char* context;            // encoded context fields, stored in data[] (NULL if not used)
+    int contextLength;              // size of encoded context fields
+    const char* format;             // deferred message: format (NULL otherwise)
+    int formatId;                   // deferred message: format identifier
+    const char* args;               // deferred message: arguments, stored in data[]
+    unsigned int argsSize;          // deferred message: size of arguments
+  };
+
+  InfoLoggerClient* client;
+  InfoLoggerMessageHelper msgHelper;
+  FullPolicy fullPolicy;
+  bool sendDeferred;
+  std::vector<bool> formatsDefined; // formats of deferred messages already defined to infoLoggerD, by id (consumer only)
+
+  std::unique_ptr<Slot[]> slots; // circular buffer
+  uint64_t slotsMask;            // number of slots - 1
+
+  alignas(64) std::atomic<uint64_t> enqueuePos; // next slot to be written (shared by producers)
+  alignas(64) uint64_t dequeuePos;              // next slot to be read (consumer only)
+
+  std::atomic<unsigned long long> droppedCount;
+  std::atomic<unsigned long long> sentCount;
+  unsigned long long droppedCountReported = 0; // dropped count when last reported (consumer only)
+  double droppedReportTime = 0;                // time of last report (consumer only)
+
+  std::atomic<bool> flusherIdle;     // set when flusher thread waits for new data
+  std::atomic<bool> flusherShutdown; // set to stop flusher thread
+  std::mutex flusherMutex;
+  std::condition_variable flusherWakeUp;
+  std::unique_ptr<std::thread> flusherThread;
+
+  void flusherLoop();             // thread loop
+  int flush();                    // send all messages currently in queue. Returns number of messages processed.
+  void reportDropped(Slot& slot); // send a warning about dropped messages, using fields of given message
+  int encode(Slot& slot, infoLog_msg_t* msg, char* buffer); // encode msg (from slot), in buffer of size ASYNC_MSG_MAX_SIZE. Returns 0 on success.
+};
+
+// _INFOLOGGER_CLIENT_ASYNC_H
+#endif
@@ -13,9 +13,17 @@
 #include <pwd.h>
 
 #include <InfoLogger/InfoLogger.hxx>
+#include <atomic>
 
 using namespace AliceO2::InfoLogger;
 
+// a new value for InfoLoggerContext::version, unique in the process
+static unsigned long long getNewVersion()
+{
+  static std::atomic<unsigned long long> lastVersion(0);
+  return ++lastVersion;
+}
+
 InfoLoggerContext::InfoLoggerContext()
 {
   // initialize and update fields
@@ -42,6 +50,7 @@ InfoLoggerContext::InfoLoggerContext(const InfoLoggerContext &sourceContext, con
   processId = sourceContext.processId;
   hostName = sourceContext.hostName;
   userName = sourceContext.userName;
+  version = getNewVersion();
 
   // now set fields provided as arguments
   setField(listOfKeyValuePairs);
@@ -53,6 +62,7 @@ InfoLoggerContext::~InfoLoggerContext()
 
 void InfoLoggerContext::reset()
 {
+  version = getNewVersion();
   facility.clear();
   role.clear();
   system.clear();
@@ -180,6 +190,7 @@ void InfoLoggerContext::refresh(pid_t pid)
 
 int InfoLoggerContext::setField(FieldName key, const std::string& value)
 {
+  version = getNewVersion();
   if (key == FieldName::Facility) {
     facility = value;
   } else if (key == FieldName::Role) {
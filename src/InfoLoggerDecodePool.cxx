@@ -0,0 +1,127 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerDecodePool.h"
+
+InfoLoggerDecodePool::InfoLoggerDecodePool(int nThreads, int vMaxPending)
+{
+  if (nThreads < 1) {
+    nThreads = 1;
+  }
+  maxPending = (vMaxPending > 0) ? vMaxPending : 1;
+  pendingCount = 0;
+  shutdown = false;
+  for (int i = 0; i < nThreads; i++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (auto& w : workers) {
+    w->thread = std::thread(&InfoLoggerDecodePool::workerLoop, this, w.get());
+  }
+}
+
+InfoLoggerDecodePool::~InfoLoggerDecodePool()
+{
+  shutdown = true;
+  for (auto& w : workers) {
+    {
+      std::unique_lock<std::mutex> lock(w->mutex);
+      w->wakeUp.notify_one();
+    }
+    w->thread.join();
+    for (auto f : w->input) {
+      TR_file_destroy(f);
+    }
+  }
+  for (auto& r : output) {
+    TR_file_destroy(r.file);
+  }
+}
+
+int InfoLoggerDecodePool::push(TR_file* f)
+{
+  if (pendingCount >= maxPending) {
+    return -1;
+  }
+  pendingCount++;
+  // same source always handled by same thread, to keep ordering
+  Worker* w = workers[(unsigned int)f->id.sender % workers.size()].get();
+  std::unique_lock<std::mutex> lock(w->mutex);
+  w->input.push_back(f);
+  if (w->input.size() == 1) {
+    w->wakeUp.notify_one();
+  }
+  return 0;
+}
+
+int InfoLoggerDecodePool::pop(Result& r, int timeout)
+{
+  std::unique_lock<std::mutex> lock(outputMutex);
+  if (output.empty()) {
+    if (timeout <= 0) {
+      return -1;
+    }
+    outputReady.wait_for(lock, std::chrono::milliseconds(timeout), [&] { return !output.empty(); });
+    if (output.empty()) {
+      return -1;
+    }
+  }
+  r = std::move(output.front());
+  output.pop_front();
+  pendingCount--;
+  return 0;
+}
+
+int InfoLoggerDecodePool::getPendingCount()
+{
+  return pendingCount;
+}
+
+bool InfoLoggerDecodePool::isFull()
+{
+  return (pendingCount >= maxPending);
+}
+
+void InfoLoggerDecodePool::workerLoop(Worker* w)
+{
+  std::vector<Result> results;
+  for (;;) {
+    // get all files waiting
+    std::deque<TR_file*> files;
+    {
+      std::unique_lock<std::mutex> lock(w->mutex);
+      w->wakeUp.wait(lock, [&] { return (!w->input.empty()) || (shutdown); });
+      if (shutdown) {
+        break;
+      }
+      files.swap(w->input);
+    }
+
+    // decode them
+    results.clear();
+    for (auto f : files) {
+      Result r;
+      r.file = f;
+      try {
+        r.msgList = std::make_shared<InfoLoggerMessageList>(f);
+      } catch (...) {
+        r.msgList = nullptr;
+      }
+      results.push_back(std::move(r));
+    }
+
+    // make them available
+    std::unique_lock<std::mutex> lock(outputMutex);
+    for (auto& r : results) {
+      output.push_back(std::move(r));
+    }
+    outputReady.notify_one();
+  }
+}
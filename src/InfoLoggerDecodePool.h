@@ -0,0 +1,83 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file InfoLoggerDecodePool.h
+/// \brief A pool of threads to decode files received by the infoLoggerServer, before they are dispatched.
+/// \author Sylvain Chapeland (sylvain.chapeland@cern.ch)
+
+#ifndef _INFOLOGGER_DECODE_POOL_H
+#define _INFOLOGGER_DECODE_POOL_H
+
+#include "InfoLoggerMessageList.h"
+#include "transport_files.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Files are decoded in parallel by a set of threads.
+// All files from a given source (same sender) are decoded by the same thread, so that they are returned in the order they were pushed.
+// Files from different sources may be returned in a different order.
+// The files are still owned by the caller, and should be released after they are returned.
+
+class InfoLoggerDecodePool
+{
+ public:
+  // a decoded file
+  struct Result {
+    TR_file* file;                                  // the file pushed
+    std::shared_ptr<InfoLoggerMessageList> msgList; // the corresponding messages. nullptr if decoding failed
+  };
+
+  // nThreads: number of decoding threads
+  // maxPending: maximum number of files pushed and not yet returned
+  InfoLoggerDecodePool(int nThreads, int maxPending);
+
+  // files not returned yet are released
+  ~InfoLoggerDecodePool();
+
+  // queue a file for decoding. Returns 0 on success, or -1 if too many pending files (file not queued).
+  int push(TR_file* f);
+
+  // get a decoded file, waiting at most timeout milliseconds if none ready. Returns 0 on success, or -1 if none.
+  int pop(Result& r, int timeout = 0);
+
+  int getPendingCount(); // number of files pushed and not yet returned
+  bool isFull();         // true if no more files can be pushed
+
+ private:
+  // a decoding thread, with its input queue
+  struct Worker {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<TR_file*> input;
+  };
+
+  void workerLoop(Worker* w);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  int maxPending;
+  std::atomic<int> pendingCount;
+  std::atomic<bool> shutdown;
+
+  std::mutex outputMutex;
+  std::condition_variable outputReady;
+  std::deque<Result> output;
+};
+
+// _INFOLOGGER_DECODE_POOL_H
+#endif
@@ -0,0 +1,361 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerDeferred.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// maximum size of the text of a message (same as for normal messages)
+#define DEFERRED_MSG_MAX_SIZE 1024
+
+// beginning of a format definition line
+#define DEFERRED_DEFINITION_TAG "*DF#"
+
+// beginning of the message field of a deferred message
+#define DEFERRED_MESSAGE_TAG "\001DF"
+
+int InfoLoggerDeferred::format(const char* format, const char* args, unsigned int argsSize, char* buffer, int bufferSize)
+{
+  if ((buffer == nullptr) || (bufferSize <= 0)) {
+    return 0;
+  }
+  int ix = 0;             // length of text in buffer
+  unsigned int argIx = 0; // position of next argument
+
+  // get next argument: type tag, and value (integer, double or pointer), or string
+  // returns false if none left
+  auto nextArg = [&](char& tag, uint64_t& value, const char*& str) {
+    if (argIx >= argsSize) {
+      return false;
+    }
+    tag = args[argIx];
+    if (tag == 's') {
+      uint16_t length;
+      if (argIx + 3 > argsSize) {
+        return false;
+      }
+      memcpy(&length, &args[argIx + 1], 2);
+      if ((argIx + 4 + length > argsSize) || (args[argIx + 3 + length] != 0)) {
+        return false;
+      }
+      str = &args[argIx + 3];
+      argIx += 4 + length;
+    } else {
+      if (argIx + 9 > argsSize) {
+        return false;
+      }
+      memcpy(&value, &args[argIx + 1], 8);
+      argIx += 9;
+    }
+    return true;
+  };
+
+  for (const char* p = format; (*p != 0) && (ix < bufferSize - 1);) {
+    if (*p != '%') {
+      buffer[ix++] = *(p++);
+      continue;
+    }
+    if (p[1] == '%') {
+      buffer[ix++] = '%';
+      p += 2;
+      continue;
+    }
+
+    // conversion specification, copied without length modifier: %[flags][width][.precision][length]conversion
+    const char* start = p++;
+    char spec[32] = "%";
+    int specLength = 1;
+    int stars[2];
+    int nStars = 0;
+    bool isValid = true;
+    auto copySpec = [&]() {
+      if (specLength < (int)sizeof(spec) - 4) {
+        spec[specLength++] = *p;
+      } else {
+        isValid = false;
+      }
+      p++;
+    };
+    auto copyStar = [&]() {
+      char tag;
+      uint64_t value = 0;
+      const char* str;
+      if ((!nextArg(tag, value, str)) || (tag != 'i')) {
+        isValid = false;
+      }
+      stars[nStars++] = (int)value;
+      copySpec();
+    };
+    while ((*p != 0) && (strchr("-+ #0'", *p) != nullptr)) {
+      copySpec();
+    }
+    if (*p == '*') {
+      copyStar();
+    }
+    while ((*p >= '0') && (*p <= '9')) {
+      copySpec();
+    }
+    if (*p == '.') {
+      copySpec();
+      if (*p == '*') {
+        copyStar();
+      }
+      while ((*p >= '0') && (*p <= '9')) {
+        copySpec();
+      }
+    }
+    int length = 0; // length modifier: -2 hh, -1 h, 0 none, 1 long types
+    for (; (*p != 0) && (strchr("hlLqjzt", *p) != nullptr); p++) {
+      if (*p == 'h') {
+        length--;
+      } else {
+        length = 1;
+      }
+    }
+    char conversion = *p;
+    if (conversion == 0) {
+      // incomplete specification, copied as is
+      p = start + strlen(start);
+      for (const char* c = start; (c < p) && (ix < bufferSize - 1); c++) {
+        buffer[ix++] = *c;
+      }
+      break;
+    }
+    p++;
+    spec[specLength] = 0;
+
+    // format the value, using the conversion with a 64-bit type
+    auto append = [&](const char* suffix, auto value) {
+      if (!isValid) {
+        return;
+      }
+      strcpy(&spec[specLength], suffix);
+      int n = -1;
+      if (nStars == 0) {
+        n = snprintf(&buffer[ix], bufferSize - ix, spec, value);
+      } else if (nStars == 1) {
+        n = snprintf(&buffer[ix], bufferSize - ix, spec, stars[0], value);
+      } else {
+        n = snprintf(&buffer[ix], bufferSize - ix, spec, stars[0], stars[1], value);
+      }
+      if (n > 0) {
+        ix += n;
+        if (ix > bufferSize - 1) {
+          ix = bufferSize - 1;
+        }
+      }
+    };
+
+    char tag = 0;
+    uint64_t value = 0;
+    const char* str = nullptr;
+    if (strchr("diuoxXcfFeEgGaAspn", conversion) == nullptr) {
+      // unknown conversion, copied as is
+      for (const char* c = start; (c < p) && (ix < bufferSize - 1); c++) {
+        buffer[ix++] = *c;
+      }
+      continue;
+    }
+    if (!nextArg(tag, value, str)) {
+      // missing argument
+      continue;
+    }
+    switch (conversion) {
+      case 'd':
+      case 'i': {
+        long long v = (long long)value;
+        if (length == -2) {
+          v = (signed char)v;
+        } else if (length == -1) {
+          v = (short)v;
+        } else if (length == 0) {
+          v = (int)v;
+        }
+        char suffix[] = { 'l', 'l', conversion, 0 };
+        append(suffix, v);
+      } break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X': {
+        unsigned long long v = value;
+        if (length == -2) {
+          v = (unsigned char)v;
+        } else if (length == -1) {
+          v = (unsigned short)v;
+        } else if (length == 0) {
+          v = (unsigned int)v;
+        }
+        char suffix[] = { 'l', 'l', conversion, 0 };
+        append(suffix, v);
+      } break;
+      case 'c':
+        append("c", (int)value);
+        break;
+      case 's':
+        append("s", (tag == 's') ? str : "?");
+        break;
+      case 'p':
+        append("p", (void*)(uintptr_t)value);
+        break;
+      case 'n':
+        break;
+      default: {
+        // floating point
+        double v = 0;
+        if (tag == 'd') {
+          memcpy(&v, &value, sizeof(v));
+        } else if (tag == 'i') {
+          v = (double)(int64_t)value;
+        }
+        char suffix[] = { conversion, 0 };
+        append(suffix, v);
+      } break;
+    }
+  }
+  buffer[ix] = 0;
+  return ix;
+}
+
+std::string InfoLoggerDeferred::getDefinition(int id, const char* format)
+{
+  std::string definition = DEFERRED_DEFINITION_TAG + std::to_string(id) + "#";
+  for (const char* p = format; *p != 0; p++) {
+    if (*p == '\\') {
+      definition += "\\\\";
+    } else if (*p == '\n') {
+      definition += "\\n";
+    } else {
+      definition += *p;
+    }
+  }
+  definition += "\n";
+  return definition;
+}
+
+int InfoLoggerDeferred::encode(int id, const char* args, unsigned int argsSize, char* buffer, int bufferSize)
+{
+  static const char hex[] = "0123456789abcdef";
+  int n = snprintf(buffer, bufferSize, DEFERRED_MESSAGE_TAG "%d:", id);
+  if ((n < 0) || (n + 2 * (int)argsSize + 1 > bufferSize)) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < argsSize; i++) {
+    buffer[n++] = hex[(unsigned char)args[i] >> 4];
+    buffer[n++] = hex[(unsigned char)args[i] & 0xF];
+  }
+  buffer[n] = 0;
+  return 0;
+}
+
+int InfoLoggerDeferred::processLine(const char* line, int length, std::vector<std::string>& records)
+{
+  if (strncmp(line, DEFERRED_DEFINITION_TAG, strlen(DEFERRED_DEFINITION_TAG)) == 0) {
+    const char* p = line + strlen(DEFERRED_DEFINITION_TAG);
+    char* end = nullptr;
+    long id = strtol(p, &end, 10);
+    if ((end == p) || (*end != '#') || (id <= 0) || (id > INT_MAX)) {
+      return 1;
+    }
+    // the text of a message is truncated to DEFERRED_MSG_MAX_SIZE anyway
+    if (strlen(end + 1) >= DEFERRED_MSG_MAX_SIZE) {
+      return 1;
+    }
+    if ((formats.find((int)id) == formats.end()) && (formats.size() >= maxFormats)) {
+      if (isFormatsFull) {
+        return 1;
+      }
+      isFormatsFull = true;
+      return 3;
+    }
+    std::string& f = formats[(int)id];
+    f.clear();
+    for (p = end + 1; *p != 0; p++) {
+      if ((*p == '\\') && (p[1] == 'n')) {
+        f += '\n';
+        p++;
+      } else if ((*p == '\\') && (p[1] == '\\')) {
+        f += '\\';
+        p++;
+      } else {
+        f += *p;
+      }
+    }
+    return 1;
+  }
+
+  // deferred message: message field (the last one) starts with tag
+  if ((length <= 0) || (line[0] != '*')) {
+    return 0;
+  }
+  const char* lastField = (const char*)memrchr(line, '#', length);
+  if ((lastField == nullptr) || (strncmp(lastField + 1, DEFERRED_MESSAGE_TAG, strlen(DEFERRED_MESSAGE_TAG)) != 0)) {
+    return 0;
+  }
+  lastField++;
+
+  char text[DEFERRED_MSG_MAX_SIZE];
+  char args[DEFERRED_MSG_MAX_SIZE];
+  unsigned int argsSize = 0;
+  const char* p = lastField + strlen(DEFERRED_MESSAGE_TAG);
+  char* end = nullptr;
+  long id = strtol(p, &end, 10);
+  bool isValid = ((end != p) && (*end == ':'));
+  if (isValid) {
+    auto hexValue = [](char c) {
+      if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+      }
+      if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+      }
+      return -1;
+    };
+    for (p = end + 1; (p[0] != 0) && isValid; p += 2) {
+      int h = hexValue(p[0]);
+      int l = hexValue(p[1]);
+      if ((h < 0) || (l < 0) || (argsSize >= sizeof(args))) {
+        isValid = false;
+        break;
+      }
+      args[argsSize++] = (char)((h << 4) | l);
+    }
+  }
+  auto f = formats.find((int)id);
+  if (!isValid) {
+    snprintf(text, sizeof(text), "[invalid deferred message]");
+  } else if (f == formats.end()) {
+    snprintf(text, sizeof(text), "[deferred message with undefined format %ld]", id);
+  } else {
+    format(f->second.c_str(), args, argsSize, text, sizeof(text));
+  }
+
+  // one record per line of text, as done by infoLog_msg_encode()
+  std::string prefix(line, lastField - line);
+  for (const char* sol = text;;) {
+    const char* eol = strchr(sol, '\n');
+    size_t lineLength = (eol == nullptr) ? strlen(sol) : (size_t)(eol - sol);
+    records.push_back(prefix);
+    std::string& r = records.back();
+    for (size_t i = 0; i < lineLength; i++) {
+      r += ((sol[i] == '*') || (sol[i] == '#')) ? '?' : sol[i];
+    }
+    if (eol == nullptr) {
+      break;
+    }
+    sol = eol + 1;
+  }
+  return 2;
+}
@@ -0,0 +1,61 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#ifndef _INFOLOGGER_DEFERRED_H
+#define _INFOLOGGER_DEFERRED_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Deferred formatting of log messages.
+// A deferred message is made of a printf-like format, identified by a number, and of its arguments in binary form
+// (see InfoLogger::DeferredArgs for the layout). The text of the message is built from them when needed.
+//
+// Deferred messages can be sent as such to infoLoggerD, which builds the text before sending them to the server:
+//   - the format is defined first on the connection, with the line: *DF#id#format
+//     (in the format, backslash and newline are escaped as \\ and \n)
+//   - messages are normal records, with the message field set to: \001DF id : arguments in hexadecimal
+// infoLoggerD keeps the formats defined by each client, and replaces these records by the expanded ones
+// (split in multiple records for multiple lines, and special characters replaced, as done by the client for normal messages).
+
+class InfoLoggerDeferred
+{
+ public:
+  // build the text of a message from its format and arguments, in buffer (NUL-terminated, truncated to bufferSize)
+  // conversions are done as by printf(), using the type of the arguments stored (length modifiers are not needed)
+  // returns the length of the text
+  static int format(const char* format, const char* args, unsigned int argsSize, char* buffer, int bufferSize);
+
+  // line defining a format for infoLoggerD, terminated by a newline
+  static std::string getDefinition(int id, const char* format);
+
+  // message field of a deferred message sent to infoLoggerD, in buffer (NUL-terminated)
+  // returns 0 on success, -1 if buffer too small
+  static int encode(int id, const char* args, unsigned int argsSize, char* buffer, int bufferSize);
+
+  // process a line received from a client (NUL-terminated, without newline)
+  // returns 0 for a normal line (to be used as is),
+  // 1 for a format definition (stored, the line should be dropped; invalid ones are dropped as well),
+  // 2 for a deferred message (the line should be replaced by the records, normal lines without newline, appended to records),
+  // 3 for a format definition refused because the maximum number of formats is reached (only for the first one refused, the next ones return 1)
+  int processLine(const char* line, int length, std::vector<std::string>& records);
+
+  // maximum number of formats kept (one per call site in the client process)
+  static constexpr int maxFormats = 4096;
+
+ private:
+  std::unordered_map<int, std::string> formats; // formats defined, by id
+  bool isFormatsFull = false;                   // set when a format was refused because maxFormats was reached
+};
+
+// _INFOLOGGER_DEFERRED_H
+#endif
@@ -109,5 +109,19 @@ class InfoLoggerDispatchStats : public InfoLoggerDispatch
  private:
   std::unique_ptr<InfoLoggerDispatchStatsImpl> dPtr;
 };
+
+// a class to evaluate alert rules on online messages, and publish alerts
+class InfoLoggerDispatchAlertsImpl;
+class InfoLoggerDispatchAlerts : public InfoLoggerDispatch
+{
+ public:
+  InfoLoggerDispatchAlerts(ConfigInfoLoggerServer* theConfig, SimpleLog* theLog);
+  ~InfoLoggerDispatchAlerts();
+  int customMessageProcess(std::shared_ptr<InfoLoggerMessageList> msg);
+  int customLoop();
+
+ private:
+  std::unique_ptr<InfoLoggerDispatchAlertsImpl> dPtr;
+};
 #endif
 
@@ -0,0 +1,358 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerDispatch.h"
+
+#include <strings.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "ConfigInfoLoggerServer.h"
+#include "InfoLoggerAlertRules.h"
+#include "infoLoggerMessage.h"
+
+////////////////////////////////////////////////////////
+// class InfoLoggerDispatchAlerts implementation
+////////////////////////////////////////////////////////
+
+// facility of the messages generated for alerts, which are not evaluated
+#define DISPATCH_ALERTS_FACILITY "ilg/alert"
+
+// size of a general purpose buffer
+#define DISPATCH_BUFFER_SIZE 200
+
+// max number of bytes waiting to be sent to a client before it is disconnected
+#define DISPATCH_ALERTS_MAX_PENDING (1024 * 1024)
+
+// state of an alert
+struct AlertState {
+  bool isFiring = false;   // set when alert active
+  time_t timeFirst = 0;    // time of first message triggering the alert, since firing
+  time_t timeLast = 0;     // time of last message triggering the alert
+  uint64_t count = 0;      // number of messages triggering the alert, since firing
+  uint64_t total = 0;      // number of messages triggering the alert, since startup
+  std::string hostname;    // host of first message triggering the alert, since firing
+  std::string message;     // text of first message triggering the alert, since firing
+};
+
+// a connected client, with data waiting to be sent
+struct AlertClient {
+  int sock = -1;
+  std::string output;
+};
+
+class InfoLoggerDispatchAlertsImpl
+{
+ public:
+  InfoLoggerAlertRules rules;     // alert definitions
+  std::vector<AlertState> alerts; // alert states, same index as rules
+  std::vector<int> matched;       // buffer for rules matching current message
+
+  int listen_sock = -1;             // listening socket
+  std::vector<AlertClient> clients; // connected clients
+
+  time_t lastTimePublished = 0; // time of last status publish
+  int ixFacility = -1;          // index of facility field
+  int ixHostname = -1;          // index of hostname field
+  int ixMessage = -1;           // index of message field
+
+  void publish(const std::string& txt); // queue an event for all clients
+  void flush(SimpleLog* theLog);        // send pending data to clients
+  std::string event(const char* type, int ix, time_t t); // format an alert event
+};
+
+// quote a string as an element of a Tcl list
+static std::string tclQuote(const std::string& s)
+{
+  if (s.empty()) {
+    return "{}";
+  }
+  std::string q;
+  q.reserve(s.size());
+  for (char c : s) {
+    switch (c) {
+      case '\n':
+        q += "\\n";
+        break;
+      case '\t':
+        q += "\\t";
+        break;
+      case '\f':
+        q += "\\f";
+        break;
+      case ' ':
+      case '"':
+      case '{':
+      case '}':
+      case '[':
+      case ']':
+      case '$':
+      case ';':
+      case '\\':
+        q += '\\';
+        q += c;
+        break;
+      default:
+        q += c;
+    }
+  }
+  return q;
+}
+
+std::string InfoLoggerDispatchAlertsImpl::event(const char* type, int ix, time_t t)
+{
+  const InfoLoggerAlertRules::Rule& r = rules.getRule(ix);
+  const AlertState& a = alerts[ix];
+  std::string txt = "{event " + std::string(type) + " id " + std::to_string(r.id) + " time " + std::to_string(t);
+  txt += " timeFirst " + std::to_string(a.timeFirst) + " timeLast " + std::to_string(a.timeLast);
+  txt += " count " + std::to_string(a.count) + " total " + std::to_string(a.total);
+  txt += " description " + tclQuote(r.description) + " doc " + tclQuote(r.doc);
+  txt += " hostname " + tclQuote(a.hostname) + " message " + tclQuote(a.message) + "}\n";
+  return txt;
+}
+
+void InfoLoggerDispatchAlertsImpl::publish(const std::string& txt)
+{
+  for (auto& c : clients) {
+    if (c.sock >= 0) {
+      c.output += txt;
+    }
+  }
+}
+
+void InfoLoggerDispatchAlertsImpl::flush(SimpleLog* theLog)
+{
+  for (int i = 0; i < (int)clients.size(); i++) {
+    AlertClient& c = clients[i];
+    if ((c.sock < 0) || (c.output.empty())) {
+      continue;
+    }
+    ssize_t n = send(c.sock, c.output.data(), c.output.size(), MSG_NOSIGNAL);
+    if (n > 0) {
+      c.output.erase(0, n);
+    } else if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      theLog->info("Write failed - connection alerts-%d closed", i + 1);
+      close(c.sock);
+      c.sock = -1;
+      c.output.clear();
+      continue;
+    }
+    if (c.output.size() > DISPATCH_ALERTS_MAX_PENDING) {
+      theLog->info("Client not reading - connection alerts-%d closed", i + 1);
+      close(c.sock);
+      c.sock = -1;
+      c.output.clear();
+    }
+  }
+}
+
+InfoLoggerDispatchAlerts::InfoLoggerDispatchAlerts(ConfigInfoLoggerServer* config, SimpleLog* log) : InfoLoggerDispatch(config, log)
+{
+  dPtr = std::make_unique<InfoLoggerDispatchAlertsImpl>();
+
+  // load rules
+  std::vector<std::string> errors;
+  int n = dPtr->rules.loadFile(theConfig->alertsRulesFile, errors);
+  for (const auto& e : errors) {
+    theLog->error("Alert rules %s: %s", theConfig->alertsRulesFile.c_str(), e.c_str());
+  }
+  if (n < 0) {
+    throw __LINE__;
+  }
+  dPtr->alerts.resize(n);
+  dPtr->ixFacility = infoLog_msg_findField("facility");
+  dPtr->ixHostname = infoLog_msg_findField("hostname");
+  dPtr->ixMessage = infoLog_msg_findField("message");
+
+  dPtr->clients.resize(theConfig->alertsMaxClients);
+
+  // initialize listening socket
+  if ((dPtr->listen_sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    throw __LINE__;
+  }
+  int opts = 1;
+  setsockopt(dPtr->listen_sock, SOL_SOCKET, SO_REUSEADDR, &opts, sizeof(opts));
+  opts = 1;
+  setsockopt(dPtr->listen_sock, SOL_SOCKET, SO_KEEPALIVE, &opts, sizeof(opts));
+
+  struct sockaddr_in srv_addr;
+  bzero((char*)&srv_addr, sizeof(srv_addr));
+  srv_addr.sin_family = AF_INET;
+  srv_addr.sin_addr.s_addr = INADDR_ANY;
+  srv_addr.sin_port = htons(theConfig->alertsPort);
+
+  if (bind(dPtr->listen_sock, (struct sockaddr*)&srv_addr, sizeof(srv_addr)) < 0) {
+    theLog->error("bind port %d - error %d = %s", theConfig->alertsPort, errno, strerror(errno));
+    close(dPtr->listen_sock);
+    throw __LINE__;
+  }
+  if (listen(dPtr->listen_sock, theConfig->alertsMaxClients) < 0) {
+    theLog->error("listen - error %d = %s", errno, strerror(errno));
+    close(dPtr->listen_sock);
+    throw __LINE__;
+  }
+  // accept() should not block the dispatch thread
+  fcntl(dPtr->listen_sock, F_SETFL, fcntl(dPtr->listen_sock, F_GETFL) | O_NONBLOCK);
+
+  theLog->info("Evaluating %d alert rules from %s, publishing alerts on port %d", n, theConfig->alertsRulesFile.c_str(), theConfig->alertsPort);
+
+  // enable customloop callback
+  isReady = true;
+}
+
+InfoLoggerDispatchAlerts::~InfoLoggerDispatchAlerts()
+{
+  // stop dispatch thread before closing the sockets and releasing the rules it uses
+  dispatchThread->stop();
+  dispatchThread->join();
+
+  if (dPtr->listen_sock >= 0) {
+    close(dPtr->listen_sock);
+  }
+  for (auto& c : dPtr->clients) {
+    if (c.sock >= 0) {
+      close(c.sock);
+    }
+  }
+}
+
+int InfoLoggerDispatchAlerts::customMessageProcess(std::shared_ptr<InfoLoggerMessageList> msg)
+{
+  time_t now = time(NULL);
+  bool published = false;
+  for (infoLog_msg_t* lmsg = msg->msg; lmsg != NULL; lmsg = lmsg->next) {
+    // skip messages generated for alerts
+    const infoLog_msgField_value_t& facility = lmsg->values[dPtr->ixFacility];
+    if ((!facility.isUndefined) && (facility.value.vString != nullptr) && (!strcmp(facility.value.vString, DISPATCH_ALERTS_FACILITY))) {
+      continue;
+    }
+
+    dPtr->matched.clear();
+    dPtr->rules.match(lmsg, dPtr->matched);
+    for (int ix : dPtr->matched) {
+      AlertState& a = dPtr->alerts[ix];
+      a.count++;
+      a.total++;
+      a.timeLast = now;
+      if (!a.isFiring) {
+        const infoLog_msgField_value_t& h = lmsg->values[dPtr->ixHostname];
+        const infoLog_msgField_value_t& m = lmsg->values[dPtr->ixMessage];
+        a.isFiring = true;
+        a.timeFirst = now;
+        a.count = 1;
+        a.hostname = ((!h.isUndefined) && (h.value.vString != nullptr)) ? h.value.vString : "";
+        a.message = ((!m.isUndefined) && (m.value.vString != nullptr)) ? m.value.vString : "";
+        theLog->info("Alert %d firing: %s", dPtr->rules.getRule(ix).id, dPtr->rules.getRule(ix).description.c_str());
+        dPtr->publish(dPtr->event("firing", ix, now));
+        published = true;
+      }
+    }
+  }
+  if (published) {
+    dPtr->flush(theLog);
+  }
+  return 0;
+}
+
+int InfoLoggerDispatchAlerts::customLoop()
+{
+  char buffer[DISPATCH_BUFFER_SIZE]; // generic purpose buffer
+
+  // new connections
+  for (;;) {
+    struct sockaddr_in new_cl_addr;
+    socklen_t cl_addr_len = sizeof(new_cl_addr);
+    int new_cl_sock = accept(dPtr->listen_sock, (struct sockaddr*)&new_cl_addr, &cl_addr_len);
+    if (new_cl_sock < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        theLog->info("accept - error %d", errno);
+      }
+      break;
+    }
+    theLog->info("%s connected on port %d", inet_ntoa(new_cl_addr.sin_addr), new_cl_addr.sin_port);
+    int i;
+    for (i = 0; i < (int)dPtr->clients.size(); i++) {
+      if (dPtr->clients[i].sock == -1) {
+        break;
+      }
+    }
+    if (i == (int)dPtr->clients.size()) {
+      theLog->info("Too many alerts connections, max=%d - closing", theConfig->alertsMaxClients);
+      close(new_cl_sock);
+      continue;
+    }
+    if (fcntl(new_cl_sock, F_SETFL, fcntl(new_cl_sock, F_GETFL) | O_NONBLOCK) == -1) {
+      theLog->error("fcntl - F_SETFL");
+      close(new_cl_sock);
+      continue;
+    }
+    theLog->info("Assigned connection alerts-%d", i + 1);
+    dPtr->clients[i].sock = new_cl_sock;
+    dPtr->clients[i].output.clear();
+    // send current state of active alerts
+    for (int ix = 0; ix < (int)dPtr->alerts.size(); ix++) {
+      if (dPtr->alerts[ix].isFiring) {
+        dPtr->clients[i].output += dPtr->event("firing", ix, dPtr->alerts[ix].timeFirst);
+      }
+    }
+  }
+
+  // detect closed connections (input is not used)
+  for (int i = 0; i < (int)dPtr->clients.size(); i++) {
+    AlertClient& c = dPtr->clients[i];
+    if (c.sock < 0) {
+      continue;
+    }
+    int result = recv(c.sock, buffer, sizeof(buffer), 0);
+    if ((result == 0) || ((result < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+      theLog->info("Connection alerts-%d closed", i + 1);
+      close(c.sock);
+      c.sock = -1;
+      c.output.clear();
+    }
+  }
+
+  // clear alerts not triggered recently
+  time_t now = time(NULL);
+  for (int ix = 0; ix < (int)dPtr->alerts.size(); ix++) {
+    AlertState& a = dPtr->alerts[ix];
+    if ((a.isFiring) && (now - a.timeLast >= theConfig->alertsTimeout)) {
+      theLog->info("Alert %d cleared: %llu messages in %ds", dPtr->rules.getRule(ix).id, (unsigned long long)a.count, (int)(a.timeLast - a.timeFirst));
+      dPtr->publish(dPtr->event("cleared", ix, now));
+      a.isFiring = false;
+    }
+  }
+
+  // publish status of firing alerts periodically
+  if (now - dPtr->lastTimePublished >= theConfig->alertsPublishInterval) {
+    dPtr->lastTimePublished = now;
+    for (int ix = 0; ix < (int)dPtr->alerts.size(); ix++) {
+      if (dPtr->alerts[ix].isFiring) {
+        dPtr->publish(dPtr->event("active", ix, now));
+      }
+    }
+  }
+
+  dPtr->flush(theLog);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////
+// end of class InfoLoggerDispatchAlerts implementation
+//////////////////////////////////////////////////////////////
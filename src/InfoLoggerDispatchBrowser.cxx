@@ -13,14 +13,20 @@
 
 #include <strings.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <deque>
 
 #include "ConfigInfoLoggerServer.h"
+#include "InfoLoggerMessageFilter.h"
+#include "infoLoggerMessage.h"
 
 ////////////////////////////////////////////////////////
 // class InfoLoggerDispatchOnlineBrowser implementation
@@ -29,20 +35,405 @@
 // size of a general purpose buffer
 #define DISPATCH_BUFFER_SIZE 200
 
+// max number of epoll events handled per loop
+#define DISPATCH_EPOLL_EVENTS 64
+
+// max number of buffers written with a single writev()
+#define DISPATCH_IOV_MAX 64
+
+// max length of a command line received from a client
+#define DISPATCH_INPUT_MAX 65536
+
+// Messages are encoded once for all clients, in a batch shared by the clients output queues.
+// Each client has a bounded output queue, sent with writev() when the socket is writable.
+// A slow client does not block the others: when its queue is full, the overflow policy applies.
+// A client can send a filter (see InfoLoggerMessageFilter), with a line: filter definition
+// Only the messages matching the filter are then sent to this client. An empty definition removes the filter.
+
+// a set of encoded messages
+struct InfoLoggerDispatchOnlineBrowserBatch {
+  std::string data;           // messages, one after the other
+  std::vector<size_t> msgEnd; // end offset of each message in data
+};
+
+// a part of a batch waiting to be sent to a client
+struct InfoLoggerDispatchOnlineBrowserOutput {
+  std::shared_ptr<const InfoLoggerDispatchOnlineBrowserBatch> batch;
+  size_t begin; // offset of next byte to be sent
+  size_t end;   // offset of last byte to be sent, plus one
+  int msg;      // index of message containing the next byte to be sent
+};
+
+// a connected client
+struct InfoLoggerDispatchOnlineBrowserClient {
+  int fd = -1;                                             // socket
+  std::deque<InfoLoggerDispatchOnlineBrowserOutput> output; // data waiting to be sent
+  size_t outputBytes = 0;                                  // number of bytes waiting to be sent
+  unsigned long dropped = 0;                               // number of messages dropped since last report
+  bool waitWritable = false;                               // set when socket registered for EPOLLOUT
+  InfoLoggerMessageFilter filter;                          // messages selected for this client
+  std::string input;                                       // data received from client, not processed yet
+  std::vector<std::pair<int, int>> runs;                   // ranges of messages of current batch selected by filter
+};
+
 class InfoLoggerDispatchOnlineBrowserImpl
 {
  public:
-  int listen_sock = -1;     // listening socket
-  std::vector<int> clients; // connected clients
+  enum class OverflowPolicy { Drop,
+                              Gap,
+                              Disconnect };
+
+  int listen_sock = -1;                                      // listening socket
+  int epoll_fd = -1;                                         // epoll instance, for listening socket and clients
+  std::vector<InfoLoggerDispatchOnlineBrowserClient> clients; // connected clients
+  int nClients = 0;                                          // number of connected clients
+  size_t bufferSize = 0;                                     // max number of bytes waiting per client
+  OverflowPolicy overflowPolicy = OverflowPolicy::Gap;       // what to do when client buffer is full
+  std::vector<int> filteredClients;                          // clients with a filter, for current batch
+  std::vector<char> selected;                                // messages selected, for each of filteredClients
+  SimpleLog* theLog = nullptr;
+
+  void closeClient(int i);
+  void acceptClients();
+  void readClient(int i);
+  void flushClient(int i);
+  void processCommand(int i, const std::string& command);
+  int sendBatch(int i, const std::shared_ptr<const InfoLoggerDispatchOnlineBrowserBatch>& b, int msgBegin, int msgEnd);
+  void dropOldest(InfoLoggerDispatchOnlineBrowserClient& c, size_t bytesNeeded);
+  std::shared_ptr<const InfoLoggerDispatchOnlineBrowserBatch> serverMessage(const char* severity, const char* text);
 };
 
+static size_t msgStart(const InfoLoggerDispatchOnlineBrowserBatch& b, int msg)
+{
+  return (msg > 0) ? b.msgEnd[msg - 1] : 0;
+}
+
+void InfoLoggerDispatchOnlineBrowserImpl::closeClient(int i)
+{
+  InfoLoggerDispatchOnlineBrowserClient& c = clients[i];
+  if (c.fd < 0) {
+    return;
+  }
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c.fd, NULL);
+  close(c.fd);
+  c.fd = -1;
+  c.output.clear();
+  c.outputBytes = 0;
+  c.dropped = 0;
+  c.waitWritable = false;
+  c.filter = InfoLoggerMessageFilter();
+  c.input.clear();
+  nClients--;
+}
+
+void InfoLoggerDispatchOnlineBrowserImpl::acceptClients()
+{
+  for (;;) {
+    struct sockaddr_in new_cl_addr; /* address of new client */
+    socklen_t cl_addr_len = sizeof(new_cl_addr);
+    int new_cl_sock = accept(listen_sock, (struct sockaddr*)&new_cl_addr, &cl_addr_len);
+    if (new_cl_sock < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+        theLog->info("accept - error %d", errno);
+      }
+      return;
+    }
+    theLog->info("%s connected on port %d", inet_ntoa(new_cl_addr.sin_addr), new_cl_addr.sin_port);
+    int i;
+    for (i = 0; i < (int)clients.size(); i++) {
+      if (clients[i].fd == -1)
+        break;
+    }
+    if (i == (int)clients.size()) {
+      theLog->info("Too many online (e.g. infoBrowser) connections, max=%d - closing", (int)clients.size());
+      close(new_cl_sock);
+      continue;
+    }
+    /* Non blocking connection */
+    int opts = fcntl(new_cl_sock, F_GETFL);
+    if ((opts == -1) || (fcntl(new_cl_sock, F_SETFL, opts | O_NONBLOCK) == -1)) {
+      theLog->error("fcntl - error %d", errno);
+      close(new_cl_sock);
+      continue;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i + 1;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_cl_sock, &ev) == -1) {
+      theLog->error("epoll_ctl - error %d", errno);
+      close(new_cl_sock);
+      continue;
+    }
+    theLog->info("Assigned connection %d", i + 1);
+    clients[i].fd = new_cl_sock;
+    nClients++;
+  }
+}
+
+void InfoLoggerDispatchOnlineBrowserImpl::readClient(int i)
+{
+  char buffer[DISPATCH_BUFFER_SIZE * 20]; /* generic purpose buffer */
+  int result = read(clients[i].fd, buffer, sizeof(buffer));
+  if (result > 0) {
+    /* process complete lines */
+    InfoLoggerDispatchOnlineBrowserClient& c = clients[i];
+    c.input.append(buffer, result);
+    size_t eol;
+    while ((eol = c.input.find('\n')) != std::string::npos) {
+      std::string command = c.input.substr(0, eol);
+      c.input.erase(0, eol + 1);
+      processCommand(i, command);
+      if (c.fd == -1) {
+        return;
+      }
+    }
+    if (c.input.size() > DISPATCH_INPUT_MAX) {
+      theLog->info("Connection %d: input line too long, discarded", i + 1);
+      c.input.clear();
+    }
+    return;
+  }
+  if (result < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+      return;
+    }
+    /* error reading socket */
+    theLog->info("read - error %d", errno);
+    result = 0;
+  }
+  /* close connection on EOF / error */
+  if (result == 0) {
+    theLog->info("Connection %d closed", i + 1);
+    closeClient(i);
+  }
+}
+
+// execute a command received from a client
+void InfoLoggerDispatchOnlineBrowserImpl::processCommand(int i, const std::string& command)
+{
+  InfoLoggerDispatchOnlineBrowserClient& c = clients[i];
+  const char* keyword = "filter";
+  size_t len = strlen(keyword);
+  if ((command.compare(0, len, keyword) != 0) || ((command.size() > len) && (command[len] != ' ') && (command[len] != '\r'))) {
+    /* other input is ignored */
+    return;
+  }
+  std::string definition = command.substr(len);
+  std::string errorMessage;
+  if (c.filter.setFilter(definition, errorMessage)) {
+    theLog->info("Connection %d: invalid filter: %s", i + 1, errorMessage.c_str());
+    std::string text = "Invalid filter, not applied: " + errorMessage;
+    auto m = serverMessage("E", text.c_str());
+    if ((m != nullptr) && (sendBatch(i, m, 0, 1) == 0) && (!c.waitWritable)) {
+      flushClient(i);
+    }
+    return;
+  }
+  if (c.filter.isEmpty()) {
+    theLog->info("Connection %d: filter removed", i + 1);
+  } else {
+    theLog->info("Connection %d: filter set:%s", i + 1, definition.c_str());
+  }
+}
+
+// send as much data as possible, without blocking
+void InfoLoggerDispatchOnlineBrowserImpl::flushClient(int i)
+{
+  InfoLoggerDispatchOnlineBrowserClient& c = clients[i];
+  struct iovec iov[DISPATCH_IOV_MAX];
+
+  while (!c.output.empty()) {
+    int n = 0;
+    size_t total = 0;
+    for (auto it = c.output.begin(); (it != c.output.end()) && (n < DISPATCH_IOV_MAX); ++it, n++) {
+      iov[n].iov_base = (void*)&it->batch->data[it->begin];
+      iov[n].iov_len = it->end - it->begin;
+      total += iov[n].iov_len;
+    }
+    ssize_t result = writev(c.fd, iov, n);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        break;
+      }
+      theLog->info("Write failed - connection %d closed", i + 1);
+      closeClient(i);
+      return;
+    }
+    // remove what was sent
+    c.outputBytes -= result;
+    size_t sent = (size_t)result;
+    while (sent > 0) {
+      InfoLoggerDispatchOnlineBrowserOutput& o = c.output.front();
+      size_t sz = o.end - o.begin;
+      if (sent < sz) {
+        o.begin += sent;
+        while (o.batch->msgEnd[o.msg] <= o.begin) {
+          o.msg++;
+        }
+        break;
+      }
+      sent -= sz;
+      c.output.pop_front();
+    }
+    if ((size_t)result < total) {
+      // socket buffer full
+      break;
+    }
+  }
+
+  // be notified when socket writable, if some data left
+  bool waitWritable = !c.output.empty();
+  if (waitWritable != c.waitWritable) {
+    struct epoll_event ev;
+    ev.events = waitWritable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.u32 = i + 1;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &ev);
+    c.waitWritable = waitWritable;
+  }
+}
+
+// remove oldest messages not sent yet, until bytesNeeded more bytes fit in client buffer
+void InfoLoggerDispatchOnlineBrowserImpl::dropOldest(InfoLoggerDispatchOnlineBrowserClient& c, size_t bytesNeeded)
+{
+  // message partly sent can not be removed
+  size_t ix = 0;
+  if ((!c.output.empty()) && (c.output.front().begin != msgStart(*c.output.front().batch, c.output.front().msg))) {
+    ix = 1;
+  }
+  while ((c.outputBytes + bytesNeeded > bufferSize) && (ix < c.output.size())) {
+    InfoLoggerDispatchOnlineBrowserOutput& o = c.output[ix];
+    size_t next = o.batch->msgEnd[o.msg];
+    c.outputBytes -= next - o.begin;
+    c.dropped++;
+    o.begin = next;
+    o.msg++;
+    if (o.begin == o.end) {
+      c.output.erase(c.output.begin() + ix);
+    }
+  }
+}
+
+// a message from the server to a client
+std::shared_ptr<const InfoLoggerDispatchOnlineBrowserBatch> InfoLoggerDispatchOnlineBrowserImpl::serverMessage(const char* severity, const char* text)
+{
+  auto b = std::make_shared<InfoLoggerDispatchOnlineBrowserBatch>();
+  infoLog_msg_t* m = infoLog_msg_create();
+  if (m == nullptr) {
+    return nullptr;
+  }
+  char hostName[DISPATCH_BUFFER_SIZE] = "";
+  gethostname(hostName, sizeof(hostName) - 1);
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  m->protocol = &protocols[0];
+  auto setString = [&](const char* field, const char* value) {
+    int ix = infoLog_msg_findField(field);
+    if (ix >= 0) {
+      m->values[ix].value.vString = value;
+      m->values[ix].isUndefined = 0;
+    }
+  };
+  setString("severity", severity);
+  setString("hostname", hostName);
+  setString("facility", "infoLoggerServer");
+  setString("message", text);
+  int ix = infoLog_msg_findField("timestamp");
+  if (ix >= 0) {
+    m->values[ix].value.vDouble = tv.tv_sec + tv.tv_usec / 1000000.0;
+    m->values[ix].isUndefined = 0;
+  }
+  ix = infoLog_msg_findField("level");
+  if (ix >= 0) {
+    m->values[ix].value.vInt = 1;
+    m->values[ix].isUndefined = 0;
+  }
+  char buffer[DISPATCH_BUFFER_SIZE * 4];
+  if (infoLog_msg_encode(m, buffer, sizeof(buffer), -1) == 0) {
+    b->data = buffer;
+    b->msgEnd.push_back(b->data.size());
+  }
+  infoLog_msg_destroy(m);
+  if (b->data.size() == 0) {
+    return nullptr;
+  }
+  return b;
+}
+
+// queue messages [msgBegin,msgEnd[ of a batch for a client
+// returns 0 on success, or -1 if client was disconnected
+int InfoLoggerDispatchOnlineBrowserImpl::sendBatch(int i, const std::shared_ptr<const InfoLoggerDispatchOnlineBrowserBatch>& b, int msgBegin, int msgEnd)
+{
+  InfoLoggerDispatchOnlineBrowserClient& c = clients[i];
+  size_t begin = msgStart(*b, msgBegin);
+  size_t end = b->msgEnd[msgEnd - 1];
+  size_t sz = end - begin;
+
+  if ((overflowPolicy == OverflowPolicy::Gap) && (c.dropped > 0)) {
+    // report messages lost, once there is space for the report and the new messages
+    char text[DISPATCH_BUFFER_SIZE];
+    snprintf(text, sizeof(text), "%lu messages not sent to this client, output buffer full (txBufferSize=%d)", c.dropped, (int)bufferSize);
+    auto gap = serverMessage("W", text);
+    if ((gap != nullptr) && (c.outputBytes + gap->data.size() + sz <= bufferSize)) {
+      theLog->info("Connection %d: %lu messages not sent, output buffer was full", i + 1, c.dropped);
+      c.output.push_back({ gap, 0, gap->data.size(), 0 });
+      c.outputBytes += gap->data.size();
+      c.dropped = 0;
+    }
+  }
+
+  if ((c.outputBytes + sz > bufferSize) || (c.dropped > 0)) {
+    switch (overflowPolicy) {
+      case OverflowPolicy::Disconnect:
+        theLog->info("Connection %d: output buffer full - closed", i + 1);
+        closeClient(i);
+        return -1;
+      case OverflowPolicy::Drop:
+        if (c.dropped == 0) {
+          theLog->info("Connection %d: output buffer full, dropping oldest messages", i + 1);
+        }
+        dropOldest(c, sz);
+        if (c.outputBytes + sz > bufferSize) {
+          c.dropped += msgEnd - msgBegin;
+          return 0;
+        }
+        if (c.dropped > 0) {
+          theLog->info("Connection %d: %lu messages dropped", i + 1, c.dropped);
+          c.dropped = 0;
+        }
+        break;
+      case OverflowPolicy::Gap:
+        if (c.dropped == 0) {
+          theLog->info("Connection %d: output buffer full, discarding new messages", i + 1);
+        }
+        c.dropped += msgEnd - msgBegin;
+        return 0;
+    }
+  }
+
+  c.output.push_back({ b, begin, end, msgBegin });
+  c.outputBytes += sz;
+  return 0;
+}
+
 InfoLoggerDispatchOnlineBrowser::InfoLoggerDispatchOnlineBrowser(ConfigInfoLoggerServer* config, SimpleLog* log) : InfoLoggerDispatch(config, log)
 {
   dPtr = std::make_unique<InfoLoggerDispatchOnlineBrowserImpl>();
+  dPtr->theLog = theLog;
 
   dPtr->clients.resize(theConfig->maxClientsTx);
-  for (int i = 0; i < theConfig->maxClientsTx; i++) {
-    dPtr->clients[i] = -1;
+  dPtr->bufferSize = (theConfig->txBufferSize > 0) ? theConfig->txBufferSize : 1;
+  if (theConfig->txOverflowPolicy == "drop") {
+    dPtr->overflowPolicy = InfoLoggerDispatchOnlineBrowserImpl::OverflowPolicy::Drop;
+  } else if (theConfig->txOverflowPolicy == "gap") {
+    dPtr->overflowPolicy = InfoLoggerDispatchOnlineBrowserImpl::OverflowPolicy::Gap;
+  } else if (theConfig->txOverflowPolicy == "disconnect") {
+    dPtr->overflowPolicy = InfoLoggerDispatchOnlineBrowserImpl::OverflowPolicy::Disconnect;
+  } else {
+    theLog->error("Invalid txOverflowPolicy %s", theConfig->txOverflowPolicy.c_str());
+    throw __LINE__;
   }
 
   // initialize listening socket
@@ -81,6 +472,27 @@ InfoLoggerDispatchOnlineBrowser::InfoLoggerDispatchOnlineBrowser(ConfigInfoLogge
     close(dPtr->listen_sock);
     throw __LINE__;
   }
+
+  // accept connections from the event loop, without blocking
+  opts = fcntl(dPtr->listen_sock, F_GETFL);
+  if ((opts == -1) || (fcntl(dPtr->listen_sock, F_SETFL, opts | O_NONBLOCK) == -1)) {
+    theLog->error("fcntl - error %d = %s", errno, strerror(errno));
+    close(dPtr->listen_sock);
+    throw __LINE__;
+  }
+  dPtr->epoll_fd = epoll_create1(0);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u32 = 0;
+  if ((dPtr->epoll_fd < 0) || (epoll_ctl(dPtr->epoll_fd, EPOLL_CTL_ADD, dPtr->listen_sock, &ev) == -1)) {
+    theLog->error("epoll - error %d = %s", errno, strerror(errno));
+    if (dPtr->epoll_fd >= 0) {
+      close(dPtr->epoll_fd);
+    }
+    close(dPtr->listen_sock);
+    throw __LINE__;
+  }
+
   //theLog.info("%s() success\n",__FUNCTION__);
   theLog->info("Publishing online messages on port %d", theConfig->serverPortTx);
 
@@ -89,14 +501,19 @@ InfoLoggerDispatchOnlineBrowser::InfoLoggerDispatchOnlineBrowser(ConfigInfoLogge
 }
 InfoLoggerDispatchOnlineBrowser::~InfoLoggerDispatchOnlineBrowser()
 {
+  // stop dispatch thread before releasing the client buffers it uses
+  dispatchThread->stop();
+  dispatchThread->join();
+
   // close sockets
+  for (int i = 0; i < theConfig->maxClientsTx; i++) {
+    dPtr->closeClient(i);
+  }
   if (dPtr->listen_sock >= 0) {
     close(dPtr->listen_sock);
   }
-  for (int i = 0; i < theConfig->maxClientsTx; i++) {
-    if (dPtr->clients[i] != -1) {
-      close(dPtr->clients[i]);
-    }
+  if (dPtr->epoll_fd >= 0) {
+    close(dPtr->epoll_fd);
   }
 }
 int InfoLoggerDispatchOnlineBrowser::customMessageProcess(std::shared_ptr<InfoLoggerMessageList> msg)
@@ -105,157 +522,116 @@ int InfoLoggerDispatchOnlineBrowser::customMessageProcess(std::shared_ptr<InfoLo
 #define MAX_MSG_LENGTH 32768
   char onlineMsg[MAX_MSG_LENGTH];
   infoLog_msg_t* lmsg;
-  int size_m;          /* message size */
-  fd_set select_write; /* List of sockets to select */
-  int highest_sock;
-  struct timeval tv;
-  int result;
   //theLog->info("dispatching a message\n");
 
+  if (dPtr->nClients == 0) {
+    return 0;
+  }
+
+  // clients with a filter
+  bool allSelected = false; // set if a client takes all messages
+  std::vector<int>& filtered = dPtr->filteredClients;
+  filtered.clear();
+  for (int i = 0; i < theConfig->maxClientsTx; i++) {
+    if (dPtr->clients[i].fd == -1)
+      continue;
+    if (dPtr->clients[i].filter.isEmpty()) {
+      allSelected = true;
+    } else {
+      dPtr->clients[i].runs.clear();
+      filtered.push_back(i);
+    }
+  }
+
+  // encode messages once for all clients, only if selected by one of them
+  auto b = std::make_shared<InfoLoggerDispatchOnlineBrowserBatch>();
+  std::vector<char>& selected = dPtr->selected;
+  selected.resize(filtered.size());
   for (lmsg = msg->msg; lmsg != NULL; lmsg = lmsg->next) {
+    bool isSelected = allSelected;
+    for (size_t k = 0; k < filtered.size(); k++) {
+      selected[k] = dPtr->clients[filtered[k]].filter.match(lmsg);
+      isSelected = isSelected || selected[k];
+    }
+    if (!isSelected) {
+      continue;
+    }
     if (infoLog_msg_encode(lmsg, onlineMsg, MAX_MSG_LENGTH, -1) == 0) {
-      size_m = strlen(onlineMsg);
-      for (int i = 0; i < theConfig->maxClientsTx; i++) {
-        if (dPtr->clients[i] == -1)
-          continue;
-
-        //theLog->info("dispatch msg to client %d\n%s\n",i,onlineMsg);
-
-        /* check that the client is writable */
-        FD_ZERO(&select_write);
-        FD_SET(dPtr->clients[i], &select_write);
-        highest_sock = dPtr->clients[i];
-        /* define timeout for message dispatch possible */
-        tv.tv_sec = 3;
-        tv.tv_usec = 0;
-        result = select(highest_sock + 1, NULL, &select_write, NULL, &tv);
-        if (result <= 0) {
-          theLog->info("Message dispatch timeout, connection %d closed", i + 1);
-          close(dPtr->clients[i]);
-          dPtr->clients[i] = -1;
+      /* no need to add \n, included in message */
+      b->data.append(onlineMsg);
+      b->msgEnd.push_back(b->data.size());
+      int ix = (int)b->msgEnd.size() - 1;
+      for (size_t k = 0; k < filtered.size(); k++) {
+        if (!selected[k]) {
           continue;
         }
-
-        int writeok = 0;
-        result = write(dPtr->clients[i], onlineMsg, size_m);
-        if (result == size_m) {
-          /* no need to add \n, included in message */
-          writeok = 1;
+        auto& runs = dPtr->clients[filtered[k]].runs;
+        if ((!runs.empty()) && (runs.back().second == ix)) {
+          runs.back().second++;
+        } else {
+          runs.push_back({ ix, ix + 1 });
         }
-        if (!writeok) {
-          theLog->info("Write failed - connection %d closed", i + 1);
-          close(dPtr->clients[i]);
-          dPtr->clients[i] = -1;
+      }
+    }
+  }
+  if (b->data.size() == 0) {
+    return 0;
+  }
+
+  int nMsg = (int)b->msgEnd.size();
+  for (int i = 0; i < theConfig->maxClientsTx; i++) {
+    InfoLoggerDispatchOnlineBrowserClient& c = dPtr->clients[i];
+    if (c.fd == -1)
+      continue;
+    if (c.filter.isEmpty()) {
+      dPtr->sendBatch(i, b, 0, nMsg);
+    } else {
+      if (c.runs.empty()) {
+        continue;
+      }
+      for (const auto& r : c.runs) {
+        if (dPtr->sendBatch(i, b, r.first, r.second)) {
+          break;
         }
       }
     }
+    if ((c.fd != -1) && (!c.waitWritable)) {
+      dPtr->flushClient(i);
+    }
   }
 
   return 0;
 }
 
-// todo: socket recv thread c++
-
 int InfoLoggerDispatchOnlineBrowser::customLoop()
 {
+  struct epoll_event events[DISPATCH_EPOLL_EVENTS];
 
-  char buffer[DISPATCH_BUFFER_SIZE]; /* generic purpose buffer */
-
-  int i; /* counter */
-
-  fd_set select_read; /* List of sockets to select */
-  int highest_sock;
-  struct timeval tv;
-  int result;
-  int new_cl_sock;                /* socket address for new client */
-  struct sockaddr_in new_cl_addr; /* address of new client */
-  socklen_t cl_addr_len;          /* address length */
-
-  // create a 'select' list, with listening socket (we don't care what clients send) */
-  FD_ZERO(&select_read);
-  // listening socket
-  FD_SET(dPtr->listen_sock, &select_read);
-  highest_sock = dPtr->listen_sock;
-  // add the connected clients
-  for (i = 0; i < theConfig->maxClientsTx; i++) {
-    if (dPtr->clients[i] != -1) {
-      FD_SET(dPtr->clients[i], &select_read);
-      if (dPtr->clients[i] > highest_sock) {
-        highest_sock = dPtr->clients[i];
-      }
+  // returns immediately
+  int n = epoll_wait(dPtr->epoll_fd, events, DISPATCH_EPOLL_EVENTS, 0);
+  if (n < 0) {
+    // an error occurred
+    if (errno != EINTR) {
+      theLog->info("epoll_wait - error %d = %s", errno, strerror(errno));
     }
+    return 0;
   }
 
-  // select returns immediately
-  tv.tv_sec = 0;
-  tv.tv_usec = 0;
-  result = select(highest_sock + 1, &select_read, NULL, NULL, &tv);
-
-  if (result < 0) {
-    // an error occurred
-    theLog->info("select - error %d = %s", errno, strerror(errno));
-  } else if (result > 0) {
-
-    // read from clients
-    for (i = 0; i < theConfig->maxClientsTx; i++) {
-      if (dPtr->clients[i] != -1) {
-        if (FD_ISSET(dPtr->clients[i], &select_read)) {
-          result = read(dPtr->clients[i], buffer, DISPATCH_BUFFER_SIZE);
-          if (result > 0) {
-            /* success */
-            /* we don't use the input */
-            buffer[result] = 0;
-            //theLog->info("connected client: init buffer: %s\n",buffer);
-          }
-          /* error reading socket ? */
-          if (result < 0) {
-            theLog->info("read - error %d", errno);
-            result = 0;
-          }
-          /* close connection on EOF / error */
-          if (result == 0) {
-            theLog->info("Connection %d closed", i + 1);
-            close(dPtr->clients[i]);
-            dPtr->clients[i] = -1;
-          }
-        }
-      }
+  for (int k = 0; k < n; k++) {
+    if (events[k].data.u32 == 0) {
+      /* new connection */
+      dPtr->acceptClients();
+      continue;
     }
-
-    /* new connection ? */
-    if (FD_ISSET(dPtr->listen_sock, &select_read)) {
-      cl_addr_len = sizeof(new_cl_addr);
-      new_cl_sock = accept(dPtr->listen_sock, (struct sockaddr*)&new_cl_addr, &cl_addr_len);
-      if (new_cl_sock < 0) {
-        theLog->info("accept - error %d", errno);
-      } else {
-        theLog->info("%s connected on port %d", inet_ntoa(new_cl_addr.sin_addr), new_cl_addr.sin_port);
-        for (i = 0; i < theConfig->maxClientsTx; i++) {
-          if (dPtr->clients[i] == -1)
-            break;
-        }
-        if (i == theConfig->maxClientsTx) {
-          theLog->info("Too many online (e.g. infoBrowser) connections, max=%d - closing", theConfig->maxClientsTx);
-          close(new_cl_sock);
-        } else {
-          /* Non blocking connection */
-          int opts;
-          opts = fcntl(new_cl_sock, F_GETFL);
-          if (opts == -1) {
-            theLog->error("fcntl - F_GETFL");
-            close(new_cl_sock);
-          } else {
-            opts = (opts | O_NONBLOCK);
-            if (fcntl(new_cl_sock, F_SETFL, opts) == -1) {
-              theLog->error("fcntl - F_SETFL");
-              close(new_cl_sock);
-            } else {
-              theLog->info("Assigned connection %d", i + 1);
-              dPtr->clients[i] = new_cl_sock;
-            }
-          }
-        }
-      }
+    int i = events[k].data.u32 - 1;
+    if (dPtr->clients[i].fd == -1) {
+      continue;
+    }
+    if (events[k].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+      dPtr->readClient(i);
+    }
+    if ((dPtr->clients[i].fd != -1) && (events[k].events & EPOLLOUT)) {
+      dPtr->flushClient(i);
     }
   }
 
@@ -18,6 +18,8 @@
 #include <unistd.h>
 #include <string.h>
 #include <Common/Timer.h>
+#include <map>
+#include <vector>
 
 #if LIBMYSQL_VERSION_ID >= 80000
 typedef bool my_bool;
@@ -25,6 +27,8 @@ typedef bool my_bool;
 
 // some constants
 #define SQL_RETRY_CONNECT 1 // SQL database connect retry time
+#define SQL_STATS_INTERVAL 60 // interval between insert statistics logs (seconds)
+#define SQL_MAX_PARAMS 65535 // maximum number of parameters in a prepared statement
 
 class InfoLoggerDispatchSQLImpl
 {
@@ -39,8 +43,10 @@ class InfoLoggerDispatchSQLImpl
 
  private:
   MYSQL *db = NULL;                    // handle to mysql db
-  MYSQL_STMT* stmt = NULL;             // prepared insertion query
-  MYSQL_BIND bind[INFOLOG_FIELDS_MAX]; // parameters bound to variables
+  std::map<int, MYSQL_STMT*> stmts;    // prepared insertion queries, indexed by number of rows inserted
+  std::vector<MYSQL_BIND> bind;        // parameters bound to variables (nFields per row)
+  my_bool paramIsNull = 1;             // boolean telling if a parameter is NULL
+  my_bool paramIsNotNull = 0;          // boolean telling if a parameter is not NULL
 
   int nFields = 0;
 
@@ -48,15 +54,41 @@ class InfoLoggerDispatchSQLImpl
   int dbLastConnectTry = 0; // time of last connect attempt
   int dbConnectTrials = 0;  // number of connection attempts since last success
 
-  std::string sql_insert;
+  std::string sql_insert; // insert query, without values
+  std::string sql_values; // values placeholders for one row
 
-  unsigned long long insertCount = 0;     // counter for number of queries executed
+  // a row to be inserted = a message, or one line of a multi-line message
+  struct PendingRow {
+    std::shared_ptr<InfoLoggerMessageList> list; // keeps message data valid until row is inserted
+    infoLog_msg_t* msg;                          // message
+    const char* line;                            // message text to be used for this row
+  };
+  std::vector<PendingRow> pendingRows; // rows waiting to be inserted
+  int batchMaxRows = 1;                // max number of rows per query
+  int batchMaxDelay = 0;               // max time rows are kept before insertion (milliseconds)
+  Timer batchTimer;                    // timer for incomplete batch
+
+  unsigned long long insertCount = 0;     // counter for number of rows inserted
+  unsigned long long queryCount = 0;      // counter for number of queries executed
   unsigned long long msgDelayedCount = 0; // counter for number of messages delayed (insert failed, retry)
   unsigned long long msgDroppedCount = 0; // counter for number of messages dropped (insert failed, dropped)
 
+  static const int batchHistogramSize = 16;
+  unsigned long long batchHistogram[batchHistogramSize] = { 0 }; // number of queries by number of rows (bin i: 2^i to 2^(i+1)-1 rows)
+  Timer statsTimer;                                              // timer for periodic statistics
+  unsigned long long statsInsertCount = 0;                       // insertCount at last statistics
+
   int connectDB(); // function to connect to database
   int disconnectDB(); // disconnect/cleanup DB connection
 
+  MYSQL_STMT* getStatement(int nRows);                      // get a prepared statement to insert nRows (created on first use)
+  unsigned int executeRows(int nRows, bool& isBindError);   // insert first nRows pending rows with a single query. Returns 0 on success, or mysql error code.
+  int insertPendingRows();                                  // insert all pending rows. Returns 0 on success, -1 if some could not be inserted yet (kept for later).
+  int startTransaction();                                   // start a new transaction, if needed. Returns 0 on success.
+  void rowsInserted(int nRows);                             // remove inserted rows from pending list, and update counters
+  void dropRow(const char* reason);                         // remove first pending row, which can not be inserted
+  void logStats();                                          // log insert statistics
+
   int commitEnabled = 1;       // flag to enable transactions
   int commitDebug = 0;         // log transactions
   int commitTimeout = 1000000; // time between commits
@@ -96,20 +128,63 @@ void InfoLoggerDispatchSQLImpl::start()
   if (nFields == 0) {
     errLine = __LINE__; // protocol is empty !
   }
-  sql_insert += ") VALUES(";
+  sql_insert += ") VALUES";
+  sql_values = "(";
   for (int i = nFields; i > 0; i--) {
     if (i > 1) {
-      sql_insert += "?,";
+      sql_values += "?,";
     } else {
-      sql_insert += "?";
+      sql_values += "?";
     }
   }
-  sql_insert += ")";
-  parent->logInfo("insert query = %s", sql_insert.c_str());
+  sql_values += ")";
+  parent->logInfo("insert query = %s%s", sql_insert.c_str(), sql_values.c_str());
   if (errLine) {
     parent->logError("Failed to initialize db query: error %d", errLine);
   }
 
+  // several rows can be inserted with a single query
+  batchMaxRows = theConfig->dbBatchMaxRows;
+  if ((nFields > 0) && (batchMaxRows > SQL_MAX_PARAMS / nFields)) {
+    batchMaxRows = SQL_MAX_PARAMS / nFields;
+  }
+  if (batchMaxRows < 1) {
+    batchMaxRows = 1;
+  }
+  batchMaxDelay = theConfig->dbBatchMaxDelay;
+  if (batchMaxDelay < 0) {
+    batchMaxDelay = 0;
+  }
+  if (batchMaxRows > 1) {
+    parent->logInfo("Insert up to %d rows per query, delay %d ms", batchMaxRows, batchMaxDelay);
+  }
+
+  // bind variables depending on type
+  bind.resize(nFields * batchMaxRows);
+  memset(bind.data(), 0, sizeof(MYSQL_BIND) * bind.size());
+  for (int i = 0; i < nFields; i++) {
+    enum enum_field_types t = MYSQL_TYPE_NULL;
+    switch (protocols[0].fields[i].type) {
+      case infoLog_msgField_def_t::ILOG_TYPE_STRING:
+        t = MYSQL_TYPE_STRING;
+        break;
+      case infoLog_msgField_def_t::ILOG_TYPE_INT:
+        t = MYSQL_TYPE_LONG;
+        break;
+      case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
+        t = MYSQL_TYPE_DOUBLE;
+        break;
+      default:
+        parent->logError("undefined field type %d", protocols[0].fields[i].type);
+        break;
+    }
+    for (int j = 0; j < batchMaxRows; j++) {
+      bind[j * nFields + i].buffer_type = t;
+    }
+  }
+  pendingRows.reserve(batchMaxRows);
+  statsTimer.reset(SQL_STATS_INTERVAL * 1000000);
+
   // try to connect DB
   // done automatically in customloop
 }
@@ -127,12 +202,30 @@ InfoLoggerDispatchSQL::InfoLoggerDispatchSQL(ConfigInfoLoggerServer* config, Sim
 
 void InfoLoggerDispatchSQLImpl::stop()
 {
+  // insert what is left
+  if (dbIsConnected) {
+    insertPendingRows();
+    if ((commitEnabled) && (commitNumberOfMsg) && (dbIsConnected)) {
+      if (mysql_query(db, "COMMIT")) {
+        parent->logError("DB transaction commit failed: %s", mysql_error(db));
+      }
+      commitNumberOfMsg = 0;
+    }
+  }
+  if (pendingRows.size()) {
+    parent->logError("%d rows could not be inserted", (int)pendingRows.size());
+  }
   disconnectDB();
-  parent->logInfo("DB thread insert count = %llu, delayed msg count = %llu, dropped msg count = %llu", insertCount, msgDelayedCount, msgDroppedCount);
+  logStats();
+  parent->logInfo("DB thread insert count = %llu, query count = %llu, delayed msg count = %llu, dropped msg count = %llu", insertCount, queryCount, msgDelayedCount, msgDroppedCount);
 }
 
 InfoLoggerDispatchSQL::~InfoLoggerDispatchSQL()
 {
+  // stop dispatch thread before flushing the pending rows and closing the database connection it uses
+  dispatchThread->stop();
+  dispatchThread->join();
+
   dPtr->stop();
 }
 
@@ -178,40 +271,8 @@ int InfoLoggerDispatchSQLImpl::connectDB()
     }
 
     // create prepared insert statement
-    stmt = mysql_stmt_init(db);
-    if (stmt == NULL) {
-      parent->logError("mysql_stmt_init() failed: %s", mysql_error(db));
-      disconnectDB();
-      return -1;
-    }
-
-    if (mysql_stmt_prepare(stmt, sql_insert.c_str(), sql_insert.length())) {
-      parent->logError("mysql_stmt_prepare() failed: %s", mysql_error(db));
-      disconnectDB();
-      return -1;
-    }
-
-    // bind variables depending on type
-    memset(bind, 0, sizeof(bind));
-    int errline = 0;
-    for (int i = 0; i < nFields; i++) {
-      switch (protocols[0].fields[i].type) {
-        case infoLog_msgField_def_t::ILOG_TYPE_STRING:
-          bind[i].buffer_type = MYSQL_TYPE_STRING;
-          break;
-        case infoLog_msgField_def_t::ILOG_TYPE_INT:
-          bind[i].buffer_type = MYSQL_TYPE_LONG;
-          break;
-        case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
-          bind[i].buffer_type = MYSQL_TYPE_DOUBLE;
-          break;
-        default:
-          parent->logError("undefined field type %d", protocols[0].fields[i].type);
-          errline = __LINE__;
-          break;
-      }
-    }
-    if (errline) {
+    // the ones for several rows are created when needed
+    if (getStatement(1) == NULL) {
       disconnectDB();
       return -1;
     }
@@ -225,10 +286,10 @@ int InfoLoggerDispatchSQLImpl::connectDB()
 
 int InfoLoggerDispatchSQLImpl::disconnectDB()
 {
-  if (stmt != NULL) {
-    mysql_stmt_close(stmt);
-    stmt = NULL;
+  for (auto& it : stmts) {
+    mysql_stmt_close(it.second);
   }
+  stmts.clear();
   if (db != NULL) {
     mysql_close(db);
     db = NULL;
@@ -246,7 +307,13 @@ int InfoLoggerDispatchSQLImpl::customLoop()
   if (err) {
     // temporization to avoid immediate retry
     sleep(SQL_RETRY_CONNECT);
-  } else if (commitEnabled) {
+  } else {
+    // insert incomplete batch, if waiting for too long
+    if ((pendingRows.size()) && (batchTimer.isTimeout())) {
+      insertPendingRows();
+    }
+  }
+  if ((dbIsConnected) && (commitEnabled)) {
     // complete pending transactions
     if (commitNumberOfMsg) {
       if (commitTimer.isTimeout()) {
@@ -263,169 +330,333 @@ int InfoLoggerDispatchSQLImpl::customLoop()
     }
   }
 
+  if (statsTimer.isTimeout()) {
+    logStats();
+    statsTimer.reset(SQL_STATS_INTERVAL * 1000000);
+  }
+
   return err;
 }
 
-int InfoLoggerDispatchSQLImpl::customMessageProcess(std::shared_ptr<InfoLoggerMessageList> lmsg)
+MYSQL_STMT* InfoLoggerDispatchSQLImpl::getStatement(int nRows)
 {
-  // procedure for dropped messages and keep count of them
-  auto returnDroppedMessage = [&](const char* message, infoLog_msg_t* m) {
-    // log bad message content (truncated)
-    const int maxLen = 200;
-
-    // verbose logging of the other fields
-    std::string logDetails;
-    for (int i = 0; i < nFields - 1; i++) {
-      logDetails += protocols[0].fields[i].name;
-      logDetails += "=";
-      if (!m->values[i].isUndefined) {
-	switch (protocols[0].fields[i].type) {
-          case infoLog_msgField_def_t::ILOG_TYPE_STRING:
-	    if (m->values[i].value.vString != nullptr) {
-	      std::string ss = m->values[i].value.vString;
-	      logDetails += ss.substr(0,maxLen);
-	      if (ss.length() > maxLen) {
-	        logDetails += "...";
-	      }
-	    }
-            break;
-          case infoLog_msgField_def_t::ILOG_TYPE_INT:
-            logDetails += std::to_string(m->values[i].value.vInt);
-            break;
-          case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
-            logDetails += std::to_string(m->values[i].value.vDouble);
-            break;
-          default:
-            break;
-	}
-      }
-      logDetails += " ";
-    }
-
-    int msgLen = (int)strlen(message);
-    parent->logError("Dropping message (%d bytes): %.*s%s", msgLen, maxLen, message, (msgLen > maxLen) ? "..." : "");
-    parent->logError("                 %s", logDetails.c_str());
-    msgDroppedCount++;
-    return 0; // remove message from queue
-  };
-
-  // procedure for delayed messages and keep count of them
-  auto returnDelayedMessage = [&]() {
-    msgDelayedCount++;
-    return -1; // keep message in queue
-  };
+  auto it = stmts.find(nRows);
+  if (it != stmts.end()) {
+    return it->second;
+  }
 
-  if (!dbIsConnected) {
-    return returnDelayedMessage();
+  // e.g. INSERT INTO messages(...) VALUES(?,...,?),(?,...,?)
+  std::string query = sql_insert;
+  for (int i = 0; i < nRows; i++) {
+    if (i) {
+      query += ",";
+    }
+    query += sql_values;
   }
 
-  infoLog_msg_t* m;
-  my_bool param_isnull = 1;    // boolean telling if a parameter is NULL
-  my_bool param_isNOTnull = 0; // boolean telling if a parameter is not NULL
-  char* msg;
-  char* nl; // variables used to reformat multiple-line messages
+  MYSQL_STMT* stmt = mysql_stmt_init(db);
+  if (stmt == NULL) {
+    parent->logError("mysql_stmt_init() failed: %s", mysql_error(db));
+    return NULL;
+  }
+  if (mysql_stmt_prepare(stmt, query.c_str(), query.length())) {
+    parent->logError("mysql_stmt_prepare() failed: %s", mysql_stmt_error(stmt));
+    mysql_stmt_close(stmt);
+    return NULL;
+  }
+  stmts[nRows] = stmt;
+  return stmt;
+}
 
-  for (m = lmsg->msg; m != NULL; m = m->next) {
+unsigned int InfoLoggerDispatchSQLImpl::executeRows(int nRows, bool& isBindError)
+{
+  isBindError = false;
+  MYSQL_STMT* stmt = getStatement(nRows);
+  if (stmt == NULL) {
+    return mysql_errno(db) ? mysql_errno(db) : CR_UNKNOWN_ERROR;
+  }
 
+  for (int j = 0; j < nRows; j++) {
+    infoLog_msg_t* m = pendingRows[j].msg;
+    MYSQL_BIND* b = &bind[j * nFields];
     for (int i = 0; i < nFields; i++) {
       switch (protocols[0].fields[i].type) {
         case infoLog_msgField_def_t::ILOG_TYPE_STRING:
-          bind[i].buffer = (void*)m->values[i].value.vString;
+          b[i].buffer = (void*)m->values[i].value.vString;
           break;
         case infoLog_msgField_def_t::ILOG_TYPE_INT:
-          bind[i].buffer = &m->values[i].value.vInt;
+          b[i].buffer = &m->values[i].value.vInt;
           break;
         case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
-          bind[i].buffer = &m->values[i].value.vDouble;
+          b[i].buffer = &m->values[i].value.vDouble;
           break;
         default:
-          bind[i].buffer = NULL;
+          b[i].buffer = NULL;
           break;
       }
-      if ((m->values[i].isUndefined) || (bind[i].buffer == NULL)) {
-        bind[i].is_null = &param_isnull;
-        bind[i].buffer_length = 0;
+      if ((m->values[i].isUndefined) || (b[i].buffer == NULL)) {
+        b[i].is_null = &paramIsNull;
+        b[i].buffer_length = 0;
       } else {
-        bind[i].is_null = &param_isNOTnull;
-        bind[i].buffer_length = m->values[i].length;
+        b[i].is_null = &paramIsNotNull;
+        b[i].buffer_length = m->values[i].length;
       }
     }
+    // message text: one line of it - assumes it is the LAST field in the protocol
+    b[nFields - 1].buffer = (void*)pendingRows[j].line;
+    b[nFields - 1].buffer_length = strlen(pendingRows[j].line);
+  }
 
-    if (commitEnabled) {
-      if (commitNumberOfMsg == 0) {
-        if (mysql_query(db, "START TRANSACTION")) {
-          parent->logError("DB start transaction failed: %s", mysql_error(db));
-          commitEnabled = 0;
-          return returnDelayedMessage();
-        } else {
-          if (commitDebug) {
-            parent->logInfo("DB transaction started");
+  // update bind variables
+  if (mysql_stmt_bind_param(stmt, bind.data())) {
+    parent->logError("mysql_stmt_bind() failed: %s", mysql_stmt_error(stmt));
+    isBindError = true;
+    return mysql_stmt_errno(stmt) ? mysql_stmt_errno(stmt) : CR_UNKNOWN_ERROR;
+  }
+
+  // do the insertion
+  if (mysql_stmt_execute(stmt)) {
+    parent->logError("mysql_stmt_exec() failed for %d rows: (%d) %s", nRows, mysql_stmt_errno(stmt), mysql_stmt_error(stmt));
+    return mysql_stmt_errno(stmt) ? mysql_stmt_errno(stmt) : CR_UNKNOWN_ERROR;
+  }
+  return 0;
+}
+
+int InfoLoggerDispatchSQLImpl::startTransaction()
+{
+  if ((commitEnabled) && (commitNumberOfMsg == 0)) {
+    if (mysql_query(db, "START TRANSACTION")) {
+      parent->logError("DB start transaction failed: %s", mysql_error(db));
+      commitEnabled = 0;
+      return -1;
+    } else {
+      if (commitDebug) {
+        parent->logInfo("DB transaction started");
+      }
+    }
+    commitTimer.reset(commitTimeout);
+  }
+  return 0;
+}
+
+void InfoLoggerDispatchSQLImpl::rowsInserted(int nRows)
+{
+  pendingRows.erase(pendingRows.begin(), pendingRows.begin() + nRows);
+  unsigned long long previousCount = insertCount;
+  insertCount += nRows;
+  commitNumberOfMsg += nRows;
+  queryCount++;
+  numberOfSuccessiveFailures = 0;
+
+  int bin = 0;
+  for (int n = nRows; (n > 1) && (bin < batchHistogramSize - 1); n >>= 1) {
+    bin++;
+  }
+  batchHistogram[bin]++;
+
+  if (commitDebug) {
+    if (insertCount / 1000 != previousCount / 1000) {
+      parent->logInfo("insert count = %llu", insertCount);
+    }
+  }
+}
+
+void InfoLoggerDispatchSQLImpl::dropRow(const char* reason)
+{
+  // log bad message content (truncated)
+  const int maxLen = 200;
+  infoLog_msg_t* m = pendingRows[0].msg;
+  const char* message = pendingRows[0].line;
+
+  // verbose logging of the other fields
+  std::string logDetails;
+  for (int i = 0; i < nFields - 1; i++) {
+    logDetails += protocols[0].fields[i].name;
+    logDetails += "=";
+    if (!m->values[i].isUndefined) {
+      switch (protocols[0].fields[i].type) {
+        case infoLog_msgField_def_t::ILOG_TYPE_STRING:
+          if (m->values[i].value.vString != nullptr) {
+            std::string ss = m->values[i].value.vString;
+            logDetails += ss.substr(0, maxLen);
+            if (ss.length() > maxLen) {
+              logDetails += "...";
+            }
           }
-        }
-        commitTimer.reset(commitTimeout);
+          break;
+        case infoLog_msgField_def_t::ILOG_TYPE_INT:
+          logDetails += std::to_string(m->values[i].value.vInt);
+          break;
+        case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
+          logDetails += std::to_string(m->values[i].value.vDouble);
+          break;
+        default:
+          break;
       }
     }
+    logDetails += " ";
+  }
 
-    // re-format message with multiple line - assumes it is the LAST field in the protocol
-    for (msg = (char*)m->values[nFields - 1].value.vString; msg != NULL; msg = nl) {
-      nl = strchr(msg, '\f');
-      if (nl != NULL) {
-        *nl = 0;
-        nl++;
+  int msgLen = (int)strlen(message);
+  parent->logError("Dropping message (%s, %d bytes): %.*s%s", reason, msgLen, maxLen, message, (msgLen > maxLen) ? "..." : "");
+  parent->logError("                 %s", logDetails.c_str());
+  msgDroppedCount++;
+
+  pendingRows.erase(pendingRows.begin());
+}
+
+int InfoLoggerDispatchSQLImpl::insertPendingRows()
+{
+  while (pendingRows.size()) {
+    if (!dbIsConnected) {
+      msgDelayedCount++;
+      return -1;
+    }
+    if (startTransaction()) {
+      msgDelayedCount++;
+      return -1;
+    }
+
+    // a full batch is inserted with a single query
+    // otherwise, use a power of 2, to limit the number of different prepared statements
+    int nRows = (int)pendingRows.size();
+    if (nRows >= batchMaxRows) {
+      nRows = batchMaxRows;
+    } else {
+      int n = 1;
+      while (n * 2 <= nRows) {
+        n *= 2;
+      }
+      nRows = n;
+    }
+
+    bool isBindError;
+    unsigned int err;
+    if (nRows > 1) {
+      err = executeRows(nRows, isBindError);
+      if (!err) {
+        rowsInserted(nRows);
+        continue;
       }
+      // server gone - retry with new connection
+      if ((err == CR_SERVER_LOST) || (err == CR_SERVER_GONE_ERROR)) {
+        disconnectDB();
+        msgDelayedCount++;
+        return -1;
+      }
+      // otherwise, insert rows one by one to isolate the bad one(s)
+      parent->logWarning("Insert of %d rows failed, retrying one by one", nRows);
+    }
 
-      // copy msg line
-      bind[nFields - 1].buffer = msg;
+    for (int i = 0; i < nRows; i++) {
+      err = executeRows(1, isBindError);
+      if (!err) {
+        rowsInserted(1);
+        continue;
+      }
+      // if can not bind, message malformed, drop it
+      if (isBindError) {
+        dropRow("bind failed");
+        continue;
+      }
+      // column too long
+      if (err == ER_DATA_TOO_LONG) {
+        dropRow("data too long");
+        continue;
+      }
+      // column with wrong value
+      if (err == ER_TRUNCATED_WRONG_VALUE_FOR_FIELD) {
+        dropRow("wrong value");
+        continue;
+      }
+      // server gone - retry with new connection
+      if ((err == CR_SERVER_LOST) || (err == CR_SERVER_GONE_ERROR)) {
+        disconnectDB();
+        msgDelayedCount++;
+        return -1;
+      }
 
-      // update bind variables
-      if (mysql_stmt_bind_param(stmt, bind)) {
-        parent->logError("mysql_stmt_bind() failed: %s", mysql_error(db));
-        parent->logError("message: %s", msg);
-        // if can not bind, message malformed, drop it
-        return returnDroppedMessage(msg, m);
+      numberOfSuccessiveFailures++;
+      if (numberOfSuccessiveFailures <= maxNumberOfRetries) {
+        disconnectDB();
+        msgDelayedCount++;
+        return -1;
       }
+      numberOfSuccessiveFailures = 0;
 
-      // Do the insertion
-      if (mysql_stmt_execute(stmt)) {
-        parent->logError("mysql_stmt_exec() failed: (%d) %s", mysql_errno(db), mysql_error(db));
-	unsigned int err = mysql_errno(db);
-        // column too long
-        if ( err == ER_DATA_TOO_LONG) {
-          return returnDroppedMessage(msg, m);
-        }
-        // column with wrong value
-        if ( err == ER_TRUNCATED_WRONG_VALUE_FOR_FIELD) {
-          return returnDroppedMessage(msg, m);
-        }
-	// server gone - retry with new connection
-	if (( err == CR_SERVER_LOST ) || ( err == CR_SERVER_GONE_ERROR )) {
-          disconnectDB();
-          return returnDelayedMessage();
-        }
+      // by default: drop message
+      parent->logError("Unhandled error code %d after %d attempts", err, maxNumberOfRetries);
+      dropRow("insert failed");
+    }
+  }
+  return 0;
+}
 
-	numberOfSuccessiveFailures++;
-	if (numberOfSuccessiveFailures <= maxNumberOfRetries) {
-          disconnectDB();
-          return returnDelayedMessage();
-	}
-        numberOfSuccessiveFailures = 0;
+void InfoLoggerDispatchSQLImpl::logStats()
+{
+  double t = statsTimer.getTime();
+  unsigned long long n = insertCount - statsInsertCount;
+  statsInsertCount = insertCount;
+  if (n == 0) {
+    return;
+  }
 
-	// by default: drop message
-        parent->logError("Unhandled error code %d after %d attempts", mysql_errno(db), maxNumberOfRetries);
-	return returnDroppedMessage(msg, m);
+  // histogram of number of rows per query
+  std::string histo;
+  for (int i = 0; i < batchHistogramSize; i++) {
+    if (batchHistogram[i]) {
+      if ((i == 0) || (i == batchHistogramSize - 1)) {
+        histo += " " + std::to_string(1 << i) + ((i == 0) ? "" : "+");
+      } else {
+        histo += " " + std::to_string(1 << i) + "-" + std::to_string((1 << (i + 1)) - 1);
       }
+      histo += ":" + std::to_string(batchHistogram[i]);
+    }
+  }
+  parent->logInfo("DB insert rate = %.1f rows/s, total %llu rows in %llu queries, rows per query =%s", (t > 0) ? n / t : 0.0, insertCount, queryCount, histo.c_str());
+}
 
-      insertCount++;
-      commitNumberOfMsg++;
+int InfoLoggerDispatchSQLImpl::customMessageProcess(std::shared_ptr<InfoLoggerMessageList> lmsg)
+{
+  if (!dbIsConnected) {
+    msgDelayedCount++;
+    return -1; // keep message in queue
+  }
 
-      if (commitDebug) {
-        if (insertCount % 1000 == 0) {
-          parent->logInfo("insert count = %llu", insertCount);
-        }
+  // previous rows not inserted yet: wait before accepting more
+  if ((int)pendingRows.size() >= batchMaxRows) {
+    if (insertPendingRows()) {
+      return -1; // keep message in queue
+    }
+  }
+
+  if (pendingRows.size() == 0) {
+    batchTimer.reset(batchMaxDelay * 1000);
+  }
+
+  infoLog_msg_t* m;
+  char* msg;
+  char* nl; // variables used to reformat multiple-line messages
+
+  for (m = lmsg->msg; m != NULL; m = m->next) {
+    // re-format message with multiple line - assumes it is the LAST field in the protocol
+    // one row per line
+    for (msg = (char*)m->values[nFields - 1].value.vString; msg != NULL; msg = nl) {
+      nl = strchr(msg, '\f');
+      if (nl != NULL) {
+        *nl = 0;
+        nl++;
       }
+      pendingRows.push_back({ lmsg, m, msg });
     }
   }
+
+  // insert rows when a batch is complete
+  // on failure, they are kept and retried later
+  if ((int)pendingRows.size() >= batchMaxRows) {
+    insertPendingRows();
+  }
+
   // report message success, it will be removed from queue
   return 0;
 }
-
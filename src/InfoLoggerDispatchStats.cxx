@@ -19,6 +19,9 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <deque>
+#include <memory>
 #include <unordered_map>
 #include <string>
 #include <cstdint>
@@ -28,6 +31,7 @@
 
 #include "ConfigInfoLoggerServer.h"
 #include "infoLoggerMessage.h"
+#include "InfoLoggerMessageStats.h"
 
 using namespace std::chrono;
 
@@ -35,35 +39,35 @@ using namespace std::chrono;
 // class InfoLoggerDispatchStats implementation
 ////////////////////////////////////////////////////////
 
-using CountMap = std::unordered_map<std::string, uint64_t>;
-
-// for each infologger field, keep a map counting occurence of each value
-// std::vector index is the field index from infoLog_msgProtocol_t
-// this is tracked for a given timespan
-struct FieldStats {
-  uint64_t timeBegin;
-  uint64_t timeEnd;
-  std::vector<CountMap> fieldCounts;
-  uint64_t totalMessages = 0;
-};
-
-// structure to store index/count of values for each log field for a given time window
-struct Window {
-    uint64_t timeBegin;   // inclusive
-    uint64_t timeEnd;     // exclusive
-    std::vector<CountMap> fieldCounts;
-    size_t totalMessages = 0;
-};
-
-
 // size of a general purpose buffer
 #define DISPATCH_BUFFER_SIZE 200
 
+// max number of buffers sent at once to a client
+#define DISPATCH_STATS_IOV_MAX 64
+
+// a connected client, with the data waiting to be sent
+// the published data are serialized once, and shared by all clients
+struct StatsClient {
+  int sock = -1;                                     // socket, -1 if not connected
+  bool needSnapshot = true;                          // set when the client did not receive a snapshot yet
+  std::deque<std::shared_ptr<const std::string>> pending; // data to be sent
+  size_t offset = 0;                                 // number of bytes already sent from the first pending item
+  size_t pendingBytes = 0;                           // total number of bytes waiting to be sent
+};
+
 class InfoLoggerDispatchStatsImpl
 {
  public:
-  int listen_sock = -1;     // listening socket
-  std::vector<int> clients; // connected clients
+  int listen_sock = -1;             // listening socket
+  std::vector<StatsClient> clients; // connected clients
+
+  bool isDelta = true;                                                         // publish a snapshot once, and then updates (otherwise, all windows each time)
+  InfoLoggerMessageStats::Format format = InfoLoggerMessageStats::Format::Tcl; // publication format
+  size_t maxPending = 0;                                                       // max number of bytes waiting for a client
+
+  void closeClient(int i, SimpleLog* theLog, const char* reason); // close a client connection
+  void queue(StatsClient& c, const std::shared_ptr<const std::string>& data); // add data to be sent to a client
+  void flushClients(SimpleLog* theLog); // send pending data, without blocking
   
   int publishInterval = 5; // interval of publication time
   uint64_t lastTimePublished = 0; // unixtime of last publish
@@ -72,53 +76,155 @@ class InfoLoggerDispatchStatsImpl
   uint64_t maxHistory = 600; // keep stats for this amount of time (seconds)
 
   // stats
-  std::map<uint64_t, FieldStats> windows; // we index with the window begin timestamp
-  FieldStats *currentWindow = nullptr; // the one currently in use, where we will likely insert new values
-  std::vector<std::pair<std::string, std::vector<int>>> ilgFieldsToIndex; // the list of infologger fields (or combination of them) to be indexed (only for protocol[0]). First = name of the index. Second = list of field indices to be combined.
+  InfoLoggerMessageStats stats; // counters for each field (or combination of fields) indexed, in successive time windows
+  bool hasWindow = false;       // set once first window started
 };
 
+void InfoLoggerDispatchStatsImpl::closeClient(int i, SimpleLog* theLog, const char* reason)
+{
+  theLog->info("%s, connection stats-%d closed", reason, i + 1);
+  close(clients[i].sock);
+  clients[i] = StatsClient();
+}
+
+void InfoLoggerDispatchStatsImpl::queue(StatsClient& c, const std::shared_ptr<const std::string>& data)
+{
+  if (data->size() == 0) {
+    return;
+  }
+  c.pending.push_back(data);
+  c.pendingBytes += data->size();
+}
+
+void InfoLoggerDispatchStatsImpl::flushClients(SimpleLog* theLog)
+{
+  for (int i = 0; i < (int)clients.size(); i++) {
+    StatsClient& c = clients[i];
+    while ((c.sock != -1) && (c.pendingBytes)) {
+      struct iovec iov[DISPATCH_STATS_IOV_MAX];
+      int n = 0;
+      for (const auto& p : c.pending) {
+        if (n == DISPATCH_STATS_IOV_MAX) {
+          break;
+        }
+        size_t skip = (n == 0) ? c.offset : 0;
+        iov[n].iov_base = (void*)(p->data() + skip);
+        iov[n].iov_len = p->size() - skip;
+        n++;
+      }
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = n;
+      ssize_t result = sendmsg(c.sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (result < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+          closeClient(i, theLog, "Write failed");
+        }
+        break;
+      }
+      // remove data sent
+      c.pendingBytes -= result;
+      size_t sent = result + c.offset;
+      while ((!c.pending.empty()) && (sent >= c.pending.front()->size())) {
+        sent -= c.pending.front()->size();
+        c.pending.pop_front();
+      }
+      c.offset = sent;
+    }
+    if ((c.sock != -1) && (c.pendingBytes > maxPending)) {
+      closeClient(i, theLog, "Client not reading");
+    }
+  }
+}
+
 InfoLoggerDispatchStats::InfoLoggerDispatchStats(ConfigInfoLoggerServer* config, SimpleLog* log) : InfoLoggerDispatch(config, log)
 {
   dPtr = std::make_unique<InfoLoggerDispatchStatsImpl>();
 
-  auto addCombination = [&](std::vector<std::string> ixs) {
-    std::vector<int> lix;
-    std::string nix;
-    for (const auto &name : ixs) {
-      int i = infoLog_msg_findField(name.c_str());
-      if (i<0) {
-        return; // invalid index name
-      }
-      lix.push_back(i);
-      if (lix.size()>1) nix += "-";
-      nix += name;
+  // indexes with approximate counts: index:topK,...
+  std::map<std::string, int> sketchIndexes;
+  for (size_t begin = 0; begin < theConfig->statsSketchIndexes.length();) {
+    size_t end = theConfig->statsSketchIndexes.find(',', begin);
+    if (end == std::string::npos) {
+      end = theConfig->statsSketchIndexes.length();
     }
-    dPtr->ilgFieldsToIndex.push_back(std::pair(std::move(nix), std::move(lix)));
-    return;
+    std::string item = theConfig->statsSketchIndexes.substr(begin, end - begin);
+    begin = end + 1;
+    if (item.length() == 0) {
+      continue;
+    }
+    size_t sep = item.find(':');
+    int topK = (sep == std::string::npos) ? 0 : atoi(item.substr(sep + 1).c_str());
+    if (topK <= 0) {
+      theLog->error("Invalid statsSketchIndexes item %s", item.c_str());
+      throw __LINE__;
+    }
+    sketchIndexes[item.substr(0, sep)] = topK;
+  }
+  if (dPtr->stats.setSketchParameters(theConfig->statsSketchError, theConfig->statsSketchDepth)) {
+    theLog->error("Invalid statsSketchError %f or statsSketchDepth %d", theConfig->statsSketchError, theConfig->statsSketchDepth);
+    throw __LINE__;
+  }
+
+  // define what we want to index
+  std::vector<std::vector<std::string>> indexes = {
+    {"severity"},
+    {"level"},
+    {"hostname"},
+    {"rolename"},
+    {"hostname","pid"},
+    {"system"},
+    {"facility"},
+    {"detector"},
+    {"partition"},
+    {"run"},
+    {"run","detector","severity","level"},
+    {"run","hostname","severity","level"},
+    {"run","hostname","facility"},
+    {"errcode"},
+    {"errsource","errline"},
+    {"hostname","pid","errsource","errline"}
   };
+  for (const auto& fields : indexes) {
+    std::string name;
+    for (const auto& f : fields) {
+      name += (name.length() ? "-" : "") + f;
+    }
+    int topK = 0;
+    auto it = sketchIndexes.find(name);
+    if (it != sketchIndexes.end()) {
+      topK = it->second;
+      sketchIndexes.erase(it);
+      theLog->info("Stats index %s approximate, top %d keys", name.c_str(), topK);
+    }
+    dPtr->stats.addIndex(fields, topK);
+  }
+  for (const auto& it : sketchIndexes) {
+    theLog->error("Invalid statsSketchIndexes: no index %s", it.first.c_str());
+    throw __LINE__;
+  }
 
-  // define what we want to index in ilgFieldsToIndex
-  addCombination({"severity"});
-  addCombination({"level"});
-  addCombination({"hostname"});
-  addCombination({"rolename"});
-  addCombination({"hostname","pid"});
-  addCombination({"system"});
-  addCombination({"facility"});
-  addCombination({"detector"});
-  addCombination({"partition"});
-  addCombination({"run"});
-  addCombination({"run","detector","severity","level"});
-  addCombination({"run","hostname","severity","level"});
-  addCombination({"run","hostname","facility"});
-  addCombination({"errcode"});
-  addCombination({"errsource","errline"});
-  addCombination({"hostname","pid","errsource","errline"});
+  if (theConfig->statsPublishMode == "delta") {
+    dPtr->isDelta = true;
+  } else if (theConfig->statsPublishMode == "full") {
+    dPtr->isDelta = false;
+  } else {
+    theLog->error("Invalid statsPublishMode %s", theConfig->statsPublishMode.c_str());
+    throw __LINE__;
+  }
+  if (theConfig->statsFormat == "tcl") {
+    dPtr->format = InfoLoggerMessageStats::Format::Tcl;
+  } else if (theConfig->statsFormat == "json") {
+    dPtr->format = InfoLoggerMessageStats::Format::Json;
+  } else {
+    theLog->error("Invalid statsFormat %s", theConfig->statsFormat.c_str());
+    throw __LINE__;
+  }
+  dPtr->maxPending = theConfig->statsBufferSize;
+  dPtr->stats.setUpdatesEnabled(dPtr->isDelta);
 
   dPtr->clients.resize(theConfig->statsMaxClients);
-  for (int i = 0; i < theConfig->statsMaxClients; i++) {
-    dPtr->clients[i] = -1;
-  }
 
   // initialize listening socket
   // create a socket
@@ -158,7 +264,7 @@ InfoLoggerDispatchStats::InfoLoggerDispatchStats(ConfigInfoLoggerServer* config,
     throw __LINE__;
   }
   //theLog.info("%s() success\n",__FUNCTION__);
-  theLog->info("Publishing stats on port %d - every %ds, window size %ds, history %ds", theConfig->statsPort, theConfig->statsPublishInterval, theConfig->statsResetInterval, theConfig->statsHistory);
+  theLog->info("Publishing stats on port %d - every %ds, window size %ds, history %ds, %s mode, %s format", theConfig->statsPort, theConfig->statsPublishInterval, theConfig->statsResetInterval, theConfig->statsHistory, theConfig->statsPublishMode.c_str(), theConfig->statsFormat.c_str());
   
   dPtr->publishInterval = theConfig->statsPublishInterval;
   dPtr->resetInterval = theConfig->statsResetInterval;
@@ -174,114 +280,17 @@ InfoLoggerDispatchStats::~InfoLoggerDispatchStats()
     close(dPtr->listen_sock);
   }
   for (int i = 0; i < theConfig->statsMaxClients; i++) {
-    if (dPtr->clients[i] != -1) {
-      close(dPtr->clients[i]);
+    if (dPtr->clients[i].sock != -1) {
+      close(dPtr->clients[i].sock);
     }
   }
 }
 int InfoLoggerDispatchStats::customMessageProcess(std::shared_ptr<InfoLoggerMessageList> msg)
 {
-
-#define MAX_MSG_LENGTH 32768
-  char onlineMsg[MAX_MSG_LENGTH];
-  infoLog_msg_t* lmsg;
-  int size_m;          /* message size */
-
-  //theLog->info("dispatching a message\n");
-
-  for (lmsg = msg->msg; lmsg != NULL; lmsg = lmsg->next) {
-    if (infoLog_msg_encode(lmsg, onlineMsg, MAX_MSG_LENGTH, -1) == 0) {
-        //infoLog_msg_print(lmsg);     
-  	//printf( "protocol=%s\n", lmsg->protocol->version);
-
-        // filter out some messages ? (eg debug)
-	// ...
-	// TBD
-	
-	// don't even care about message original timestamp, we just insert in current time window (ie using message reception time here)
-	if (dPtr->currentWindow != nullptr) {
-            dPtr->currentWindow->totalMessages++;
-	    
-	    auto getStringValue = [](infoLog_msg_t *m, int i) -> std::string {
-	      if (m->values[i].isUndefined) {
-	          return "";
-	      }
-	      switch (m->protocol->fields[i].type) {
-		case infoLog_msgField_def_t::ILOG_TYPE_STRING:
-		  return m->values[i].value.vString;
-		  break;
-		case infoLog_msgField_def_t::ILOG_TYPE_INT:
-		  return std::to_string(m->values[i].value.vInt);
-		  break;
-		case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:		    
-		  return std::to_string(m->values[i].value.vDouble);
-		  break;
-		default:
-		  break;
-	      }
-	      return "";
-	    };
-	    
-	    constexpr bool debug = 0;
-	    
-	    for(int id = 0; id < (int)dPtr->ilgFieldsToIndex.size(); id++) {
-	    
-              bool incomplete = 0;
-	      std::string v;
-	           
-	      if (debug) {printf("indexing %s\n",dPtr->ilgFieldsToIndex[id].first.c_str());}
-	      
-	      for (int ii = 0 ; ii < (int)dPtr->ilgFieldsToIndex[id].second.size(); ii++) {
-	        if (debug) {printf("  get [%d]\n",  dPtr->ilgFieldsToIndex[id].second[ii]);}
-	        if (ii) {
-		  v += "-";
-		}
-		std::string fv = getStringValue(lmsg, dPtr->ilgFieldsToIndex[id].second[ii]);
-		if (debug) {printf("    = %s\n",fv.c_str());}
-		if (fv == "") {
-	          incomplete = 1;
-		  break;
-	        }
-		v += fv;
-	      }
-	      
-	      if (!incomplete) {
-	        if (debug) {printf("  -> %s\n",v.c_str());}
-	        dPtr->currentWindow->fieldCounts[id][v]++;
-	      }
-	    }
-    
-/*	    
-	    for (int i = 0; i < lmsg->protocol->numberOfFields - 1; i++) {
-	      // skip message field
-//	       printf("%s = ", m->protocol->fields[i].name);
-	      if (lmsg->values[i].isUndefined) {
-	        continue;
-	      } else {
-		v="";
-		switch (lmsg->protocol->fields[i].type) {
-        	  case infoLog_msgField_def_t::ILOG_TYPE_STRING:
-        	    v=lmsg->values[i].value.vString;
-        	    break;
-        	  case infoLog_msgField_def_t::ILOG_TYPE_INT:
-        	    v=std::to_string(lmsg->values[i].value.vInt);
-        	    break;
-        	  case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:		    
-		    v=std::to_string(lmsg->values[i].value.vDouble);
-        	    break;
-        	  default:
-        	    break;
-		}
-		if (v!="") {
-		  dPtr->currentWindow->fieldCounts[i][v]++;
-		}
-	      }
-	   }
-	   */
-	}
-    }
+  // don't even care about message original timestamp, we just insert in current time window (ie using message reception time here)
+  for (infoLog_msg_t* lmsg = msg->msg; lmsg != NULL; lmsg = lmsg->next) {
+    dPtr->stats.count(lmsg);
   }
-
   return 0;
 }
 
@@ -302,8 +311,6 @@ int InfoLoggerDispatchStats::customLoop()
   struct sockaddr_in new_cl_addr; /* address of new client */
   socklen_t cl_addr_len;          /* address length */
   
-  fd_set select_write; /* List of sockets to select */
-  
   
   // create a 'select' list, with listening socket (we don't care what clients send) */
   FD_ZERO(&select_read);
@@ -312,10 +319,10 @@ int InfoLoggerDispatchStats::customLoop()
   highest_sock = dPtr->listen_sock;
   // add the connected clients
   for (i = 0; i < theConfig->statsMaxClients; i++) {
-    if (dPtr->clients[i] != -1) {
-      FD_SET(dPtr->clients[i], &select_read);
-      if (dPtr->clients[i] > highest_sock) {
-        highest_sock = dPtr->clients[i];
+    if (dPtr->clients[i].sock != -1) {
+      FD_SET(dPtr->clients[i].sock, &select_read);
+      if (dPtr->clients[i].sock > highest_sock) {
+        highest_sock = dPtr->clients[i].sock;
       }
     }
   }
@@ -332,9 +339,9 @@ int InfoLoggerDispatchStats::customLoop()
 
     // read from clients
     for (i = 0; i < theConfig->statsMaxClients; i++) {
-      if (dPtr->clients[i] != -1) {
-        if (FD_ISSET(dPtr->clients[i], &select_read)) {
-          result = read(dPtr->clients[i], buffer, DISPATCH_BUFFER_SIZE);
+      if (dPtr->clients[i].sock != -1) {
+        if (FD_ISSET(dPtr->clients[i].sock, &select_read)) {
+          result = read(dPtr->clients[i].sock, buffer, DISPATCH_BUFFER_SIZE - 1);
           if (result > 0) {
             /* success */
             /* we don't use the input */
@@ -348,9 +355,7 @@ int InfoLoggerDispatchStats::customLoop()
           }
           /* close connection on EOF / error */
           if (result == 0) {
-            theLog->info("Connection stats-%d closed", i + 1);
-            close(dPtr->clients[i]);
-            dPtr->clients[i] = -1;
+            dPtr->closeClient(i, theLog, "EOF");
           }
         }
       }
@@ -365,7 +370,7 @@ int InfoLoggerDispatchStats::customLoop()
       } else {
         theLog->info("%s connected on port %d", inet_ntoa(new_cl_addr.sin_addr), new_cl_addr.sin_port);
         for (i = 0; i < theConfig->statsMaxClients; i++) {
-          if (dPtr->clients[i] == -1)
+          if (dPtr->clients[i].sock == -1)
             break;
         }
         if (i == theConfig->statsMaxClients) {
@@ -385,7 +390,7 @@ int InfoLoggerDispatchStats::customLoop()
               close(new_cl_sock);
             } else {
               theLog->info("Assigned connection stats-%d", i + 1);
-              dPtr->clients[i] = new_cl_sock;
+              dPtr->clients[i].sock = new_cl_sock;
             }
           }
         }
@@ -398,116 +403,44 @@ int InfoLoggerDispatchStats::customLoop()
   if (now - dPtr->lastTimePublished > dPtr->publishInterval) {
     dPtr->lastTimePublished = now;
     
-    //printf("publish\n");
-    
-    
-    // create a TCL list style output for statistics
-    auto toTclList = [&] (const FieldStats& w) -> std::string {
-	std::ostringstream out;
-	
-	out << "{timeBegin " << w.timeBegin
-            << " timeEnd " << w.timeEnd
-            << " totalMessages " << w.totalMessages
-            << " fieldCounts {";
-
-	for (int i=0; i < (int)w.fieldCounts.size(); i++) {
-            if (w.fieldCounts[i].size()>0) {
-              //out << protocols[0].fields[i].name << " {";
-	      out << dPtr->ilgFieldsToIndex[i].first << " {";
-	      bool isFirst = 1;
-              for (const auto& [key, val] : w.fieldCounts[i]) {
-        	  
-		  if (isFirst) {
-		    isFirst = 0;
-		  } else {
-                    out << " ";
-		  }
-		  out << key << " " << val;
-              }
-              out << "} ";
-	    }
-	}
-
-	out << "}}"; // close fieldCounts and outer list
-
-	return out.str();
-    };
-    
-    std::string txt;
-    for (const auto& [timestamp, window] : dPtr->windows) {
-        //txt += "{ " + std::to_string(timestamp) +  " " + toTclList(window) + " }";
-	txt += toTclList(window);
-    }
-    txt += "\n";
-    
-    //printf("%s",txt.c_str());
 
+    // serialize stats once for all clients
     // to test RX:  socat - TCP:127.0.0.1:6103
-    
-    // publish stats
-      for (int i = 0; i < theConfig->statsMaxClients; i++) {
-        if (dPtr->clients[i] == -1)
-          continue;
-
-        // check that the client is writable
-        FD_ZERO(&select_write);
-        FD_SET(dPtr->clients[i], &select_write);
-        highest_sock = dPtr->clients[i];
-        // define timeout for message dispatch possible
-        tv.tv_sec = 3;
-        tv.tv_usec = 0;
-        result = select(highest_sock + 1, NULL, &select_write, NULL, &tv);
-        if (result <= 0) {
-          theLog->info("Dispatch timeout, connection stats-%d closed", i + 1);
-          close(dPtr->clients[i]);
-          dPtr->clients[i] = -1;
-          continue;
-        }
-
-        int writeok = 0;
-	int size_m = (int)txt.length();
-        result = write(dPtr->clients[i], txt.c_str(), size_m);
-        if (result == size_m) {
-          // no need to add \n, included in message
-          writeok = 1;
-        }
-        if (!writeok) {
-          theLog->info("Write failed - connection stats-%d closed", i + 1);
-          close(dPtr->clients[i]);
-          dPtr->clients[i] = -1;
+    std::shared_ptr<const std::string> update, snapshot;
+    if (dPtr->isDelta) {
+      update = std::make_shared<const std::string>(dPtr->stats.getUpdate(dPtr->format));
+    }
+    for (auto& c : dPtr->clients) {
+      if (c.sock == -1) {
+        continue;
+      }
+      if ((dPtr->isDelta) && (!c.needSnapshot)) {
+        dPtr->queue(c, update);
+        continue;
+      }
+      if (snapshot == nullptr) {
+        snapshot = std::make_shared<const std::string>(dPtr->stats.getSnapshot(dPtr->format));
+      }
+      if (!dPtr->isDelta) {
+        // previous snapshots not sent yet are obsolete
+        while (c.pending.size() > ((c.offset) ? 1 : 0)) {
+          c.pendingBytes -= c.pending.back()->size();
+          c.pending.pop_back();
         }
       }
+      dPtr->queue(c, snapshot);
+      c.needSnapshot = false;
+    }
   }
-  
-  // create new window when needed
-  if ((now - dPtr->lastTimeReset >= dPtr->resetInterval)||(dPtr->currentWindow == nullptr)) {
-    dPtr->lastTimeReset = now;
-    // printf("reset\n");
-    // if first reset, just align to first minute system clock
 
-    // close previous time window
-    if (dPtr->currentWindow) {
-      dPtr->currentWindow->timeEnd = now;
-    }
+  // send pending data
+  dPtr->flushClients(theLog);
 
-    // add a new time window
-    FieldStats w;
-    w.timeBegin = now;
-    w.timeEnd = w.timeBegin + dPtr->resetInterval;
-    w.totalMessages = 0;
-    w.fieldCounts.resize(dPtr->ilgFieldsToIndex.size());
-
-    auto it = dPtr->windows.emplace(now, std::move(w)).first;
-    dPtr->currentWindow = &it->second;
-
-    // remove old windows
-    for (auto it = dPtr->windows.begin(); it != dPtr->windows.end(); ) {
-	if (it->second.timeEnd < now - dPtr->maxHistory) {
-            it = dPtr->windows.erase(it);  // erase() returns the next iterator
-	} else {
-            ++it;
-	}
-    }
+  // create new window when needed
+  if ((now - dPtr->lastTimeReset >= dPtr->resetInterval) || (!dPtr->hasWindow)) {
+    dPtr->lastTimeReset = now;
+    dPtr->hasWindow = true;
+    dPtr->stats.startWindow(now, dPtr->resetInterval, dPtr->maxHistory);
   }
 
   return 0;
@@ -58,6 +58,7 @@ static constexpr ErrorCode errorCodes[]={
   // infoLogger error codes
   { 1101, "Message flood detected", nullptr},
   { 1102, "End of message flood", nullptr},    
+  { 1103, "Asynchronous logging queue full, messages dropped", nullptr},
   { 0, nullptr, nullptr}
 };
 
@@ -0,0 +1,250 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerMessageFilter.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// match a string against a pattern where * matches any sequence of characters
+static bool wildcardMatch(const char* s, const char* p)
+{
+  const char* star = nullptr; // position of last * in pattern
+  const char* retry = nullptr; // position in string to retry from, after last *
+  while (*s) {
+    if (*p == '*') {
+      star = p++;
+      retry = s;
+    } else if (*p == *s) {
+      p++;
+      s++;
+    } else if (star != nullptr) {
+      p = star + 1;
+      s = ++retry;
+    } else {
+      return false;
+    }
+  }
+  while (*p == '*') {
+    p++;
+  }
+  return (*p == 0);
+}
+
+// parse an integer value. Returns 0 on success.
+static int parseInt(const std::string& s, long long& v)
+{
+  if (s.empty()) {
+    return -1;
+  }
+  char* end = nullptr;
+  errno = 0;
+  v = strtoll(s.c_str(), &end, 10);
+  if ((errno) || (*end != 0)) {
+    return -1;
+  }
+  return 0;
+}
+
+InfoLoggerMessageFilter::InfoLoggerMessageFilter()
+{
+}
+
+InfoLoggerMessageFilter::~InfoLoggerMessageFilter()
+{
+}
+
+int InfoLoggerMessageFilter::setFilter(const std::string& definition, std::string& errorMessage)
+{
+  // split in words, separated by spaces, with \ escape
+  // each word is a list of items separated by commas, an escaped comma is kept in the item
+  std::vector<std::vector<std::string>> words; // for each word, list of items
+  std::vector<bool> isSeparator;               // set if word is an unescaped |
+  bool inWord = false;
+  bool escaped = false;
+  for (size_t i = 0; i <= definition.size(); i++) {
+    char c = (i < definition.size()) ? definition[i] : 0;
+    if ((c == '\\') && (!escaped)) {
+      escaped = true;
+      continue;
+    }
+    if (((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == 0)) && (!escaped)) {
+      inWord = false;
+      continue;
+    }
+    if (!inWord) {
+      words.push_back({ "" });
+      isSeparator.push_back((c == '|') && (!escaped));
+      inWord = true;
+    }
+    if ((c == ',') && (!escaped)) {
+      words.back().push_back("");
+    } else {
+      words.back().back() += c;
+    }
+    escaped = false;
+  }
+
+  std::vector<Alternative> newAlternatives;
+  Alternative current;
+  for (size_t w = 0; w < words.size(); w++) {
+    if (isSeparator[w]) {
+      if ((words[w].size() != 1) || (words[w][0] != "|") || (current.empty())) {
+        errorMessage = "misplaced |";
+        return -1;
+      }
+      newAlternatives.push_back(current);
+      current.clear();
+      continue;
+    }
+
+    // split field name, operator, and first item
+    std::string& first = words[w][0];
+    size_t ix = first.find_first_of("!=~");
+    if ((ix == std::string::npos) || (ix == 0)) {
+      errorMessage = "bad criteria " + first;
+      return -1;
+    }
+    std::string fieldName = first.substr(0, ix);
+    Criteria c;
+    if (first[ix] == '=') {
+      c.op = Operator::Match;
+      ix++;
+    } else if (first[ix] == '~') {
+      c.op = Operator::Contains;
+      ix++;
+    } else if (first.compare(ix, 2, "!=") == 0) {
+      c.op = Operator::Exclude;
+      ix += 2;
+    } else {
+      errorMessage = "bad operator in " + first;
+      return -1;
+    }
+    first.erase(0, ix);
+
+    c.field = infoLog_msg_findField(fieldName.c_str());
+    if (c.field < 0) {
+      errorMessage = "unknown field " + fieldName;
+      return -1;
+    }
+    if (protocols[0].fields[c.field].type == infoLog_msgField_def_t::ILOG_TYPE_INT) {
+      c.isInt = true;
+    } else if (protocols[0].fields[c.field].type == infoLog_msgField_def_t::ILOG_TYPE_STRING) {
+      c.isInt = false;
+    } else {
+      errorMessage = "field " + fieldName + " can not be filtered";
+      return -1;
+    }
+    if ((c.isInt) && (c.op == Operator::Contains)) {
+      errorMessage = "operator ~ not allowed for integer field " + fieldName;
+      return -1;
+    }
+
+    for (auto& s : words[w]) {
+      Item item;
+      item.min = LLONG_MIN;
+      item.max = LLONG_MAX;
+      item.isWildcard = false;
+      if (c.isInt) {
+        size_t r = s.find("..");
+        int err = 0;
+        if (r == std::string::npos) {
+          err = parseInt(s, item.min);
+          item.max = item.min;
+        } else {
+          if (r > 0) {
+            err |= parseInt(s.substr(0, r), item.min);
+          }
+          if (r + 2 < s.size()) {
+            err |= parseInt(s.substr(r + 2), item.max);
+          }
+        }
+        if (err) {
+          errorMessage = "bad value " + s + " for field " + fieldName;
+          return -1;
+        }
+      } else {
+        // % is the SQL wildcard, as used in infoBrowser filters
+        for (auto& ch : s) {
+          if (ch == '%') {
+            ch = '*';
+          }
+        }
+        item.isWildcard = (s.find('*') != std::string::npos);
+        item.pattern = s;
+      }
+      c.items.push_back(item);
+    }
+    current.push_back(c);
+  }
+  if (!current.empty()) {
+    newAlternatives.push_back(current);
+  } else if (!newAlternatives.empty()) {
+    errorMessage = "misplaced |";
+    return -1;
+  }
+
+  alternatives.swap(newAlternatives);
+  return 0;
+}
+
+bool InfoLoggerMessageFilter::matchCriteria(const Criteria& c, const infoLog_msg_t* msg) const
+{
+  const infoLog_msgField_value_t& v = msg->values[c.field];
+  bool found = false;
+  if (v.isUndefined) {
+    // undefined value does not match any item
+  } else if (c.isInt) {
+    for (const auto& item : c.items) {
+      if ((v.value.vInt >= item.min) && (v.value.vInt <= item.max)) {
+        found = true;
+        break;
+      }
+    }
+  } else {
+    const char* s = (v.value.vString != nullptr) ? v.value.vString : "";
+    for (const auto& item : c.items) {
+      if (c.op == Operator::Contains) {
+        found = (strstr(s, item.pattern.c_str()) != nullptr);
+      } else if (item.isWildcard) {
+        found = wildcardMatch(s, item.pattern.c_str());
+      } else {
+        found = (strcmp(s, item.pattern.c_str()) == 0);
+      }
+      if (found) {
+        break;
+      }
+    }
+  }
+  return (c.op == Operator::Exclude) ? !found : found;
+}
+
+bool InfoLoggerMessageFilter::match(const infoLog_msg_t* msg) const
+{
+  if (alternatives.empty()) {
+    return true;
+  }
+  for (const auto& a : alternatives) {
+    bool ok = true;
+    for (const auto& c : a) {
+      if (!matchCriteria(c, msg)) {
+        ok = false;
+        break;
+      }
+    }
+    if (ok) {
+      return true;
+    }
+  }
+  return false;
+}
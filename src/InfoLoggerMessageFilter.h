@@ -0,0 +1,77 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/*
+   a filter to select messages based on their fields, evaluated on decoded messages (infoLog_msg_t)
+
+   The filter definition is a list of criteria separated by spaces, all of them must be met (AND).
+   Several alternatives can be given, separated by a | (OR).
+   Each criteria is one of:
+     field=item1,item2,...   field value matches one of the items
+     field!=item1,item2,...  field value matches none of the items
+     field~item1,item2,...   field value contains one of the items (strings only)
+   Field names are those of the default protocol (e.g. severity, level, hostname, facility, detector, run, message).
+   For string fields, an item can include wildcards (* or %) matching any string.
+   For integer fields, an item is a value, or a range min..max (min or max can be omitted).
+   A space, comma, | or \ in an item must be escaped with \.
+   An undefined field does not match any item.
+   An empty definition selects all messages.
+
+   Example: severity=E,F level=..6 detector!=TST | facility=runControl message=Starting*
+*/
+
+#ifndef _INFOLOGGER_MESSAGE_FILTER_H
+#define _INFOLOGGER_MESSAGE_FILTER_H
+
+#include "infoLoggerMessage.h"
+#include <string>
+#include <vector>
+
+class InfoLoggerMessageFilter
+{
+ public:
+  InfoLoggerMessageFilter();
+  ~InfoLoggerMessageFilter();
+
+  // define filter. Returns 0 on success, or -1 on error (with description in errorMessage, filter unchanged).
+  int setFilter(const std::string& definition, std::string& errorMessage);
+
+  // returns true if no filter defined (all messages selected)
+  bool isEmpty() const { return alternatives.empty(); }
+
+  // returns true if message selected by filter. The message should use the default protocol (see infoLog_msg_convert()).
+  bool match(const infoLog_msg_t* msg) const;
+
+ private:
+  struct Item {
+    std::string pattern; // string value, possibly with wildcards (*)
+    bool isWildcard;     // set if pattern includes wildcards
+    long long min;       // integer range (inclusive)
+    long long max;
+  };
+  enum class Operator { Match,
+                        Exclude,
+                        Contains };
+  struct Criteria {
+    int field;   // field index in default protocol
+    bool isInt;  // set for integer field, string otherwise
+    Operator op; // test to be done
+    std::vector<Item> items;
+  };
+  typedef std::vector<Criteria> Alternative; // criteria all met
+
+  std::vector<Alternative> alternatives; // one of them met
+
+  bool matchCriteria(const Criteria& c, const infoLog_msg_t* msg) const;
+};
+
+// _INFOLOGGER_MESSAGE_FILTER_H
+#endif
@@ -14,6 +14,9 @@
 #include <time.h>
 #include <sys/time.h>
 #include <stdio.h>
+#include <math.h>
+#include <stdint.h>
+#include <charconv>
 #include <string>
 
 #include "InfoLoggerMessageHelper.h"
@@ -302,3 +305,181 @@ int InfoLoggerMessageHelper::MessageToText(infoLog_msg_t* msg, char* buffer, int
   return 0;
 }
 
+
+/* copy a string, replacing special characters as done by infoLog_msg_encode() */
+static void copyEscaped(char* dest, const char* src, int length)
+{
+  for (int i = 0; i < length; i++) {
+    char c = src[i];
+    dest[i] = ((c == '*') || (c == '#') || (c == '\n')) ? '?' : c;
+  }
+}
+
+/* append the value of a field at the given index of buffer, converted as done by infoLog_msg_encode().
+Returns the new index, or -1 if buffer too short (space is always left for a final NUL). */
+static int appendValue(const infoLog_msg_t* msg, int i, char* buffer, int bufferSize, int ix)
+{
+  if (msg->values[i].isUndefined) {
+    return ix;
+  }
+  char tmp[32];
+  int length = 0;
+  switch (msg->protocol->fields[i].type) {
+    case infoLog_msgField_def_t::ILOG_TYPE_STRING: {
+      const char* str = msg->values[i].value.vString;
+      if (str == NULL) {
+        return ix;
+      }
+      length = strlen(str);
+      if (ix + length >= bufferSize) {
+        return -1;
+      }
+      copyEscaped(&buffer[ix], str, length);
+      return ix + length;
+    }
+    case infoLog_msgField_def_t::ILOG_TYPE_INT:
+      length = std::to_chars(tmp, tmp + sizeof(tmp), msg->values[i].value.vInt).ptr - tmp;
+      break;
+    case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE: {
+      double v = msg->values[i].value.vDouble;
+      if ((v >= 1073741824.0) && (v < 4294967296.0)) {
+        // same as %lf for timestamps (years 2004 to 2106): in this range, the fraction of second in microseconds
+        // is computed without rounding error, and ties are rounded to even, as by printf
+        uint64_t sec = (uint64_t)v;
+        uint64_t usec = (uint64_t)nearbyint((v - sec) * 1000000.0);
+        if (usec >= 1000000) {
+          sec++;
+          usec -= 1000000;
+        }
+        char* p = std::to_chars(tmp, tmp + sizeof(tmp), sec).ptr;
+        *(p++) = '.';
+        for (int k = 5; k >= 0; k--) {
+          p[k] = '0' + usec % 10;
+          usec /= 10;
+        }
+        length = p + 6 - tmp;
+      } else {
+        length = snprintf(&buffer[ix], bufferSize - ix, "%lf", v);
+        if ((length < 0) || (ix + length >= bufferSize)) {
+          return -1;
+        }
+        return ix + length;
+      }
+    } break;
+    default:
+      return -1;
+  }
+  if (ix + length >= bufferSize) {
+    return -1;
+  }
+  memcpy(&buffer[ix], tmp, length);
+  return ix + length;
+}
+
+std::string InfoLoggerMessageHelper::EncodeContext(infoLog_msg_t* msg)
+{
+  // enough space for numbers, and strings of any length
+  int bufferSize = 64 * (ix_run - ix_hostname + 1);
+  for (int i = ix_hostname; i <= ix_run; i++) {
+    if ((!msg->values[i].isUndefined) && (msg->protocol->fields[i].type == infoLog_msgField_def_t::ILOG_TYPE_STRING) && (msg->values[i].value.vString != NULL)) {
+      bufferSize += strlen(msg->values[i].value.vString);
+    }
+  }
+  std::string context(bufferSize, 0);
+  int ix = 0;
+  for (int i = ix_hostname; (i <= ix_run) && (ix >= 0); i++) {
+    if (i != ix_hostname) {
+      context[ix++] = '#';
+    }
+    ix = appendValue(msg, i, &context[0], bufferSize, ix);
+  }
+  context.resize((ix >= 0) ? ix : 0);
+  return context;
+}
+
+/* same result as infoLog_msg_encode(msg, buffer, bufferSize, ix_message), including truncation of long messages,
+   with the fields before the message encoded once for all the records of a multiple lines message */
+int InfoLoggerMessageHelper::EncodeWithContext(infoLog_msg_t* msg, const char* context, int contextLength, char* buffer, int bufferSize)
+{
+  if ((msg == NULL) || (msg->protocol == NULL) || (context == NULL) || (buffer == NULL) || (bufferSize <= 0)) {
+    return __LINE__;
+  }
+  // the context fields are consecutive, and the message is the last field
+  if ((ix_hostname > ix_run) || (ix_message != msg->protocol->numberOfFields - 1)) {
+    return __LINE__;
+  }
+
+  // fields before message, written for first record
+  int ix = snprintf(buffer, bufferSize, "*%s", msg->protocol->version);
+  if ((ix < 0) || (ix >= bufferSize)) {
+    ix = -1;
+  }
+  for (int i = 0; (i < ix_message) && (ix >= 0); i++) {
+    if (ix + 1 >= bufferSize) {
+      ix = -1;
+      break;
+    }
+    buffer[ix++] = '#';
+    if (i == ix_hostname) {
+      if (ix + contextLength >= bufferSize) {
+        ix = -1;
+        break;
+      }
+      memcpy(&buffer[ix], context, contextLength);
+      ix += contextLength;
+      i = ix_run;
+    } else {
+      ix = appendValue(msg, i, buffer, bufferSize, ix);
+    }
+  }
+  if ((ix < 0) || (ix + 1 >= bufferSize)) {
+    buffer[0] = 0;
+    return __LINE__;
+  }
+  buffer[ix++] = '#';
+  int prefixLength = ix;
+
+  // one record per line of message
+  static const char truncateMsg[] = " [...]\n";
+  const char* sol = NULL;
+  if (!msg->values[ix_message].isUndefined) {
+    sol = msg->values[ix_message].value.vString;
+  }
+  int length = 0; // end of last complete record
+  for (;;) {
+    const char* eol = (sol == NULL) ? NULL : strchr(sol, '\n');
+    int lineLength = (sol == NULL) ? 0 : ((eol == NULL) ? (int)strlen(sol) : (int)(eol - sol));
+    int recordLength = prefixLength + lineLength + 1;
+    if ((length + recordLength < bufferSize) && ((eol == NULL) || (length + recordLength + (int)sizeof(truncateMsg) <= bufferSize))) {
+      if (length > 0) {
+        memcpy(&buffer[length], buffer, prefixLength);
+      }
+      copyEscaped(&buffer[length + prefixLength], sol, lineLength);
+      length += recordLength;
+      buffer[length - 1] = '\n';
+      buffer[length] = 0;
+      if (eol == NULL) {
+        return 0;
+      }
+      sol = eol + 1;
+      continue;
+    }
+
+    // record does not fit: message truncated, or previous records only
+    int end = bufferSize - (int)sizeof(truncateMsg);
+    if ((sol != NULL) && (length + prefixLength <= end)) {
+      if (length > 0) {
+        memcpy(&buffer[length], buffer, prefixLength);
+      }
+      copyEscaped(&buffer[length + prefixLength], sol, end - length - prefixLength);
+      memcpy(&buffer[end], truncateMsg, sizeof(truncateMsg));
+      return 0;
+    }
+    if (length > 0) {
+      memcpy(&buffer[length - 1], truncateMsg, sizeof(truncateMsg));
+      return 0;
+    }
+    buffer[0] = 0;
+    return __LINE__;
+  }
+}
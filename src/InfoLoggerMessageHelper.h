@@ -17,6 +17,7 @@
 #define _INFOLOGGER_MESSAGE_HELPER_H
 
 #include "infoLoggerMessage.h"
+#include <string>
 
 // macro to quickly set field in a message
 // example usage:
@@ -43,6 +44,13 @@ class InfoLoggerMessageHelper
                 Debug };
   int MessageToText(infoLog_msg_t* msg, char* buffer, int bufferSize, InfoLoggerMessageHelper::Format format);
 
+  // encoding for infoLoggerD (same result as MessageToText() with Format::Encoded), in two steps,
+  // so that the fields of a context (hostname to run) are encoded once for all messages using it:
+  // EncodeContext() returns the encoded context fields of msg, to be given to EncodeWithContext() (which ignores the context fields of msg).
+  // EncodeWithContext() returns 0 on success (including truncated messages), or an error code.
+  std::string EncodeContext(infoLog_msg_t* msg);
+  int EncodeWithContext(infoLog_msg_t* msg, const char* context, int contextLength, char* buffer, int bufferSize);
+
   // indexes to access a given field in msg struct (protocol independent)
   int ix_severity;
   int ix_level;
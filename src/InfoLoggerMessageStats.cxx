@@ -0,0 +1,598 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerMessageStats.h"
+
+#include <algorithm>
+#include <charconv>
+#include <math.h>
+#include <stdio.h>
+
+// HyperLogLog precision: 2^12 registers, standard error 1.04/sqrt(4096) = 1.6%
+#define STATS_HLL_BITS 12
+#define STATS_HLL_SIZE (1 << STATS_HLL_BITS)
+
+// final mix of a 64-bit hash
+static inline uint64_t mixHash(uint64_t h)
+{
+  h ^= h >> 30;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 27;
+  h *= 0x94D049BB133111EBULL;
+  h ^= h >> 31;
+  return h;
+}
+
+size_t InfoLoggerMessageStats::KeyHash::operator()(const Key& k) const
+{
+  uint64_t h = (((uint64_t)k.id[0] << 32) | k.id[1]) * 0x9E3779B97F4A7C15ULL;
+  h ^= (((uint64_t)k.id[2] << 32) | k.id[3]);
+  h ^= h >> 29;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 32;
+  return (size_t)h;
+}
+
+InfoLoggerMessageStats::InfoLoggerMessageStats()
+{
+  fieldValues.resize(INFOLOG_FIELDS_MAX);
+  messageIds.resize(INFOLOG_FIELDS_MAX, 0);
+  messageValues.resize(INFOLOG_FIELDS_MAX);
+  valueBuffers.resize(INFOLOG_FIELDS_MAX);
+  isInterned.resize(INFOLOG_FIELDS_MAX, false);
+  setSketchParameters(sketchError, sketchDepth);
+}
+
+InfoLoggerMessageStats::~InfoLoggerMessageStats()
+{
+}
+
+int InfoLoggerMessageStats::addIndex(const std::vector<std::string>& fields, int topK)
+{
+  if ((fields.size() == 0) || (fields.size() > INFOLOGGER_STATS_INDEX_MAX_FIELDS) || (windows.size()) || (topK < 0)) {
+    return -1;
+  }
+  Index index;
+  index.topK = topK;
+  for (const auto& name : fields) {
+    int i = infoLog_msg_findField(name.c_str());
+    if (i < 0) {
+      return -1; // invalid field name
+    }
+    index.fields.push_back(i);
+    if (index.name.length()) {
+      index.name += "-";
+    }
+    index.name += name;
+  }
+  for (int i : index.fields) {
+    if (std::find(usedFields.begin(), usedFields.end(), i) == usedFields.end()) {
+      usedFields.push_back(i);
+    }
+    if (topK == 0) {
+      isInterned[i] = true;
+    }
+  }
+  indexes.push_back(std::move(index));
+  return 0;
+}
+
+int InfoLoggerMessageStats::setSketchParameters(double error, int depth)
+{
+  if ((error <= 0) || (error >= 1) || (depth <= 0) || (depth > 16) || (windows.size())) {
+    return -1;
+  }
+  sketchError = error;
+  sketchDepth = depth;
+  sketchWidth = (uint32_t)ceil(M_E / error);
+  return 0;
+}
+
+uint32_t InfoLoggerMessageStats::intern(int field, std::string_view value)
+{
+  FieldValues& fv = fieldValues[field];
+  auto it = fv.ids.find(value);
+  if (it != fv.ids.end()) {
+    return it->second;
+  }
+  fv.values.emplace_back(value);
+  uint32_t id = (uint32_t)fv.values.size();
+  fv.ids.emplace(std::string_view(fv.values.back()), id);
+  return id;
+}
+
+void InfoLoggerMessageStats::count(const infoLog_msg_t* msg)
+{
+  if (currentWindow == nullptr) {
+    return;
+  }
+  currentWindow->totalMessages++;
+
+  // value of each field used, and interned value for exact indexes
+  for (int f : usedFields) {
+    const infoLog_msgField_value_t& v = msg->values[f];
+    std::string_view& s = messageValues[f];
+    s = std::string_view();
+    if (!v.isUndefined) {
+      switch (msg->protocol->fields[f].type) {
+        case infoLog_msgField_def_t::ILOG_TYPE_STRING:
+          if (v.value.vString != nullptr) {
+            s = v.value.vString;
+          }
+          break;
+        case infoLog_msgField_def_t::ILOG_TYPE_INT: {
+          auto r = std::to_chars(valueBuffers[f].data(), valueBuffers[f].data() + valueBuffers[f].size(), v.value.vInt);
+          s = std::string_view(valueBuffers[f].data(), r.ptr - valueBuffers[f].data());
+          break;
+        }
+        case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE: {
+          int n = snprintf(valueBuffers[f].data(), valueBuffers[f].size(), "%f", v.value.vDouble);
+          s = std::string_view(valueBuffers[f].data(), std::min(n, (int)valueBuffers[f].size() - 1));
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    messageIds[f] = ((isInterned[f]) && (s.length())) ? intern(f, s) : 0;
+  }
+
+  // increment counter of each complete combination
+  for (size_t i = 0; i < indexes.size(); i++) {
+    if (indexes[i].topK) {
+      countApproximate(indexes[i], currentWindow->sketches[i]);
+      continue;
+    }
+    Key k = {};
+    bool incomplete = false;
+    for (size_t j = 0; j < indexes[i].fields.size(); j++) {
+      k.id[j] = messageIds[indexes[i].fields[j]];
+      if (k.id[j] == 0) {
+        incomplete = true;
+        break;
+      }
+    }
+    if (!incomplete) {
+      currentWindow->counts[i][k].count++;
+    }
+  }
+}
+
+void InfoLoggerMessageStats::countApproximate(const Index& index, Sketch& sketch)
+{
+  // hash of the combination
+  uint64_t h = 0;
+  for (size_t j = 0; j < index.fields.size(); j++) {
+    std::string_view s = messageValues[index.fields[j]];
+    if (s.length() == 0) {
+      return; // incomplete
+    }
+    h = mixHash(h ^ std::hash<std::string_view>()(s) ^ ((uint64_t)j << 56));
+  }
+  sketch.total++;
+
+  // distinct count: register indexed by first bits, keeps max position of first bit set in the others
+  uint64_t rest = (h << STATS_HLL_BITS) | ((uint64_t)1 << (STATS_HLL_BITS - 1));
+  uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+  uint8_t& r = sketch.registers[h >> (64 - STATS_HLL_BITS)];
+  if (rank > r) {
+    r = rank;
+  }
+
+  // frequency, with conservative update: only the smallest counters of the key are incremented
+  uint32_t cells[16];
+  uint32_t h1 = (uint32_t)h;
+  uint32_t h2 = (uint32_t)(h >> 32) | 1;
+  uint32_t estimate = UINT32_MAX;
+  for (int i = 0; i < sketchDepth; i++) {
+    cells[i] = i * sketchWidth + (h1 + i * h2) % sketchWidth;
+    estimate = std::min(estimate, sketch.cells[cells[i]]);
+  }
+  if (estimate == UINT32_MAX) {
+    return; // saturated
+  }
+  estimate++;
+  for (int i = 0; i < sketchDepth; i++) {
+    if (sketch.cells[cells[i]] < estimate) {
+      sketch.cells[cells[i]] = estimate;
+    }
+  }
+
+  // update top list
+  auto it = sketch.top.find(h);
+  if (it != sketch.top.end()) {
+    it->second.count = estimate;
+    return;
+  }
+  if ((int)sketch.top.size() >= index.topK) {
+    if (estimate <= sketch.minCount) {
+      return;
+    }
+    // find the smallest entry, and the next one
+    auto itMin = sketch.top.end();
+    uint64_t nextMin = UINT64_MAX;
+    for (auto i = sketch.top.begin(); i != sketch.top.end(); ++i) {
+      if ((itMin == sketch.top.end()) || (i->second.count < itMin->second.count)) {
+        if (itMin != sketch.top.end()) {
+          nextMin = itMin->second.count;
+        }
+        itMin = i;
+      } else if (i->second.count < nextMin) {
+        nextMin = i->second.count;
+      }
+    }
+    if (estimate <= itMin->second.count) {
+      sketch.minCount = itMin->second.count;
+      return;
+    }
+    sketch.top.erase(itMin);
+    sketch.minCount = std::min(nextMin, (uint64_t)estimate);
+  }
+  TopEntry e;
+  e.key = {};
+  for (size_t j = 0; j < index.fields.size(); j++) {
+    e.key.id[j] = intern(index.fields[j], messageValues[index.fields[j]]);
+  }
+  e.count = estimate;
+  sketch.top.emplace(h, e);
+}
+
+void InfoLoggerMessageStats::startWindow(uint64_t now, uint64_t duration, uint64_t maxHistory)
+{
+  // close previous time window
+  if (currentWindow != nullptr) {
+    currentWindow->timeEnd = now;
+    if (updatesEnabled) {
+      closedWindows.push_back(currentWindow->timeBegin);
+    }
+  }
+
+  // add a new time window
+  Window w;
+  w.timeBegin = now;
+  w.timeEnd = now + duration;
+  w.counts.resize(indexes.size());
+  w.sketches.resize(indexes.size());
+  for (size_t i = 0; i < indexes.size(); i++) {
+    if (indexes[i].topK) {
+      w.sketches[i].cells.resize(sketchDepth * sketchWidth, 0);
+      w.sketches[i].registers.resize(STATS_HLL_SIZE, 0);
+      w.sketches[i].top.reserve(indexes[i].topK);
+    }
+  }
+  auto it = windows.insert_or_assign(now, std::move(w)).first;
+  currentWindow = &it->second;
+
+  // remove old windows
+  for (auto it = windows.begin(); it != windows.end();) {
+    if ((now > maxHistory) && (it->second.timeEnd < now - maxHistory)) {
+      if (updatesEnabled) {
+        removedWindows.push_back(it->first);
+        closedWindows.erase(std::remove(closedWindows.begin(), closedWindows.end(), it->first), closedWindows.end());
+      }
+      it = windows.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // cleanup values when their number doubled
+  if (getNumberOfValues() > 2 * valuesAfterCompaction + 10000) {
+    compact();
+  }
+}
+
+size_t InfoLoggerMessageStats::getNumberOfValues() const
+{
+  size_t n = 0;
+  for (const auto& fv : fieldValues) {
+    n += fv.values.size();
+  }
+  return n;
+}
+
+void InfoLoggerMessageStats::compact()
+{
+  std::vector<FieldValues> newValues(INFOLOG_FIELDS_MAX);
+  std::vector<std::vector<uint32_t>> remap(INFOLOG_FIELDS_MAX); // old id -> new id
+  for (int f : usedFields) {
+    remap[f].resize(fieldValues[f].values.size() + 1, 0);
+  }
+  auto remapKey = [&](const Index& index, const Key& oldKey) {
+    Key k = {};
+    for (size_t j = 0; j < index.fields.size(); j++) {
+      int f = index.fields[j];
+      uint32_t& id = remap[f][oldKey.id[j]];
+      if (id == 0) {
+        FieldValues& fv = newValues[f];
+        fv.values.push_back(fieldValues[f].values[oldKey.id[j] - 1]);
+        id = (uint32_t)fv.values.size();
+        fv.ids.emplace(std::string_view(fv.values.back()), id);
+      }
+      k.id[j] = id;
+    }
+    return k;
+  };
+  for (auto& w : windows) {
+    for (size_t i = 0; i < indexes.size(); i++) {
+      if (indexes[i].topK) {
+        for (auto& e : w.second.sketches[i].top) {
+          e.second.key = remapKey(indexes[i], e.second.key);
+        }
+        continue;
+      }
+      CountMap newCounts;
+      newCounts.reserve(w.second.counts[i].size());
+      for (const auto& c : w.second.counts[i]) {
+        newCounts[remapKey(indexes[i], c.first)] = c.second;
+      }
+      w.second.counts[i].swap(newCounts);
+    }
+  }
+  fieldValues.swap(newValues);
+  valuesAfterCompaction = getNumberOfValues();
+}
+
+std::string InfoLoggerMessageStats::keyToString(const Index& index, const Key& k) const
+{
+  std::string s;
+  for (size_t j = 0; j < index.fields.size(); j++) {
+    if (j) {
+      s += "-";
+    }
+    s += fieldValues[index.fields[j]].values[k.id[j] - 1];
+  }
+  return s;
+}
+
+// append a string to JSON output, quoted
+static void appendJsonString(std::string& out, const std::string& s)
+{
+  out += '"';
+  for (char c : s) {
+    if ((c == '"') || (c == '\\')) {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned char)c);
+      out += buffer;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// append an integer to output
+static void appendNumber(std::string& out, uint64_t v)
+{
+  char buffer[24];
+  auto r = std::to_chars(buffer, buffer + sizeof(buffer), v);
+  out.append(buffer, r.ptr - buffer);
+}
+
+void InfoLoggerMessageStats::appendWindow(std::string& out, const Window& w, Format format, bool isUpdate, bool isClosed) const
+{
+  bool isJson = (format == Format::Json);
+  out += isJson ? "{\"timeBegin\":" : "{timeBegin ";
+  appendNumber(out, w.timeBegin);
+  out += isJson ? ",\"timeEnd\":" : " timeEnd ";
+  appendNumber(out, w.timeEnd);
+  out += isJson ? ",\"totalMessages\":" : " totalMessages ";
+  appendNumber(out, w.totalMessages);
+  if (isUpdate) {
+    if (isJson) {
+      out += isClosed ? ",\"closed\":true" : ",\"closed\":false";
+    } else {
+      out += isClosed ? " closed 1" : " closed 0";
+    }
+  }
+  out += isJson ? ",\"fieldCounts\":{" : " fieldCounts {";
+  bool isFirstIndex = true;
+  auto appendIndexName = [&](int i) {
+    if (isJson) {
+      if (!isFirstIndex) {
+        out += ",";
+      }
+      appendJsonString(out, indexes[i].name);
+      out += ":{";
+    } else {
+      if (!isFirstIndex) {
+        out += " ";
+      }
+      out += indexes[i].name;
+      out += " {";
+    }
+    isFirstIndex = false;
+  };
+  auto appendCount = [&](int i, const Key& k, uint64_t count, bool isFirst) {
+    if (!isFirst) {
+      out += isJson ? "," : " ";
+    }
+    if (isJson) {
+      appendJsonString(out, keyToString(indexes[i], k));
+      out += ":";
+    } else {
+      out += keyToString(indexes[i], k);
+      out += " ";
+    }
+    appendNumber(out, count);
+  };
+  bool hasSketch = false;
+  for (size_t i = 0; i < w.counts.size(); i++) {
+    if (indexes[i].topK) {
+      // top list, most frequent first
+      const Sketch& sketch = w.sketches[i];
+      if ((sketch.top.empty()) || ((isUpdate) && (sketch.total == sketch.totalPublished))) {
+        continue;
+      }
+      std::vector<const TopEntry*> top;
+      for (const auto& e : sketch.top) {
+        top.push_back(&e.second);
+      }
+      std::sort(top.begin(), top.end(), [](const TopEntry* a, const TopEntry* b) { return a->count > b->count; });
+      appendIndexName(i);
+      for (size_t j = 0; j < top.size(); j++) {
+        appendCount(i, top[j]->key, top[j]->count, j == 0);
+      }
+      out += "}";
+      hasSketch = true;
+      continue;
+    }
+    bool isFirst = true;
+    for (const auto& c : w.counts[i]) {
+      if ((isUpdate) && (c.second.count == c.second.published)) {
+        continue;
+      }
+      if (isFirst) {
+        appendIndexName(i);
+      }
+      appendCount(i, c.first, c.second.count, isFirst);
+      isFirst = false;
+    }
+    if (!isFirst) {
+      out += "}";
+    }
+  }
+  out += "}"; // close fieldCounts
+
+  // error bounds of approximate indexes published
+  if (hasSketch) {
+    out += isJson ? ",\"sketchInfo\":{" : " sketchInfo {";
+    isFirstIndex = true;
+    for (size_t i = 0; i < w.counts.size(); i++) {
+      const Sketch& sketch = w.sketches[i];
+      if ((!indexes[i].topK) || (sketch.top.empty()) || ((isUpdate) && (sketch.total == sketch.totalPublished))) {
+        continue;
+      }
+      uint64_t distinct, distinctError, countError;
+      getSketchInfo(sketch, distinct, distinctError, countError);
+      appendIndexName(i);
+      out += isJson ? "\"distinct\":" : "distinct ";
+      appendNumber(out, distinct);
+      out += isJson ? ",\"distinctError\":" : " distinctError ";
+      appendNumber(out, distinctError);
+      out += isJson ? ",\"countError\":" : " countError ";
+      appendNumber(out, countError);
+      out += "}";
+    }
+    out += "}";
+  }
+  out += "}"; // close window
+}
+
+void InfoLoggerMessageStats::getSketchInfo(const Sketch& sketch, uint64_t& distinct, uint64_t& distinctError, uint64_t& countError) const
+{
+  // HyperLogLog estimate, with linear counting for small cardinalities
+  double sum = 0;
+  int zeros = 0;
+  for (uint8_t r : sketch.registers) {
+    sum += ldexp(1.0, -r);
+    if (r == 0) {
+      zeros++;
+    }
+  }
+  double m = STATS_HLL_SIZE;
+  double e = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+  if ((e <= 2.5 * m) && (zeros)) {
+    e = m * log(m / zeros);
+  }
+  distinct = (uint64_t)llround(e);
+  distinctError = (uint64_t)ceil(e * 1.04 / sqrt(m));
+  countError = (uint64_t)ceil(sketchError * sketch.total);
+}
+
+std::string InfoLoggerMessageStats::getSnapshot(Format format) const
+{
+  std::string out;
+  if (format == Format::Json) {
+    out = "{\"type\":\"snapshot\",\"windows\":[";
+  } else if (updatesEnabled) {
+    out = "snapshot ";
+  }
+  bool isFirst = true;
+  for (const auto& it : windows) {
+    if (!isFirst) {
+      out += (format == Format::Json) ? "," : " ";
+    }
+    isFirst = false;
+    appendWindow(out, it.second, format, false, false);
+  }
+  if (format == Format::Json) {
+    out += "]}";
+  }
+  out += "\n";
+  return out;
+}
+
+std::string InfoLoggerMessageStats::getUpdate(Format format)
+{
+  std::string out;
+  auto publish = [&](Window& w, bool isClosed) {
+    bool isChanged = (isClosed) || (w.totalMessages != w.totalPublished);
+    if (!isChanged) {
+      return;
+    }
+    out += (format == Format::Json) ? "{\"type\":\"update\",\"window\":" : "update ";
+    appendWindow(out, w, format, true, isClosed);
+    out += (format == Format::Json) ? "}\n" : "\n";
+    w.totalPublished = w.totalMessages;
+    for (auto& m : w.counts) {
+      for (auto& c : m) {
+        c.second.published = c.second.count;
+      }
+    }
+    for (auto& sketch : w.sketches) {
+      sketch.totalPublished = sketch.total;
+    }
+  };
+  for (uint64_t t : removedWindows) {
+    out += (format == Format::Json) ? "{\"type\":\"removed\",\"timeBegin\":" : "removed ";
+    appendNumber(out, t);
+    out += (format == Format::Json) ? "}\n" : "\n";
+  }
+  removedWindows.clear();
+  for (uint64_t t : closedWindows) {
+    auto it = windows.find(t);
+    if ((it != windows.end()) && (&it->second != currentWindow)) {
+      publish(it->second, true);
+    }
+  }
+  closedWindows.clear();
+  if (currentWindow != nullptr) {
+    publish(*currentWindow, false);
+  }
+  return out;
+}
+
+void InfoLoggerMessageStats::getCounts(int ix, std::map<std::string, uint64_t>& counts) const
+{
+  counts.clear();
+  if ((currentWindow == nullptr) || (ix < 0) || (ix >= (int)indexes.size())) {
+    return;
+  }
+  for (const auto& c : currentWindow->counts[ix]) {
+    counts[keyToString(indexes[ix], c.first)] = c.second.count;
+  }
+  for (const auto& e : currentWindow->sketches[ix].top) {
+    counts[keyToString(indexes[ix], e.second.key)] = e.second.count;
+  }
+}
+
+int InfoLoggerMessageStats::getSketchInfo(int ix, uint64_t& distinct, uint64_t& distinctError, uint64_t& countError) const
+{
+  if ((currentWindow == nullptr) || (ix < 0) || (ix >= (int)indexes.size()) || (!indexes[ix].topK)) {
+    return -1;
+  }
+  getSketchInfo(currentWindow->sketches[ix], distinct, distinctError, countError);
+  return 0;
+}
@@ -0,0 +1,196 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/*
+   counters of messages, per value of some fields (or combination of fields), for successive time windows
+   used by infoLoggerServer to publish statistics (see InfoLoggerDispatchStats)
+
+   Field values are interned: each distinct value of a field is stored once, and identified by a number.
+   Counters are indexed by the fixed-size tuple of these numbers, so that counting a message does not allocate memory
+   (except for new values or new combinations).
+   Values no longer used by the windows kept are removed from time to time.
+
+   An index can be approximate, to bound memory for combinations with many distinct values (eg with pid):
+   frequencies are estimated with a count-min sketch (conservative update), only the topK most frequent keys are kept,
+   and the number of distinct keys is estimated with HyperLogLog. The error bounds are published with the counts.
+
+   Counters can be published as a snapshot (all windows), and, when updates are enabled, as updates:
+   the counters changed since previous update (for current window, and windows closed since then), and the windows removed.
+   Output is a Tcl list or a JSON object, one line per item (see getSnapshot() and getUpdate() for the formats).
+*/
+
+#ifndef _INFOLOGGER_MESSAGE_STATS_H
+#define _INFOLOGGER_MESSAGE_STATS_H
+
+#include "infoLoggerMessage.h"
+#include <array>
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// max number of fields combined in an index
+#define INFOLOGGER_STATS_INDEX_MAX_FIELDS 4
+
+class InfoLoggerMessageStats
+{
+ public:
+  InfoLoggerMessageStats();
+  ~InfoLoggerMessageStats();
+
+  // define an index on a field, or a combination of fields (names from the default protocol)
+  // it is named after the fields, separated by "-". Returns 0 on success, -1 on error.
+  // if topK is not zero, counts are approximate, and only the topK most frequent keys are kept.
+  int addIndex(const std::vector<std::string>& fields, int topK = 0);
+
+  // parameters of the count-min sketch used by approximate indexes (to be set before first window)
+  // counts are over-estimated by at most error * (number of messages counted in the index), with probability 1 - exp(-depth)
+  // memory used per index and window is about 4 * depth * e / error bytes (+4kB for distinct count estimate)
+  // Returns 0 on success, -1 on error.
+  int setSketchParameters(double error, int depth);
+
+  int getNumberOfIndexes() const { return (int)indexes.size(); }
+  const std::string& getIndexName(int ix) const { return indexes[ix].name; }
+  bool isApproximate(int ix) const { return indexes[ix].topK > 0; }
+
+  // start a new window, at time now (unix time, seconds) for the given duration
+  // the previous one is closed, and windows ending more than maxHistory seconds ago are removed
+  void startWindow(uint64_t now, uint64_t duration, uint64_t maxHistory);
+
+  // count a message in current window (it is ignored if no window started)
+  // message should use the default protocol (see infoLog_msg_convert())
+  // a combination is counted only if all its fields are defined and not empty
+  void count(const infoLog_msg_t* msg);
+
+  // output formats
+  enum class Format { Tcl,
+                      Json };
+
+  // keep track of changes, to be published with getUpdate()
+  void setUpdatesEnabled(bool enabled) { updatesEnabled = enabled; }
+
+  // all windows, as one line
+  // Tcl: {timeBegin t timeEnd t totalMessages n fieldCounts {index {value count ...} ...} sketchInfo {...}} ...
+  //      when updates are enabled, the line starts with "snapshot"
+  // Json: {"type":"snapshot","windows":[{"timeBegin":t,"timeEnd":t,"totalMessages":n,"fieldCounts":{"index":{"value":count,...},...},"sketchInfo":{...}},...]}
+  // sketchInfo is present when there are approximate indexes, it gives for each of them the estimated number of distinct keys,
+  // its standard error, and the max over-estimation of counts (see setSketchParameters()): index {distinct n distinctError n countError n}
+  std::string getSnapshot(Format format) const;
+
+  // changes since previous call, one line per window changed (possibly none)
+  // only the counters changed are included, with their new value. Closed windows are reported once, with closed set.
+  // for approximate indexes, the full top list is given when changed (it replaces the previous one), with sketchInfo.
+  // Tcl: update {timeBegin t timeEnd t totalMessages n closed 0|1 fieldCounts {...}}
+  //      removed t
+  // Json: {"type":"update","window":{"timeBegin":t,...,"closed":false,"fieldCounts":{...}}}
+  //       {"type":"removed","timeBegin":t}
+  std::string getUpdate(Format format);
+
+  // counts of an index in the current window, by value (fields values separated by "-")
+  // for approximate indexes, the estimated counts of the top keys
+  void getCounts(int ix, std::map<std::string, uint64_t>& counts) const;
+
+  // error bounds of an approximate index in the current window (see getSnapshot()). Returns 0 on success, -1 on error.
+  int getSketchInfo(int ix, uint64_t& distinct, uint64_t& distinctError, uint64_t& countError) const;
+
+  // number of distinct field values stored
+  size_t getNumberOfValues() const;
+
+ private:
+  // a tuple of interned values (0: unused)
+  struct Key {
+    uint32_t id[INFOLOGGER_STATS_INDEX_MAX_FIELDS];
+    bool operator==(const Key& k) const
+    {
+      for (int i = 0; i < INFOLOGGER_STATS_INDEX_MAX_FIELDS; i++) {
+        if (id[i] != k.id[i]) {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& k) const;
+  };
+  struct Counter {
+    uint64_t count = 0;     // current value
+    uint64_t published = 0; // value at last update
+  };
+  typedef std::unordered_map<Key, Counter, KeyHash> CountMap;
+
+  // an entry of the top list of an approximate index
+  struct TopEntry {
+    Key key;
+    uint64_t count;
+  };
+
+  // counters of an approximate index
+  struct Sketch {
+    uint64_t total = 0;                          // number of messages counted
+    uint64_t totalPublished = 0;                 // value of total at last update
+    std::vector<uint32_t> cells;                 // count-min sketch, depth rows of width counters
+    std::vector<uint8_t> registers;              // HyperLogLog registers
+    std::unordered_map<uint64_t, TopEntry> top;  // most frequent keys, indexed by hash
+    uint64_t minCount = 0;                       // when top list full, lower bound of its smallest count
+  };
+
+  struct Window {
+    uint64_t timeBegin;
+    uint64_t timeEnd;
+    uint64_t totalMessages = 0;
+    uint64_t totalPublished = 0;   // value of totalMessages at last update
+    std::vector<CountMap> counts;  // for each index
+    std::vector<Sketch> sketches;  // for each index (used only for approximate ones)
+  };
+
+  struct Index {
+    std::string name;
+    std::vector<int> fields; // field indexes in default protocol
+    int topK = 0;            // number of keys kept, for approximate index (0: exact)
+  };
+
+  // interned values of a field
+  struct FieldValues {
+    std::unordered_map<std::string_view, uint32_t> ids; // value -> id
+    std::deque<std::string> values;                     // id - 1 -> value (storage of the keys of ids)
+  };
+
+  std::vector<Index> indexes;
+  std::vector<int> usedFields;                    // fields used by at least one index
+  std::vector<FieldValues> fieldValues;           // for each field of default protocol
+  std::vector<uint32_t> messageIds;               // for each field, interned value of current message
+  std::vector<std::string_view> messageValues;    // for each field, value of current message (empty if undefined)
+  std::vector<std::array<char, 32>> valueBuffers; // for each field, storage of the value of current message, when not a string
+  std::vector<bool> isInterned;                   // for each field, set when values interned for each message (field used by an exact index)
+  double sketchError = 0.001;                     // count-min sketch error
+  int sketchDepth = 4;                            // count-min sketch number of rows
+  uint32_t sketchWidth = 0;                       // count-min sketch number of counters per row
+  std::map<uint64_t, Window> windows;             // indexed by begin time
+  Window* currentWindow = nullptr;                // window where messages are counted
+  size_t valuesAfterCompaction = 0;               // number of values after last cleanup
+  bool updatesEnabled = false;                    // set when changes are tracked
+  std::vector<uint64_t> closedWindows;            // windows closed since last update
+  std::vector<uint64_t> removedWindows;           // windows removed since last update
+
+  uint32_t intern(int field, std::string_view value);
+  void countApproximate(const Index& index, Sketch& sketch); // count current message in an approximate index
+  void getSketchInfo(const Sketch& sketch, uint64_t& distinct, uint64_t& distinctError, uint64_t& countError) const;
+  std::string keyToString(const Index& index, const Key& k) const;
+  void appendWindow(std::string& out, const Window& w, Format format, bool isUpdate, bool isClosed) const;
+  void compact(); // remove values not used anymore
+};
+
+// _INFOLOGGER_MESSAGE_STATS_H
+#endif
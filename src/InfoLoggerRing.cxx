@@ -0,0 +1,196 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include "InfoLoggerRing.h"
+
+#include <string>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// maximum size of ring data
+#define RING_MAX_SIZE (1U << 30)
+
+InfoLoggerRing::InfoLoggerRing()
+{
+}
+
+InfoLoggerRing::~InfoLoggerRing()
+{
+  release();
+}
+
+void InfoLoggerRing::release()
+{
+  if (header != nullptr) {
+    munmap(header, dataOffset + size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  fd = -1;
+  signalSocket = -1;
+  header = nullptr;
+  data = nullptr;
+  size = 0;
+  localIndex = 0;
+}
+
+int InfoLoggerRing::create(unsigned int requestedSize, int newSignalSocket)
+{
+  release();
+  unsigned int s = dataOffset;
+  while ((s < requestedSize) && (s < RING_MAX_SIZE)) {
+    s *= 2;
+  }
+
+  fd = memfd_create("infoLoggerRing", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    release();
+    return -1;
+  }
+  if ((ftruncate(fd, dataOffset + s) != 0) || (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)) {
+    release();
+    return -1;
+  }
+  void* p = mmap(nullptr, dataOffset + s, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    release();
+    return -1;
+  }
+  header = (Header*)p;
+  data = (char*)p + dataOffset;
+  size = s;
+  header->version = INFOLOGGER_RING_VERSION;
+  header->size = s;
+  header->writeIndex.store(0);
+  header->readIndex.store(0);
+  header->magic = magicValue;
+  signalSocket = newSignalSocket;
+  return 0;
+}
+
+int InfoLoggerRing::attach(int newFd, unsigned int maxSize)
+{
+  release();
+
+  // the memory file should not be resized while mapped
+  struct stat info;
+  if ((fstat(newFd, &info) != 0) || (!S_ISREG(info.st_mode))) {
+    return -1;
+  }
+  int seals = fcntl(newFd, F_GET_SEALS);
+  if ((seals == -1) || ((seals & (F_SEAL_SHRINK | F_SEAL_SEAL)) != (F_SEAL_SHRINK | F_SEAL_SEAL))) {
+    return -1;
+  }
+  // check layout
+  if ((info.st_size <= dataOffset) || (info.st_size - dataOffset > maxSize) || (info.st_size - dataOffset > RING_MAX_SIZE)) {
+    return -1;
+  }
+  unsigned int s = (unsigned int)(info.st_size - dataOffset);
+  if ((s & (s - 1)) != 0) {
+    return -1;
+  }
+  void* p = mmap(nullptr, dataOffset + s, PROT_READ | PROT_WRITE, MAP_SHARED, newFd, 0);
+  if (p == MAP_FAILED) {
+    return -1;
+  }
+  Header* h = (Header*)p;
+  if ((h->magic != magicValue) || (h->version != INFOLOGGER_RING_VERSION) || (h->size != s)) {
+    munmap(p, dataOffset + s);
+    return -1;
+  }
+
+  fd = newFd;
+  header = h;
+  data = (char*)p + dataOffset;
+  size = s;
+  localIndex = header->readIndex.load();
+  return 0;
+}
+
+const char* InfoLoggerRing::getSetupLine()
+{
+  static const std::string setupLine = INFOLOGGER_RING_SETUP_TAG + std::to_string(INFOLOGGER_RING_VERSION) + "\n";
+  return setupLine.c_str();
+}
+
+bool InfoLoggerRing::isSetupLine(const char* line, int length)
+{
+  int tagLength = (int)strlen(INFOLOGGER_RING_SETUP_TAG);
+  return ((length >= tagLength) && (strncmp(line, INFOLOGGER_RING_SETUP_TAG, tagLength) == 0));
+}
+
+int InfoLoggerRing::write(const char* buffer, unsigned int bufferSize)
+{
+  if (bufferSize > size) {
+    return -1;
+  }
+  uint64_t readIndex = header->readIndex.load(std::memory_order_acquire);
+  if (localIndex + bufferSize - readIndex > size) {
+    return 1;
+  }
+  unsigned int offset = (unsigned int)(localIndex & (size - 1));
+  unsigned int firstPart = size - offset;
+  if (firstPart >= bufferSize) {
+    memcpy(&data[offset], buffer, bufferSize);
+  } else {
+    memcpy(&data[offset], buffer, firstPart);
+    memcpy(data, &buffer[firstPart], bufferSize - firstPart);
+  }
+  uint64_t previousIndex = localIndex;
+  localIndex += bufferSize;
+
+  // publish data, then signal if the reader had read everything before (it may be waiting)
+  // both sides store their index before loading the other one (sequentially consistent), so that one of them sees the update
+  header->writeIndex.store(localIndex, std::memory_order_seq_cst);
+  if (header->readIndex.load(std::memory_order_seq_cst) == previousIndex) {
+    signal();
+  }
+  return 0;
+}
+
+void InfoLoggerRing::signal()
+{
+  char c = INFOLOGGER_RING_SIGNAL;
+  if (::send(signalSocket, &c, 1, MSG_DONTWAIT | MSG_NOSIGNAL) != 1) {
+    // socket full: reader has wake-up bytes pending anyway
+  }
+}
+
+int InfoLoggerRing::read(char* buffer, int bufferSize)
+{
+  uint64_t writeIndex = header->writeIndex.load(std::memory_order_seq_cst);
+  uint64_t available = writeIndex - localIndex;
+  if (available > size) {
+    return -1;
+  }
+  if ((available == 0) || (bufferSize <= 0)) {
+    return 0;
+  }
+  unsigned int n = (available < (uint64_t)bufferSize) ? (unsigned int)available : (unsigned int)bufferSize;
+  unsigned int offset = (unsigned int)(localIndex & (size - 1));
+  unsigned int firstPart = size - offset;
+  if (firstPart >= n) {
+    memcpy(buffer, &data[offset], n);
+  } else {
+    memcpy(buffer, &data[offset], firstPart);
+    memcpy(&buffer[firstPart], data, n - firstPart);
+  }
+  localIndex += n;
+  header->readIndex.store(localIndex, std::memory_order_seq_cst);
+  return (int)n;
+}
+
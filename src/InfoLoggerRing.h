@@ -0,0 +1,106 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#ifndef _INFOLOGGER_RING_H
+#define _INFOLOGGER_RING_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Shared memory ring, to transmit messages from a client process to infoLoggerD without a system call per message.
+// The ring is a memory file (memfd) created by the client, with a header page followed by the data area.
+// Its size is sealed, so that the client can not shrink it while infoLoggerD accesses it.
+// Data is the same stream of newline-terminated records as sent on the socket (each write is made visible at once).
+// The client writes and infoLoggerD reads (single producer, single consumer). The client sends one byte on the socket
+// only when the ring was empty before a write (infoLoggerD reads until the ring is empty, and then waits for it).
+// infoLoggerD only reads from its own (non-blocking) end of the socket: a client can not make it block.
+//
+// Setup: the client connects the infoLoggerD socket as usual, and sends a line "*RING#version" on it,
+// with the memory file descriptor attached (SCM_RIGHTS).
+// infoLoggerD replies with one byte: '1' if the ring is used, '0' if not (then the client uses the socket).
+// After that, data received on the socket are only wake-up bytes.
+// The socket stays connected: closing it tells infoLoggerD the client is gone (after having read the ring until empty).
+
+// beginning of the line sent to set up a ring
+#define INFOLOGGER_RING_SETUP_TAG "*RING#"
+
+// version of the ring layout
+#define INFOLOGGER_RING_VERSION 1
+
+// byte sent on the socket to wake up infoLoggerD
+#define INFOLOGGER_RING_SIGNAL '\n'
+
+class InfoLoggerRing
+{
+ public:
+  InfoLoggerRing();
+  ~InfoLoggerRing(); // unmap ring, and close memory file
+  InfoLoggerRing(const InfoLoggerRing&) = delete;
+  InfoLoggerRing& operator=(const InfoLoggerRing&) = delete;
+
+  // client side: create a new ring, with data size rounded up to a power of 2
+  // signalSocket is the socket connected to infoLoggerD, used to wake it up (not owned)
+  // returns 0 on success, -1 on error
+  int create(unsigned int size, int signalSocket);
+
+  // infoLoggerD side: map a ring received from a client, checking its layout (data size up to maxSize)
+  // file descriptor is owned by the object on success
+  // returns 0 on success, -1 on error
+  int attach(int fd, unsigned int maxSize);
+
+  // unmap ring, and close memory file
+  void release();
+
+  bool isOk() const { return (header != nullptr); }
+  int getFd() const { return fd; }
+  unsigned int getSize() const { return size; }
+
+  // line to send on the socket to set up the ring (newline-terminated)
+  static const char* getSetupLine();
+
+  // check if a line received (without newline) is a ring setup line
+  static bool isSetupLine(const char* line, int length);
+
+  // client side: write data in ring
+  // returns 0 on success, 1 if not enough space left (nothing written), -1 if data larger than ring
+  int write(const char* data, unsigned int dataSize);
+
+  // client side: signal reader (e.g. when waiting for space)
+  void signal();
+
+  // infoLoggerD side: copy up to bufferSize bytes from ring to buffer, and release them in ring
+  // returns the number of bytes copied (0 if ring empty), -1 if ring state invalid
+  int read(char* buffer, int bufferSize);
+
+ private:
+  // header of the shared memory file, followed by data (at offset dataOffset)
+  struct Header {
+    uint32_t magic;                              // set when initialized
+    uint32_t version;                            // layout version
+    uint64_t size;                               // size of data, power of 2
+    alignas(64) std::atomic<uint64_t> writeIndex; // total number of bytes written, updated by writer
+    alignas(64) std::atomic<uint64_t> readIndex;  // total number of bytes read, updated by reader
+  };
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "atomic index in shared memory must be lock-free");
+
+  static constexpr uint32_t magicValue = 0x494C5247; // ILRG
+  static constexpr unsigned int dataOffset = 4096;   // header page
+
+  int fd = -1;                // memory file
+  int signalSocket = -1;      // client side: socket to infoLoggerD, to signal new data
+  Header* header = nullptr;   // mapped header
+  char* data = nullptr;       // mapped data
+  unsigned int size = 0;      // size of data
+  uint64_t localIndex = 0;    // writer: writeIndex, reader: readIndex (own copy, not read back from shared memory)
+};
+
+// _INFOLOGGER_RING_H
+#endif
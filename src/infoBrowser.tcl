@@ -1790,6 +1790,29 @@ if {$i==0} {
 
 
 
+############################################################
+# format a list of filter items for the server
+# returns empty string if the items can not be matched the same way by the server
+############################################################
+proc server_filter_items {field items} {
+  set l {}
+  foreach i $items {
+    if {[string length $i]<=0} {continue}
+    if {("$field"=="run")||("$field"=="errcode")} {
+      if {![string is integer -strict $i]} {return ""}
+    } elseif {[string first "*" $i]!=-1} {
+      # * is a wildcard for server
+      return ""
+    } elseif {[string first "%" $i]!=-1} {
+      # other string match special characters are not supported by server
+      if {[regexp {[?\[\]\\]} $i]} {return ""}
+    }
+    lappend l [string map {"\\" "\\\\" " " "\\ " "," "\\," "|" "\\|"} $i]
+  }
+  return [join $l ","]
+}
+
+
 ############################################################
 # create "online_filter" proc
 # this new proc returns 1 if message should be discarded
@@ -1803,11 +1826,16 @@ proc create_online_filter {} {
 
   set bad_query 0
 
+  # same filter, to be applied by server (see InfoLoggerMessageFilter.h for syntax)
+  global server_filter
+  set server_filter {}
+
   # level
   global vfilter_level
   if ($vfilter_level>=0) {
     lappend online_filter "upvar v_level v_level"
     lappend online_filter "if {(\$v_level==\"\")||(\$v_level>$vfilter_level)} {return 1}"
+    lappend server_filter "level=..$vfilter_level"
   }
 
   
@@ -1836,6 +1864,10 @@ proc create_online_filter {} {
       lappend online_filter "}"
       if {$count} {
         lappend online_filter "if {\$reject==1} {return 1}"
+        set items [server_filter_items $field $filtered_items]
+        if {"$items"!=""} {
+          lappend server_filter "${field}=$items"
+        }
       }
     }
   }
@@ -1865,10 +1897,19 @@ proc create_online_filter {} {
       lappend online_filter "}"
       if {$count} {
         lappend online_filter "if {\$reject==1} {return 1}"
+        set items [server_filter_items $field $filtered_items]
+        if {"$items"!=""} {
+          lappend server_filter "${field}!=$items"
+        }
       }
     }
   }
 
+  # keep start of run messages, for autoclean
+  if {[llength $server_filter]} {
+    lappend server_filter "|" "facility=runControl" "message=Starting\\ processes\\ for\\ run*"
+  }
+  set server_filter [join $server_filter " "]
 
   lappend online_filter "return 0"
   lappend online_filter "}"
@@ -2122,6 +2163,15 @@ proc server_connect {} {
   fconfigure $server_fd -blocking false   
   fconfigure $server_fd -buffersize 1000000
   fileevent $server_fd readable server_event
+
+  # ask server to send only messages matching filter
+  global server_filter
+  if {"$server_filter"!=""} {
+    catch {
+      puts $server_fd "filter $server_filter"
+      flush $server_fd
+    }
+  }
   
   .cmd.online configure -selectcolor "green"  
   .stat_action.v configure -text "Connected" -fg black
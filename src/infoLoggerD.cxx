@@ -33,6 +33,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
 
 #include <sys/stat.h>
 #include <string.h>
@@ -40,13 +41,19 @@
 #include <signal.h>
 #include <limits.h>
 
+#include <deque>
 #include <list>
+#include <unordered_map>
+#include <vector>
 #include <filesystem>
 #include <sys/resource.h>
 
 #include <Common/Daemon.h>
 #include <Common/SimpleLog.h>
 #include "transport_client.h"
+#include "permanentFIFO.h"
+#include "InfoLoggerDeferred.h"
+#include "InfoLoggerRing.h"
 
 #include "simplelog.h"
 #include "infoLoggerDefaults.h"
@@ -71,6 +78,8 @@ class ConfigInfoLoggerD
   std::string rxSocketPath = INFOLOGGER_DEFAULT_LOCAL_SOCKET; // name of socket used to receive log messages from clients
   int rxSocketInBufferSize = -1;                              // size of socket receiving buffer. -1 will leave to sys default.
   int rxMaxConnections = 2048;                                // maximum number of incoming connections
+  int rxClientBufferSize = 16384;                             // size of buffer to receive data from each client. Longer messages are truncated.
+  int rxRingMaxSize = 16777216;                               // maximum size of shared memory ring accepted from a client (bytes). 0 to use sockets only.
 
   // settings for remote infoLoggerServer access
   std::string serverHost = "localhost";                // IP name to connect infoLoggerServer
@@ -78,8 +87,13 @@ class ConfigInfoLoggerD
   int msgQueueLength = 10000;                           // transmission queue size
   std::string msgQueuePath = localLogDirectory + "/infoLoggerD.queue"; // path to temp file storing messages
   int msgQueueReset = 0;                                               // when set, existing temp file is cleared (and pending messages lost)
+  std::string msgQueueSync = "none";                                   // when to sync temp file to disk: none (left to the system), interval, batch (each write)
+  int msgQueueSyncInterval = 1;                                        // minimum time between syncs of temp file, in seconds (for msgQueueSync=interval)
   std::string clientName = "infoLoggerD";              // name identifying client to infoLoggerServer
   int isProxy = 0;                                     // flag set to allow infoLoggerD to be a transport proxy to infoLoggerServer
+  int msgBatchMaxCount = 100;                          // maximum number of messages sent together to infoLoggerServer (if server supports it). 1 to disable.
+  int msgBatchMaxSize = 65536;                         // maximum size of messages sent together to infoLoggerServer (bytes)
+  int msgBatchMaxDelay = 10;                           // maximum time to wait for more messages to send together (milliseconds)
 
   // settings for output
   int outputToServer = 1; // enable output to infoLoggerServer
@@ -101,14 +115,21 @@ void ConfigInfoLoggerD::readFromConfigFile(ConfigFile& config)
   config.getOptionalValue<std::string>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".rxSocketPath", rxSocketPath);
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".rxSocketInBufferSize", rxSocketInBufferSize);
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".rxMaxConnections", rxMaxConnections);
+  config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".rxClientBufferSize", rxClientBufferSize);
+  config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".rxRingMaxSize", rxRingMaxSize);
 
   config.getOptionalValue<std::string>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".serverHost", serverHost);
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".serverPort", serverPort);
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgQueueLength", msgQueueLength);
   config.getOptionalValue<std::string>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgQueuePath", msgQueuePath);
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgQueueReset", msgQueueReset);
+  config.getOptionalValue<std::string>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgQueueSync", msgQueueSync);
+  config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgQueueSyncInterval", msgQueueSyncInterval);
   config.getOptionalValue<std::string>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".clientName", clientName);
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".isProxy", isProxy);
+  config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgBatchMaxCount", msgBatchMaxCount);
+  config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgBatchMaxSize", msgBatchMaxSize);
+  config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".msgBatchMaxDelay", msgBatchMaxDelay);
 
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".outputToServer", outputToServer);
   config.getOptionalValue<int>(INFOLOGGER_CONFIG_SECTION_NAME_INFOLOGGERD ".outputToLog", outputToLog);
@@ -197,10 +218,19 @@ int checkDirAndCreate(const char* dir, SimpleLog* log = NULL)
 
 typedef struct {
   int socket;
-  std::string buffer; // currently pending data
-  int pollIx; // index of client in poll structure
+  std::vector<char> buffer; // receiving buffer, allocated once for the lifetime of the connection
+  int bufferUsed;           // currently pending data (incomplete message) at beginning of buffer
+  bool isTruncating;        // set when a message too long for the buffer is being dropped, until end of line
+  bool isPending;           // set when socket was not read until no more data available (to be continued on next iteration)
+  InfoLoggerDeferred deferred; // formats of deferred messages defined by the client
+  InfoLoggerRing ring;         // shared memory ring used by the client, if any (see InfoLoggerRing)
+  bool isRingPending;          // set when ring was not read until empty (to be continued on next iteration)
+  std::vector<int> receivedFds; // file descriptors received from the client, for ring setup
 } t_clientConnection;
 
+// max number of reads per client per iteration, to round-robin between clients
+#define RX_MAX_READS_PER_CLIENT 16
+
 class InfoLoggerD : public Daemon
 {
  public:
@@ -215,9 +245,27 @@ class InfoLoggerD : public Daemon
   int rxSocket = -1;                   // socket for incoming messages
 
   unsigned long long numberOfMessagesReceived = 0;
-  std::list<t_clientConnection> clients;
-  struct pollfd *fds = nullptr;  // array for poll()
-  int nfds = 0;  // size of array
+  std::unordered_map<int, t_clientConnection> clients; // connected clients, indexed by socket
+  int epollFd = -1;                                    // epoll instance, for events on receiving socket and clients
+  std::vector<struct epoll_event> epollEvents;         // events returned by epoll, room for all sockets
+  std::vector<int> clientsPending;                     // clients with data left to be read (not signaled again by epoll)
+  int clientsDisconnected = 0;                         // number of clients disconnected during current iteration
+
+  void acceptClients();                             // accept all new connections
+  void readClient(t_clientConnection& client);      // read available data from client
+  void readClientRing(t_clientConnection& client, bool isClosing = false); // read available data from client ring (until empty if closing)
+  void processData(t_clientConnection& client, int bytesRead); // process data added to client buffer
+  void setupRing(t_clientConnection& client);       // use ring received from client, and reply to it
+  void closeReceivedFds(t_clientConnection& client); // close file descriptors received and not used
+  void closeClient(t_clientConnection& client);     // close connection with client, and remove it from list (reference not valid after call)
+  void processLine(t_clientConnection& client, const char* line, int length); // handle a line received (NUL-terminated, pointing to client buffer)
+  void processMessage(const char* msg, int length); // handle a message received (NUL-terminated, pointing to client buffer)
+  void flushMessages();                             // send messages received so far to server, in one go
+
+  std::vector<const char*> rxMessages; // messages received and not sent yet (they point to client buffer, or to rxExpandedMessages)
+  std::vector<int> rxMessagesLength;   // length of messages in rxMessages
+  std::deque<std::string> rxExpandedMessages; // messages built from deferred messages, not sent yet
+  std::vector<std::string> deferredRecords;   // records of the deferred message being processed
 
   TR_client_configuration cfgCx;  // config for transport
   TR_client_handle hCx = nullptr; // handle to server transport
@@ -323,13 +371,45 @@ InfoLoggerD::InfoLoggerD(int argc, char* argv[]) : Daemon(argc, argv, nullptr, E
         throw __LINE__;
       }
 
+      // create epoll instance to monitor sockets
+      if (configInfoLoggerD.rxClientBufferSize < 2) {
+        configInfoLoggerD.rxClientBufferSize = 2;
+      }
+      epollFd = epoll_create1(EPOLL_CLOEXEC);
+      if (epollFd == -1) {
+        log.error("epoll_create1() failed: %s", strerror(errno));
+        throw __LINE__;
+      }
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLET;
+      ev.data.fd = rxSocket;
+      if (epoll_ctl(epollFd, EPOLL_CTL_ADD, rxSocket, &ev) == -1) {
+        log.error("epoll_ctl() failed: %s", strerror(errno));
+        throw __LINE__;
+      }
+
       if (configInfoLoggerD.outputToServer) {
         // create transport handle (to central server)
         cfgCx.server_name = configInfoLoggerD.serverHost.c_str();
         cfgCx.server_port = configInfoLoggerD.serverPort;
         cfgCx.queue_length = configInfoLoggerD.msgQueueLength;
         cfgCx.msg_queue_path = configInfoLoggerD.msgQueuePath.c_str();
+        cfgCx.msg_queue_sync_interval = configInfoLoggerD.msgQueueSyncInterval;
+        if (configInfoLoggerD.msgQueueSync == "none") {
+          cfgCx.msg_queue_sync = PERMFIFO_SYNC_NONE;
+        } else if (configInfoLoggerD.msgQueueSync == "interval") {
+          cfgCx.msg_queue_sync = PERMFIFO_SYNC_INTERVAL;
+        } else if (configInfoLoggerD.msgQueueSync == "batch") {
+          cfgCx.msg_queue_sync = PERMFIFO_SYNC_BATCH;
+        } else {
+          log.error("Invalid value msgQueueSync=%s", configInfoLoggerD.msgQueueSync.c_str());
+          throw __LINE__;
+        }
         cfgCx.client_name = configInfoLoggerD.clientName.c_str();
+        cfgCx.batch_max_msg = configInfoLoggerD.msgBatchMaxCount;
+        cfgCx.batch_max_size = configInfoLoggerD.msgBatchMaxSize;
+        cfgCx.batch_max_delay = configInfoLoggerD.msgBatchMaxDelay;
+        cfgCx.file_options = 0;
         if (configInfoLoggerD.isProxy) {
           cfgCx.proxy_state = TR_PROXY_CAN_NOT_BE_PROXY;
         } else {
@@ -338,14 +418,10 @@ InfoLoggerD::InfoLoggerD(int argc, char* argv[]) : Daemon(argc, argv, nullptr, E
 
         // check message queue
         struct stat queueInfo;
-        std::string msgQueuePathFifo = configInfoLoggerD.msgQueuePath + ".fifo";
-        log.info("Checking message queue file %s", msgQueuePathFifo.c_str());
-        if (lstat(msgQueuePathFifo.c_str(), &queueInfo) == 0) {
-          if (S_ISREG(queueInfo.st_mode)) {
-            log.info("Pending messages = %ld bytes", (long)queueInfo.st_size);
-          } else {
-            log.error("This is not a regular file");
-          }
+        log.info("Checking message queue files %s.fifo*", configInfoLoggerD.msgQueuePath.c_str());
+        long long queueSize = permFIFO_file_size((char*)configInfoLoggerD.msgQueuePath.c_str());
+        if (queueSize >= 0) {
+          log.info("Pending messages = %lld bytes", queueSize);
         } else {
           log.info("No pending messages");
         }
@@ -363,8 +439,8 @@ InfoLoggerD::InfoLoggerD(int argc, char* argv[]) : Daemon(argc, argv, nullptr, E
 
         if (configInfoLoggerD.msgQueueReset) {
           log.info("Clearing queue");
-          if (remove(msgQueuePathFifo.c_str())) {
-            log.info("Failed to delete %s", msgQueuePathFifo.c_str());
+          if (permFIFO_file_remove((char*)configInfoLoggerD.msgQueuePath.c_str())) {
+            log.info("Failed to delete %s.fifo*", configInfoLoggerD.msgQueuePath.c_str());
           }
         }
 
@@ -384,6 +460,8 @@ InfoLoggerD::InfoLoggerD(int argc, char* argv[]) : Daemon(argc, argv, nullptr, E
       // check consistency of settings for max number of incoming connections
       if (1) {
         log.info("Checking resources for rxMaxConnections = %d", configInfoLoggerD.rxMaxConnections);
+	// each client uses a socket, and with a shared memory ring its memory file
+	long fileDescriptorPerClient = (configInfoLoggerD.rxRingMaxSize > 0) ? 2 : 1;
 	long fileDescriptorCount = 0;
 	long fileDescriptorMax = 0;
 	struct rlimit rlim;
@@ -403,12 +481,12 @@ InfoLoggerD::InfoLoggerD(int argc, char* argv[]) : Daemon(argc, argv, nullptr, E
 	  }
 	  fileDescriptorMax = (long) rlim.rlim_cur;
 	  log.info("getrlimit(): soft = %lu, hard = %lu", (unsigned long)rlim.rlim_cur, (unsigned long)rlim.rlim_max);
-	  if (fileDescriptorCount + configInfoLoggerD.rxMaxConnections > (long)rlim.rlim_cur) {
+	  if (fileDescriptorCount + configInfoLoggerD.rxMaxConnections * fileDescriptorPerClient > (long)rlim.rlim_cur) {
             log.info("Current limits are not compatible with rxMaxConnections = %d", configInfoLoggerD.rxMaxConnections);
 
 	    // trying to increase limits once
             if (i) break;
-	    rlim.rlim_cur = (unsigned long)(fileDescriptorCount + configInfoLoggerD.rxMaxConnections + 1);
+	    rlim.rlim_cur = (unsigned long)(fileDescriptorCount + configInfoLoggerD.rxMaxConnections * fileDescriptorPerClient + 1);
 	    log.info("Trying to increase limit to %ld", (long)rlim.rlim_cur);
 	    if (rlim.rlim_cur > rlim.rlim_max) {
 	      rlim.rlim_cur = rlim.rlim_max;
@@ -425,7 +503,7 @@ InfoLoggerD::InfoLoggerD(int argc, char* argv[]) : Daemon(argc, argv, nullptr, E
 	  }
 	}
         if (!limitOk) {
-          configInfoLoggerD.rxMaxConnections = fileDescriptorMax - fileDescriptorCount - 1;
+          configInfoLoggerD.rxMaxConnections = (fileDescriptorMax - fileDescriptorCount - 1) / fileDescriptorPerClient;
 	  if (configInfoLoggerD.rxMaxConnections <= 0) {
             configInfoLoggerD.rxMaxConnections = 1;
 	  }
@@ -433,6 +511,10 @@ InfoLoggerD::InfoLoggerD(int argc, char* argv[]) : Daemon(argc, argv, nullptr, E
         }
       }
 
+      // events for all clients are retrieved at once (one socket per client, plus the receiving socket),
+      // so that disconnections are processed before checking max number of connections
+      epollEvents.resize((configInfoLoggerD.rxMaxConnections > 0) ? configInfoLoggerD.rxMaxConnections + 1 : 1024);
+
       isInitialized = 1;
       log.info("infoLoggerD started");
     }
@@ -452,11 +534,13 @@ InfoLoggerD::~InfoLoggerD()
   if (rxSocket >= 0) {
     close(rxSocket);
   }
-  for (auto c : clients) {
-    close(c.socket);
+  for (auto& c : clients) {
+    closeReceivedFds(c.second);
+    close(c.second.socket);
   }
-  if (fds) {
-    free(fds);
+  clients.clear();
+  if (epollFd >= 0) {
+    close(epollFd);
   }
   if (hCx != nullptr) {
     TR_client_stop(hCx);
@@ -469,142 +553,367 @@ Daemon::LoopStatus InfoLoggerD::doLoop()
     return LoopStatus::Error;
   }
 
-  bool updateFds = false; // raise this flag to renew structure (change in client list)
-  if (fds == nullptr)  {
-    // create new poll structure based on current list of clients
-    size_t sz = sizeof(struct pollfd) * (clients.size() + 1);
-    fds = (struct pollfd *)malloc(sz);
-    if (fds == nullptr) {
-      return LoopStatus::Error;
+  // wait for events, 1 second timeout
+  // don't wait if some clients were not fully read on previous iteration
+  struct epoll_event* events = epollEvents.data();
+  int nEvents = epoll_wait(epollFd, events, (int)epollEvents.size(), clientsPending.size() ? 0 : 1000);
+  if (nEvents < 0) {
+    if (errno == EINTR) {
+      return LoopStatus::Ok;
     }
-    memset(fds, 0, sz);
-    nfds = 1;
-    fds[0].fd = rxSocket;
-    fds[0].events = POLLIN;
-
-    for (auto &client : clients) {
-      if (client.socket<0) continue;
-      fds[nfds].fd = client.socket;
-      fds[nfds].events = POLLIN;
-      fds[nfds].revents = 0;
-      client.pollIx = nfds; // keep index of fds for this client, to be able to check poll result
-      nfds++;
+    log.error("epoll_wait() failed: %s", strerror(errno));
+    return LoopStatus::Error;
+  }
+
+  clientsDisconnected = 0;
+
+  // continue with clients not fully read previously
+  std::vector<int> previouslyPending;
+  previouslyPending.swap(clientsPending);
+  for (auto fd : previouslyPending) {
+    auto it = clients.find(fd);
+    if ((it != clients.end()) && (it->second.isRingPending)) {
+      it->second.isRingPending = false;
+      readClientRing(it->second);
+    }
+    it = clients.find(fd);
+    if ((it != clients.end()) && (it->second.isPending)) {
+      it->second.isPending = false;
+      readClient(it->second);
     }
   }
 
-  // poll with 1 second timeout
-  if (poll(fds, nfds, 1000) > 0) {
-
-    // check existing clients
-    int cleanupNeeded = 0;
-    for (auto& client : clients) {
-      if (client.socket<0) continue;
-      if ((client.pollIx >= 0) && (fds[client.pollIx].revents)) {
-        char newData[1024000]; // never read more than 10k at a time... allows to round-robin through clients
-        int bytesRead = read(client.socket, newData, sizeof(newData));
-        if (bytesRead > 0) {
-          int ix = 0;
-          for (int i = 0; i < bytesRead; i++) {
-
-            //break; // skip processing
-
-            int nToPush = 0;
-            int endOfLine = (newData[i] == '\n');
-            int endOfBuffer = ((i + 1) == bytesRead);
-
-            if (endOfLine) {
-              nToPush = i - ix;
-            } else if (endOfBuffer) {
-              nToPush = i - ix + 1;
-            }
-            if (nToPush) {
-              // push new data to buffer
-              client.buffer.append(&newData[ix], nToPush);
-              if (endOfLine) {
-                //printf("received new message: %s\n",client.buffer.c_str());
-                numberOfMessagesReceived++;
-                //if (numberOfMessagesReceived%100000==0) {
-                //  printf("received %lld messages\n",numberOfMessagesReceived);
-                //}
-
-                // todo: add mode "to file"
-
-                if (configInfoLoggerD.outputToLog) {
-                  if (logOutput == nullptr) {
-                    printf("%s\n", client.buffer.c_str());
-                  }
-                }
-
-                if (configInfoLoggerD.outputToServer) {
-                  TR_client_send_msg(hCx, client.buffer.c_str());
-                }
-                client.buffer.clear();
-              }
-
-              ix = i + 1;
-              // todo: add protection max size on client.buffer
-            }
-          }
-        } else {
-          int nDropped = client.buffer.length();
-          if (nDropped) {
-            log.info("partial data dropped:%s\n", client.buffer.c_str());
+  // process new events
+  bool newConnections = false;
+  for (int i = 0; i < nEvents; i++) {
+    int fd = events[i].data.fd;
+    if (fd == rxSocket) {
+      newConnections = true;
+      continue;
+    }
+    auto it = clients.find(fd);
+    if (it == clients.end()) {
+      continue;
+    }
+    if (!it->second.isPending) {
+      readClient(it->second);
+    }
+  }
+
+  // handle new connection requests
+  if (newConnections) {
+    acceptClients();
+  }
+
+  if (clientsDisconnected) {
+    log.info("%d clients disconnected, now having %d/%d", clientsDisconnected, (int)clients.size(), configInfoLoggerD.rxMaxConnections);
+  }
+
+  return LoopStatus::Ok;
+}
+
+void InfoLoggerD::acceptClients()
+{
+  // edge-triggered: accept until no more pending connection
+  for (;;) {
+    struct sockaddr_un socketAddress;
+    socklen_t socketAddressLen = sizeof(socketAddress);
+    int tmpSocket = accept4(rxSocket, (struct sockaddr*)&socketAddress, &socketAddressLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (tmpSocket == -1) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (!stateAcceptFailed) {
+        stateAcceptFailed = 1;
+        log.error("accept() failed: %s", strerror(errno));
+      }
+      break;
+    }
+    if (stateAcceptFailed) {
+      log.info("accept() failure now recovered");
+      stateAcceptFailed = 0;
+    }
+    if (((int)clients.size() >= configInfoLoggerD.rxMaxConnections) && (configInfoLoggerD.rxMaxConnections > 0)) {
+      log.warning("Closing new client, maximum number of connections reached (%d)", configInfoLoggerD.rxMaxConnections);
+      close(tmpSocket);
+      continue;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = tmpSocket;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, tmpSocket, &ev) == -1) {
+      log.error("epoll_ctl() failed: %s", strerror(errno));
+      close(tmpSocket);
+      continue;
+    }
+
+    t_clientConnection& newClient = clients[tmpSocket];
+    newClient.socket = tmpSocket;
+    newClient.buffer.resize(configInfoLoggerD.rxClientBufferSize);
+    newClient.bufferUsed = 0;
+    newClient.isTruncating = false;
+    newClient.isPending = false;
+    newClient.isRingPending = false;
+    log.info("New client: %d/%d", (int)clients.size(), configInfoLoggerD.rxMaxConnections);
+
+    // data may already be there
+    readClient(newClient);
+  }
+}
+
+void InfoLoggerD::readClient(t_clientConnection& client)
+{
+  char* buffer = client.buffer.data();
+  int bufferSize = (int)client.buffer.size() - 1; // keep space for a terminating NUL
+
+  // file descriptors may be attached to data, for ring setup
+  union {
+    char buffer[CMSG_SPACE(2 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+
+  bool isAllRead = false;     // set when no more data available on socket
+  bool isRingSignaled = false; // set when client wrote in its ring (see InfoLoggerRing)
+
+  // edge-triggered: read until no more data available, or give a chance to other clients
+  for (int nReads = 0; nReads < RX_MAX_READS_PER_CLIENT; nReads++) {
+    struct iovec iov;
+    iov.iov_base = &buffer[client.bufferUsed];
+    iov.iov_len = bufferSize - client.bufferUsed;
+    struct msghdr msg;
+    bzero(&msg, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    int bytesRead = recvmsg(client.socket, &msg, MSG_CMSG_CLOEXEC);
+    if (bytesRead < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        // all data read
+        isAllRead = true;
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+    }
+    if (bytesRead > 0) {
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+          int nFds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+          for (int i = 0; i < nFds; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            client.receivedFds.push_back(fd);
           }
-          close(client.socket);
-          client.socket = -1;
-          cleanupNeeded++;
         }
       }
     }
-    // cleanup list: remove items with invalid socket
-    if (cleanupNeeded) {
-      clients.remove_if([](t_clientConnection& c) { return (c.socket == -1); });
-      log.info("%d clients disconnected, now having %d/%d", cleanupNeeded, (int)clients.size(), configInfoLoggerD.rxMaxConnections);
-      updateFds = 1;
+    if (bytesRead <= 0) {
+      // connection closed, or error
+      closeClient(client);
+      return;
     }
+    if (client.ring.isOk()) {
+      // when using a ring, data received on socket are only wake-up bytes
+      isRingSignaled = true;
+      continue;
+    }
+    processData(client, bytesRead);
+  }
 
-    // handle new connection requests
-    if (fds[0].revents) {
-      struct sockaddr_un socketAddress;
-      socklen_t socketAddressLen = sizeof(socketAddress);
-      int tmpSocket = accept(rxSocket, (struct sockaddr*)&socketAddress, &socketAddressLen);
-      if (tmpSocket == -1) {
-        if (!stateAcceptFailed) {
-          stateAcceptFailed = 1;
-	  log.error("accept() failed: %s", strerror(errno));
-	}
-      } else {
-        if (stateAcceptFailed) {
-          log.info("accept() failure now recovered");
-          stateAcceptFailed = 0;
-	}
-        if (((int)clients.size() >= configInfoLoggerD.rxMaxConnections) && (configInfoLoggerD.rxMaxConnections > 0)) {
-          log.warning("Closing new client, maximum number of connections reached (%d)", configInfoLoggerD.rxMaxConnections);
-          close(tmpSocket);
-        } else {
-          int socketMode = fcntl(rxSocket, F_GETFL);
-          socketMode = (socketMode | O_NONBLOCK);
-          fcntl(rxSocket, F_SETFL, socketMode);
-
-          t_clientConnection newClient;
-          newClient.socket = tmpSocket;
-          newClient.buffer.clear();
-          clients.push_back(newClient);
-          log.info("New client: %d/%d", (int)clients.size(), configInfoLoggerD.rxMaxConnections);
-	  updateFds = 1;
-        }
+  if (!isAllRead) {
+    // there may be more to read, continue on next iteration
+    client.isPending = true;
+    clientsPending.push_back(client.socket);
+  }
+  if ((isRingSignaled) && (!client.isRingPending)) {
+    readClientRing(client); // client may be closed on error
+  }
+}
+
+void InfoLoggerD::readClientRing(t_clientConnection& client, bool isClosing)
+{
+  char* buffer = client.buffer.data();
+  int bufferSize = (int)client.buffer.size() - 1; // keep space for a terminating NUL
+
+  // read until ring empty, or give a chance to other clients
+  // when closing, read what is in the ring (up to its size, the client may still write if it has been forked)
+  long long bytesLeft = client.ring.getSize();
+  for (int nReads = 0; (nReads < RX_MAX_READS_PER_CLIENT) || ((isClosing) && (bytesLeft > 0)); nReads++) {
+    int bytesRead = client.ring.read(&buffer[client.bufferUsed], bufferSize - client.bufferUsed);
+    if (bytesRead == 0) {
+      return;
+    }
+    if (bytesRead < 0) {
+      log.error("Invalid shared memory ring, closing client");
+      client.ring.release();
+      if (!isClosing) {
+        closeClient(client);
       }
+      return;
+    }
+    bytesLeft -= bytesRead;
+    processData(client, bytesRead);
+  }
+  if (isClosing) {
+    return;
+  }
+
+  // there may be more to read, continue on next iteration
+  client.isRingPending = true;
+  clientsPending.push_back(client.socket);
+}
+
+void InfoLoggerD::processData(t_clientConnection& client, int bytesRead)
+{
+  char* buffer = client.buffer.data();
+  int bufferSize = (int)client.buffer.size() - 1;
+
+  // process complete lines
+  char* startOfLine = buffer;
+  char* endOfData = &buffer[client.bufferUsed + bytesRead];
+  char* ptr = &buffer[client.bufferUsed]; // new data
+  for (;;) {
+    char* endOfLine = (char*)memchr(ptr, '\n', endOfData - ptr);
+    if (endOfLine == nullptr) {
+      break;
+    }
+    *endOfLine = 0;
+    if (client.isTruncating) {
+      // end of a too long message, already processed
+      client.isTruncating = false;
+    } else {
+      processLine(client, startOfLine, endOfLine - startOfLine);
+    }
+    startOfLine = endOfLine + 1;
+    ptr = startOfLine;
+  }
+
+  // keep incomplete line for later
+  client.bufferUsed = endOfData - startOfLine;
+  if (client.isTruncating) {
+    client.bufferUsed = 0;
+  } else if (client.bufferUsed == bufferSize) {
+    // message longer than buffer: keep beginning of it, drop the rest
+    buffer[client.bufferUsed] = 0;
+    log.warning("Message too long (more than %d bytes), truncated", bufferSize);
+    processLine(client, buffer, bufferSize);
+    client.bufferUsed = 0;
+    client.isTruncating = true;
+  }
+
+  // messages point to client buffer: send them before it is modified
+  flushMessages();
+  if ((client.bufferUsed) && (startOfLine != buffer)) {
+    memmove(buffer, startOfLine, client.bufferUsed);
+  }
+}
+
+void InfoLoggerD::setupRing(t_clientConnection& client)
+{
+  // ring descriptor is received with the setup line
+  // (no other descriptor accepted: infoLoggerD should never wait on a file shared with the client)
+  char reply = '0';
+  if ((configInfoLoggerD.rxRingMaxSize > 0) && (!client.ring.isOk()) && (client.receivedFds.size() == 1)) {
+    if (client.ring.attach(client.receivedFds[0], configInfoLoggerD.rxRingMaxSize) == 0) {
+      client.receivedFds.clear();
+      reply = '1';
+      log.info("Client using shared memory ring (%u bytes)", client.ring.getSize());
+    } else {
+      log.warning("Invalid shared memory ring received from client");
     }
+  }
+  closeReceivedFds(client);
+  if (write(client.socket, &reply, 1) != 1) {
+    log.warning("Failed to reply to client ring setup");
+  }
+}
 
-    if (updateFds) {
-      if (fds != nullptr) {
-        free(fds);
+void InfoLoggerD::closeReceivedFds(t_clientConnection& client)
+{
+  for (auto fd : client.receivedFds) {
+    close(fd);
+  }
+  client.receivedFds.clear();
+}
+
+void InfoLoggerD::closeClient(t_clientConnection& client)
+{
+  // messages written in ring before disconnection
+  if (client.ring.isOk()) {
+    readClientRing(client, true);
+    client.ring.release();
+  }
+  closeReceivedFds(client);
+  if (client.bufferUsed) {
+    client.buffer[client.bufferUsed] = 0;
+    log.info("partial data dropped:%s\n", client.buffer.data());
+  }
+  int socket = client.socket;
+  close(socket); // this also removes it from epoll set
+  clientsDisconnected++;
+  clients.erase(socket);
+}
+
+void InfoLoggerD::processLine(t_clientConnection& client, const char* line, int length)
+{
+  // ring setup (see InfoLoggerRing)
+  if (InfoLoggerRing::isSetupLine(line, length)) {
+    setupRing(client);
+    return;
+  }
+
+  // deferred messages (see InfoLoggerDeferred): formats are kept per client, and messages replaced by their text
+  deferredRecords.clear();
+  switch (client.deferred.processLine(line, length, deferredRecords)) {
+    case 0:
+      processMessage(line, length);
+      break;
+    case 2:
+      for (auto& r : deferredRecords) {
+        rxExpandedMessages.push_back(std::move(r));
+        processMessage(rxExpandedMessages.back().c_str(), (int)rxExpandedMessages.back().length());
       }
-      fds = nullptr;
+      break;
+    case 3:
+      log.warning("Client on socket %d defined more than %d formats of deferred messages, next ones ignored", client.socket, InfoLoggerDeferred::maxFormats);
+      break;
+    default:
+      break;
+  }
+}
+
+void InfoLoggerD::processMessage(const char* msg, int length)
+{
+  numberOfMessagesReceived++;
+
+  // todo: add mode "to file"
+
+  if (configInfoLoggerD.outputToLog) {
+    if (logOutput == nullptr) {
+      printf("%s\n", msg);
     }
   }
 
-  return LoopStatus::Ok;
+  if (configInfoLoggerD.outputToServer) {
+    rxMessages.push_back(msg);
+    rxMessagesLength.push_back(length);
+  }
+}
+
+void InfoLoggerD::flushMessages()
+{
+  if (rxMessages.size()) {
+    TR_client_send_msgs(hCx, rxMessages.data(), rxMessagesLength.data(), (int)rxMessages.size());
+    rxMessages.clear();
+    rxMessagesLength.clear();
+  }
+  rxExpandedMessages.clear();
 }
 
 //////////////////////////////////////////////////////
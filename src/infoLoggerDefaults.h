@@ -32,6 +32,9 @@
 // default infoLoggerServer listening port for stats plublish
 #define INFOLOGGER_DEFAULT_SERVER_STATS_PORT 6103
 
+// default infoLoggerServer listening port for alerts publish
+#define INFOLOGGER_DEFAULT_SERVER_ALERTS_PORT 6104
+
 // default listening socket name for infoLoggerD
 #define INFOLOGGER_DEFAULT_LOCAL_SOCKET "infoLoggerD"
 
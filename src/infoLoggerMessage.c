@@ -350,6 +350,108 @@ int infoLog_msg_encode(infoLog_msg_t* msg, char* buffer, int bufferSize, int spl
   return isError;
 }
 
+/* append an unsigned varint (7 bits per byte, least significant first) to buffer. Returns new write index, or -1 if buffer too small */
+static int infoLog_binary_put_varint(unsigned char* buffer, int ix, int bufferSize, unsigned long long v)
+{
+  do {
+    if (ix >= bufferSize) {
+      return -1;
+    }
+    buffer[ix] = (unsigned char)(v & 0x7F);
+    v >>= 7;
+    if (v) {
+      buffer[ix] |= 0x80;
+    }
+    ix++;
+  } while (v);
+  return ix;
+}
+
+int infoLog_msg_encode_binary(infoLog_msg_t* msg, char* outBuffer, int bufferSize)
+{
+  unsigned char* buffer = (unsigned char*)outBuffer;
+  unsigned long long definedMask = 0;
+  int i, ix;
+
+  if ((msg == NULL) || (buffer == NULL)) {
+    return -2;
+  }
+  if (msg->protocol != &protocols[0]) {
+    return -2;
+  }
+  if (bufferSize < INFOLOG_BINARY_HEADER_SIZE) {
+    return -1;
+  }
+
+  for (i = 0; i < msg->protocol->numberOfFields; i++) {
+    if (!msg->values[i].isUndefined) {
+      definedMask |= 1ULL << i;
+    }
+  }
+
+  /* payload first, header filled at the end when length known */
+  ix = INFOLOG_BINARY_HEADER_SIZE;
+  ix = infoLog_binary_put_varint(buffer, ix, bufferSize, msg->protocol->numberOfFields);
+  if (ix < 0) {
+    return -1;
+  }
+  ix = infoLog_binary_put_varint(buffer, ix, bufferSize, definedMask);
+  if (ix < 0) {
+    return -1;
+  }
+
+  for (i = 0; i < msg->protocol->numberOfFields; i++) {
+    if (msg->values[i].isUndefined) {
+      continue;
+    }
+    switch (msg->protocol->fields[i].type) {
+      case ILOG_TYPE_STRING: {
+        const char* str = msg->values[i].value.vString;
+        size_t len = (str == NULL) ? 0 : strlen(str);
+        ix = infoLog_binary_put_varint(buffer, ix, bufferSize, len);
+        if ((ix < 0) || (ix + (int)len + 1 > bufferSize)) {
+          return -1;
+        }
+        memcpy(&buffer[ix], str, len);
+        ix += len;
+        buffer[ix++] = 0;
+      } break;
+      case ILOG_TYPE_INT: {
+        int v = msg->values[i].value.vInt;
+        unsigned int zz = ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+        ix = infoLog_binary_put_varint(buffer, ix, bufferSize, zz);
+        if (ix < 0) {
+          return -1;
+        }
+      } break;
+      case ILOG_TYPE_DOUBLE: {
+        unsigned long long bits;
+        int k;
+        memcpy(&bits, &msg->values[i].value.vDouble, sizeof(bits));
+        if (ix + 8 > bufferSize) {
+          return -1;
+        }
+        for (k = 0; k < 8; k++) {
+          buffer[ix++] = (unsigned char)(bits >> (8 * k));
+        }
+      } break;
+      default:
+        return -2;
+    }
+  }
+
+  /* header */
+  unsigned int payloadSize = ix - INFOLOG_BINARY_HEADER_SIZE;
+  buffer[0] = INFOLOG_BINARY_MARKER;
+  buffer[1] = INFOLOG_BINARY_VERSION;
+  buffer[2] = (unsigned char)(payloadSize);
+  buffer[3] = (unsigned char)(payloadSize >> 8);
+  buffer[4] = (unsigned char)(payloadSize >> 16);
+  buffer[5] = (unsigned char)(payloadSize >> 24);
+
+  return ix;
+}
+
 /* conversion statics */
 static int infolog_msg_isInit = 0;
 
@@ -449,6 +551,17 @@ int infoLog_msg_convert(infoLog_msg_t* msg)
 }
 
 #include "utility.h"
+#include <pthread.h>
+
+#define INFOLOG_MSG_POOL_SIZE 65536 /* maximum number of released message structures kept for reuse */
+
+static struct mem_pool* infoLog_msg_pool = NULL;
+static pthread_once_t infoLog_msg_pool_once = PTHREAD_ONCE_INIT;
+
+static void infoLog_msg_pool_init()
+{
+  infoLog_msg_pool = mem_pool_new(sizeof(infoLog_msg_t), INFOLOG_MSG_POOL_SIZE);
+}
 
 int infoLog_msg_init(infoLog_msg_t* m)
 {
@@ -457,6 +570,7 @@ int infoLog_msg_init(infoLog_msg_t* m)
   }
   memset(m, 0, sizeof(infoLog_msg_t));
   m->data = NULL;
+  m->dataBufferSize = 0;
   m->next = NULL;
   m->protocol = NULL;
   int i;
@@ -468,27 +582,32 @@ int infoLog_msg_init(infoLog_msg_t* m)
 }
 
 /* create an empty message structure - initializes partially the structure (just enough to be destroyed) */
-/* uses checked_malloc() */
+/* taken from a memory pool */
 infoLog_msg_t* infoLog_msg_create(void)
 {
   infoLog_msg_t* m;
 
-  m = checked_malloc(sizeof(infoLog_msg_t));
+  pthread_once(&infoLog_msg_pool_once, infoLog_msg_pool_init);
+  m = mem_pool_get(infoLog_msg_pool);
   infoLog_msg_init(m);
 
   return m;
 }
 
 /* free memory allocated to a infoLog_msg_t */
-/* uses checked_free() */
+/* structure goes back to memory pool, data is released the way it was allocated */
 void infoLog_msg_destroy(infoLog_msg_t* m)
 {
   infoLog_msg_t* new, *old;
 
   for (new = m; new != NULL; new = old) {
     old = new->next;
-    checked_free(new->data);
-    checked_free(new);
+    if (new->dataBufferSize > 0) {
+      mem_buffer_release(new->data, new->dataBufferSize);
+    } else {
+      checked_free(new->data);
+    }
+    mem_pool_release(infoLog_msg_pool, new);
   }
 }
 
@@ -64,6 +64,7 @@ typedef struct _infoLog_msgList_t {
   infoLog_msgField_value_t values[INFOLOG_FIELDS_MAX];
 
   void* data;                      /* data containing all above data - the one to be freed */
+  int dataBufferSize;              /* size given to mem_buffer_get() if data comes from memory pools, 0 if allocated with checked_malloc() */
   struct _infoLog_msgList_t* next; /* next message */
 
   infoLog_msgProtocol_t* protocol; /* protocol used to encode this message */
@@ -91,6 +92,36 @@ int infoLog_msg_print(infoLog_msg_t* msg);
 */
 int infoLog_msg_encode(infoLog_msg_t* msg, char* buffer, int bufferSize, int splitLinesForThisFieldIndex);
 
+/* Binary encoding of messages (protocol 2.0).
+   It carries the fields of the default protocol, in the same order, without text conversion:
+
+   record header:
+     1 byte   INFOLOG_BINARY_MARKER (text records start with '*')
+     1 byte   INFOLOG_BINARY_VERSION
+     4 bytes  length of payload (little-endian)
+   payload:
+     varint   number of fields (must match default protocol)
+     varint   bitmask of defined fields (bit i set = field i defined)
+     then, for each defined field, in order:
+       INT    : varint of zigzag-encoded value
+       DOUBLE : 8 bytes IEEE 754 (little-endian)
+       STRING : varint length, characters, NUL
+
+   Strings are NUL-terminated in the record, so that a decoded message can point directly into it.
+*/
+#define INFOLOG_BINARY_MARKER 0x02
+#define INFOLOG_BINARY_VERSION 0x20
+#define INFOLOG_BINARY_HEADER_SIZE 6
+
+/* This function encodes a struct message in binary format (see above).
+  msg: struct to be encoded. Must be using the default protocol (see infoLog_msg_convert()).
+  buffer: a buffer where the result is written
+  bufferSize: size of the buffer
+
+  returns: number of bytes written (>0) if success, -1 if buffer too small, or -2 on other errors.
+*/
+int infoLog_msg_encode_binary(infoLog_msg_t* msg, char* buffer, int bufferSize);
+
 /* helper functions to easily write/append formatted string to a buffer */
 typedef struct {
   int bufferSize; // size of the buffer
@@ -18,20 +18,312 @@
 /* Message parsing  */
 /********************/
 
+/* Decode a single message record, in place.
+   ptr: beginning of record, end: end of record (exclusive). Record content is altered (fields NUL-terminated).
+   Returns 0 on success, or an error code.
+*/
+static int infoLog_decode_record(infoLog_msg_t* newMsg, char* ptr, char* end)
+{
+  char* start;
+
+  /* check initial marker */
+  if (*ptr != '*') {
+    return __LINE__;
+  }
+  ptr++;
+  if (ptr >= end) {
+    return __LINE__;
+  }
+
+  /* read version number */
+  for (start = ptr; (*ptr != '#') && (ptr < end); ptr++) {
+  }
+  if (ptr >= end) {
+    return __LINE__;
+  }
+  *ptr = 0;
+  ptr++;
+
+  /* find good protocol */
+  int protoIx;
+  int protoN;
+  protoN = sizeof(protocols) / sizeof(infoLog_msgProtocol_t);
+  for (protoIx = 0; protoIx < protoN; protoIx++) {
+    if (!strcmp(start, protocols[protoIx].version)) {
+      break;
+    }
+  }
+  if (protoIx == protoN) {
+    return __LINE__; // protocol not found
+  }
+  newMsg->protocol = &protocols[protoIx];
+
+  /* decode protocol fields accordingly */
+  /* should be like: *1.3#I#1099570259#pcald10#roleName#30287#slord#DAQ#testclient#defaultLog#12345#blablabla [NULL terminated] */
+
+  int fieldIx = 0;
+  for (fieldIx = 0; protocols[protoIx].fields[fieldIx].type != ILOG_TYPE_NULL; fieldIx++) {
+    int length = 0;
+    /* if last field, we assume value until end of line, i.e. no halt on '#' */
+    int lastField = 0;
+    if (protocols[protoIx].fields[fieldIx + 1].type == ILOG_TYPE_NULL) {
+      lastField = 1;
+    }
+
+    if (lastField) {
+      start = ptr;
+      *end = 0;
+      ptr = end;
+      length = strlen(start);
+    } else {
+      for (start = ptr; (*ptr != '#') && (ptr < end); ptr++) {
+        length++;
+      } // skip data until end of field / end of string
+      if (ptr >= end) {
+        return __LINE__;
+      }
+      *ptr = 0; // truncate string
+      ptr++;    //
+    }
+
+    // by default, new value is undefined, length 0 (infolog_msg_create())
+    int vali = 0;
+    double vald = 0;
+    switch (protocols[protoIx].fields[fieldIx].type) {
+      case ILOG_TYPE_STRING:
+        if (length) {
+          newMsg->values[fieldIx].value.vString = start;
+          newMsg->values[fieldIx].length = length;
+          newMsg->values[fieldIx].isUndefined = 0;
+        }
+        break;
+      case ILOG_TYPE_INT:
+        if (*start) {
+          if (sscanf(start, "%d", &vali) != 1) {
+            //              is_error=__LINE__;
+          } else {
+            if (vali > 0) { // filter out negative/zero values
+              newMsg->values[fieldIx].value.vInt = vali;
+              newMsg->values[fieldIx].isUndefined = 0;
+            }
+          }
+        }
+        break;
+      case ILOG_TYPE_DOUBLE:
+
+        if (*start) {
+          if (sscanf(start, "%lf", &vald) != 1) {
+            //              is_error=__LINE__;
+          } else {
+            if (vald > 0) { // filter out negative/zero values
+              newMsg->values[fieldIx].value.vDouble = vald;
+              newMsg->values[fieldIx].isUndefined = 0;
+            }
+          }
+        }
+        break;
+
+      default:
+        return __LINE__;
+    }
+  }
+
+  //    infoLog_msg_print(new);
+
+  /* convert message to default protocol */
+  if (infoLog_msg_convert(newMsg)) {
+    return __LINE__;
+  }
+
+  return 0;
+}
+
+/* read an unsigned varint from ptr, not going beyond end. Returns pointer after value, or NULL on error */
+static inline const unsigned char* infoLog_binary_get_varint(const unsigned char* ptr, const unsigned char* end, unsigned long long* v)
+{
+  unsigned long long result = 0;
+  int shift;
+  for (shift = 0; (ptr < end) && (shift < 64); shift += 7) {
+    unsigned char c = *(ptr++);
+    result |= ((unsigned long long)(c & 0x7F)) << shift;
+    if (!(c & 0x80)) {
+      *v = result;
+      return ptr;
+    }
+  }
+  return NULL;
+}
+
+/* Get size of a binary record (header included).
+   Returns 0 if header is not valid, or record does not fit before end.
+*/
+static int infoLog_binary_record_size(const char* ptr, const char* end)
+{
+  const unsigned char* p = (const unsigned char*)ptr;
+  unsigned long payloadSize;
+  if (end - ptr < INFOLOG_BINARY_HEADER_SIZE) {
+    return 0;
+  }
+  if ((p[0] != INFOLOG_BINARY_MARKER) || (p[1] != INFOLOG_BINARY_VERSION)) {
+    return 0;
+  }
+  payloadSize = (unsigned long)p[2] | ((unsigned long)p[3] << 8) | ((unsigned long)p[4] << 16) | ((unsigned long)p[5] << 24);
+  if (payloadSize > (unsigned long)(end - ptr - INFOLOG_BINARY_HEADER_SIZE)) {
+    return 0;
+  }
+  return INFOLOG_BINARY_HEADER_SIZE + (int)payloadSize;
+}
+
+/* Decode a single binary message record (see infoLog_msg_encode_binary()), in place.
+   ptr: beginning of record, end: end of record (exclusive), as given by infoLog_binary_record_size().
+   String values point directly into the record, which is not modified.
+   Returns 0 on success, or an error code.
+*/
+static int infoLog_decode_binary_record(infoLog_msg_t* newMsg, char* ptr, char* end)
+{
+  const unsigned char* p = (const unsigned char*)ptr + INFOLOG_BINARY_HEADER_SIZE;
+  const unsigned char* e = (const unsigned char*)end;
+  unsigned long long numberOfFields, definedMask, v;
+  int i, k;
+
+  newMsg->protocol = &protocols[0];
+
+  p = infoLog_binary_get_varint(p, e, &numberOfFields);
+  if ((p == NULL) || (numberOfFields != (unsigned long long)protocols[0].numberOfFields)) {
+    return __LINE__;
+  }
+  p = infoLog_binary_get_varint(p, e, &definedMask);
+  if (p == NULL) {
+    return __LINE__;
+  }
+
+  for (i = 0; i < protocols[0].numberOfFields; i++) {
+    if (!(definedMask & (1ULL << i))) {
+      continue;
+    }
+    switch (protocols[0].fields[i].type) {
+      case ILOG_TYPE_STRING:
+        p = infoLog_binary_get_varint(p, e, &v);
+        if ((p == NULL) || (v >= (unsigned long long)(e - p)) || (p[v] != 0)) {
+          return __LINE__;
+        }
+        newMsg->values[i].value.vString = (const char*)p;
+        newMsg->values[i].length = (int)v;
+        newMsg->values[i].isUndefined = 0;
+        p += v + 1;
+        break;
+      case ILOG_TYPE_INT:
+        p = infoLog_binary_get_varint(p, e, &v);
+        if (p == NULL) {
+          return __LINE__;
+        }
+        newMsg->values[i].value.vInt = (int)((unsigned int)(v >> 1) ^ -(unsigned int)(v & 1));
+        newMsg->values[i].isUndefined = 0;
+        break;
+      case ILOG_TYPE_DOUBLE:
+        if (e - p < 8) {
+          return __LINE__;
+        }
+        v = 0;
+        for (k = 0; k < 8; k++) {
+          v |= ((unsigned long long)p[k]) << (8 * k);
+        }
+        memcpy(&newMsg->values[i].value.vDouble, &v, sizeof(double));
+        newMsg->values[i].isUndefined = 0;
+        p += 8;
+        break;
+      default:
+        return __LINE__;
+    }
+  }
+  if (p != e) {
+    return __LINE__;
+  }
+
+  return 0;
+}
+
+/* Get size of the message record at the beginning of a buffer: text (up to end or NUL terminator, included) or binary (header included).
+   Returns 0 if record is not valid.
+*/
+int infoLog_msg_record_size(const char* ptr, const char* end)
+{
+  const char* recordEnd;
+  if (ptr >= end) {
+    return 0;
+  }
+  if (*ptr == INFOLOG_BINARY_MARKER) {
+    return infoLog_binary_record_size(ptr, end);
+  }
+  recordEnd = memchr(ptr, 0, end - ptr);
+  if (recordEnd == NULL) {
+    return (int)(end - ptr);
+  }
+  return (int)(recordEnd + 1 - ptr);
+}
+
+/* Replace the timestamp of a binary message record, in place.
+   ptr: beginning of record, end: end of record (exclusive), as given by infoLog_msg_record_size().
+   Doubles have a fixed size in binary format, so the record size does not change.
+   Returns 0 on success, or an error code (in which case record is left unchanged).
+*/
+int infoLog_binary_record_set_timestamp(char* ptr, char* end, double t)
+{
+  infoLog_msg_t msg;
+  char* buffer;
+  int i, size, err;
+
+  size = (int)(end - ptr);
+  if (infoLog_binary_record_size(ptr, end) != size) {
+    return __LINE__;
+  }
+  infoLog_msg_init(&msg);
+  err = infoLog_decode_binary_record(&msg, ptr, end);
+  if (err) {
+    return err;
+  }
+  for (i = 0; i < protocols[0].numberOfFields; i++) {
+    if ((protocols[0].fields[i].type == ILOG_TYPE_DOUBLE) && (!strcmp(protocols[0].fields[i].name, "timestamp"))) {
+      break;
+    }
+  }
+  if ((i == protocols[0].numberOfFields) || (msg.values[i].isUndefined)) {
+    return __LINE__;
+  }
+  msg.values[i].value.vDouble = t;
+
+  /* decoded strings point into the record: encode in a separate buffer */
+  buffer = (char*)checked_malloc(size);
+  if (buffer == NULL) {
+    return __LINE__;
+  }
+  if (infoLog_msg_encode_binary(&msg, buffer, size) != size) {
+    err = __LINE__;
+  } else {
+    memcpy(ptr, buffer, size);
+  }
+  checked_free(buffer);
+  return err;
+}
+
 /* Decode message from string:
    This function is destructive, (memory) file content is altered (blobs content removed) to avoid data copy.
+   A blob may contain several messages (batch mode), each of them NUL-terminated (text) or length-prefixed (binary).
+   The first message decoded from a blob owns the blob data (msg->data), the following ones point into it.
+   Records which can not be decoded are skipped. Returns NULL if no message could be decoded.
 */
 infoLog_msg_t* infoLog_decode(TR_file* f)
 {
 
-  char *ptr, *start, *end;
+  char *ptr, *end, *recordEnd;
   infoLog_msg_t *newMsg, *old, *first;
   TR_blob* b;
   int is_error;
+  void* blobData;
+  int blobBufferSize;
 
   first = NULL;
   old = NULL;
-  is_error = 0;
 
 /* buffer to keep copy of last message */
 #define MSG_BUFFER_SIZE 200
@@ -42,177 +334,92 @@ infoLog_msg_t* infoLog_decode(TR_file* f)
   /* parse all blobs */
   for (b = f->first; b != NULL; b = b->next) {
 
-    /* keep a copy */
-    buffer_i = b->size;
-    if (buffer_i >= MSG_BUFFER_SIZE) {
-      buffer_i = MSG_BUFFER_SIZE;
-    }
-    memcpy(buffer, b->value, buffer_i);
-    buffer[buffer_i] = 0;
-
-    /* create structure */
-    newMsg = infoLog_msg_create();
-
     /* steal data from blob */
-    newMsg->data = b->value;
-    end = ((char*)b->value) + b->size;
+    blobData = b->value;
+    blobBufferSize = b->buffer_size;
+    ptr = (char*)blobData;
+    end = ptr + b->size;
     b->value = NULL;
     b->size = 0;
+    b->buffer_size = 0;
 
-    /* chain item to current list */
-    if (first == NULL) {
-      first = newMsg;
-    } else {
-      old->next = newMsg;
-    }
-    old = newMsg;
-
-    /* parse data */
-    ptr = (char*)newMsg->data;
-
-    //    slog(SLOG_INFO,"MSG=%s[end of MSG]",ptr);
+    /* parse all records in blob */
+    while (ptr < end) {
 
-    /* check initial marker */
-    if (*ptr != '*') {
-      is_error = __LINE__;
-      break;
-    }
-    ptr++;
-    if (ptr >= end) {
-      is_error = __LINE__;
-      break;
-    }
-
-    /* read version number */
-    for (start = ptr; (*ptr != '#') && (ptr < end); ptr++) {
-    }
-    if (ptr >= end) {
-      is_error = __LINE__;
-      break;
-    }
-    *ptr = 0;
-    ptr++;
-
-    /* find good protocol */
-    int protoIx;
-    int protoN;
-    protoN = sizeof(protocols) / sizeof(infoLog_msgProtocol_t);
-    for (protoIx = 0; protoIx < protoN; protoIx++) {
-      if (!strcmp(start, protocols[protoIx].version)) {
-        break;
-      }
-    }
-    if (protoIx == protoN) {
-      is_error = __LINE__;
-      break; // protocol not found
-    }
-    newMsg->protocol = &protocols[protoIx];
-
-    /* decode protocol fields accordingly */
-    /* should be like: *1.3#I#1099570259#pcald10#roleName#30287#slord#DAQ#testclient#defaultLog#12345#blablabla [NULL terminated] */
-
-    int fieldIx = 0;
-    for (fieldIx = 0; protocols[protoIx].fields[fieldIx].type != ILOG_TYPE_NULL; fieldIx++) {
-      int length = 0;
-      /* if last field, we assume value until end of line, i.e. no halt on '#' */
-      int lastField = 0;
-      if (protocols[protoIx].fields[fieldIx + 1].type == ILOG_TYPE_NULL) {
-        lastField = 1;
-      }
-
-      if (lastField) {
-        start = ptr;
-        *end = 0;
-        ptr = end;
-        length = strlen(start);
-      } else {
-        for (start = ptr; (*ptr != '#') && (ptr < end); ptr++) {
-          length++;
-        } // skip data until end of field / end of string
-        if (ptr >= end) {
-          is_error = __LINE__;
+      if (*ptr == INFOLOG_BINARY_MARKER) {
+        /* binary record: size given in header */
+        int recordSize = infoLog_binary_record_size(ptr, end);
+        if (recordSize == 0) {
+          slog(SLOG_ERROR, "Decoding failed: invalid binary record, %d bytes skipped", (int)(end - ptr));
           break;
         }
-        *ptr = 0; // truncate string
-        ptr++;    //
-      }
+        recordEnd = ptr + recordSize;
+        newMsg = infoLog_msg_create();
+        is_error = infoLog_decode_binary_record(newMsg, ptr, recordEnd);
+        if (is_error) {
+          snprintf(buffer, sizeof(buffer), "[binary record, %d bytes]", recordSize);
+        }
+        ptr = recordEnd;
+      } else {
+        /* find end of record */
+        recordEnd = memchr(ptr, 0, end - ptr);
+        if (recordEnd == NULL) {
+          recordEnd = end;
+        }
+        if (recordEnd == ptr) {
+          /* skip empty record */
+          ptr++;
+          continue;
+        }
 
-      // by default, new value is undefined, length 0 (infolog_msg_create())
-      int vali = 0;
-      double vald = 0;
-      switch (protocols[protoIx].fields[fieldIx].type) {
-        case ILOG_TYPE_STRING:
-          if (length) {
-            newMsg->values[fieldIx].value.vString = start;
-            newMsg->values[fieldIx].length = length;
-            newMsg->values[fieldIx].isUndefined = 0;
-          }
-          break;
-        case ILOG_TYPE_INT:
-          if (*start) {
-            if (sscanf(start, "%d", &vali) != 1) {
-              //              is_error=__LINE__;
-            } else {
-              if (vali > 0) { // filter out negative/zero values
-                newMsg->values[fieldIx].value.vInt = vali;
-                newMsg->values[fieldIx].isUndefined = 0;
-              }
-            }
-          }
-          break;
-        case ILOG_TYPE_DOUBLE:
-
-          if (*start) {
-            if (sscanf(start, "%lf", &vald) != 1) {
-              //              is_error=__LINE__;
-            } else {
-              if (vald > 0) { // filter out negative/zero values
-                newMsg->values[fieldIx].value.vDouble = vald;
-                newMsg->values[fieldIx].isUndefined = 0;
-              }
-            }
-          }
-          break;
+        /* keep a copy */
+        buffer_i = recordEnd - ptr;
+        if (buffer_i >= MSG_BUFFER_SIZE) {
+          buffer_i = MSG_BUFFER_SIZE;
+        }
+        memcpy(buffer, ptr, buffer_i);
+        buffer[buffer_i] = 0;
 
-        default:
-          is_error = __LINE__;
-          break;
+        /* create structure */
+        newMsg = infoLog_msg_create();
+
+        /* parse data */
+        //    slog(SLOG_INFO,"MSG=%s[end of MSG]",ptr);
+        is_error = infoLog_decode_record(newMsg, ptr, recordEnd);
+        ptr = recordEnd + 1;
       }
+
       if (is_error) {
-        break;
+        /* skip this record only, others in the same blob may be fine */
+        slog(SLOG_ERROR, "Decoding failed (%d) for message: %s", is_error, buffer);
+        infoLog_msg_destroy(newMsg);
+        continue;
       }
-    }
 
-    //    infoLog_msg_print(new);
+      /* first message of the blob takes ownership of data */
+      newMsg->data = blobData;
+      newMsg->dataBufferSize = blobBufferSize;
+      blobData = NULL;
 
-    /* convert message to default protocol */
-    if (infoLog_msg_convert(newMsg)) {
-      is_error = __LINE__;
-      break;
+      /* chain item to current list */
+      if (first == NULL) {
+        first = newMsg;
+      } else {
+        old->next = newMsg;
+      }
+      old = newMsg;
     }
 
-    //    infoLog_msg_print(newMsg);
-
-    /*
-    // print decoded message
-    if (!is_error) {
-      infoLog_msg_print(newMsg, &protocols[protoIx]);
+    /* release blob data if not attached to a message */
+    if (blobBufferSize > 0) {
+      mem_buffer_release(blobData, blobBufferSize);
+    } else {
+      checked_free(blobData);
     }
-    */
   }
 
   /* we have emptied file from blobs */
   f->size = 0;
 
-  if (!is_error) {
-    return first;
-  }
-
-  /* in case of errors */
-  slog(SLOG_ERROR, "Decoding failed (%d) for message: %s", is_error, buffer);
-
-  /* free memory on error */
-  infoLog_msg_destroy(first);
-
-  return NULL;
+  return first;
 }
@@ -21,6 +21,12 @@ extern "C" {
 
 infoLog_msg_t* infoLog_decode(TR_file* f);
 
+/* get size of the (text or binary) message record at the beginning of a buffer. Returns 0 if not valid. */
+int infoLog_msg_record_size(const char* ptr, const char* end);
+
+/* replace the timestamp of a binary message record, in place. Returns 0 on success. */
+int infoLog_binary_record_set_timestamp(char* ptr, char* end, double t);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,551 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+// infoLoggerReplay
+// A command line utility to replay messages captured by infoLoggerServer (msgDumpFile option),
+// sending them to an infoLoggerServer with the infoLoggerD transport, to benchmark it.
+
+#include <Common/Configuration.h>
+#include <Common/SimpleLog.h>
+#ifdef WITH_MYSQL
+#include <mysql.h>
+#endif
+
+#include "infoLoggerDefaults.h"
+#include "infoLoggerMessageDecode.h"
+#include "transport_client.h"
+#include "simplelog.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+void printUsage()
+{
+  printf("Usage: o2-infologger-replay -f dumpFile [options]\n");
+  printf("  -f dumpFile : file created by infoLoggerServer with the msgDumpFile option\n");
+  printf("  [-s serverHost] : infoLoggerServer host. By default localhost\n");
+  printf("  [-p serverPort] : infoLoggerServer port. By default %d\n", INFOLOGGER_DEFAULT_SERVER_RX_PORT);
+  printf("  [-c numberOfClients] : number of infoLoggerD clients simulated. By default 1\n");
+  printf("  [-r rate] : total number of dump records (usually one message each) sent per second. By default 0 (as fast as possible)\n");
+  printf("  [-b batchSize] : max number of dump records sent in a single file. By default 100\n");
+  printf("  [-n loops] : number of times the dump is replayed. By default 1\n");
+  printf("  [-u] : update timestamp of messages to the time they are sent\n");
+  printf("  [-d] : measure delay of messages insertion in database (implies -u). Requires database settings in configuration file\n");
+  printf("  [-z pathToConfigurationFile] : configuration used to access database. By default %s\n", INFOLOGGER_DEFAULT_CONFIG_PATH);
+  printf("  [-h] : print this help\n");
+}
+
+// read a message dump file. Returns 0 on success, content of each blob received in blobs
+static int readDumpFile(const char* path, std::vector<std::string>& blobs)
+{
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return -1;
+  }
+  int err = 0;
+  char line[128];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    int size;
+    if ((sscanf(line, "*** begin: %d bytes", &size) != 1) || (size < 0)) {
+      err = -1;
+      break;
+    }
+    std::string b(size, 0);
+    if ((size) && (fread(&b[0], size, 1, fp) != 1)) {
+      err = -1;
+      break;
+    }
+    if ((fgets(line, sizeof(line), fp) == NULL) || (fgets(line, sizeof(line), fp) == NULL) || (strcmp(line, "*** end\n"))) {
+      err = -1;
+      break;
+    }
+    blobs.push_back(b);
+  }
+  fclose(fp);
+  return err;
+}
+
+// count the messages of a blob: text records are NUL-separated, binary ones length-prefixed. Returns -1 if blob is not valid.
+static int countMessages(const std::string& blob)
+{
+  const char* ptr = blob.data();
+  const char* end = ptr + blob.size();
+  int n = 0;
+  while (ptr < end) {
+    int size = infoLog_msg_record_size(ptr, end);
+    if (size <= 0) {
+      return -1;
+    }
+    if (*ptr != 0) {
+      // empty text records are skipped by server
+      n++;
+    }
+    ptr += size;
+  }
+  return n;
+}
+
+// copy a blob, replacing the timestamp of each message (text or binary record) by the given one. Returns 0 on success.
+static int setTimestamp(const std::string& blob, double t, std::string& out)
+{
+  char ts[32];
+  snprintf(ts, sizeof(ts), "%.6lf", t);
+  out.clear();
+  out.reserve(blob.size() + 32);
+  size_t ix = 0;
+  while (ix < blob.size()) {
+    int size = infoLog_msg_record_size(&blob[ix], blob.data() + blob.size());
+    if (size <= 0) {
+      return -1;
+    }
+    size_t end = ix + size;
+    if (blob[ix] == INFOLOG_BINARY_MARKER) {
+      // binary format: timestamp has a fixed size, replaced in place
+      size_t p = out.size();
+      out.append(blob, ix, size);
+      if (infoLog_binary_record_set_timestamp(&out[p], &out[p] + size, t)) {
+        return -1;
+      }
+      ix = end;
+      continue;
+    }
+    // text format: *1.x#severity#level#timestamp#...
+    size_t p = std::string::npos;
+    if (blob.compare(ix, 3, "*1.") == 0) {
+      p = ix;
+      for (int i = 0; (i < 3) && (p != std::string::npos); i++) {
+        p = blob.find('#', p + 1);
+        if (p >= end) {
+          p = std::string::npos;
+        }
+      }
+    }
+    size_t q = (p == std::string::npos) ? p : blob.find('#', p + 1);
+    if ((q != std::string::npos) && (q < end)) {
+      out.append(blob, ix, p + 1 - ix);
+      out.append(ts);
+      out.append(blob, q, end - q);
+    } else {
+      out.append(blob, ix, end - ix);
+    }
+    ix = end;
+  }
+  return 0;
+}
+
+// time since epoch, in seconds
+static double getTime()
+{
+  return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char* argv[])
+{
+  SimpleLog log;                                          // handle to log
+  std::string configPath(INFOLOGGER_DEFAULT_CONFIG_PATH); // path to configuration
+
+  std::string dumpFile;                               // file to replay
+  std::string serverHost = "localhost";               // server host
+  int serverPort = INFOLOGGER_DEFAULT_SERVER_RX_PORT; // server port
+  int nClients = 1;                                   // number of clients
+  double rate = 0;                                    // dump records per second (0: as fast as possible)
+  int batchSize = 100;                                // dump records per file
+  int nLoops = 1;                                     // number of replays
+  bool optTimestamp = 0;                              // update timestamps
+  bool optDB = 0;                                     // measure DB insertion delay
+
+  // configure log output
+  log.setOutputFormat(SimpleLog::FormatOption::ShowTimeStamp | SimpleLog::FormatOption::ShowSeverityTxt | SimpleLog::FormatOption::ShowMessage);
+
+  // parse command line parameters
+  int option;
+  while ((option = getopt(argc, argv, "f:s:p:c:r:b:n:udz:h")) != -1) {
+    switch (option) {
+      case 'f':
+        dumpFile = optarg;
+        break;
+      case 's':
+        serverHost = optarg;
+        break;
+      case 'p':
+        serverPort = atoi(optarg);
+        break;
+      case 'c':
+        nClients = atoi(optarg);
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 'b':
+        batchSize = atoi(optarg);
+        break;
+      case 'n':
+        nLoops = atoi(optarg);
+        break;
+      case 'u':
+        optTimestamp = 1;
+        break;
+      case 'd':
+        optDB = 1;
+        optTimestamp = 1;
+        break;
+      case 'z':
+        configPath = optarg;
+        break;
+      case 'h':
+        printUsage();
+        return 0;
+      default:
+        printUsage();
+        return -1;
+    }
+  }
+  if ((dumpFile.length() == 0) || (nClients <= 0) || (rate < 0) || (batchSize <= 0) || (nLoops <= 0)) {
+    printUsage();
+    return -1;
+  }
+
+  // load messages
+  std::vector<std::string> blobs;
+  if (readDumpFile(dumpFile.c_str(), blobs)) {
+    log.error("Failed to read dump file %s", dumpFile.c_str());
+    return -1;
+  }
+  // count messages: a blob may contain several messages
+  std::vector<int> blobMsgCount;
+  unsigned long long totalBytes = 0, totalMsg = 0;
+  for (size_t i = 0; i < blobs.size(); i++) {
+    const auto& b = blobs[i];
+    int n = countMessages(b);
+    if (n < 0) {
+      log.error("Invalid message record in dump file %s, record %d", dumpFile.c_str(), (int)i + 1);
+      return -1;
+    }
+    std::string bUpdated;
+    if ((optTimestamp) && (setTimestamp(b, 0, bUpdated))) {
+      log.error("Can not update timestamp of messages in dump file %s, record %d", dumpFile.c_str(), (int)i + 1);
+      return -1;
+    }
+    blobMsgCount.push_back(n);
+    totalBytes += b.size();
+    totalMsg += n;
+  }
+  log.info("Loaded %llu messages (%llu bytes) from %s", totalMsg, totalBytes, dumpFile.c_str());
+  if (blobs.size() == 0) {
+    return 0;
+  }
+
+#ifdef WITH_MYSQL
+  MYSQL db; // handle to mysql db
+  if (optDB) {
+    ConfigFile config; // handle to configuration
+    try {
+      config.load("file:" + configPath);
+    } catch (std::string err) {
+      log.error("Failed to load configuration: %s", err.c_str());
+      return -1;
+    }
+    std::string dbHost = "localhost", dbUser, dbPwd, dbName;
+    config.getOptionalValue(INFOLOGGER_CONFIG_SECTION_NAME_SERVER ".dbUser", dbUser);
+    config.getOptionalValue(INFOLOGGER_CONFIG_SECTION_NAME_SERVER ".dbPassword", dbPwd);
+    config.getOptionalValue(INFOLOGGER_CONFIG_SECTION_NAME_SERVER ".dbHost", dbHost);
+    config.getOptionalValue(INFOLOGGER_CONFIG_SECTION_NAME_SERVER ".dbName", dbName);
+    if ((mysql_init(&db) == NULL) || (mysql_real_connect(&db, dbHost.c_str(), dbUser.c_str(), dbPwd.c_str(), dbName.c_str(), 0, NULL, 0) == NULL)) {
+      log.error("Failed to connect database : %s", mysql_error(&db));
+      return -1;
+    }
+    log.info("Database %s @ %s connected", dbName.c_str(), dbHost.c_str());
+  }
+  // get timestamp of last message inserted in database. Returns -1 on error.
+  auto getLastInsertTime = [&]() {
+    double t = -1;
+    if (mysql_query(&db, "select max(timestamp) from " INFOLOGGER_TABLE_MESSAGES)) {
+      return t;
+    }
+    MYSQL_RES* res = mysql_store_result(&db);
+    if (res == NULL) {
+      return t;
+    }
+    MYSQL_ROW row = mysql_fetch_row(res);
+    if ((row != NULL) && (row[0] != NULL)) {
+      t = atof(row[0]);
+    }
+    mysql_free_result(res);
+    return t;
+  };
+#else
+  if (optDB) {
+    log.error("Not built with MySQL support - can not measure database delay");
+    return -1;
+  }
+  auto getLastInsertTime = [&]() { return -1.0; };
+#endif
+
+  // start clients
+  std::vector<TR_client_handle> clients;
+  std::vector<std::string> clientNames;
+  for (int i = 0; i < nClients; i++) {
+    char name[128] = "localhost";
+    gethostname(name, sizeof(name) - 1);
+    clientNames.push_back(std::string(name) + "-replay-" + std::to_string(getpid()) + "-" + std::to_string(i));
+  }
+  for (int i = 0; i < nClients; i++) {
+    TR_client_configuration cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.server_name = serverHost.c_str();
+    cfg.server_port = serverPort;
+    cfg.queue_length = 1000;
+    cfg.client_name = clientNames[i].c_str();
+    cfg.proxy_state = TR_PROXY_CAN_NOT_BE_PROXY;
+    cfg.msg_queue_path = NULL;
+    cfg.batch_max_msg = batchSize;
+    cfg.file_options = TR_OPTION_BATCH | TR_OPTION_BINARY;
+    TR_client_handle h = TR_client_start(&cfg);
+    if (h == NULL) {
+      log.error("Failed to start client %d", i);
+      return -1;
+    }
+    clients.push_back(h);
+  }
+  for (int i = 0; i < 1000; i++) {
+    int nConnected = 0;
+    for (auto h : clients) {
+      if (TR_client_isConnected(h) == 1) {
+        nConnected++;
+      }
+    }
+    if (nConnected == nClients) {
+      break;
+    }
+    usleep(10000);
+  }
+  log.info("Starting replay: %d clients, rate %s, %d loops", nClients, (rate > 0) ? (std::to_string((int)rate) + " msg/s").c_str() : "max", nLoops);
+
+  // replay
+  std::vector<int> nextId(nClients, 1); // file ids, per client
+  std::vector<int> nPending(nClients, 0); // files sent and not acknowledged, per client
+  std::vector<double> ackDelays;           // time between file queued and acknowledged, in seconds
+  unsigned long long nMsgSent = 0, nBytesSent = 0, nFilesSent = 0, nFilesAcked = 0;
+  double lastSentTime = 0;
+  double maxDBDelay = -1;
+  double lastDBCheck = 0;
+
+  double t0 = getTime();
+  double lastCollect = 0;
+  auto collectAcks = [&]() {
+    double now = getTime();
+    lastCollect = now;
+    for (int i = 0; i < nClients; i++) {
+      for (;;) {
+        TR_file* f = TR_client_getLastFileSent(clients[i]);
+        if (f == NULL) {
+          break;
+        }
+        // clock is the time file was queued, in milliseconds since start
+        ackDelays.push_back(now - t0 - f->clock / 1000.0);
+        nFilesAcked++;
+        nPending[i]--;
+        TR_file_dec_usage(f);
+      }
+    }
+    if ((optDB) && (now >= lastDBCheck + 1)) {
+      lastDBCheck = now;
+      double t = getLastInsertTime();
+      if ((t >= t0) && (now - t > maxDBDelay)) {
+        maxDBDelay = now - t;
+      }
+    }
+  };
+
+  size_t nTotal = blobs.size() * nLoops;
+  size_t ix = 0;
+  int clientIx = 0;
+  while (ix < nTotal) {
+    // check acknowledged files regularly
+    if (getTime() >= lastCollect + 0.001) {
+      collectAcks();
+    }
+
+    // pace the sending
+    if (rate > 0) {
+      double tNext = t0 + ix / rate;
+      double now = getTime();
+      if (now < tNext) {
+        collectAcks();
+        std::this_thread::sleep_for(std::chrono::microseconds((long)((tNext - now) * 1000000) + 1));
+        continue;
+      }
+    }
+
+    // find a client with room in queue
+    int i;
+    for (i = 0; i < nClients; i++) {
+      if (TR_client_queueGetSpaceLeft(clients[clientIx]) > 0) {
+        break;
+      }
+      clientIx = (clientIx + 1) % nClients;
+    }
+    if (i == nClients) {
+      collectAcks();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    // create file with next messages
+    TR_file* f = TR_file_new();
+    f->id.source = checked_strdup(clientNames[clientIx].c_str());
+    f->id.majId = 1;
+    f->id.minId = nextId[clientIx]++;
+    double now = getTime();
+    f->clock = (int)((now - t0) * 1000);
+    int nMsg = batchSize;
+    if (rate > 0) {
+      // do not send in advance
+      int nLate = (int)((now - t0) * rate) - (int)ix + 1;
+      if (nLate < nMsg) {
+        nMsg = (nLate > 0) ? nLate : 1;
+      }
+    }
+    unsigned long long nBytes = 0, nMsgFile = 0;
+    size_t ixFile = ix;
+    for (int k = 0; (k < nMsg) && (ixFile < nTotal); k++, ixFile++) {
+      std::string data = blobs[ixFile % blobs.size()];
+      if (optTimestamp) {
+        std::string dataUpdated;
+        if (setTimestamp(data, now, dataUpdated) == 0) {
+          data = std::move(dataUpdated);
+        }
+      }
+      TR_blob* b = TR_blob_new(data.size());
+      memcpy(b->value, data.data(), b->size);
+      if (f->last == NULL) {
+        f->first = b;
+      } else {
+        f->last->next = b;
+      }
+      f->last = b;
+      f->size += b->size;
+      nBytes += b->size;
+      nMsgFile += blobMsgCount[ixFile % blobs.size()];
+      if ((b->size) && (((char*)b->value)[0] != '*')) {
+        f->options |= TR_OPTION_BINARY;
+      }
+    }
+    if (nMsgFile > 1) {
+      f->options |= TR_OPTION_BATCH;
+    }
+    if (TR_client_queueAddFile(clients[clientIx], f)) {
+      log.error("Failed to queue file");
+    } else {
+      nMsgSent += nMsgFile;
+      nBytesSent += nBytes;
+      ix = ixFile;
+      nFilesSent++;
+      nPending[clientIx]++;
+      lastSentTime = now;
+    }
+    TR_file_dec_usage(f);
+    clientIx = (clientIx + 1) % nClients;
+  }
+  double t1 = getTime();
+
+  // wait all files acknowledged
+  for (int i = 0; i < 6000; i++) {
+    collectAcks();
+    if (nFilesAcked == nFilesSent) {
+      break;
+    }
+    usleep(10000);
+  }
+  double t2 = getTime();
+
+  // wait all messages in database
+  double t3 = -1;
+  if (optDB) {
+    for (int i = 0; i < 600; i++) {
+      double t = getLastInsertTime();
+      double now = getTime();
+      if ((t >= t0) && (now - t > maxDBDelay)) {
+        maxDBDelay = now - t;
+      }
+      if (t >= lastSentTime - 0.000001) {
+        t3 = now;
+        break;
+      }
+      usleep(100000);
+    }
+  }
+
+  // transport statistics, before clients are stopped
+  int windowMin = -1, windowMax = -1, transportLatencyMax = -1;
+  for (auto h : clients) {
+    TR_client_stats stats;
+    if (TR_client_getStats(h, &stats) == 0) {
+      if ((windowMin < 0) || (stats.window < windowMin)) {
+        windowMin = stats.window;
+      }
+      if (stats.window > windowMax) {
+        windowMax = stats.window;
+      }
+      if (stats.ack_latency_max_ms > transportLatencyMax) {
+        transportLatencyMax = stats.ack_latency_max_ms;
+      }
+    }
+  }
+
+  for (auto h : clients) {
+    TR_client_stop(h);
+  }
+
+  // report
+  printf("Sent %llu messages (%.1f MB) in %llu files, in %.3f s: %.0f msg/s, %.1f MB/s\n", nMsgSent, nBytesSent / (1024.0 * 1024.0), nFilesSent, t1 - t0,
+         nMsgSent / (t1 - t0), nBytesSent / (1024.0 * 1024.0 * (t1 - t0)));
+  if (nFilesAcked == nFilesSent) {
+    printf("All acknowledged in %.3f s: ingest rate %.0f msg/s, %.1f MB/s\n", t2 - t0, nMsgSent / (t2 - t0), nBytesSent / (1024.0 * 1024.0 * (t2 - t0)));
+  } else {
+    printf("Timeout: %llu / %llu files acknowledged\n", nFilesAcked, nFilesSent);
+  }
+  if (ackDelays.size()) {
+    std::sort(ackDelays.begin(), ackDelays.end());
+    double sum = 0;
+    for (auto d : ackDelays) {
+      sum += d;
+    }
+    printf("Ack latency: avg %.3f ms, median %.3f ms, 99%% %.3f ms, max %.3f ms\n", sum * 1000 / ackDelays.size(), ackDelays[ackDelays.size() / 2] * 1000,
+           ackDelays[(ackDelays.size() * 99) / 100] * 1000, ackDelays.back() * 1000);
+  }
+  if (windowMax > 0) {
+    printf("Transport window: %d - %d files, max ack latency seen by transport %d ms\n", windowMin, windowMax, transportLatencyMax);
+  } else {
+    printf("Transport window not supported by server\n");
+  }
+  if (optDB) {
+    if (t3 > 0) {
+      printf("All inserted in database in %.3f s: insert rate %.0f msg/s, max insert delay %.3f s\n", t3 - t0, nMsgSent / (t3 - t0), maxDBDelay);
+    } else {
+      printf("Timeout: messages not all inserted in database, max insert delay seen %.3f s\n", maxDBDelay);
+    }
+#ifdef WITH_MYSQL
+    mysql_close(&db);
+#endif
+  }
+
+  return 0;
+}
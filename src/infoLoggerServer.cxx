@@ -16,6 +16,7 @@
 #include "simplelog.h"
 #include "infoLoggerMessageDecode.h"
 #include "InfoLoggerMessageList.h"
+#include "InfoLoggerDecodePool.h"
 #include "InfoLoggerDispatch.h"
 #include "InfoLoggerMessageHelper.h"
 
@@ -76,6 +77,9 @@ class InfoLoggerServer : public Daemon
   Daemon::LoopStatus doLoop();
 
  private:
+  void dumpFile(TR_file* f);                                                    // write copy of file received in dump file
+  void dispatchMessages(const std::shared_ptr<InfoLoggerMessageList>& msgList); // push decoded messages to dispatch engines
+
   ConfigInfoLoggerServer configInfoLoggerServer; // object for configuration parameters
 
   TR_server_configuration tcpServerConfig;
@@ -89,7 +93,9 @@ class InfoLoggerServer : public Daemon
   unsigned int dbRoundRobinIx = 0;
 
   unsigned long long msgCount = 0;
-  
+
+  std::unique_ptr<InfoLoggerDecodePool> decodePool; // threads to decode incoming messages, if enabled
+
   FILE *msgDump = nullptr;
 };
 
@@ -109,6 +115,7 @@ InfoLoggerServer::InfoLoggerServer(int argc, char* argv[]) : Daemon(argc, argv)
       tcpServerConfig.server_port = configInfoLoggerServer.serverPortRx;      // server port
       tcpServerConfig.max_clients = configInfoLoggerServer.maxClientsRx;      // max clients
       tcpServerConfig.queue_length = configInfoLoggerServer.msgQueueLengthRx; // queue size
+      tcpServerConfig.rx_threads = configInfoLoggerServer.rxNThreads;         // receiving threads
 
       tcpServerHandle = TR_server_start(&tcpServerConfig);
       if (tcpServerHandle == NULL) {
@@ -128,6 +135,12 @@ InfoLoggerServer::InfoLoggerServer(int argc, char* argv[]) : Daemon(argc, argv)
 	}
       }
 
+      // create decoding threads
+      if (configInfoLoggerServer.decodeNThreads > 0) {
+        log.info("Decoding messages with %d threads", configInfoLoggerServer.decodeNThreads);
+        decodePool = std::make_unique<InfoLoggerDecodePool>(configInfoLoggerServer.decodeNThreads, configInfoLoggerServer.decodeQueueSize);
+      }
+
       // create dispatch engines
       try {
         //dispatchEngines.push_back(std::make_unique<InfoLoggerDispatchPrint>(&log));
@@ -137,6 +150,10 @@ InfoLoggerServer::InfoLoggerServer(int argc, char* argv[]) : Daemon(argc, argv)
 	  dispatchEngines.push_back(std::make_unique<InfoLoggerDispatchStats>(&configInfoLoggerServer, &log));
 	}
 
+        if (configInfoLoggerServer.alertsRulesFile.length()) {
+          dispatchEngines.push_back(std::make_unique<InfoLoggerDispatchAlerts>(&configInfoLoggerServer, &log));
+        }
+
         if (configInfoLoggerServer.dbEnabled) {
 #ifdef WITH_MYSQL
           log.info("SQL DB initialization");
@@ -166,6 +183,7 @@ InfoLoggerServer::~InfoLoggerServer()
     if (tcpServerHandle != NULL) {
       TR_server_stop(tcpServerHandle);
     }
+    decodePool = nullptr;
 
     log.info("Received %llu messages", msgCount);
     if (msgDump != nullptr) {
@@ -174,12 +192,120 @@ InfoLoggerServer::~InfoLoggerServer()
   }
 }
 
+void InfoLoggerServer::dumpFile(TR_file* f)
+{
+  TR_blob* b;
+  for (b = f->first; b != NULL; b = b->next) {
+    fprintf(msgDump, "*** begin: %d bytes\n", (int)b->size);
+    fwrite(b->value, b->size, 1, msgDump);
+    fprintf(msgDump, "\n*** end\n");
+    fflush(msgDump);
+  }
+}
+
+void InfoLoggerServer::dispatchMessages(const std::shared_ptr<InfoLoggerMessageList>& msgList)
+{
+  //printf("got message\n");
+
+  // base dispatch engines
+  for (const auto& dispatch : dispatchEngines) {
+    dispatch->pushMessage(msgList);
+  }
+
+  // DB dispatch engine ... find one available, or wait
+  unsigned int nThreads = dispatchEnginesDB.size();
+  unsigned int nTry = 1;
+  int pushOk = 0;
+
+  // distribute message based on timestamp
+  // to try keeping messages inserted in same order when parallel insert
+  InfoLoggerMessageHelper h;
+  unsigned char * tptr= (unsigned char *) &msgList->msg->values[h.ix_timestamp].value.vDouble;
+  dbRoundRobinIx = (tptr[0] + tptr[1] + tptr[2] + tptr[3] + tptr[4] + tptr[5] + tptr[6] + tptr[7]) % nThreads;
+
+  for (; nTry <= nThreads * 3; nTry++) {
+    int err = dispatchEnginesDB[dbRoundRobinIx]->pushMessage(msgList);
+    dbRoundRobinIx++;
+    if (dbRoundRobinIx >= nThreads) {
+      dbRoundRobinIx = 0;
+    }
+    if (err == 0) {
+      pushOk = 1;
+      break;
+    }
+    if (nTry % nThreads == 0) {
+      //log.warning("Warning, DB busy, waiting...");
+      usleep(10000);
+      // todo: keep newFile for next loop iteration, in order not to get stuck in sleep here
+    }
+  }
+  if (!pushOk) {
+    log.warning("Warning DB dispatch full, 1 message lost");
+  }
+
+  // count messages
+  for (infoLog_msg_t* m = msgList->msg; m != nullptr; m = m->next) {
+    msgCount++;
+    /*
+    if (msgCount%1000==0) {
+      log.info("msg %llu",msgCount);
+    }
+    */
+  }
+  // todo: online analysis of message: set extra field (e.g. partition based on detector name and run, etc)
+  // dispatch message to online clients
+  // dispatch message to database, etc.
+}
+
 Daemon::LoopStatus InfoLoggerServer::doLoop()
 {
   if (!isInitialized) {
     return LoopStatus::Error;
   }
 
+  if (decodePool != nullptr) {
+    // read files from transport, and queue them for decoding
+    int nFiles = 0;
+    for (;;) {
+      if (decodePool->isFull()) {
+        break;
+      }
+      TR_file* newFile = TR_server_get_file(tcpServerHandle, 0);
+      if (newFile == NULL) {
+        break;
+      }
+      if (msgDump != nullptr) {
+        dumpFile(newFile);
+      }
+      if (decodePool->push(newFile)) {
+        // should not happen, pool size checked before
+        TR_server_ack_file(tcpServerHandle, &newFile->id);
+        TR_file_destroy(newFile);
+        continue;
+      }
+      nFiles++;
+    }
+
+    // dispatch decoded messages. Files from a given source come back in order, acknowledge them once dispatched.
+    // wait a bit for decoding to complete if nothing else to do
+    int nDecoded = 0;
+    InfoLoggerDecodePool::Result r;
+    while (!decodePool->pop(r, ((nFiles == 0) && (nDecoded == 0) && (decodePool->getPendingCount() > 0)) ? 10 : 0)) {
+      if (r.msgList != nullptr) {
+        dispatchMessages(r.msgList);
+      }
+      TR_server_ack_file(tcpServerHandle, &r.file->id);
+      TR_file_destroy(r.file);
+      r.msgList = nullptr;
+      nDecoded++;
+    }
+
+    if ((nFiles == 0) && (nDecoded == 0) && (decodePool->getPendingCount() == 0)) {
+      return LoopStatus::Idle;
+    }
+    return LoopStatus::Ok;
+  }
+
   // read a file from transport (collection of messages, with a format depending on the transport used)
   TR_file* newFile;
   newFile = TR_server_get_file(tcpServerHandle, 0);
@@ -190,13 +316,7 @@ Daemon::LoopStatus InfoLoggerServer::doLoop()
 
     // dump new message
     if (msgDump != nullptr) {
-      TR_blob* b;
-      for (b = newFile->first; b != NULL; b = b->next) {
-        fprintf(msgDump, "*** begin: %d bytes\n", (int)b->size);
-	fwrite(b->value, b->size, 1, msgDump);
-	fprintf(msgDump, "\n*** end\n");
-	fflush(msgDump);
-      }
+      dumpFile(newFile);
     }
 
     // decode raw message
@@ -208,56 +328,7 @@ Daemon::LoopStatus InfoLoggerServer::doLoop()
     }
 
     if (msgList != nullptr) {
-      //printf("got message\n");
-
-      // base dispatch engines
-      for (const auto& dispatch : dispatchEngines) {
-        dispatch->pushMessage(msgList);
-      }
-
-      // DB dispatch engine ... find one available, or wait
-      unsigned int nThreads = dispatchEnginesDB.size();
-      unsigned int nTry = 1;
-      int pushOk = 0;
-
-      // distribute message based on timestamp
-      // to try keeping messages inserted in same order when parallel insert
-      InfoLoggerMessageHelper h;
-      unsigned char * tptr= (unsigned char *) &msgList->msg->values[h.ix_timestamp].value.vDouble;
-      dbRoundRobinIx = (tptr[0] + tptr[1] + tptr[2] + tptr[3] + tptr[4] + tptr[5] + tptr[6] + tptr[7]) % nThreads;
-
-      for (; nTry <= nThreads * 3; nTry++) {
-        int err = dispatchEnginesDB[dbRoundRobinIx]->pushMessage(msgList);
-        dbRoundRobinIx++;
-        if (dbRoundRobinIx >= nThreads) {
-          dbRoundRobinIx = 0;
-        }
-        if (err == 0) {
-          pushOk = 1;
-          break;
-        }
-        if (nTry % nThreads == 0) {
-          //log.warning("Warning, DB busy, waiting...");
-          usleep(10000);
-          // todo: keep newFile for next loop iteration, in order not to get stuck in sleep here
-        }
-      }
-      if (!pushOk) {
-        log.warning("Warning DB dispatch full, 1 message lost");
-      }
-
-      // count messages
-      for (infoLog_msg_t* m = msgList->msg; m != nullptr; m = m->next) {
-        msgCount++;
-        /*
-        if (msgCount%1000==0) {
-          log.info("msg %llu",msgCount);
-        }
-        */
-      }
-      // todo: online analysis of message: set extra field (e.g. partition based on detector name and run, etc)
-      // dispatch message to online clients
-      // dispatch message to database, etc.
+      dispatchMessages(msgList);
     }
   }
 
@@ -24,6 +24,9 @@
 #include <ctype.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/mman.h>
 
 #include "permanentFIFO.h"
 #include "utility.h"
@@ -51,27 +54,55 @@ void debug(const char* const msg, ...)
 
 /** implementation of a thread safe FIFO with wait / sync, storing pointers to void */
 
-#define FIFO_FILE_TAG 1234  /* a static header to mark fifo structs */
-#define FIFO_FILE_PERM 0666 /* file permission for fifo - use all r/w as infologgerreader started by unknown user */
-
-/* FIFO file format stored on disk:
-   - main header
-   - sub header 1
-   - data 1
-   - sub header 2
-   - data 2
-   - ...
+#define FIFO_FILE_TAG 1234     /* a static header to mark fifo structs */
+#define FIFO_FILE_TAG_ACK 1236 /* a static header to mark fifo ack file */
+#define FIFO_SEGMENT_TAG 1237  /* a static header to mark fifo segment files */
+#define FIFO_FILE_PERM 0666    /* file permission for fifo - use all r/w as infologgerreader started by unknown user */
+
+#define FIFO_SEGMENT_SIZE (16 * 1024 * 1024) /* size of segment files (bigger if needed for a large item) */
+#define FIFO_SEGMENT_ALIGN 8                 /* items in segment files are aligned on this size */
+#define FIFO_SEGMENT_DIGITS 12               /* number of digits of sequence number in segment file names */
+
+/* FIFO files stored on disk:
+   - path.fifo : ack file, containing the id of the last item acknowledged
+   - path.fifo.000000000001, path.fifo.000000000002, ... : segment files, of fixed size, mapped in memory.
+     Each one contains:
+       - segment header
+       - sub header 1
+       - data 1 (padded to FIFO_SEGMENT_ALIGN)
+       - sub header 2
+       - data 2
+       - ...
+       - zeros (unused space)
+   Segments are filled one after the other. A new one is started when current is full, and on each startup.
+   Sub header tag is written last, so that an item not fully written (crash) is ignored.
+   Segments with all items acknowledged are removed.
+   Ids stored on disk always increase, ids of FIFO items are the ones on disk minus idBase, which is
+   set at startup to the last id acknowledged (so that FIFO ids restart from 1 without rewriting files).
+
+   Older format: a single file path.fifo, containing main header, then sub header / data pairs.
+   It is converted to segments on startup.
 */
 
-/* struct at the beginning of a FIFO file */
+/* struct at the beginning of a FIFO file (older format) */
 struct FIFO_file_main_header {
   int tag;                 /* a static header */
   unsigned long lastAckId; /* last id acknowledged */
   unsigned long currentId; /* biggest item id used */
 };
 
-/* a variable to define default value */
-static struct FIFO_file_main_header FIFOFILE_DEFAULT_MAIN_HEADER = { FIFO_FILE_TAG, 0, 0 };
+/* struct stored in FIFO ack file */
+struct FIFO_file_ack {
+  int tag;                 /* a static header */
+  unsigned long lastAckId; /* id on disk of last item acknowledged */
+};
+
+/* struct at the beginning of a FIFO segment file */
+struct FIFO_file_segment_header {
+  int tag;               /* a static header */
+  unsigned long seq;     /* sequence number of this segment */
+  unsigned long firstId; /* id on disk of first item in this segment */
+};
 
 /* struct delimiting data blocks in a FIFO file */
 struct FIFO_file_sub_header {
@@ -83,6 +114,12 @@ struct FIFO_file_sub_header {
 /* a variable to define default value */
 static struct FIFO_item EMPTY_FIFO_ITEM = { 0, NULL, 0 };
 
+/* description of a segment file, as stored in FIFO index of segments */
+struct FIFO_segment {
+  unsigned long seq;     /* sequence number */
+  unsigned long firstId; /* id on disk of first item */
+};
+
 /* definition of circular table, used to implement FIFO structs in memory */
 struct circular_table {
   int size;                /* FIFO size */
@@ -97,21 +134,45 @@ struct permFIFO {
   struct circular_table* table_client; /* table containing data available for FIFO consumer */
   struct circular_table* table_disk;   /* table containing data to be saved on disk */
 
-  int fd;                  /* file descriptor of FIFO file buffer */
+  char* path;              /* path to FIFO files (NULL if not on disk) */
+  int fd;                  /* file descriptor of FIFO ack file */
   unsigned long currentId; /* last id used */
+  unsigned long idBase;    /* ids on disk are FIFO ids + idBase */
 
   pthread_mutex_t mutex; /* mutex to access FIFO */
   pthread_cond_t cond;   /* condition signaled when data available to read in FIFO */
 
   unsigned long lastIdOut;           /* id of the last item read from FIFO by client */
-  off_t lastOutOffset;               /* position in file of the next item after the last one read by client */
   unsigned long nextIdInClientTable; /* id of the next item that should be inserted in client table */
   unsigned long lastIdOnDisk;        /* id of the last item stored on disk */
   int ackOnDisk;                     /* when some ack should be done on disk */
 
   time_t lastFlush; /* time of last flush to disk */
+
+  struct FIFO_segment* segments; /* index of segment files on disk, oldest first */
+  int segmentsSize;              /* number of entries allocated in segments */
+  int segmentsFirst;             /* index of first valid entry */
+  int segmentsCount;             /* number of valid entries */
+  unsigned long nextSeq;         /* sequence number of next segment to be created */
+
+  int writeFd;        /* file descriptor of segment being written (the last one), -1 if none */
+  char* writeMap;     /* segment being written, mapped in memory */
+  size_t writeSize;   /* size of segment being written */
+  size_t writeOffset; /* position in segment of next item to write */
+  size_t syncOffset;  /* data of segment being written is synced up to this position */
+
+  unsigned long readSeq; /* sequence number of segment being read */
+  char* readMap;         /* segment being read, mapped in memory (NULL if none) */
+  size_t readSize;       /* size of segment being read */
+  size_t readOffset;     /* position in segment of the next item after the last one read by client */
+
+  int syncPolicy;   /* when to sync data to disk (PERMFIFO_SYNC_...) */
+  int syncInterval; /* minimum time between sync (seconds), for PERMFIFO_SYNC_INTERVAL */
+  int syncPending;  /* set when data written but not synced yet */
+  time_t lastSync;  /* time of last sync */
 };
 
+
 /* This function creates FIFO file names from path. Result stored as a NULL terminated string in current, old, new pointers. */
 /* Strings are allocated with checked_malloc, to be release with checked_free */
 
@@ -135,63 +196,330 @@ void permFIFO_getFileName(char* path, char** current, char** old, char** new)
   }
 }
 
-/* Dumps the content of "on disk" FIFO file, which is used for permanent storage of a memory FIFO */
-int permFIFO_file_dump(char* path)
+
+/* This function creates the name of a FIFO segment file from path and segment sequence number. */
+/* String is allocated with checked_malloc, to be release with checked_free */
+static char* permFIFO_getSegmentName(const char* path, unsigned long seq)
+{
+  int size;
+  char* name;
+
+  size = strlen(path) + FIFO_SEGMENT_DIGITS + 10;
+  name = (char*)checked_malloc(sizeof(char) * size);
+  if (name != NULL) {
+    snprintf(name, size, "%s.fifo.%0*lu", path, FIFO_SEGMENT_DIGITS, seq);
+  }
+  return name;
+}
+
+static int permFIFO_compareSeq(const void* a, const void* b)
+{
+  unsigned long sa = *(const unsigned long*)a;
+  unsigned long sb = *(const unsigned long*)b;
+  return (sa > sb) - (sa < sb);
+}
+
+/* Get the directory of FIFO files from path, allocated with checked_malloc (to be released with checked_free).
+   If baseName not NULL, it is set to point to the file name prefix in path.
+*/
+static char* permFIFO_getDirName(const char* path, const char** baseName)
+{
+  char* dirName;
+  const char* ptr;
+
+  ptr = strrchr(path, '/');
+  if (ptr == NULL) {
+    dirName = checked_strdup(".");
+    ptr = path;
+  } else {
+    dirName = checked_strdup(path);
+    if (dirName != NULL) {
+      dirName[(ptr == path) ? 1 : (ptr - path)] = 0;
+    }
+    ptr++;
+  }
+  if (baseName != NULL) {
+    *baseName = ptr;
+  }
+  return dirName;
+}
+
+/* List the segment files existing for a FIFO.
+   Sequence numbers are returned in *seqs, sorted, allocated with checked_malloc (to be released with checked_free).
+   Returns the number of segments, or -1 on error.
+*/
+static int permFIFO_listSegments(const char* path, unsigned long** seqs)
+{
+  char* dirName;
+  const char* baseName;
+  int baseLength;
+  DIR* dir;
+  struct dirent* entry;
+  unsigned long* list = NULL;
+  unsigned long* newList;
+  int listSize = 0;
+  int n = 0;
+  int i;
+
+  *seqs = NULL;
+
+  dirName = permFIFO_getDirName(path, &baseName);
+  if (dirName == NULL) {
+    return -1;
+  }
+  baseLength = strlen(baseName);
+
+  dir = opendir(dirName);
+  checked_free(dirName);
+  if (dir == NULL) {
+    return -1;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    /* look for baseName.fifo.[digits] */
+    if (strncmp(entry->d_name, baseName, baseLength) || strncmp(&entry->d_name[baseLength], ".fifo.", 6)) {
+      continue;
+    }
+    const char* suffix = &entry->d_name[baseLength + 6];
+    if (strlen(suffix) != FIFO_SEGMENT_DIGITS) {
+      continue;
+    }
+    for (i = 0; i < FIFO_SEGMENT_DIGITS; i++) {
+      if (!isdigit((unsigned char)suffix[i])) {
+        break;
+      }
+    }
+    if (i != FIFO_SEGMENT_DIGITS) {
+      continue;
+    }
+    if (n == listSize) {
+      listSize = (listSize) ? listSize * 2 : 64;
+      newList = (unsigned long*)checked_malloc(sizeof(unsigned long) * listSize);
+      if (newList == NULL) {
+        checked_free(list);
+        closedir(dir);
+        return -1;
+      }
+      if (n) {
+        memcpy(newList, list, sizeof(unsigned long) * n);
+      }
+      checked_free(list);
+      list = newList;
+    }
+    list[n++] = strtoul(suffix, NULL, 10);
+  }
+  closedir(dir);
+
+  if (n) {
+    qsort(list, n, sizeof(unsigned long), permFIFO_compareSeq);
+  }
+  *seqs = list;
+  return n;
+}
+
+/* Read the main header of a FIFO file in older format.
+   fd should be positionned at the beginning of the file. On success, it is left after the header.
+   Returns 0 on success, 1 if file is empty, -1 if header is not valid.
+*/
+static int permFIFO_read_main_header(int fd, struct FIFO_file_main_header* hm)
+{
+  ssize_t bytes;
+
+  hm->tag = 0;
+  hm->lastAckId = 0;
+  hm->currentId = 0;
+  bytes = read(fd, hm, sizeof(*hm));
+  if (bytes == 0)
+    return 1;
+  if ((bytes != sizeof(*hm)) || (hm->tag != FIFO_FILE_TAG))
+    return -1;
+  return 0;
+}
+
+/* Map a segment file in memory (read-only). Returns address, or NULL on error. Size of segment is returned in *size. */
+static char* permFIFO_mapSegment(const char* path, unsigned long seq, size_t* size)
 {
   char* filename;
   int fd;
-  struct FIFO_file_main_header hm;
-  struct FIFO_file_sub_header hs;
-  unsigned int bytes;
-  void* data;
+  struct stat statbuf;
+  void* map;
 
-  /* open FIFO file */
+  filename = permFIFO_getSegmentName(path, seq);
+  if (filename == NULL)
+    return NULL;
+  fd = open(filename, O_RDONLY);
+  checked_free(filename);
+  if (fd == -1)
+    return NULL;
+  if ((fstat(fd, &statbuf)) || (statbuf.st_size < (off_t)sizeof(struct FIFO_file_segment_header))) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+  *size = statbuf.st_size;
+  return (char*)map;
+}
+
+/* Get the item at given position in a mapped segment. Returns NULL if none (end of valid data). */
+static struct FIFO_file_sub_header* permFIFO_segmentItem(char* map, size_t size, size_t offset)
+{
+  struct FIFO_file_sub_header* hs;
+
+  if (offset + sizeof(struct FIFO_file_sub_header) > size)
+    return NULL;
+  hs = (struct FIFO_file_sub_header*)&map[offset];
+  if (__atomic_load_n(&hs->tag, __ATOMIC_ACQUIRE) != FIFO_FILE_TAG)
+    return NULL;
+  if (hs->size > size - offset - sizeof(struct FIFO_file_sub_header))
+    return NULL;
+  return hs;
+}
+
+/* Size used in a segment by an item with given data size */
+static size_t permFIFO_segmentItemSize(unsigned long size)
+{
+  return (sizeof(struct FIFO_file_sub_header) + size + FIFO_SEGMENT_ALIGN - 1) & ~((size_t)FIFO_SEGMENT_ALIGN - 1);
+}
+
+/* Dumps the content of "on disk" FIFO files, which are used for permanent storage of a memory FIFO */
+int permFIFO_file_dump(char* path)
+{
+  char* filename;
+  int fd;
+  struct FIFO_file_ack ha;
+  struct FIFO_file_segment_header* hseg;
+  struct FIFO_file_sub_header* hs;
+  unsigned long* seqs;
+  char* map;
+  size_t size, offset;
+  int i, n;
+
+  /* read ack file */
   permFIFO_getFileName(path, &filename, NULL, NULL);
   fd = open(filename, O_RDONLY);
   checked_free(filename);
   if (fd == -1)
     return 1;
-
-  /* read file header */
-  hm.tag = 0;
-  hm.lastAckId = 0;
-  if (read(fd, &hm, sizeof(hm)) != sizeof(hm))
+  if (read(fd, &ha, sizeof(ha)) != sizeof(ha))
     return 2;
-  if (hm.tag != FIFO_FILE_TAG)
+  close(fd);
+  if (ha.tag != FIFO_FILE_TAG_ACK)
     return 3;
 
   printf("FIFO file dump %s\n", path);
-  printf("Header ok : lastAckId = %ld, currentId = %ld\n", hm.lastAckId, hm.currentId);
-
-  /* read file data */
-  for (;;) {
-    /* read sub header */
-    bytes = read(fd, &hs, sizeof(hs));
-    if (bytes == 0)
-      break; /* end of file */
-    if (bytes != sizeof(hs))
-      return 4;
-    if (hs.tag != FIFO_FILE_TAG)
+  printf("Header ok : lastAckId = %ld\n", ha.lastAckId);
+
+  /* read segments */
+  n = permFIFO_listSegments(path, &seqs);
+  if (n < 0)
+    return 4;
+  for (i = 0; i < n; i++) {
+    map = permFIFO_mapSegment(path, seqs[i], &size);
+    if (map == NULL) {
+      checked_free(seqs);
       return 5;
-
-    /* read data */
-    data = checked_malloc(hs.size);
-    printf("pos = %ld\n", (long)lseek(fd, 0, SEEK_CUR));
-    bytes = read(fd, data, hs.size);
-    if (bytes != hs.size)
-      return 6;
-    printf("Data : id = %ld, size = %ld, value = %s\n", hs.id, hs.size, (char*)data);
-    checked_free(data);
+    }
+    hseg = (struct FIFO_file_segment_header*)map;
+    printf("Segment %lu : tag %s, firstId = %lu, size = %lu\n", seqs[i], (hseg->tag == FIFO_SEGMENT_TAG) ? "ok" : "bad", hseg->firstId, (unsigned long)size);
+    for (offset = sizeof(struct FIFO_file_segment_header); (hs = permFIFO_segmentItem(map, size, offset)) != NULL; offset += permFIFO_segmentItemSize(hs->size)) {
+      printf("Data : pos = %lu, id = %ld, size = %ld, value = %.*s\n", (unsigned long)offset, hs->id, hs->size, (int)hs->size, (char*)&hs[1]);
+    }
+    munmap(map, size);
   }
-
-  /* close file */
-  close(fd);
+  checked_free(seqs);
 
   printf("FIFO file is ok\n");
 
   return 0;
 }
 
+/* Get the amount of disk space used by a FIFO (bytes). Returns -1 if no FIFO file found. */
+long long permFIFO_file_size(char* path)
+{
+  char* filename;
+  struct stat statbuf;
+  unsigned long* seqs;
+  long long total = -1;
+  int i, n;
+
+  permFIFO_getFileName(path, &filename, NULL, NULL);
+  if (stat(filename, &statbuf) == 0) {
+    total = statbuf.st_blocks * 512LL;
+  }
+  checked_free(filename);
+
+  n = permFIFO_listSegments(path, &seqs);
+  for (i = 0; i < n; i++) {
+    filename = permFIFO_getSegmentName(path, seqs[i]);
+    if ((filename != NULL) && (stat(filename, &statbuf) == 0)) {
+      if (total < 0) {
+        total = 0;
+      }
+      total += statbuf.st_blocks * 512LL;
+    }
+    checked_free(filename);
+  }
+  checked_free(seqs);
+
+  return total;
+}
+
+/* Remove files of a FIFO (pending items are lost). Returns 0 on success, or -1 if some files could not be removed. */
+int permFIFO_file_remove(char* path)
+{
+  char* filename;
+  unsigned long* seqs;
+  int i, n;
+  int err = 0;
+
+  permFIFO_getFileName(path, &filename, NULL, NULL);
+  if ((unlink(filename)) && (errno != ENOENT)) {
+    err = -1;
+  }
+  checked_free(filename);
+
+  n = permFIFO_listSegments(path, &seqs);
+  for (i = 0; i < n; i++) {
+    filename = permFIFO_getSegmentName(path, seqs[i]);
+    if ((filename == NULL) || (unlink(filename))) {
+      err = -1;
+    }
+    checked_free(filename);
+  }
+  checked_free(seqs);
+
+  return err;
+}
+
+/* Rename files of a FIFO with a timestamp suffix, so that a fresh one can be started. */
+static void permFIFO_file_backup(char* path)
+{
+  char* filename;
+  char backupName[PATH_MAX];
+  unsigned long* seqs;
+  unsigned int bTime = (unsigned int)time(NULL);
+  int i, n;
+
+  slog(SLOG_INFO, "Backup suffix = %u", bTime);
+
+  permFIFO_getFileName(path, &filename, NULL, NULL);
+  snprintf(backupName, sizeof(backupName), "%s.%u", filename, bTime);
+  rename(filename, backupName);
+  checked_free(filename);
+
+  n = permFIFO_listSegments(path, &seqs);
+  for (i = 0; i < n; i++) {
+    filename = permFIFO_getSegmentName(path, seqs[i]);
+    if (filename != NULL) {
+      snprintf(backupName, sizeof(backupName), "%s.%u", filename, bTime);
+      rename(filename, backupName);
+    }
+    checked_free(filename);
+  }
+  checked_free(seqs);
+}
 /******************************************************************/
 /* The construction block of a FIFO is a circular table structure */
 /******************************************************************/
@@ -288,118 +616,291 @@ int ct_read(struct circular_table* t, struct FIFO_item* item)
   return 0;
 }
 
-/* save disk buffer to a file */
-/* fd is positionned at the end of the file */
-int ct_save(int fd, struct circular_table* t)
+/******************************************************************/
+/* Segment files, used to store FIFO items on disk               */
+/******************************************************************/
+
+/* sync directory of FIFO files, so that files created are persistent */
+static void permFIFO_syncDir(const char* path)
 {
-  struct FIFO_item item;
-  struct FIFO_file_sub_header hs;
+  char* dirName;
+  int fd;
 
-  if (t == NULL)
-    return -1;
-  if (fd == -1)
-    return -1;
+  dirName = permFIFO_getDirName(path, NULL);
+  if (dirName == NULL)
+    return;
+  fd = open(dirName, O_RDONLY | O_DIRECTORY);
+  checked_free(dirName);
+  if (fd != -1) {
+    fsync(fd);
+    close(fd);
+  }
+}
 
-  hs.tag = FIFO_FILE_TAG;
+/* add a segment at the end of FIFO index of segments. Returns 0 on success, -1 on error */
+static int permFIFO_addSegment(struct permFIFO* f, unsigned long seq, unsigned long firstId)
+{
+  struct FIFO_segment* newSegments;
+  int newSize;
+
+  if (f->segmentsFirst + f->segmentsCount == f->segmentsSize) {
+    if (f->segmentsFirst > f->segmentsSize / 2) {
+      /* reuse space of removed entries */
+      memmove(f->segments, &f->segments[f->segmentsFirst], sizeof(struct FIFO_segment) * f->segmentsCount);
+      f->segmentsFirst = 0;
+    } else {
+      newSize = (f->segmentsSize) ? f->segmentsSize * 2 : 64;
+      newSegments = checked_malloc(sizeof(struct FIFO_segment) * newSize);
+      if (newSegments == NULL)
+        return -1;
+      if (f->segmentsCount) {
+        memcpy(newSegments, &f->segments[f->segmentsFirst], sizeof(struct FIFO_segment) * f->segmentsCount);
+      }
+      checked_free(f->segments);
+      f->segments = newSegments;
+      f->segmentsSize = newSize;
+      f->segmentsFirst = 0;
+    }
+  }
+  f->segments[f->segmentsFirst + f->segmentsCount].seq = seq;
+  f->segments[f->segmentsFirst + f->segmentsCount].firstId = firstId;
+  f->segmentsCount++;
+  return 0;
+}
 
-  if (lseek(fd, 0, SEEK_END) == -1)
-    return -2;
+/* sync data of segment being written, if needed by policy (or whenever some data not synced yet, if force set) */
+static void permFIFO_sync(struct permFIFO* f, int force)
+{
+  time_t now;
+  size_t start;
 
-  for (;;) {
-    if (ct_read(t, &item))
-      break;
-    //  debug("save: id=%ld val=*%s* size=%ld\n",item.id,(char *)item.data,item.size);
-    hs.size = item.size;
-    hs.id = item.id;
-    if ((item.size == 0) || (item.data == NULL))
-      continue;
-    if (write(fd, &hs, sizeof(hs)) != sizeof(hs)) {
+  if ((!f->syncPending) || (f->syncPolicy == PERMFIFO_SYNC_NONE))
+    return;
+  now = time(NULL);
+  if ((f->syncPolicy == PERMFIFO_SYNC_INTERVAL) && (now < f->lastSync + f->syncInterval) && (!force))
+    return;
+  if ((f->writeMap != NULL) && (f->writeOffset > f->syncOffset)) {
+    start = f->syncOffset & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+    if (msync(&f->writeMap[start], f->writeOffset - start, MS_SYNC)) {
+      slog(SLOG_ERROR, "FIFO file sync failed: %s", strerror(errno));
     }
-    if (write(fd, item.data, hs.size) != (long long)hs.size) {
+    f->syncOffset = f->writeOffset;
+  }
+  f->syncPending = 0;
+  f->lastSync = now;
+}
+
+/* release segment being written. Data not synced yet is synced first if doSync set. */
+static void permFIFO_closeWriteSegment(struct permFIFO* f, int doSync)
+{
+  size_t start;
+
+  if (f->writeMap == NULL)
+    return;
+  if ((doSync) && (f->writeOffset > f->syncOffset)) {
+    start = f->syncOffset & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+    if (msync(&f->writeMap[start], f->writeOffset - start, MS_SYNC)) {
+      slog(SLOG_ERROR, "FIFO file sync failed: %s", strerror(errno));
     }
-    checked_free(item.data);
   }
+  munmap(f->writeMap, f->writeSize);
+  close(f->writeFd);
+  f->writeMap = NULL;
+  f->writeFd = -1;
+  f->writeSize = 0;
+  f->writeOffset = 0;
+  f->syncOffset = 0;
+}
 
-  return 0;
+/* remove the oldest segment (file and index entry) */
+static void permFIFO_removeFirstSegment(struct permFIFO* f)
+{
+  struct FIFO_segment* s;
+  char* filename;
+
+  if (f->segmentsCount == 0)
+    return;
+  s = &f->segments[f->segmentsFirst];
+  if ((f->readMap != NULL) && (f->readSeq == s->seq)) {
+    munmap(f->readMap, f->readSize);
+    f->readMap = NULL;
+  }
+  if (f->segmentsCount == 1) {
+    /* this is the one being written, if any */
+    permFIFO_closeWriteSegment(f, 0);
+  }
+  filename = permFIFO_getSegmentName(f->path, s->seq);
+  if (filename != NULL) {
+    if (unlink(filename)) {
+      slog(SLOG_ERROR, "Failed to remove %s: %s", filename, strerror(errno));
+    }
+    checked_free(filename);
+  }
+  f->segmentsFirst++;
+  f->segmentsCount--;
+  if (f->segmentsCount == 0) {
+    f->segmentsFirst = 0;
+  }
 }
 
-/* read table from a file */
-/* fd should be positionned with correct offset to read from, should point at a "FIFO_file_sub_header" structure */
-/* if "id" non zero, skip records with lower id until the one is found */
-int ct_load(int fd, struct circular_table* t, unsigned long id)
+/* create a new segment to write items, starting with given id, with room for at least minSize bytes. Returns 0 on success, -1 on error */
+static int permFIFO_newSegment(struct permFIFO* f, unsigned long firstId, size_t minSize)
 {
-  struct FIFO_item item;
-  struct FIFO_file_sub_header hs;
-  unsigned int bytes;
-  int n_read = 0;
+  char* filename;
+  struct FIFO_file_segment_header* hseg;
+  size_t size;
+  size_t pageSize;
+  void* map = MAP_FAILED;
+  int fd;
+  int err;
 
-  if (t == NULL)
+  permFIFO_closeWriteSegment(f, f->syncPolicy != PERMFIFO_SYNC_NONE);
+
+  size = FIFO_SEGMENT_SIZE;
+  minSize += sizeof(struct FIFO_file_segment_header);
+  if (size < minSize) {
+    pageSize = sysconf(_SC_PAGESIZE);
+    size = ((minSize + pageSize - 1) / pageSize) * pageSize;
+  }
+
+  filename = permFIFO_getSegmentName(f->path, f->nextSeq);
+  if (filename == NULL)
     return -1;
-  if (fd == -1)
+  fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, FIFO_FILE_PERM);
+  if (fd == -1) {
+    slog(SLOG_ERROR, "Failed to create %s: %s", filename, strerror(errno));
+    checked_free(filename);
     return -1;
+  }
+  fchmod(fd, FIFO_FILE_PERM);
+
+  /* allocate disk space now, so that writing to memory does not fail later (e.g. disk full) */
+  err = posix_fallocate(fd, 0, size);
+  if (!err) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      err = errno;
+    }
+  }
+  if ((!err) && (permFIFO_addSegment(f, f->nextSeq, firstId))) {
+    err = ENOMEM;
+  }
+  if (err) {
+    slog(SLOG_ERROR, "Failed to create %s: %s", filename, strerror(err));
+    if (map != MAP_FAILED) {
+      munmap(map, size);
+    }
+    close(fd);
+    unlink(filename);
+    checked_free(filename);
+    return -1;
+  }
+  checked_free(filename);
 
-  /* read file data */
-  for (;;) {
+  hseg = (struct FIFO_file_segment_header*)map;
+  hseg->seq = f->nextSeq;
+  hseg->firstId = firstId;
+  __atomic_store_n(&hseg->tag, FIFO_SEGMENT_TAG, __ATOMIC_RELEASE);
+  f->nextSeq++;
+
+  f->writeFd = fd;
+  f->writeMap = (char*)map;
+  f->writeSize = size;
+  f->writeOffset = sizeof(struct FIFO_file_segment_header);
+  f->syncOffset = 0;
+  f->syncPending = 1;
+
+  if (f->syncPolicy != PERMFIFO_SYNC_NONE) {
+    /* new file should be found after a crash */
+    fdatasync(fd);
+    permFIFO_syncDir(f->path);
+  }
 
-    /* check space in table */
-    if (t->n_items == t->size)
-      return -3;
+  return 0;
+}
 
-    /* read sub header */
-    bytes = read(fd, &hs, sizeof(hs));
-    if (bytes == 0)
-      break; /* end of file */
-    if (bytes != sizeof(hs)) {
-      slog(SLOG_ERROR, "read %d bytes %s\n", bytes, strerror(errno));
-      return 4;
-    }
+/* write an item at the end of segments. Returns 0 on success, -1 on error */
+static int permFIFO_writeItem(struct permFIFO* f, unsigned long id, void* data, unsigned long size)
+{
+  struct FIFO_file_sub_header* hs;
+  size_t itemSize;
 
-    int i;
-    for (i = 0; i < (int)sizeof(hs); i++) {
-      debug("%d \n", (int)(((char*)&hs)[i]));
-    }
-    debug("FIFO TAG=%d\n", FIFO_FILE_TAG);
-    debug("read tag: %d\n", hs.tag);
-    debug("read size: %u\n", hs.size);
-    debug("read id: %u\n", hs.id);
-    if (hs.tag != FIFO_FILE_TAG)
-      return 5;
+  itemSize = permFIFO_segmentItemSize(size);
+  if ((f->writeMap == NULL) || (f->writeOffset + itemSize > f->writeSize)) {
+    if (permFIFO_newSegment(f, id, itemSize))
+      return -1;
+  }
 
-    /* check/look for good id */
-    if (id) {
-      if (hs.id < id) {
-        /* skip this one */
-        if (lseek(fd, hs.size, SEEK_CUR) == (off_t)-1) {
-          return 7;
-        }
-        continue;
-      }
-    }
+  /* tag is set last, item is valid only when complete */
+  hs = (struct FIFO_file_sub_header*)&f->writeMap[f->writeOffset];
+  hs->size = size;
+  hs->id = id;
+  memcpy(&hs[1], data, size);
+  __atomic_store_n(&hs->tag, FIFO_FILE_TAG, __ATOMIC_RELEASE);
 
-    /* read data */
-    item.data = checked_malloc(hs.size);
-    item.size = hs.size;
-    item.id = hs.id;
+  f->writeOffset += itemSize;
+  f->syncPending = 1;
+  return 0;
+}
 
-    if (item.data == NULL) {
-      return -2;
-    }
-    bytes = read(fd, item.data, hs.size);
-    // debug("data read (%d bytes) : %s\n",bytes,(char *)item.data);
+/* load items from segments to client table, starting from current read position, and with id >= given one.
+   Returns 0 on success, -1 on error.
+*/
+static int permFIFO_loadSegments(struct permFIFO* f, unsigned long id)
+{
+  struct circular_table* t = f->table_client;
+  struct FIFO_file_sub_header* hs;
+  struct FIFO_item item;
+  unsigned long diskId = id + f->idBase;
+  int i;
+  int n_read = 0;
 
-    if (bytes != hs.size) {
-      checked_free(item.data);
-      return 6;
+  while (t->n_items < t->size) {
+    if (f->readMap == NULL) {
+      /* map first segment not fully read */
+      for (i = 0; i < f->segmentsCount; i++) {
+        if (f->segments[f->segmentsFirst + i].seq >= f->readSeq)
+          break;
+      }
+      if (i == f->segmentsCount)
+        break;
+      if (f->segments[f->segmentsFirst + i].seq != f->readSeq) {
+        f->readSeq = f->segments[f->segmentsFirst + i].seq;
+        f->readOffset = sizeof(struct FIFO_file_segment_header);
+      }
+      f->readMap = permFIFO_mapSegment(f->path, f->readSeq, &f->readSize);
+      if (f->readMap == NULL) {
+        slog(SLOG_ERROR, "Failed to read FIFO segment %lu", f->readSeq);
+        return -1;
+      }
     }
 
-    // debug("disk read : found item %lu, size=%lu, data = %s\n",item.id,item.size,(char *)item.data);
+    hs = permFIFO_segmentItem(f->readMap, f->readSize, f->readOffset);
+    if (hs != NULL) {
+      if (hs->id >= diskId) {
+        item.size = hs->size;
+        item.id = hs->id - f->idBase;
+        item.data = checked_malloc(hs->size);
+        if (item.data == NULL)
+          return -1;
+        memcpy(item.data, &hs[1], hs->size);
+        if (ct_write(t, &item)) {
+          checked_free(item.data);
+          break;
+        }
+        n_read++;
+      }
+      f->readOffset += permFIFO_segmentItemSize(hs->size);
+      continue;
+    }
 
-    if (ct_write(t, &item)) {
-      // debug("data %s failed to table\n",(char *)item.data);
-      checked_free(item.data);
+    /* end of valid data in this segment: continue with next one, if any */
+    if ((f->segmentsCount == 0) || (f->readSeq >= f->segments[f->segmentsFirst + f->segmentsCount - 1].seq))
       break;
-    }
-    n_read++;
+    munmap(f->readMap, f->readSize);
+    f->readMap = NULL;
+    f->readSeq++;
+    f->readOffset = sizeof(struct FIFO_file_segment_header);
   }
 
   debug("%d items loaded from disk\n", n_read);
@@ -407,203 +908,291 @@ int ct_load(int fd, struct circular_table* t, unsigned long id)
   return 0;
 }
 
-/******************************************************************/
-/* End of circular table functions                                */
-/******************************************************************/
-
-/* Clean fifo file:
-     - keep only non-ack data
-     - reassign id numbers starting from zero
-   It is required that the fifo is not in use at the time this function is called.
-   When doBackup set, existing fifo files removed (saved to timestamped name) and fresh ones created.
+/* Convert FIFO file from older format (single file) to segments, if needed.
+   Returns 0 on success (or nothing to do), or an error code.
 */
-int permFIFO_file_clean(char* path, int doBackup)
+static int permFIFO_file_convert(struct permFIFO* f)
 {
-  char *f1, *f2, *f3;
-  int fd1, fd3;
-  struct stat statbuf;
-
+  char *fileName, *fileNameNew;
   struct FIFO_file_main_header hm;
   struct FIFO_file_sub_header hs;
+  struct FIFO_file_ack ha;
+  unsigned long* seqs;
   void* buffer = NULL;
-  unsigned int buffer_size = 0;
-  unsigned int bytes;
-  unsigned long currentId = 0;
-
-  /* retrieve filenames associated to FIFO */
-  permFIFO_getFileName(path, &f1, &f2, &f3);
-  
-  if (doBackup) {
-      char backupName[256];
-      unsigned int bTime = (unsigned int)time(NULL);
-      slog(SLOG_INFO, "Backup suffix = %d", bTime);
-      snprintf(backupName,sizeof(backupName), "%s.%u", f1, bTime);
-      rename(f1, backupName);
-      snprintf(backupName,sizeof(backupName), "%s.%u", f2, bTime);
-      rename(f2, backupName);
-      snprintf(backupName,sizeof(backupName), "%s.%u", f3, bTime);
-      rename(f3, backupName);
-  }
-
-  for (int retry = 0; retry < 3; retry++) {
-    if (stat(f1, &statbuf)) {
-      /* file does not exists */
-      if (stat(f2, &statbuf)) {
-        /* old file not available either, we start a blank new one */
-        fd1 = creat(f1, FIFO_FILE_PERM);
-        if (fd1 == -1)
-          return 1;
-        hm = FIFOFILE_DEFAULT_MAIN_HEADER;
-        if (write(fd1, &hm, sizeof(hm)) != sizeof(hm))
-          return 2;
-        close(fd1);
+  unsigned long bufferSize = 0;
+  unsigned long id = 0;
+  ssize_t bytes;
+  int tag = 0;
+  int fd, i, n;
+  int err = 0;
+
+  permFIFO_getFileName(f->path, &fileName, NULL, &fileNameNew);
+
+  fd = open(fileName, O_RDONLY);
+  if (fd == -1) {
+    /* no file */
+    checked_free(fileName);
+    checked_free(fileNameNew);
+    return 0;
+  }
+  if ((read(fd, &tag, sizeof(tag)) == sizeof(tag)) && (tag == FIFO_FILE_TAG_ACK)) {
+    /* current format */
+    close(fd);
+    checked_free(fileName);
+    checked_free(fileNameNew);
+    return 0;
+  }
+  if (lseek(fd, 0, SEEK_SET) == (off_t)-1) {
+    err = 1;
+  } else {
+    err = permFIFO_read_main_header(fd, &hm);
+    if (err == 1) {
+      /* empty file, just remove it */
+      close(fd);
+      unlink(fileName);
+      checked_free(fileName);
+      checked_free(fileNameNew);
+      return 0;
+    }
+    if (err) {
+      err = 2;
+    }
+  }
+  if (err) {
+    close(fd);
+    checked_free(fileName);
+    checked_free(fileNameNew);
+    return err;
+  }
+
+  slog(SLOG_INFO, "Converting FIFO file %s", fileName);
+
+  /* remove segments left by an interrupted conversion */
+  n = permFIFO_listSegments(f->path, &seqs);
+  for (i = 0; i < n; i++) {
+    char* segmentName = permFIFO_getSegmentName(f->path, seqs[i]);
+    if (segmentName != NULL) {
+      unlink(segmentName);
+    }
+    checked_free(segmentName);
+  }
+  checked_free(seqs);
+  f->nextSeq = 1;
+
+  /* copy items not acknowledged */
+  while (!err) {
+    bytes = read(fd, &hs, sizeof(hs));
+    if (bytes == 0)
+      break; /* end of file */
+    if ((bytes != sizeof(hs)) || (hs.tag != FIFO_FILE_TAG)) {
+      err = 4;
+      break;
+    }
+    if (hs.id <= hm.lastAckId) {
+      if (lseek(fd, hs.size, SEEK_CUR) == (off_t)-1) {
+        err = 5;
+      }
+      continue;
+    }
+    if (hs.size > bufferSize) {
+      checked_free(buffer);
+      bufferSize = hs.size;
+      buffer = checked_malloc(bufferSize);
+      if (buffer == NULL) {
+        err = 6;
         break;
-      } else {
-        /* the old file is here, rename it and clean it */
-        if (rename(f2, f1) != 0)
-          return 3;
-        continue;
       }
+    }
+    if (read(fd, buffer, hs.size) != (ssize_t)hs.size) {
+      err = 7;
+      break;
+    }
+    id++;
+    if (permFIFO_writeItem(f, id, buffer, hs.size)) {
+      err = 8;
+      break;
+    }
+  }
+  close(fd);
+  checked_free(buffer);
+
+  /* segments are read again from disk afterwards */
+  permFIFO_closeWriteSegment(f, 1);
+  f->segmentsFirst = 0;
+  f->segmentsCount = 0;
+
+  /* replace old file by ack file */
+  if (!err) {
+    fd = open(fileNameNew, O_WRONLY | O_CREAT | O_TRUNC, FIFO_FILE_PERM);
+    if (fd == -1) {
+      err = 9;
     } else {
-      /* file exists, clean it */
-      fd1 = open(f1, O_RDWR);
-      if (fd1 == -1)
-        return 4;
-      /* first remove temp files if any */
-      unlink(f2);
-      unlink(f3);
-
-      /* read file header */
-      bytes = read(fd1, &hm, sizeof(hm));
-      if (bytes == 0) {
-        /* file empty, remove and create new one */
-	close(fd1);
-	unlink(f1);
-	continue;
-      }
-      if ( bytes != sizeof(hm))
-        return 5;
-      if (hm.tag != FIFO_FILE_TAG)
-        return 6;
-      if (!hm.lastAckId) { /* no acknowledged data in the file */
-        /* look for last id in file */
-        for (;;) {
-          /* read sub header */
-          bytes = read(fd1, &hs, sizeof(hs));
-          if (bytes == 0)
-            break; /* end of file */
-          if (bytes != sizeof(hs))
-            return 31;
-          if (hs.tag != FIFO_FILE_TAG)
-            return 32;
-          currentId = hs.id;
-          /* skip to next */
-          if (lseek(fd1, hs.size, SEEK_CUR) == (off_t)-1)
-            return 34;
-        }
-        /* if relevant, write id in main header */
-        if (currentId) {
-          if (lseek(fd1, 0, SEEK_SET) == (off_t)-1)
-            return 35;
-          hm.currentId = currentId;
-          if (write(fd1, &hm, sizeof(hm)) != sizeof(hm))
-            return 36;
-        }
-        close(fd1);
-        break; /* FIFO file is clean */
+      ha.tag = FIFO_FILE_TAG_ACK;
+      ha.lastAckId = 0;
+      if ((write(fd, &ha, sizeof(ha)) != sizeof(ha)) || (fsync(fd))) {
+        err = 10;
       }
+      close(fd);
+    }
+  }
+  if (!err) {
+    if (rename(fileNameNew, fileName)) {
+      err = 11;
+    }
+  }
+  if (!err) {
+    permFIFO_syncDir(f->path);
+    slog(SLOG_INFO, "FIFO file converted, %lu items pending", id);
+  }
 
-      /* copy unacknowledged data only, so start copy from "lastAckId+1" */
-      debug("cleaning !!!: copy from id=%lu\n", hm.lastAckId + 1);
-      debug("tag=%d  lastack=%lu   currentId=%lu\n", hm.tag, hm.lastAckId, hm.currentId);
-      if (hm.lastAckId) {
-        for (;;) {
-          /* read sub header */
-          bytes = read(fd1, &hs, sizeof(hs));
-          if (bytes == 0)
-            break; /* end of file */
-          if (bytes != sizeof(hs))
-            return 50;
-          if (hs.tag != FIFO_FILE_TAG)
-            return 51;
-          if (hs.id > hm.lastAckId) {
-            /* this one is not acknowledged, skip back and stop search */
-            if (lseek(fd1, -sizeof(hs), SEEK_CUR) == (off_t)-1)
-              return 52;
-            break;
-          }
-          if (lseek(fd1, hs.size, SEEK_CUR) == (off_t)-1)
-            return 53;
-        }
-        // debug("copying from id=%lu\n",hs.id);
-      }
+  checked_free(fileName);
+  checked_free(fileNameNew);
 
-      /* create clean copy */
-      fd3 = creat(f3, FIFO_FILE_PERM);
-      if (fd3 == -1)
-        return 7;
-      hm = FIFOFILE_DEFAULT_MAIN_HEADER;
-      if (write(fd3, &hm, sizeof(hm)) != sizeof(hm))
-        return 8;
-
-      /* copy data from file to file */
-      for (;;) {
-        /* read sub header */
-        bytes = read(fd1, &hs, sizeof(hs));
-        if (bytes == 0)
-          break; /* end of file */
-        if (bytes != sizeof(hs))
-          return 10;
-        if (hs.tag != FIFO_FILE_TAG)
-          return 11;
-        /* allocate buffer big enough to read data */
-        if (hs.size > buffer_size) {
-          checked_free(buffer);
-          buffer_size = hs.size;
-          buffer = (char*)checked_malloc(buffer_size);
-        }
-        /* read data */
-        bytes = read(fd1, buffer, hs.size);
-        if (bytes != hs.size)
-          return 12;
-        /* copy data */
-        currentId++;
-        hs.id = currentId;
-        if (write(fd3, &hs, sizeof(hs)) != sizeof(hs))
-          return 13;
-        if ((unsigned int)write(fd3, buffer, hs.size) != hs.size)
-          return 14;
-      }
-      checked_free(buffer);
+  return err;
+}
 
-      /* if relevant, write id in main header */
-      if (currentId) {
-        if (lseek(fd3, 0, SEEK_SET) == (off_t)-1)
-          return 41;
-        hm.currentId = currentId;
-        if (write(fd3, &hm, sizeof(hm)) != sizeof(hm))
-          return 42;
-      }
+/* release FIFO files resources */
+static void permFIFO_file_close(struct permFIFO* f)
+{
+  permFIFO_closeWriteSegment(f, f->syncPolicy != PERMFIFO_SYNC_NONE);
+  if (f->readMap != NULL) {
+    munmap(f->readMap, f->readSize);
+    f->readMap = NULL;
+  }
+  if (f->fd != -1) {
+    close(f->fd);
+    f->fd = -1;
+  }
+  checked_free(f->segments);
+  f->segments = NULL;
+  f->segmentsSize = 0;
+  f->segmentsFirst = 0;
+  f->segmentsCount = 0;
+}
 
-      /* close files */
-      close(fd1);
-      close(fd3);
+/* Open FIFO files, and get FIFO state from them: this is done without reading all items, nor rewriting files.
+   Returns 0 on success, or an error code.
+*/
+static int permFIFO_file_open(struct permFIFO* f)
+{
+  char* fileName;
+  struct FIFO_file_ack ha;
+  struct FIFO_file_segment_header hseg;
+  struct FIFO_file_sub_header* hs;
+  struct FIFO_segment* last;
+  unsigned long* seqs;
+  unsigned long lastId;
+  char* map;
+  size_t size, offset;
+  ssize_t bytes;
+  int i, n, fd;
+  int err = 0;
+
+  /* files from previous versions */
+  err = permFIFO_file_convert(f);
+  if (err) {
+    return 100 + err;
+  }
 
-      /* rename files */
-      if (rename(f1, f2))
-        return 15;
-      if (rename(f3, f1))
-        return 16;
-      if (unlink(f2))
-        return 17;
+  /* open ack file */
+  permFIFO_getFileName(f->path, &fileName, NULL, NULL);
+  f->fd = open(fileName, O_RDWR | O_CREAT, FIFO_FILE_PERM);
+  checked_free(fileName);
+  if (f->fd == -1)
+    return 1;
+  fchmod(f->fd, FIFO_FILE_PERM);
+  bytes = pread(f->fd, &ha, sizeof(ha), 0);
+  if (bytes == 0) {
+    /* new file */
+    ha.tag = FIFO_FILE_TAG_ACK;
+    ha.lastAckId = 0;
+    if (pwrite(f->fd, &ha, sizeof(ha), 0) != sizeof(ha))
+      return 2;
+  } else if ((bytes != sizeof(ha)) || (ha.tag != FIFO_FILE_TAG_ACK)) {
+    return 3;
+  }
 
+  /* build index of segments, from their headers */
+  n = permFIFO_listSegments(f->path, &seqs);
+  if (n < 0)
+    return 4;
+  for (i = 0; (i < n) && (!err); i++) {
+    fileName = permFIFO_getSegmentName(f->path, seqs[i]);
+    if (fileName == NULL) {
+      err = 5;
       break;
     }
+    bytes = -1;
+    fd = open(fileName, O_RDONLY);
+    if (fd != -1) {
+      bytes = pread(fd, &hseg, sizeof(hseg), 0);
+      close(fd);
+    }
+    if ((bytes != sizeof(hseg)) || (hseg.tag != FIFO_SEGMENT_TAG) || (hseg.seq != seqs[i])) {
+      /* creation of segment did not complete, there is nothing in it */
+      slog(SLOG_WARNING, "Removing invalid FIFO segment %s", fileName);
+      unlink(fileName);
+    } else if (permFIFO_addSegment(f, seqs[i], hseg.firstId)) {
+      err = 6;
+    }
+    checked_free(fileName);
+  }
+  checked_free(seqs);
+  if (err)
+    return err;
+  if (f->segmentsCount) {
+    f->nextSeq = f->segments[f->segmentsFirst + f->segmentsCount - 1].seq + 1;
   }
 
-  checked_free(f1);
-  checked_free(f2);
-  checked_free(f3);
+  /* remove segments fully acknowledged */
+  while ((f->segmentsCount > 1) && (f->segments[f->segmentsFirst + 1].firstId <= ha.lastAckId + 1)) {
+    permFIFO_removeFirstSegment(f);
+  }
+
+  /* get last id from last segment. Empty ones are removed. */
+  lastId = ha.lastAckId;
+  while (f->segmentsCount) {
+    last = &f->segments[f->segmentsFirst + f->segmentsCount - 1];
+    map = permFIFO_mapSegment(f->path, last->seq, &size);
+    if (map == NULL)
+      return 7;
+    n = 0;
+    for (offset = sizeof(struct FIFO_file_segment_header); (hs = permFIFO_segmentItem(map, size, offset)) != NULL; offset += permFIFO_segmentItemSize(hs->size)) {
+      if (hs->id > lastId) {
+        lastId = hs->id;
+      }
+      n++;
+    }
+    munmap(map, size);
+    if (n)
+      break;
+    fileName = permFIFO_getSegmentName(f->path, last->seq);
+    if (fileName != NULL) {
+      unlink(fileName);
+    }
+    checked_free(fileName);
+    f->segmentsCount--;
+  }
+
+  /* drop everything if all acknowledged */
+  if (lastId <= ha.lastAckId) {
+    while (f->segmentsCount) {
+      permFIFO_removeFirstSegment(f);
+    }
+  }
+  if (f->segmentsCount == 0) {
+    f->nextSeq = 1;
+  }
+
+  /* ids restart from 1 for items not acknowledged */
+  f->idBase = ha.lastAckId;
+  f->currentId = lastId - f->idBase;
+  f->lastIdOnDisk = f->currentId;
+  f->ackOnDisk = (f->currentId) ? 1 : 0;
+  f->readSeq = (f->segmentsCount) ? f->segments[f->segmentsFirst].seq : 0;
+  f->readOffset = sizeof(struct FIFO_file_segment_header);
+
+  debug("cur=%lu, lastId=%lu, idBase=%lu, segments=%d\n", f->currentId, f->lastIdOnDisk, f->idBase, f->segmentsCount);
 
   return 0;
 }
@@ -612,6 +1201,8 @@ int permFIFO_file_clean(char* path, int doBackup)
 int permFIFO_save_tabledisk(struct permFIFO* f)
 {
   int index;
+  struct FIFO_item item;
+  int err = 0;
 
   if (f->table_disk->n_items) {
     index = f->table_disk->index_first + f->table_disk->n_items - 1;
@@ -619,67 +1210,90 @@ int permFIFO_save_tabledisk(struct permFIFO* f)
       index -= f->table_disk->size;
     f->lastIdOnDisk = f->table_disk->items[index].id;
 
-    /* we could compute offset of next to read from disk, but hard to find */
-
-    if (ct_save(f->fd, f->table_disk))
-      return -1;
+    for (;;) {
+      if (ct_read(f->table_disk, &item))
+        break;
+      if ((item.size == 0) || (item.data == NULL))
+        continue;
+      if ((!err) && (permFIFO_writeItem(f, item.id + f->idBase, item.data, item.size))) {
+        /* following items are dropped as well */
+        slog(SLOG_ERROR, "FIFO items could not be saved to disk");
+        err = -1;
+      }
+      checked_free(item.data);
+    }
     f->ackOnDisk = 1; /* there is now data to acknowledge on disk */
+    permFIFO_sync(f, 0);
 
     debug("last Id on disk: %ld", f->lastIdOnDisk);
   }
 
   f->lastFlush = time(NULL);
 
-  return 0;
+  return err;
 }
 
 /** permFIFO constructor */
 /*
     - size : size of FIFO
-    - path : path to file to be used as permanent storage (can be NULL)
+    - path : path to files to be used as permanent storage (can be NULL)
 */
 struct permFIFO* permFIFO_new(int size, char* path)
 {
-  char* filename = NULL;
   struct permFIFO* new;
-  int fd = -1;
   int err;
 
-  struct FIFO_file_main_header hm;
+  new = checked_malloc(sizeof(struct permFIFO));
+  if (new == NULL)
+    return NULL;
+  new->path = NULL;
+  new->fd = -1;
+  new->currentId = 0;
+  new->idBase = 0;
+  new->lastIdOut = 0;
+  new->lastIdOnDisk = 0;
+  new->ackOnDisk = 0;
+  new->lastFlush = time(NULL);
+
+  new->segments = NULL;
+  new->segmentsSize = 0;
+  new->segmentsFirst = 0;
+  new->segmentsCount = 0;
+  new->nextSeq = 1;
+  new->writeFd = -1;
+  new->writeMap = NULL;
+  new->writeSize = 0;
+  new->writeOffset = 0;
+  new->syncOffset = 0;
+  new->readSeq = 0;
+  new->readMap = NULL;
+  new->readSize = 0;
+  new->readOffset = 0;
+
+  new->syncPolicy = PERMFIFO_SYNC_NONE;
+  new->syncInterval = 0;
+  new->syncPending = 0;
+  new->lastSync = time(NULL);
 
   if (path != NULL) {
-    /* first clean FIFO file */
-    err = permFIFO_file_clean(path, 0);
+    new->path = checked_strdup(path);
+    err = permFIFO_file_open(new);
     if (err) {
-      slog(SLOG_ERROR, "FIFO file cleaning failed : error %d", err);
+      slog(SLOG_ERROR, "FIFO file opening failed : error %d", err);
       slog(SLOG_ERROR, "FIFO file backup and create fresh");
-      err = permFIFO_file_clean(path, 1);
+      permFIFO_file_close(new);
+      permFIFO_file_backup(path);
+      err = permFIFO_file_open(new);
     }
     if (err) {
-      slog(SLOG_ERROR, "FIFO file cleaning failed : error %d", err);
+      slog(SLOG_ERROR, "FIFO file opening failed : error %d", err);
+      permFIFO_file_close(new);
+      checked_free(new->path);
+      checked_free(new);
       return NULL;
     }
-    /* then open FIFO file for use */
-    permFIFO_getFileName(path, &filename, NULL, NULL);
-    fd = open(filename, O_RDWR);
-    if (fd == -1) {
-      slog(SLOG_ERROR, "Failed to open %s for writting", filename);
-      checked_free(filename);
-      return NULL;
-    }
-    checked_free(filename);
-    fchmod(fd, FIFO_FILE_PERM);
   }
 
-  new = checked_malloc(sizeof(struct permFIFO));
-  new->fd = fd;
-  new->currentId = 0;
-  new->lastIdOut = 0;
-  new->lastOutOffset = sizeof(struct FIFO_file_main_header);
-  new->lastIdOnDisk = 0;
-  new->ackOnDisk = 0;
-  new->lastFlush = time(NULL);
-
   new->table_client = ct_new(size);
 
   if (path != NULL) {
@@ -693,20 +1307,6 @@ struct permFIFO* permFIFO_new(int size, char* path)
   pthread_mutex_init(&new->mutex, NULL);
   pthread_cond_init(&new->cond, NULL);
 
-  if (fd != -1) {
-    /* read file header */
-    lseek(new->fd, 0, SEEK_SET);
-    if (read(fd, &hm, sizeof(hm)) != sizeof(hm))
-      return NULL;
-    if (hm.tag != FIFO_FILE_TAG)
-      return NULL;
-    new->currentId = hm.currentId;
-    new->lastIdOnDisk = hm.currentId;
-    if (hm.currentId)
-      new->ackOnDisk = 1;
-    debug("cur=%lu, lastId=%lu\n", new->currentId, new->lastIdOnDisk);
-  }
-
   return new;
 }
 
@@ -721,16 +1321,15 @@ int permFIFO_destroy(struct permFIFO* f)
   if (f->fd != -1) {
     /* flush data to disk if any */
     permFIFO_save_tabledisk(f);
-    /* close file */
-    close(f->fd);
+    permFIFO_sync(f, 1);
+    /* close files */
+    permFIFO_file_close(f);
   }
 
-  /* TODO */
-  /* clean file */
-
   /* free structures */
   ct_destroy(f->table_client);
   ct_destroy(f->table_disk);
+  checked_free(f->path);
 
   pthread_mutex_destroy(&f->mutex);
   pthread_cond_destroy(&f->cond);
@@ -739,6 +1338,7 @@ int permFIFO_destroy(struct permFIFO* f)
   return 0;
 }
 
+
 /** Read FIFO 
   returns on timeout (if timout >0) or immediately (timeout == 0)
   or when an item is available (timeout<0).
@@ -863,13 +1463,8 @@ int permFIFO_read(struct permFIFO* f, struct FIFO_item* item, int timeout)
       if ((k == 0) && (retcode == 0)) {
         debug("nothing in mem, load from disk buffer\n");
 
-        retcode = lseek(f->fd, f->lastOutOffset, SEEK_SET);
-        debug("read disk: lseek %ld : %d\n", f->lastOutOffset, retcode);
-        retcode = ct_load(f->fd, f->table_client, f->lastIdOut + 1);
-        debug("ct_load : %d\n", retcode);
-        if (!retcode) {
-          f->lastOutOffset = lseek(f->fd, 0, SEEK_CUR);
-        }
+        retcode = permFIFO_loadSegments(f, f->lastIdOut + 1);
+        debug("load segments : %d\n", retcode);
 
         /* TODO: check if FIFO corruption ... in this case, try to recover */
 
@@ -901,39 +1496,17 @@ int permFIFO_read(struct permFIFO* f, struct FIFO_item* item, int timeout)
   return retcode;
 }
 
-/** Write item in FIFO
-    if size is 0, assumes it is a NULL terminated chain and duplicates it.
-    returns 0 on success or -1 on error.
+/* Insert an item in FIFO. Must be called with FIFO mutex locked.
+   Returns 0 on success, or -1 on error (item not inserted, data still belongs to caller).
 */
-
-int permFIFO_write(struct permFIFO* f, void* data, int size)
+static int permFIFO_insert(struct permFIFO* f, struct FIFO_item* item_new)
 {
   struct FIFO_item item;
   struct FIFO_item item_copy;
   int retcode = 0;
   int do_copy = 0;
 
-  /* check parameters */
-  if (f == NULL)
-    return -1;
-  if (data == NULL)
-    return -1;
-  if (size < 0)
-    return -1;
-
-  /* create a FIFO item with given data */
-  item = EMPTY_FIFO_ITEM;
-  if (size == 0) {
-    item.size = strlen((char*)data) + 1;
-    item.data = checked_strdup((char*)data);
-    if (item.data == NULL)
-      return -1;
-  } else {
-    item.data = data;
-    item.size = size;
-  }
-
-  pthread_mutex_lock(&f->mutex);
+  item = *item_new;
   f->currentId++;
   item.id = f->currentId;
   debug("ITEM ID=%lu\n", item.id);
@@ -976,19 +1549,100 @@ int permFIFO_write(struct permFIFO* f, void* data, int size)
     retcode = ct_write(f->table_client, &item);
   }
 
+  return retcode;
+}
+
+/** Write item in FIFO
+    if size is 0, assumes it is a NULL terminated chain and duplicates it.
+    returns 0 on success or -1 on error.
+*/
+int permFIFO_write(struct permFIFO* f, void* data, int size)
+{
+  struct FIFO_item item;
+  int retcode = 0;
+
+  /* check parameters */
+  if (f == NULL)
+    return -1;
+  if (data == NULL)
+    return -1;
+  if (size < 0)
+    return -1;
+
+  /* create a FIFO item with given data */
+  item = EMPTY_FIFO_ITEM;
+  if (size == 0) {
+    item.size = strlen((char*)data) + 1;
+    item.data = checked_strdup((char*)data);
+    if (item.data == NULL)
+      return -1;
+  } else {
+    item.data = data;
+    item.size = size;
+  }
+
+  pthread_mutex_lock(&f->mutex);
+  retcode = permFIFO_insert(f, &item);
+
   /* notify FIFO update */
   pthread_cond_broadcast(&f->cond);
 
   pthread_mutex_unlock(&f->mutex);
 
+  if ((retcode) && (size == 0)) {
+    /* release our copy */
+    checked_free(item.data);
+  }
+
   return retcode;
 }
 
+int permFIFO_write_copy(struct permFIFO* f, const char* const* data, const int* size, int n)
+{
+  int i, n_written;
+
+  /* check parameters */
+  if ((f == NULL) || (data == NULL) || (size == NULL) || (n <= 0))
+    return 0;
+
+  pthread_mutex_lock(&f->mutex);
+  for (n_written = 0, i = 0; i < n; i++) {
+    struct FIFO_item item;
+    if ((data[i] == NULL) || (size[i] < 0))
+      break;
+
+    /* copy data, NUL-terminated */
+    item = EMPTY_FIFO_ITEM;
+    item.size = size[i] + 1;
+    item.data = checked_malloc(item.size);
+    if (item.data == NULL)
+      break;
+    memcpy(item.data, data[i], size[i]);
+    ((char*)item.data)[size[i]] = 0;
+
+    if (permFIFO_insert(f, &item)) {
+      checked_free(item.data);
+      break;
+    }
+    n_written++;
+  }
+
+  /* notify FIFO update, once for all */
+  if (n_written) {
+    pthread_cond_broadcast(&f->cond);
+  }
+
+  pthread_mutex_unlock(&f->mutex);
+
+  return n_written;
+}
+
+/** Remove all items which have lower id than the one given */
 int permFIFO_ack(struct permFIFO* f, unsigned long id)
 {
   int i;
   struct circular_table* t;
-  struct FIFO_file_main_header hm;
+  struct FIFO_file_ack ha;
 
   /* check parameters */
   if (f == NULL)
@@ -1029,37 +1683,32 @@ int permFIFO_ack(struct permFIFO* f, unsigned long id)
 
   debug("ACK on disk: going on \n", id);
 
-  /* ack all ? */
+  /* update ack cursor */
+  ha.tag = FIFO_FILE_TAG_ACK;
+  ha.lastAckId = id + f->idBase;
+  if (pwrite(f->fd, &ha, sizeof(ha), 0) != sizeof(ha)) {
+    pthread_mutex_unlock(&f->mutex);
+    return 2;
+  }
+
   if (f->lastIdOnDisk <= id) {
-    debug("Reset fifo file");
-    /* then we just drop the file */
-    if (ftruncate(f->fd, sizeof(struct FIFO_file_main_header))) {
-      slog(SLOG_ERROR, "Could not truncate fifo file");
-    } else {
-      f->lastOutOffset = sizeof(struct FIFO_file_main_header);
+    /* ack all: we just drop the segments */
+    debug("Reset fifo segments");
+    while (f->segmentsCount) {
+      permFIFO_removeFirstSegment(f);
     }
+    f->nextSeq = 1;
+    f->readSeq = 0;
+    f->readOffset = sizeof(struct FIFO_file_segment_header);
     /* no need to further ack on disk if it's the last one */
     f->ackOnDisk = 0;
+  } else {
+    /* segments where all items acknowledged can be dropped */
+    while ((f->segmentsCount > 1) && (f->segments[f->segmentsFirst + 1].firstId <= id + f->idBase + 1)) {
+      permFIFO_removeFirstSegment(f);
+    }
   }
-
-  hm.tag = FIFO_FILE_TAG;
-  hm.lastAckId = id;
-  hm.currentId = f->lastIdOnDisk;
-  /* if not found, then update disk info */
-  if (lseek(f->fd, 0, SEEK_SET) == (off_t)-1) {
-    pthread_mutex_unlock(&f->mutex);
-    return 1;
-  }
-  if (write(f->fd, &hm, sizeof(hm)) != sizeof(hm)) {
-    pthread_mutex_unlock(&f->mutex);
-    return 2;
-  }
-
-  /* write id of last acknowledged, because offset is hard to remember... */
-  /* will just take more time at startup when cleaning */
-
-  /* TODO */
-  /* if currentid=id+1 ... grand menage */
+  permFIFO_sync(f, 0);
 
   pthread_mutex_unlock(&f->mutex);
   return 0;
@@ -1075,6 +1724,7 @@ int permFIFO_flush(struct permFIFO* f, int timeout)
   pthread_mutex_lock(&f->mutex);
   if (time(NULL) >= f->lastFlush + timeout) {
     retcode = permFIFO_save_tabledisk(f);
+    permFIFO_sync(f, 0);
     //    slog(SLOG_INFO,"FIFO flushed to disk after timeout");
   } else {
     //    slog(SLOG_INFO,"FIFO flush - timeout not reached yet");
@@ -1084,6 +1734,22 @@ int permFIFO_flush(struct permFIFO* f, int timeout)
   return retcode;
 }
 
+/** Set policy to sync data to disk */
+int permFIFO_setSync(struct permFIFO* f, int policy, int interval)
+{
+  if (f == NULL)
+    return -1;
+  if ((policy != PERMFIFO_SYNC_NONE) && (policy != PERMFIFO_SYNC_INTERVAL) && (policy != PERMFIFO_SYNC_BATCH))
+    return -1;
+  if (interval < 0)
+    return -1;
+  pthread_mutex_lock(&f->mutex);
+  f->syncPolicy = policy;
+  f->syncInterval = interval;
+  pthread_mutex_unlock(&f->mutex);
+  return 0;
+}
+
 /***************************************/
 /* test functions for various features */
 /***************************************/
@@ -1099,20 +1765,20 @@ int test1()
 
   printf("Path=%s\n", path);
   printf("FIFO file dump  : %d\n", permFIFO_file_dump(path));
-  printf("FIFO file clean : %d\n", permFIFO_file_clean(path, 0));
+  printf("FIFO file remove: %d\n", permFIFO_file_remove(path));
   printf("FIFO file dump  : %d\n", permFIFO_file_dump(path));
 
   fifo = ct_new(10);
   printf("FIFO=%p\bn", (void*)fifo);
   for (i = 0; i < 15; i++) {
-    buf = malloc(1000);
+    buf = checked_malloc(1000);
     snprintf(buf, 1000, "Test %d", i);
     item = EMPTY_FIFO_ITEM;
     item.size = strlen(buf);
     item.data = buf;
 
     if (ct_write(fifo, &item)) {
-      free(buf);
+      checked_free(buf);
       printf("%d -> insert failed\n", i);
     } else {
       printf("%d -> insert ok\n", i);
@@ -1122,7 +1788,7 @@ int test1()
     if (ct_read(fifo, &item))
       break;
     printf("%ld : %s\n", item.id, (char*)item.data);
-    free(item.data);
+    checked_free(item.data);
   }
   ct_destroy(fifo);
 
@@ -1152,10 +1818,10 @@ int test2()
   for (j = 0; j < 1; j++) {
     for (i = 0; i < 70.0 * rand() / RAND_MAX; i++) {
       k++;
-      buf = malloc(1000);
+      buf = checked_malloc(1000);
       snprintf(buf, 1000, "Test %d", k);
       if (permFIFO_write(f, buf, strlen(buf) + 1)) {
-        free(buf);
+        checked_free(buf);
         printf("%d -> insert failed\n", k);
       } else {
         printf("%d -> insert ok\n", k);
@@ -1165,7 +1831,7 @@ int test2()
       if (permFIFO_read(f, &item, 0))
         break;
       printf("%ld : %s\n", item.id, (char*)item.data);
-      free(item.data);
+      checked_free(item.data);
     }
   }
   printf("emptying:\n");
@@ -1174,7 +1840,7 @@ int test2()
     if (permFIFO_read(f, &item, 0))
       break;
     printf("%ld : %s\n", item.id, (char*)item.data);
-    free(item.data);
+    checked_free(item.data);
   }
   permFIFO_destroy(f);
   //  printf("FIFO file dump  : %d\n",permFIFO_file_dump(path));
@@ -1203,10 +1869,10 @@ int test3()
   k = 0;
   for (i = 0; i < 20; i++) {
     k++;
-    buf = malloc(1000);
+    buf = checked_malloc(1000);
     snprintf(buf, 1000, "Test %d", k);
     if (permFIFO_write(f, buf, strlen(buf) + 1)) {
-      free(buf);
+      checked_free(buf);
       printf("%d -> insert failed\n", k);
     } else {
       printf("%d -> insert ok\n", k);
@@ -1216,14 +1882,14 @@ int test3()
     if (permFIFO_read(f, &item, 0))
       break;
     printf("READ = %ld : %s\n", item.id, (char*)item.data);
-    free(item.data);
+    checked_free(item.data);
   }
   for (i = 0; i < 5; i++) {
     k++;
-    buf = malloc(1000);
+    buf = checked_malloc(1000);
     snprintf(buf, 1000, "Test %d", k);
     if (permFIFO_write(f, buf, strlen(buf) + 1)) {
-      free(buf);
+      checked_free(buf);
       printf("%d -> insert failed\n", k);
     } else {
       printf("%d -> insert ok\n", k);
@@ -1236,7 +1902,7 @@ int test3()
     if (permFIFO_read(f, &item, 0))
       break;
     printf("READ = %ld : %s\n", item.id, (char*)item.data);
-    free(item.data);
+    checked_free(item.data);
   }
   permFIFO_destroy(f);
   //  printf("FIFO file dump  : %d\n",permFIFO_file_dump(path));
@@ -1261,10 +1927,10 @@ int test4()
   k = 0;
   for (i = 0; i < 10; i++) {
     k++;
-    buf = malloc(1000);
+    buf = checked_malloc(1000);
     snprintf(buf, 1000, "Test %d", k);
     if (permFIFO_write(f, buf, strlen(buf) + 1)) {
-      free(buf);
+      checked_free(buf);
       printf("%d -> insert failed\n", k);
     } else {
       printf("%d -> insert ok\n", k);
@@ -1285,7 +1951,7 @@ int test4()
     if (permFIFO_read(f, &item, 0))
       break;
     printf("READ = %ld : %s\n", item.id, (char*)item.data);
-    free(item.data);
+    checked_free(item.data);
   }
   permFIFO_destroy(f);
   //  printf("FIFO file dump  : %d\n",permFIFO_file_dump(path));
@@ -1312,10 +1978,10 @@ int test5()
   k = 0;
   for (i = 0; i < 50; i++) {
     k++;
-    buf = malloc(1000);
+    buf = checked_malloc(1000);
     snprintf(buf, 1000, "Test %d", k);
     if (permFIFO_write(f, buf, strlen(buf) + 1)) {
-      free(buf);
+      checked_free(buf);
       printf("%d -> insert failed\n", k);
     } else {
       printf("%d -> insert ok\n", k);
@@ -1326,7 +1992,7 @@ int test5()
     if (permFIFO_read(f, &item, 0))
       break;
     printf("READ = %ld : %s\n", item.id, (char*)item.data);
-    free(item.data);
+    checked_free(item.data);
   }
   permFIFO_ack(f, 49);
   permFIFO_destroy(f);
@@ -1344,7 +2010,7 @@ int test5()
     if (permFIFO_read(f, &item, 0))
       break;
     printf("READ = %ld : %s\n", item.id, (char*)item.data);
-    free(item.data);
+    checked_free(item.data);
   }
   permFIFO_destroy(f);
   //  printf("FIFO file dump  : %d\n",permFIFO_file_dump(path));
@@ -1374,10 +2040,10 @@ int test6()
   for (;;) {
     for (i = 0; i < rand() * 15.0 / RAND_MAX; i++) {
       k++;
-      buf = malloc(1000);
+      buf = checked_malloc(1000);
       snprintf(buf, 1000, "Test %d", k);
       if (permFIFO_write(f, buf, strlen(buf) + 1)) {
-        free(buf);
+        checked_free(buf);
         printf("%d -> insert failed\n", k);
         exit(0);
       }
@@ -1390,7 +2056,7 @@ int test6()
       }
       printf("READ = %ld : %s\n", item.id, (char*)item.data);
       rid = item.id;
-      free(item.data);
+      checked_free(item.data);
     }
 
     permFIFO_ack(f, rid - 2);
@@ -1400,7 +2066,6 @@ int test6()
   }
   permFIFO_destroy(f);
 
-  permFIFO_file_clean(path, 0);
   printf("FIFO file dump  : %d\n", permFIFO_file_dump(path));
   return 0;
 }
@@ -38,12 +38,32 @@ int permFIFO_read(struct permFIFO* f, struct FIFO_item* item, int timeout);
 /** Write FIFO */
 int permFIFO_write(struct permFIFO* f, void* data, int size);
 
+/** Write several items to FIFO at once (FIFO locked and readers notified once for all).
+    Item i is a copy of the size[i] bytes at data[i] (need not be NUL-terminated), NUL appended.
+    Returns number of items written (stops at first error).
+*/
+int permFIFO_write_copy(struct permFIFO* f, const char* const* data, const int* size, int n);
+
 /** Remove all items which have lower id than the one given */
 int permFIFO_ack(struct permFIFO* f, unsigned long id);
 
 /** Flush data to disk, if timeout elapsed since last flush (use 0 to force, timeout is in seconds) */
 int permFIFO_flush(struct permFIFO* f, int timeout);
 
+/* policies to sync data written to disk */
+#define PERMFIFO_SYNC_NONE 0     /* never, left to the system (default) */
+#define PERMFIFO_SYNC_INTERVAL 1 /* at most once per interval */
+#define PERMFIFO_SYNC_BATCH 2    /* each time a group of items is written */
+
+/** Set policy to sync data to disk (PERMFIFO_SYNC_...), and interval in seconds if needed. Returns 0 on success or -1 on error. */
+int permFIFO_setSync(struct permFIFO* f, int policy, int interval);
+
+/** Get disk space used by the files of a FIFO stored at given path (bytes), or -1 if there is none */
+long long permFIFO_file_size(char* path);
+
+/** Remove the files of a FIFO stored at given path (FIFO should not be in use). Returns 0 on success, -1 on error. */
+int permFIFO_file_remove(char* path);
+
 #ifdef __cplusplus
 }
 #endif
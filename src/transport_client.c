@@ -55,6 +55,12 @@ FILE* debug_fp = NULL;
 
 #define MAX_RETRY_TIME 300
 
+#define DEFAULT_BATCH_MAX_SIZE 65536
+
+/* flow control window, when supported by server */
+#define WINDOW_MIN 4 /* minimum window */
+#define WINDOW_RTT_TOLERANCE 5 /* increase of round-trip time (milliseconds), above twice the minimum, tolerated before reducing window */
+
 /** Structure containing all client information */
 struct _TR_client {
   char* root_name; /**< Root server name */
@@ -83,8 +89,154 @@ struct _TR_client {
   int server_shutdown_request; /**< Set to 1 when server has requested client to shut down, 0 otherwise */
 
   struct permFIFO* input_queue_msg; /**< Structure to store messages in a permanent way. */
+
+  int batch_max_msg;   /**< maximum number of messages per file */
+  int batch_max_size;  /**< maximum size of a file grouping messages */
+  int batch_max_delay; /**< maximum time to wait for more messages (milliseconds) */
+  int batch_enabled;   /**< set when server accepts several messages per file */
+
+  int file_options;   /**< protocol options used by files added to queue (TR_OPTION_...) */
+  int server_options; /**< protocol options accepted by server (TR_OPTION_...), on current or last connection */
+
+  int window_enabled;                /**< set when server uses flow control window */
+  int window_server;                 /**< window advertised by server */
+  int window_rtt;                    /**< window adapted to round-trip time */
+  int window;                        /**< current window: maximum number of files sent and not acknowledged */
+  int window_limited;                /**< set when sending was blocked by window since last update */
+  struct timeval window_reduce_time; /**< last time window was reduced */
+  int window_max;                    /**< maximum window: size of transmission queue */
+  struct timeval* send_time;         /**< time when files in flight were sent (circular buffer of window_max) */
+  int send_time_start;               /**< index of oldest file in send_time */
+  int send_time_count;               /**< number of files in send_time */
+
+  int stat_in_flight;       /**< number of files sent and not acknowledged */
+  int stat_ack_latency;     /**< smoothed time between sending a file and acknowledgement (milliseconds), -1 if unknown */
+  int stat_ack_latency_min; /**< minimum time between sending a file and acknowledgement (milliseconds), -1 if unknown */
+  int stat_ack_latency_max; /**< maximum time between sending a file and acknowledgement (milliseconds), -1 if unknown */
 };
 
+/* time elapsed since t0, in milliseconds */
+static int TR_client_elapsed_ms(struct timeval* t0)
+{
+  struct timeval t1;
+  gettimeofday(&t1, NULL);
+  return (int)((t1.tv_sec - t0->tv_sec) * 1000 + (t1.tv_usec - t0->tv_usec) / 1000);
+}
+
+/* format in buf the header of a file to be sent
+   if blob is not NULL, only this blob of the file (one message) is sent as a file:
+   the file id (the one of its last message) is decremented for each message after this one, so that ids sent keep increasing
+   and the acknowledgement of a message does not release the whole file */
+static void TR_client_file_header(TR_client_handle c, char* buf, int bufSize, TR_file* f, TR_blob* blob)
+{
+  int minId = f->id.minId;
+  int size = f->size;
+  TR_blob* b;
+
+  if (blob != NULL) {
+    size = blob->size;
+    for (b = blob->next; b != NULL; b = b->next) {
+      minId--;
+    }
+  }
+
+  /* current window is given to server, so that it acknowledges early enough */
+  if (c->window_enabled) {
+    snprintf(buf, bufSize, "File %s %d %d %d %d\n", f->id.source, minId, f->id.majId, size, c->window);
+  } else {
+    snprintf(buf, bufSize, "File %s %d %d %d\n", f->id.source, minId, f->id.majId, size);
+  }
+}
+
+/* reset window state, on new connection */
+/* initial window is the whole transmission queue, until server gives its own and round-trip time increases */
+static void TR_client_window_reset(TR_client_handle c)
+{
+  c->window_server = c->window_max;
+  c->window_rtt = c->window_max;
+  c->window = c->window_max;
+  c->window_limited = 0;
+  timerclear(&c->window_reduce_time);
+  c->send_time_start = 0;
+  c->send_time_count = 0;
+  c->stat_in_flight = 0;
+  c->stat_ack_latency = -1;
+  c->stat_ack_latency_min = -1;
+}
+
+/* keep track of time when a file is sent - only if window used, this bounds the number of files in flight */
+static void TR_client_window_sent(TR_client_handle c)
+{
+  if ((!c->window_enabled) || (c->send_time_count >= c->window_max)) {
+    return;
+  }
+  gettimeofday(&c->send_time[(c->send_time_start + c->send_time_count) % c->window_max], NULL);
+  c->send_time_count++;
+}
+
+/* remove oldest file from those in flight, and get the time it was sent. Returns 0 on success, -1 if none */
+static int TR_client_window_acked(TR_client_handle c, struct timeval* t)
+{
+  if (c->send_time_count <= 0) {
+    return -1;
+  }
+  *t = c->send_time[c->send_time_start];
+  c->send_time_start = (c->send_time_start + 1) % c->window_max;
+  c->send_time_count--;
+  return 0;
+}
+
+/* update window after acknowledgement of n_acked files, the last one sent at t_sent */
+/* the window grows as long as the round-trip time does not increase, i.e. the server and network keep up */
+static void TR_client_window_update(TR_client_handle c, int n_acked, struct timeval* t_sent)
+{
+  int rtt;
+
+  rtt = TR_client_elapsed_ms(t_sent);
+  if (rtt < 0) {
+    rtt = 0;
+  }
+
+  /* ack latency statistics */
+  if ((c->stat_ack_latency_min < 0) || (rtt < c->stat_ack_latency_min)) {
+    c->stat_ack_latency_min = rtt;
+  }
+  if (rtt > c->stat_ack_latency_max) {
+    c->stat_ack_latency_max = rtt;
+  }
+  if (c->stat_ack_latency < 0) {
+    c->stat_ack_latency = rtt;
+  } else {
+    c->stat_ack_latency = (7 * c->stat_ack_latency + rtt) / 8;
+  }
+
+  /* window adapted only when it limits sending - otherwise round-trip includes delay before server acknowledges */
+  if (!c->window_limited) {
+    return;
+  }
+  c->window_limited = 0;
+
+  if (rtt <= 2 * c->stat_ack_latency_min + WINDOW_RTT_TOLERANCE) {
+    /* no queuing: increase window by number of files acknowledged (doubles each round-trip) */
+    c->window_rtt += n_acked;
+    if (c->window_rtt > c->window_max) {
+      c->window_rtt = c->window_max;
+    }
+  } else if ((!timerisset(&c->window_reduce_time)) || (TR_client_elapsed_ms(&c->window_reduce_time) > c->stat_ack_latency)) {
+    /* files are queuing: reduce window, at most once per round-trip */
+    c->window_rtt = c->window_rtt * 3 / 4;
+    if (c->window_rtt < WINDOW_MIN) {
+      c->window_rtt = WINDOW_MIN;
+    }
+    gettimeofday(&c->window_reduce_time, NULL);
+  }
+
+  c->window = c->window_rtt;
+  if (c->window_server < c->window) {
+    c->window = c->window_server;
+  }
+}
+
 /** Open connection */
 /*  uses : client->root_name, client->root_port, client->proxy name, client->proxy_port */
 /*  modifies : client->fd*/
@@ -231,6 +383,8 @@ void TR_client_state_machine(void* arg)
   TR_file* current_file;  /* the current file transmitted */
   TR_blob* current_blob;  /* the current blob of the file being transmitted */
   int current_file_index; /* the current file index in transmit FIFO */
+  int current_split;      /* set when the messages (blobs) of current file are sent one per file */
+  int split_next;         /* set when the next message of current file should be preceded by a new file header */
 
   /* variables used for the socket send non blocking buffer */
   char buf_val[TR_BUFFER_SIZE];
@@ -246,10 +400,14 @@ void TR_client_state_machine(void* arg)
 
   FILE* fp;
 
-  int min_id, maj_id;
+  int min_id, maj_id, window;
   TR_file_id ack_id; /* the last file acknowledged by the server */
   int result;
 
+  int n_acked;              /* number of files acknowledged by last server replies */
+  struct timeval t_sent;    /* time when last file acknowledged was sent */
+  struct timeval t_sent_ok; /* same, valid if n_acked > 0 */
+
   TR_file* the_file;
 
   int ini_state; /* counter for steps in connect init procedure */
@@ -265,6 +423,11 @@ void TR_client_state_machine(void* arg)
 
   char* debug_file_name; /* the filename where to log transport communications */
 
+  TR_file* batch_file = NULL; /* file grouping messages, waiting for more before being sent */
+  int batch_count = 0;        /* number of messages in batch_file */
+  struct timeval batch_time;  /* time when batch_file was created */
+  int poll_timeout;
+
   time_t watchdog_timer = 0;          /* limit maximum time for sending a file */
   int watchdog_last_index = -1;       /* keep track of last buffer index to see if transmit stalled */
   int watchdog_count_noprogress = -1; /* count loop without transmit progress */
@@ -366,6 +529,9 @@ void TR_client_state_machine(void* arg)
           ini_state = 1;
         }
         ini_last_state = -1;
+        the_client->batch_enabled = 0;
+        the_client->window_enabled = 0;
+        TR_client_window_reset(the_client);
 
         /* loop active while in this state and no shutdown is requested */
         while ((the_client->state == STATE_OPEN_CLIENT) && (the_client->command != COMMAND_STOP)) {
@@ -385,7 +551,8 @@ void TR_client_state_machine(void* arg)
           switch (ini_state) {
             case 0:
               /* send init */
-              snprintf(buf_val, TR_BUFFER_SIZE, "INI %s %d\n", the_client->client_name, the_client->proxy_state);
+              /* advertise protocol options supported */
+              snprintf(buf_val, TR_BUFFER_SIZE, "INI %s %d%s%s %s\n", the_client->client_name, the_client->proxy_state, ((the_client->batch_max_msg > 1) || (the_client->file_options & TR_OPTION_BATCH)) ? " " TR_PROTOCOL_OPTION_BATCH : "", (the_client->file_options & TR_OPTION_BINARY) ? " " TR_PROTOCOL_OPTION_BINARY : "", TR_PROTOCOL_OPTION_WINDOW);
               send(the_client->fd, buf_val, strlen(buf_val), 0);
               ini_state = 1;
 
@@ -420,7 +587,25 @@ void TR_client_state_machine(void* arg)
             slog(SLOG_DEBUG, "Server : %s", srv_cmd);
 
             /* server ready : transmit can begin */
-            if (!strcmp(srv_cmd, "READY")) {
+            /* reply is followed by the protocol options accepted */
+            if ((!strncmp(srv_cmd, "READY", 5)) && ((srv_cmd[5] == 0) || (srv_cmd[5] == ' '))) {
+              char* tok;
+              char* tok_ptr = NULL;
+              int server_options = 0;
+              for (tok = strtok_r(&srv_cmd[5], " ", &tok_ptr); tok != NULL; tok = strtok_r(NULL, " ", &tok_ptr)) {
+                if (!strcmp(tok, TR_PROTOCOL_OPTION_BATCH)) {
+                  the_client->batch_enabled = 1;
+                  server_options |= TR_OPTION_BATCH;
+                  slog(SLOG_INFO, "Server accepts several messages per file");
+                } else if (!strcmp(tok, TR_PROTOCOL_OPTION_BINARY)) {
+                  server_options |= TR_OPTION_BINARY;
+                  slog(SLOG_INFO, "Server accepts binary messages");
+                } else if (!strcmp(tok, TR_PROTOCOL_OPTION_WINDOW)) {
+                  the_client->window_enabled = 1;
+                  slog(SLOG_INFO, "Server uses flow control window");
+                }
+              }
+              the_client->server_options = server_options;
               the_client->state = STATE_CONNECTED;
               break;
             }
@@ -574,6 +759,8 @@ for(;;) {
         current_file = NULL;
         current_blob = NULL;
         current_file_index = 0;
+        current_split = 0;
+        split_next = 0;
 
         send_buf.start = 0;
         send_buf.stop = 0;
@@ -603,12 +790,19 @@ for(;;) {
               slog(SLOG_INFO,"ACK : %s\n",srv_cmd);
               */
 
-              /* read the file id acknowledged */
-              if (sscanf(&srv_cmd[4], " %d %d", &min_id, &maj_id) == 2) {
+              /* read the file id acknowledged, and the window if any */
+              result = sscanf(&srv_cmd[4], " %d %d %d", &min_id, &maj_id, &window);
+              if (result >= 2) {
+                if ((result == 3) && (window > 0)) {
+                  the_client->window_server = window;
+                  the_client->window = (the_client->window_rtt < window) ? the_client->window_rtt : window;
+                }
                 result = 1; /* succeed to parse server reply */
 
                 ack_id.minId = min_id;
                 ack_id.majId = maj_id;
+              } else {
+                result = 0;
               }
             }
 
@@ -628,6 +822,7 @@ for(;;) {
           }
 
           /* Remove acknowledged files from transmit buffer */
+          n_acked = 0;
           pthread_mutex_lock(&the_client->input_mutex);
           for (;;) {
             the_file = FIFO_read_index(the_client->input_queue, 0);
@@ -650,6 +845,10 @@ for(;;) {
               permFIFO_ack(the_client->input_queue_msg, the_file->id.minId); /* ACK input message queue */
               TR_file_dec_usage(the_file);                                   /* destroy file */
               current_file_index--;
+              if (TR_client_window_acked(the_client, &t_sent) == 0) {
+                t_sent_ok = t_sent;
+                n_acked++;
+              }
               continue;
             }
 
@@ -659,6 +858,10 @@ for(;;) {
               FIFO_read(the_client->input_queue);             /* remove from input queue */
               FIFO_write(the_client->output_queue, the_file); /* move to output queue */
               current_file_index--;
+              if (TR_client_window_acked(the_client, &t_sent) == 0) {
+                t_sent_ok = t_sent;
+                n_acked++;
+              }
             }
             pthread_mutex_unlock(&the_client->output_mutex);
             if (result)
@@ -671,10 +874,23 @@ for(;;) {
             current_file_index = 0;
           }
 
+          /* adapt window to round-trip time */
+          if (n_acked > 0) {
+            TR_client_window_update(the_client, n_acked, &t_sent_ok);
+          }
+          while (the_client->send_time_count > current_file_index) {
+            TR_client_window_acked(the_client, &t_sent);
+          }
+          the_client->stat_in_flight = current_file_index;
+
           /* where are we in transmission ? */
           if ((current_file == NULL) && (send_buf.start == send_buf.stop)) {
 
-            if (!file_transfert_deinit) {
+            if ((!file_transfert_deinit) && (the_client->window_enabled) && (current_file_index >= the_client->window)) {
+              /* window full: wait for acknowledgements before sending next file */
+              the_client->window_limited = 1;
+
+            } else if (!file_transfert_deinit) {
               /* at this point last file transfert is completed */
 
               /* get the next file to transmit */
@@ -684,32 +900,52 @@ for(;;) {
               /* if nothing, populate from message queue if any */
               if ((current_file == NULL) && (the_client->input_queue_msg != NULL) && (!FIFO_is_full(the_client->input_queue))) {
                 TR_file* f;
-                TR_blob *b, *last;
+                TR_blob* b;
                 struct FIFO_item item;
+                int max_msg;
+
+                /* one message per file, unless server accepts more */
+                max_msg = 1;
+                if (the_client->batch_enabled) {
+                  max_msg = the_client->batch_max_msg;
+                }
 
-                f = NULL;
-                last = NULL;
-                while (!permFIFO_read(the_client->input_queue_msg, &item, 0)) {
+                /* continue pending file, if any */
+                f = batch_file;
+                batch_file = NULL;
+                while ((f == NULL) || ((batch_count < max_msg) && (f->size < the_client->batch_max_size))) {
+                  if (permFIFO_read(the_client->input_queue_msg, &item, 0)) {
+                    break;
+                  }
                   if (f == NULL) {
                     f = TR_file_new();
                     f->id.source = checked_strdup(the_client->client_name);
                     f->id.majId = 1;
+                    batch_count = 0;
+                    gettimeofday(&batch_time, NULL);
                   }
+                  /* file id is the one of the last message, so that ack covers them all */
                   f->id.minId = item.id;
-                  b = (TR_blob*)checked_malloc(sizeof(TR_blob));
+                  b = TR_blob_new(0);
                   b->value = (void*)item.data;
                   b->size = item.size;
-                  b->next = NULL;
-                  if (last == NULL) {
+                  if (f->last == NULL) {
                     f->first = b;
                   } else {
-                    last->next = b;
+                    f->last->next = b;
                   }
                   f->size += b->size;
-                  last = b;
+                  f->last = b;
+                  batch_count++;
+                  if (batch_count > 1) {
+                    f->options |= TR_OPTION_BATCH;
+                  }
+                }
 
-                  /* currently the server does not accept concatenated blobs, so just send one */
-                  break;
+                /* incomplete group of messages: wait a bit for more */
+                if ((f != NULL) && (batch_count < max_msg) && (f->size < the_client->batch_max_size) && (TR_client_elapsed_ms(&batch_time) < the_client->batch_max_delay)) {
+                  batch_file = f;
+                  f = NULL;
                 }
 
                 if (f != NULL) {
@@ -725,8 +961,22 @@ for(;;) {
 
               pthread_mutex_unlock(&the_client->input_mutex);
 
+              /* the file may rely on protocol options not accepted by server, if queued before reconnection */
+              current_split = 0;
+              if ((current_file != NULL) && (current_file->options & ~the_client->server_options)) {
+                if (((current_file->options & ~the_client->server_options) == TR_OPTION_BATCH) && (the_client->input_queue_msg != NULL)) {
+                  /* file built from message queue, one message per blob: they are sent one per file */
+                  current_split = 1;
+                } else {
+                  slog(SLOG_ERROR, "File %d %d needs protocol options not accepted by server, held until reconnection", current_file->id.minId, current_file->id.majId);
+                  current_file = NULL;
+                  break;
+                }
+              }
+
               if (current_file != NULL) {
                 current_file_index++;
+                TR_client_window_sent(the_client);
                 file_transfert_init = 0;
                 file_transfert_deinit = 1;
 
@@ -753,7 +1003,18 @@ for(;;) {
             ufsd.events = POLLIN | POLLPRI;
             ufsd.revents = 0;
 
-            if (poll(&ufsd, 1, 1000) < 0)
+            /* if messages are pending, don't wait longer than needed */
+            poll_timeout = 1000;
+            if (batch_file != NULL) {
+              poll_timeout = the_client->batch_max_delay - TR_client_elapsed_ms(&batch_time);
+              if (poll_timeout < 1) {
+                poll_timeout = 1;
+              }
+              if (poll_timeout > 1000) {
+                poll_timeout = 1000;
+              }
+            }
+            if (poll(&ufsd, 1, poll_timeout) < 0)
               the_client->state = STATE_CLOSE_CLIENT;
             if (ufsd.revents & (POLLERR | POLLHUP))
               the_client->state = STATE_CLOSE_CLIENT;
@@ -791,7 +1052,8 @@ for(;;) {
                   current_file->id.source = checked_strdup("Unknown");
                 }
 
-                snprintf(buf_val, TR_BUFFER_SIZE, "File %s %d %d %d\n", current_file->id.source, current_file->id.minId, current_file->id.majId, current_file->size);
+                TR_client_file_header(the_client, buf_val, TR_BUFFER_SIZE, current_file, current_split ? current_file->first : NULL);
+                split_next = 0;
                 send_buf.start = 0;
                 send_buf.stop = strlen(buf_val);
                 send_buf.value = buf_val;
@@ -838,11 +1100,20 @@ for(;;) {
 
                 } else {
                   /* file is a blob list in memory */
-                  if (current_blob != NULL) {
+                  if (split_next) {
+                    /* messages sent one per file: end the previous one, and start the next one */
+                    strcpy(buf_val, "END\n");
+                    TR_client_file_header(the_client, &buf_val[4], TR_BUFFER_SIZE - 4, current_file, current_blob);
+                    send_buf.start = 0;
+                    send_buf.stop = strlen(buf_val);
+                    send_buf.value = buf_val;
+                    split_next = 0;
+                  } else if (current_blob != NULL) {
                     send_buf.start = 0;
                     send_buf.stop = current_blob->size;
                     send_buf.value = current_blob->value;
                     current_blob = current_blob->next;
+                    split_next = ((current_split) && (current_blob != NULL));
                   } else {
                     /* this file transfert is completed */
                     current_file = NULL;
@@ -870,6 +1141,17 @@ for(;;) {
           fclose(fp);
         }
 
+        /* put pending messages in transmit queue, they will be sent on reconnection */
+        if (batch_file != NULL) {
+          pthread_mutex_lock(&the_client->input_mutex);
+          if (FIFO_write(the_client->input_queue, batch_file)) {
+            slog(SLOG_ERROR, "Writing to non-full FIFO failed");
+            TR_file_dec_usage(batch_file);
+          }
+          pthread_mutex_unlock(&the_client->input_mutex);
+          batch_file = NULL;
+        }
+
         /* files sent but not acknowledged will be re-sent on reconnection */
 
         the_client->state = STATE_CLOSE_CLIENT;
@@ -916,6 +1198,9 @@ TR_client_handle TR_client_start(TR_client_configuration* config)
       checked_free(the_client);
       return NULL;
     }
+    if (permFIFO_setSync(the_client->input_queue_msg, config->msg_queue_sync, config->msg_queue_sync_interval)) {
+      slog(SLOG_WARNING, "Invalid message queue sync policy %d, not used", config->msg_queue_sync);
+    }
   } else {
     the_client->input_queue_msg = NULL;
   }
@@ -933,6 +1218,28 @@ TR_client_handle TR_client_start(TR_client_configuration* config)
   the_client->client_id = -1;
   the_client->proxy_state = config->proxy_state;
 
+  /* grouping of messages in files */
+  the_client->batch_max_msg = config->batch_max_msg;
+  the_client->batch_max_size = config->batch_max_size;
+  if (the_client->batch_max_size <= 0) {
+    the_client->batch_max_size = DEFAULT_BATCH_MAX_SIZE;
+  }
+  the_client->batch_max_delay = config->batch_max_delay;
+  the_client->batch_enabled = 0;
+
+  /* encoding of messages */
+
+  /* protocol options */
+  the_client->file_options = config->file_options;
+  the_client->server_options = 0;
+
+  /* flow control window */
+  the_client->window_enabled = 0;
+  the_client->window_max = (config->queue_length > WINDOW_MIN) ? config->queue_length : WINDOW_MIN;
+  the_client->send_time = (struct timeval*)checked_malloc(sizeof(struct timeval) * the_client->window_max);
+  TR_client_window_reset(the_client);
+  the_client->stat_ack_latency_max = -1;
+
   /* init queues */
   the_client->input_queue = FIFO_new(config->queue_length);
   pthread_mutex_init(&the_client->input_mutex, NULL);
@@ -987,6 +1294,7 @@ int TR_client_stop(TR_client_handle the_client)
   checked_free(the_client->root_name);
   checked_free(the_client->proxy_name);
   checked_free(the_client->client_name);
+  checked_free(the_client->send_time);
 
   /* purge input queue */
   pthread_mutex_destroy(&the_client->input_mutex);
@@ -1138,3 +1446,45 @@ int TR_client_send_msg(TR_client_handle h, char const* msg)
 
   return -1;
 }
+
+/** Send several messages at once. Requires permfifo_path provided.
+  * Messages are copied and buffered locally until reception acknowledged by server.
+  * Returns immediately.
+  * @return        : number of messages queued (n on success).
+*/
+int TR_client_send_msgs(TR_client_handle h, char const* const* msgs, int const* sizes, int n)
+{
+
+  if (h->input_queue_msg != NULL) {
+    return permFIFO_write_copy(h->input_queue_msg, msgs, sizes, n);
+  }
+
+  return 0;
+}
+
+/** Get protocol options accepted by server.
+  * @return        : TR_OPTION_... flags.
+*/
+int TR_client_getOptions(TR_client_handle h)
+{
+  if (h == NULL) {
+    return 0;
+  }
+  return h->server_options;
+}
+
+/** Get client statistics.
+  * @return        : 0 on success, -1 on error.
+*/
+int TR_client_getStats(TR_client_handle h, TR_client_stats* stats)
+{
+  if ((h == NULL) || (stats == NULL)) {
+    return -1;
+  }
+  stats->files_in_flight = h->stat_in_flight;
+  stats->window = h->window_enabled ? h->window : 0;
+  stats->ack_latency_ms = h->stat_ack_latency;
+  stats->ack_latency_min_ms = h->stat_ack_latency_min;
+  stats->ack_latency_max_ms = h->stat_ack_latency_max;
+  return 0;
+}
@@ -69,8 +69,26 @@ typedef struct {
 
   char const* msg_queue_path; /**< path to a permanent FIFO storage location
                                if using messages (NULL if not). */
+  int msg_queue_sync;          /**< when to sync msg_queue_path file to disk: 0 = left to the system, 1 = at interval, 2 = each write. */
+  int msg_queue_sync_interval; /**< minimum time between syncs of msg_queue_path file (seconds), if msg_queue_sync = 1. */
+
+  int batch_max_msg;   /**< maximum number of messages grouped in a single file, if server accepts it (0 or 1: disabled). */
+  int batch_max_size;  /**< maximum size of a file grouping messages (bytes). */
+  int batch_max_delay; /**< maximum time to wait for more messages before sending an incomplete group (milliseconds). */
+
+  int file_options; /**< protocol options (TR_OPTION_...) used by files added with TR_client_queueAddFile(), advertised to server (e.g. for a proxy forwarding files as received).
+                         Files needing an option not accepted by server (see TR_file.options) are held until reconnection. */
 } TR_client_configuration;
 
+/** Client statistics, see TR_client_getStats() */
+typedef struct {
+  int files_in_flight;    /**< number of files sent and not acknowledged yet */
+  int window;             /**< maximum number of files sent and not acknowledged, adapted to round-trip time and server load. 0 if not supported by server */
+  int ack_latency_ms;     /**< smoothed time between sending a file and its acknowledgement by server (milliseconds). -1 if unknown */
+  int ack_latency_min_ms; /**< minimum time between sending a file and its acknowledgement (milliseconds), for current connection. -1 if unknown */
+  int ack_latency_max_ms; /**< maximum time between sending a file and its acknowledgement (milliseconds). -1 if unknown */
+} TR_client_stats;
+
 /** Start a client with a given configuration.
   * @param  config :  client configuration.
   * @return        :  a handle to the client connexion.
@@ -133,6 +151,31 @@ TR_file* TR_client_get_unacknowledged(TR_client_handle h);
 */
 int TR_client_send_msg(TR_client_handle h, char const* msg);
 
+/** Send several messages at once. Requires permfifo_path provided.
+  * Cheaper than calling TR_client_send_msg() for each: lengths are known, and the queue is locked once.
+  * @param  msgs   : array of messages. They are not necessarily NUL terminated (e.g. lines of a receiving buffer).
+  * @param  sizes  : array of message lengths (without terminating NUL).
+  * @param  n      : number of messages.
+  * Messages are copied and buffered locally until reception acknowledged by server.
+  * Returns immediately.
+  * @return        : number of messages queued (n on success).
+*/
+int TR_client_send_msgs(TR_client_handle h, char const* const* msgs, int const* sizes, int n);
+
+/** Get the protocol options accepted by server.
+  * @param  h      : client handle.
+  * @return        : TR_OPTION_... flags accepted on the current connection (or on the last one, if not connected). 0 if never connected.
+*/
+int TR_client_getOptions(TR_client_handle h);
+
+/** Get client statistics.
+  * Acknowledgement latency is measured only when server supports flow control window.
+  * @param  h      : client handle.
+  * @param  stats  : structure to be filled.
+  * @return        : 0 on success, -1 on error.
+*/
+int TR_client_getStats(TR_client_handle h, TR_client_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
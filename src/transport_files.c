@@ -23,6 +23,18 @@
 
 #include <stdio.h>
 
+#define TR_FILE_POOL_SIZE 8192 /**< Maximum number of released TR_file and TR_blob structures kept for reuse */
+
+static struct mem_pool* TR_file_pool = NULL;
+static struct mem_pool* TR_blob_pool = NULL;
+static pthread_once_t TR_file_pool_once = PTHREAD_ONCE_INIT;
+
+static void TR_file_pool_init()
+{
+  TR_file_pool = mem_pool_new(sizeof(TR_file), TR_FILE_POOL_SIZE);
+  TR_blob_pool = mem_pool_new(sizeof(TR_blob), TR_FILE_POOL_SIZE);
+}
+
 /** File id comparison function.
   *
   * @return   1 if fid1 > fid2 , 0 otherwise.
@@ -40,13 +52,17 @@ int TR_file_id_compare(TR_file_id f1, TR_file_id f2)
 }
 
 /** Create a new TR_file structure.
-  * Uses checked_malloc().
+  * Taken from a memory pool.
 */
 TR_file* TR_file_new()
 {
   TR_file* new_file;
 
-  new_file = (TR_file*)checked_malloc(sizeof(TR_file));
+  pthread_once(&TR_file_pool_once, TR_file_pool_init);
+  new_file = (TR_file*)mem_pool_get(TR_file_pool);
+  if (new_file == NULL) {
+    return NULL;
+  }
   new_file->id.source = NULL;
   new_file->id.minId = -1;
   new_file->id.majId = -1;
@@ -54,6 +70,7 @@ TR_file* TR_file_new()
   new_file->first = NULL;
   new_file->last = NULL;
   new_file->size = 0;
+  new_file->options = 0;
 
   new_file->clock = 0;
 
@@ -64,7 +81,7 @@ TR_file* TR_file_new()
 }
 
 /** Destroy a TR_file structure
-  * Resources (including list of TR_blobs) are deallocated with checked_free().
+  * Resources (including list of TR_blobs) are released to memory pools, or deallocated with checked_free().
   * Files on disk are not destroyed, just the structure in memory.
 */
 void TR_file_destroy(TR_file* f)
@@ -85,8 +102,8 @@ void TR_file_destroy(TR_file* f)
   /* destroy blob list*/
   for (blob_record = f->first; blob_record != NULL;) {
     tmp = blob_record->next;
-    checked_free(blob_record->value);
-    checked_free(blob_record);
+    TR_blob_release_value(blob_record);
+    mem_pool_release(TR_blob_pool, blob_record);
     blob_record = tmp;
   }
 
@@ -100,11 +117,55 @@ void TR_file_destroy(TR_file* f)
 
   pthread_mutex_destroy(&f->mutex);
 
-  checked_free(f);
+  mem_pool_release(TR_file_pool, f);
 
   return;
 }
 
+/** Create a new TR_blob structure, with a value of the given size (if not zero).
+  * Taken from memory pools.
+*/
+TR_blob* TR_blob_new(int size)
+{
+  TR_blob* new_blob;
+
+  pthread_once(&TR_file_pool_once, TR_file_pool_init);
+  new_blob = (TR_blob*)mem_pool_get(TR_blob_pool);
+  if (new_blob == NULL) {
+    return NULL;
+  }
+  new_blob->value = NULL;
+  new_blob->size = 0;
+  new_blob->buffer_size = 0;
+  new_blob->next = NULL;
+
+  if (size > 0) {
+    new_blob->value = mem_buffer_get(size + 1);
+    if (new_blob->value == NULL) {
+      mem_pool_release(TR_blob_pool, new_blob);
+      return NULL;
+    }
+    ((char*)new_blob->value)[size] = 0;
+    new_blob->size = size;
+    new_blob->buffer_size = size + 1;
+  }
+
+  return new_blob;
+}
+
+/** Release value of a TR_blob, the way it was allocated.
+*/
+void TR_blob_release_value(TR_blob* b)
+{
+  if (b->buffer_size > 0) {
+    mem_buffer_release(b->value, b->buffer_size);
+  } else {
+    checked_free(b->value);
+  }
+  b->value = NULL;
+  b->buffer_size = 0;
+}
+
 /** Increment the counter of users for the file.
 */
 void TR_file_inc_usage(TR_file* f)
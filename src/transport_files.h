@@ -45,9 +45,24 @@ typedef struct {
 typedef struct _TR_blob {
   void* value;           /**< data value*/
   int size;              /**< data size */
+  int buffer_size;       /**< size given to mem_buffer_get() if value was allocated from memory pools, 0 if allocated with checked_malloc() */
   struct _TR_blob* next; /**< next in the list */
 } TR_blob;
 
+/** Protocol option negotiated on connection (INI / READY) : a file may contain several messages, each NUL-terminated */
+#define TR_PROTOCOL_OPTION_BATCH "BATCH"
+
+/** Protocol option negotiated on connection (INI / READY) : messages may be re-encoded by client before sending (binary format) */
+#define TR_PROTOCOL_OPTION_BINARY "BINARY"
+
+/** Protocol option negotiated on connection (INI / READY) : flow control window.
+    Server acknowledges as "ACK minId majId window", window being the number of files the client may send without acknowledgement. */
+#define TR_PROTOCOL_OPTION_WINDOW "WINDOW"
+
+/** Protocol options a file relies on (see TR_file.options), or accepted on a connection */
+#define TR_OPTION_BATCH 0x01  /**< several messages in a file (TR_PROTOCOL_OPTION_BATCH) */
+#define TR_OPTION_BINARY 0x02 /**< binary messages (TR_PROTOCOL_OPTION_BINARY) */
+
 #define TR_FILE_STATUS_NONE 0
 #define TR_FILE_STATUS_TRANSMITTED 1
 
@@ -55,10 +70,11 @@ typedef struct _TR_blob {
 typedef struct {
   TR_file_id id;
 
-  /* the list of blobs must be allocated with checked_malloc() */
+  /* the list of blobs must be allocated with TR_blob_new() */
   struct _TR_blob* first;
   struct _TR_blob* last;
   int size; /** Total data size */
+  int options; /** Protocol options (TR_OPTION_...) needed to send the content. 0 by default */
 
   /* internal vars */
   char* path;            /** Path to the directory where it is stored. NULL if not on disk 
@@ -76,17 +92,27 @@ typedef struct {
 int TR_file_id_compare(TR_file_id f1, TR_file_id f2);
 
 /** Create a new TR_file structure.
-  * Uses checked_malloc().
+  * Taken from a memory pool (see mem_pool_get()).
   * @return : an initialized TR_file. NULL if failure.
 */
 TR_file* TR_file_new();
 
 /** Destroy a TR_file structure.
-  * Resources (including list of TR_blobs) are deallocated with checked_free().
+  * Resources (including list of TR_blobs) are released to memory pools, or deallocated with checked_free().
   * @return : nothing.
 */
 void TR_file_destroy(TR_file* f);
 
+/** Create a new TR_blob structure, taken from a memory pool.
+  * If size is not zero, the value is a buffer of size bytes from memory pools (see mem_buffer_get()), followed by a NUL byte.
+  * Otherwise, value is NULL and can be set by caller with a buffer allocated by checked_malloc().
+  * @return : an initialized TR_blob (not part of a list). NULL if failure.
+*/
+TR_blob* TR_blob_new(int size);
+
+/** Release value of a TR_blob (to memory pools, or with checked_free()). Value is set to NULL. */
+void TR_blob_release_value(TR_blob* b);
+
 /** Increment the counter of users for the file.
 */
 void TR_file_inc_usage(TR_file* f);
@@ -84,6 +84,12 @@ void* TR_proxy_main(void* arg)
   cl_config.client_name = the_proxy->proxy_name;
   cl_config.proxy_state = TR_PROXY_IS_PROXY;
   cl_config.msg_queue_path = NULL;
+  cl_config.msg_queue_sync = 0;
+  cl_config.msg_queue_sync_interval = 0;
+  cl_config.batch_max_msg = 0;
+  cl_config.batch_max_size = 0;
+  cl_config.batch_max_delay = 0;
+  cl_config.file_options = TR_OPTION_BATCH | TR_OPTION_BINARY; /* files are forwarded as received */
 
   cl_h = TR_client_start(&cl_config);
   if (cl_h == NULL) {
@@ -96,6 +102,7 @@ void* TR_proxy_main(void* arg)
   srv_config.server_port = the_proxy->proxy_port;
   srv_config.max_clients = TR_PROXY_MAX_CLIENTS;
   srv_config.queue_length = TR_PROXY_SERVER_QUEUE;
+  srv_config.rx_threads = 1;
 
   srv_h = TR_server_start(&srv_config);
   if (srv_h == NULL) {
@@ -103,6 +110,8 @@ void* TR_proxy_main(void* arg)
     slog(SLOG_ERROR, "Proxy : can not start server");
     return NULL;
   }
+  /* files are forwarded as received: accept from clients only the protocol options accepted upstream */
+  TR_server_set_options(srv_h, 0);
 
   /* finalize init */
   the_proxy->running = 1;
@@ -114,6 +123,9 @@ void* TR_proxy_main(void* arg)
 				   the control code if it wishes some delay
 				   at the end of the loop. */
 
+    /* options accepted upstream may change on reconnection */
+    TR_server_set_options(srv_h, TR_client_getOptions(cl_h));
+
     /* PART ONE : file transmission */
 
     /* Is there some free space in transmit buffer? */
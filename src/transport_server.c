@@ -19,11 +19,14 @@
  *  If set to 'log', output is done in usual log file
  *
  *  Output format:
- *  	time	number of connexions	bytes received	average (kb/s)
+ *  	time	number of connexions	files received	bytes received	average (b/s)	memory allocated	output queue usage (%)
+ *  	files in flight (received, not acknowledged)	average ack latency (ms)	max ack latency (ms)	window
  *
  *
  *  Updates:
  * 	   11/2003: added server support for UDP data
+ *	10/2026: flow control window negotiated with clients, acknowledgements every 100ms at most
+ *	10/2026: TCP reception based on epoll, connections shared between several receiving threads
  *	04/03/2003: code rewritten - single threaded
  *	19/12/2002: KEEP_ALIVE option on sockets, client name logging when disconnected
  *
@@ -48,6 +51,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 
 #include <errno.h>
@@ -61,15 +66,21 @@
 #define TR_SERVER_DEBUG 1
 */
 
-#define TR_SERVER_LOG_HEADER "Server : "      /** Header to log messages */
-#define TR_SERVER_MAX_INCOMING_CONNECTIONS 50 /** listening socket backlog parameter : see `man 2 listen` */
-#define TR_SERVER_BUFFER_SIZE 5000            /** Reception buffer size for a client. */
-#define TR_SERVER_QUEUE_LENGTH 1000           /** Number of files stored in/out FIFOs */
-#define TR_SERVER_ACK_MAX_FILES 20            /** Maximum number of files received before acknowledging \
+#define TR_SERVER_LOG_HEADER "Server : "        /** Header to log messages */
+#define TR_SERVER_MAX_INCOMING_CONNECTIONS 1024 /** listening socket backlog parameter : see `man 2 listen` */
+#define TR_SERVER_EPOLL_EVENTS 256              /** Maximum number of events processed per wakeup of a receiving thread */
+#define TR_SERVER_EXTRA_FILES 64                /** Number of file descriptors needed in addition to client sockets */
+#define TR_SERVER_BUFFER_SIZE 5000              /** Reception buffer size for a client. */
+#define TR_SERVER_QUEUE_LENGTH 1000             /** Number of files stored in/out FIFOs */
+#define TR_SERVER_ACK_MAX_FILES 20              /** Maximum number of files received before acknowledging \
                         This should never be more than the output FIFO of the client.                   \
                         This will limit the number of files transmitted by second otherwise.            \
-                        An acknowledge is done every second, disregarding number of files received.     \
+                        An acknowledge is done every TR_SERVER_ACK_DELAY, disregarding number of files received. \
+                        For clients using a window, acknowledge is done after a quarter of the window.  \
                     */
+#define TR_SERVER_ACK_DELAY 100                 /** Maximum time (milliseconds) before acknowledging files received */
+#define TR_SERVER_WINDOW_MIN 4                  /** Minimum window advertised to clients (number of files) */
+#define TR_SERVER_WINDOW_MAX 10000              /** Maximum window advertised to clients (number of files) */
 
 /* UDP settings */
 #define TR_SERVER_UDP_SOCKETBUFFER 2000000 /* Size of socket buffer for UDP */
@@ -101,9 +112,26 @@ struct _TR_data_connection {
   TR_file_id ack_file;  /**< file id to acknowledged */
   int non_acknowledged; /**< number of files not acknowledged yet*/
 
+  int opt_window;                 /**< set when client uses flow control window */
+  int options;                    /**< protocol options (TR_OPTION_...) accepted for this connection */
+  int client_window;              /**< window currently used by client (can be less than the one advertised by server) */
+  int rx_unacked;                 /**< number of files received and not acknowledged yet to client */
+  struct timeval rx_unacked_time; /**< reception time of oldest file not acknowledged yet to client */
+
   pthread_mutex_t mutex; /**< mutex for cx_id, ack_file, and socket variables   */
 };
 
+/** Structure describing a thread receiving data from a subset of the connections.
+    Connections are assigned to thread number cx_id % number of threads.
+    The first thread also accepts new connections, and does the periodic tasks (acknowledge, statistics).
+*/
+struct _TR_rx_thread {
+  pthread_t thread;          /**< Handle to the thread */
+  int epoll_fd;              /**< epoll instance monitoring the sockets of this thread */
+  int index;                 /**< Thread index */
+  struct _TR_server* handle; /**< handle to the server */
+};
+
 /** Structure containing all server data.
     A handle to a server is a reference to such a structure.
 */
@@ -111,7 +139,10 @@ struct _TR_server {
   int listen_sock; /**< The socket on which the server accepts connections. */
   int server_type; /**< The server type: TR_SERVER_UDP or TR_SERVER_TCP */
 
-  pthread_t thread; /**< Handle to the state machine thread */
+  pthread_t thread; /**< Handle to the state machine thread (UDP) */
+
+  struct _TR_rx_thread* rx_threads; /**< Array of receiving threads (TCP) */
+  int rx_threads_count;             /**< Number of receiving threads */
 
   struct _TR_data_connection* cx_table; /**< Array of connections */
   int cx_table_size;                    /**< Number of connections allowed */
@@ -123,6 +154,9 @@ struct _TR_server {
   int cx_counter; /**< A counter to identify connexions */
 
   struct ptFIFO* output_queue; /**< The queue of files received - contains TR_file structs* to be freed */
+  int output_queue_length;     /**< Size of output queue */
+  int window;                  /**< Window advertised to clients: number of files they may send without acknowledgement */
+  int options;                 /**< Protocol options (TR_OPTION_...) which may be accepted from new clients */
 
   /* statistics */
   char* stat_file;            /**< file to output statistics. NULL if function disabled */
@@ -131,31 +165,52 @@ struct _TR_server {
   int stat_bytes_received;    /**< number of bytes received */
   int stat_files_received;    /**< number of files received */
   int stat_connected_clients; /**< number of connected clients */
+  int stat_files_in_flight;   /**< number of files received and not acknowledged yet to clients */
+
+  pthread_mutex_t stat_mutex;       /**< lock on acknowledge latency statistics */
+  long long stat_ack_latency_sum;     /**< sum of acknowledge latencies (ms) */
+  long long stat_ack_latency_count;   /**< number of acknowledges sent */
+  int stat_ack_latency_max;           /**< max acknowledge latency (ms) */
+  long long stat_ack_latency_sum_p;   /**< same as above, for the periodic stats file */
+  long long stat_ack_latency_count_p;
+  int stat_ack_latency_max_p;
 };
 
+/* time elapsed between t0 and t1, in milliseconds */
+static int TR_server_elapsed_ms(struct timeval* t0, struct timeval* t1)
+{
+  return (int)((t1->tv_sec - t0->tv_sec) * 1000 + (t1->tv_usec - t0->tv_usec) / 1000);
+}
+
 /* close a given connexion */
+/* the slot may be reused for a new connection as soon as socket is set to -1, so this is done last */
 void TR_server_connection_close(struct _TR_data_connection* cx)
 {
 
+  /* delete file being received if any */
+  TR_file_destroy(cx->current_file);
+  cx->current_file = NULL;
+
+  slog(SLOG_INFO, TR_SERVER_LOG_HEADER "%s disconnected", inet_ntoa(cx->address.sin_addr));
+
   /* mutex to ensure nobody is acknowledging on this socket in another thread */
 
   pthread_mutex_lock(&cx->mutex);
 
-  close(cx->socket);
-  cx->socket = -1;
-  cx->cx_id = -1;
-
 #ifdef TR_SERVER_DEBUG
   slog(SLOG_INFO, TR_SERVER_LOG_HEADER "last ack file %d %d", cx->ack_file.minId, cx->ack_file.majId);
 #endif
 
-  pthread_mutex_unlock(&cx->mutex);
+  /* closed socket is removed automatically from epoll set */
+  close(cx->socket);
+  cx->socket = -1;
+  cx->cx_id = -1;
 
-  /* delete file being received if any */
-  TR_file_destroy(cx->current_file);
-  cx->current_file = NULL;
+  /* files not acknowledged will be sent again by client */
+  __sync_fetch_and_sub(&cx->handle->stat_files_in_flight, cx->rx_unacked);
+  cx->rx_unacked = 0;
 
-  slog(SLOG_INFO, TR_SERVER_LOG_HEADER "%s disconnected", inet_ntoa(cx->address.sin_addr));
+  pthread_mutex_unlock(&cx->mutex);
 
   return;
 }
@@ -170,9 +225,10 @@ int TR_server_connection_read(struct _TR_data_connection* cx)
   char* end_buffer = NULL;
   char* end_line = NULL;
   char* parse_ptr = NULL;
-  int min_id, maj_id, size;
+  int min_id, maj_id, size, window;
 
   int result, i;
+  int cx_id = cx->cx_id; /**< to detect when connection is closed */
 
 #ifdef TR_SERVER_DEBUG
   slog(SLOG_INFO, "Reception in progress");
@@ -228,8 +284,8 @@ int TR_server_connection_read(struct _TR_data_connection* cx)
   }
 
   /* Now parse buffer content - can be several lines */
-  /* Check connection still valid (can be closed during parsing) */
-  for (; cx->socket != -1;) {
+  /* Check connection still valid (can be closed during parsing, and slot reused by another connection) */
+  for (; cx->cx_id == cx_id;) {
 
     /* does the buffer contain a full line? */
     end_line = strchr(parse_ptr, '\n');
@@ -274,10 +330,16 @@ int TR_server_connection_read(struct _TR_data_connection* cx)
           min_id = -1;
           maj_id = -1;
           size = 0;
-          if ((4 != sscanf(parse_ptr, "File %s %d %d %d", buffer_tmp, &min_id, &maj_id, &size)) || (size <= 0)) {
+          window = 0;
+          /* clients using a window give its current value after file size */
+          result = sscanf(parse_ptr, "File %s %d %d %d %d", buffer_tmp, &min_id, &maj_id, &size, &window);
+          if ((result < 4) || (size <= 0)) {
             slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "Can't parse %s", parse_ptr);
             TR_server_connection_close(cx);
           } else {
+            if (result == 5) {
+              cx->client_window = window;
+            }
 
 #ifdef TR_SERVER_DEBUG
             slog(SLOG_INFO, "Client %03d : receiving file	%d %d (%d bytes)", cx->cx_id, min_id, maj_id, size);
@@ -289,14 +351,10 @@ int TR_server_connection_read(struct _TR_data_connection* cx)
             cx->current_file->id.source = checked_strdup(buffer_tmp);
             cx->current_file->id.sender = cx->cx_id;
             cx->current_file->id.sender_magic = (void*)cx;
-            cx->current_file->first = checked_malloc(sizeof(struct _TR_blob));
+            cx->current_file->first = TR_blob_new(size); /* NULL terminated value will help parsing */
             cx->current_file->last = cx->current_file->first;
             cx->current_file->size = size;
-
-            cx->current_file->first->size = size;
-            cx->current_file->first->next = NULL;
-            cx->current_file->first->value = checked_malloc(size + 1);
-            ((char*)cx->current_file->first->value)[size] = 0; /* NULL terminated value will help parsing */
+            cx->current_file->options = cx->options;
 
             cx->state = TR_SERVER_STATE_RECEIVING_FILE;
 
@@ -336,15 +394,24 @@ int TR_server_connection_read(struct _TR_data_connection* cx)
             slog(SLOG_INFO, "File received : %s", cx->current_file->first->value);
 #endif
 
+            /* keep track of files not acknowledged to client */
+            pthread_mutex_lock(&cx->mutex);
+            if (cx->rx_unacked == 0) {
+              gettimeofday(&cx->rx_unacked_time, NULL);
+            }
+            cx->rx_unacked++;
+            pthread_mutex_unlock(&cx->mutex);
+            __sync_fetch_and_add(&cx->handle->stat_files_in_flight, 1);
+
             /* try to push to output buffer */
             for (i = 0;; i++) {
 #ifdef TR_SERVER_DEBUG
               slog(SLOG_INFO, "Try to write FIFO");
 #endif
 
-              /* update statistics */
-              cx->handle->stat_bytes_received += cx->current_file->size;
-              cx->handle->stat_files_received++;
+              /* update statistics - shared by receiving threads */
+              __sync_fetch_and_add(&cx->handle->stat_bytes_received, cx->current_file->size);
+              __sync_fetch_and_add(&cx->handle->stat_files_received, 1);
 
               result = ptFIFO_write(cx->handle->output_queue, cx->current_file, 1);
 
@@ -382,12 +449,42 @@ int TR_server_connection_read(struct _TR_data_connection* cx)
 
         case TR_SERVER_STATE_INIT:
 
-          /* here we should parse 'INI node ...' command */
-
-          snprintf(buffer_tmp, TR_SERVER_BUFFER_SIZE, "READY\n");
-          result = send(cx->socket, buffer_tmp, 6, MSG_DONTWAIT);
+          /* parse 'INI node proxy_state [options]' command */
+          /* options are protocol extensions supported by client, the ones accepted are given back in reply */
+          /* files with several messages, or binary messages, are handled by decoder, nothing to do here */
+          /* they are accepted unless restricted by TR_server_set_options() */
+          {
+            char* tok;
+            char* tok_ptr = NULL;
+            int tok_n = 0;
+            int opt_batch = 0;
+            int opt_binary = 0;
+            int opt_window = 0;
+            int options = cx->handle->options;
+            if (!strncmp(parse_ptr, "INI ", 4)) {
+              for (tok = strtok_r(parse_ptr, " ", &tok_ptr); tok != NULL; tok = strtok_r(NULL, " ", &tok_ptr)) {
+                if ((tok_n >= 3) && (!strcmp(tok, TR_PROTOCOL_OPTION_BATCH)) && (options & TR_OPTION_BATCH)) {
+                  opt_batch = 1;
+                }
+                if ((tok_n >= 3) && (!strcmp(tok, TR_PROTOCOL_OPTION_BINARY)) && (options & TR_OPTION_BINARY)) {
+                  opt_binary = 1;
+                }
+                if ((tok_n >= 3) && (!strcmp(tok, TR_PROTOCOL_OPTION_WINDOW))) {
+                  opt_window = 1;
+                }
+                tok_n++;
+              }
+            }
+            snprintf(buffer_tmp, TR_SERVER_BUFFER_SIZE, "READY%s%s%s\n", opt_batch ? " " TR_PROTOCOL_OPTION_BATCH : "", opt_binary ? " " TR_PROTOCOL_OPTION_BINARY : "", opt_window ? " " TR_PROTOCOL_OPTION_WINDOW : "");
+            pthread_mutex_lock(&cx->mutex);
+            cx->opt_window = opt_window;
+            cx->options = (opt_batch ? TR_OPTION_BATCH : 0) | (opt_binary ? TR_OPTION_BINARY : 0);
+            pthread_mutex_unlock(&cx->mutex);
+          }
+          size = strlen(buffer_tmp);
+          result = send(cx->socket, buffer_tmp, size, MSG_DONTWAIT);
 
-          if (result != 6) {
+          if (result != size) {
             /* don't waste time on this socket */
             slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "send failed");
             TR_server_connection_close(cx);
@@ -413,14 +510,35 @@ int TR_server_connection_read(struct _TR_data_connection* cx)
 
 /* acknowledge files for a given connection */
 /* this function is thread-safe */
+/* if min_number < 0, the minimum number of files is the default for this connection */
+/* returns 0 if connection is active, -1 otherwise */
 
-void TR_server_acknowledge_files(struct _TR_data_connection* cx, int min_number)
+int TR_server_acknowledge_files(struct _TR_data_connection* cx, int min_number)
 {
   char buffer_ack[TR_SERVER_BUFFER_SIZE];
+  int result = -1;
+  int window;
+  struct timeval now;
+  int latency;
 
   pthread_mutex_lock(&cx->mutex);
 
   if (cx->socket != -1) {
+    result = 0;
+
+    /* acknowledge early enough for the client to keep sending */
+    window = cx->handle->window;
+    if (min_number < 0) {
+      if (cx->opt_window) {
+        min_number = window;
+        if ((cx->client_window > 0) && (cx->client_window < min_number)) {
+          min_number = cx->client_window;
+        }
+        min_number = min_number / 4;
+      } else {
+        min_number = TR_SERVER_ACK_MAX_FILES;
+      }
+    }
 
     if (cx->non_acknowledged > min_number) {
 
@@ -431,17 +549,54 @@ void TR_server_acknowledge_files(struct _TR_data_connection* cx, int min_number)
            cx->ack_file.sender);
 #endif
 
-      snprintf(buffer_ack, TR_SERVER_BUFFER_SIZE, "ACK %d %d\n",
-               cx->ack_file.minId,
-               cx->ack_file.majId);
+      /* window is given along with acknowledge, if client uses it */
+      if (cx->opt_window) {
+        snprintf(buffer_ack, TR_SERVER_BUFFER_SIZE, "ACK %d %d %d\n",
+                 cx->ack_file.minId,
+                 cx->ack_file.majId,
+                 window);
+      } else {
+        snprintf(buffer_ack, TR_SERVER_BUFFER_SIZE, "ACK %d %d\n",
+                 cx->ack_file.minId,
+                 cx->ack_file.majId);
+      }
 
       if (send(cx->socket, buffer_ack, strlen(buffer_ack), MSG_DONTWAIT) != -1) {
+
+        /* update statistics: time since reception of oldest file acknowledged */
+        gettimeofday(&now, NULL);
+        latency = TR_server_elapsed_ms(&cx->rx_unacked_time, &now);
+        pthread_mutex_lock(&cx->handle->stat_mutex);
+        cx->handle->stat_ack_latency_sum += latency;
+        cx->handle->stat_ack_latency_count++;
+        if (latency > cx->handle->stat_ack_latency_max) {
+          cx->handle->stat_ack_latency_max = latency;
+        }
+        if (cx->handle->stat_file != NULL) {
+          cx->handle->stat_ack_latency_sum_p += latency;
+          cx->handle->stat_ack_latency_count_p++;
+          if (latency > cx->handle->stat_ack_latency_max_p) {
+            cx->handle->stat_ack_latency_max_p = latency;
+          }
+        }
+        pthread_mutex_unlock(&cx->handle->stat_mutex);
+
+        /* remaining files were received at most now */
+        if (cx->non_acknowledged > cx->rx_unacked) {
+          cx->non_acknowledged = cx->rx_unacked;
+        }
+        __sync_fetch_and_sub(&cx->handle->stat_files_in_flight, cx->non_acknowledged);
+        cx->rx_unacked -= cx->non_acknowledged;
+        cx->rx_unacked_time = now;
+
         cx->non_acknowledged = 0;
       }
     }
   }
 
   pthread_mutex_unlock(&cx->mutex);
+
+  return result;
 }
 
 /* output file statistics */
@@ -450,22 +605,42 @@ void TR_server_print_stats(TR_server_handle h, time_t new_time)
 
   FILE* fp; /**< A file pointer for the stat file */
   long the_mem_alloc;
+  int bytes_received, files_received;
+  long long ack_latency_sum, ack_latency_count;
+  int ack_latency_max;
 
   if (h->stat_file != NULL) {
     if (new_time - h->stat_last_time >= h->stat_sample_freq) {
       the_mem_alloc = checked_memstat();
 
+      /* counters are updated concurrently by the receiving threads: get and reset them at once */
+      bytes_received = __sync_lock_test_and_set(&h->stat_bytes_received, 0);
+      files_received = __sync_lock_test_and_set(&h->stat_files_received, 0);
+
+      pthread_mutex_lock(&h->stat_mutex);
+      ack_latency_sum = h->stat_ack_latency_sum_p;
+      ack_latency_count = h->stat_ack_latency_count_p;
+      ack_latency_max = h->stat_ack_latency_max_p;
+      h->stat_ack_latency_sum_p = 0;
+      h->stat_ack_latency_count_p = 0;
+      h->stat_ack_latency_max_p = 0;
+      pthread_mutex_unlock(&h->stat_mutex);
+
       if (strcmp("log", h->stat_file)) {
         fp = fopen(h->stat_file, "a");
         if (fp != NULL) {
-          fprintf(fp, "%d\t%d\t%d\t%d\t%.2f\t%ld\t%d\n",
+          fprintf(fp, "%d\t%d\t%d\t%d\t%.2f\t%ld\t%d\t%d\t%d\t%d\t%d\n",
                   (int)new_time,
                   h->stat_connected_clients,
-                  h->stat_files_received,
-                  h->stat_bytes_received,
-                  h->stat_bytes_received * 1.0 / h->stat_sample_freq,
+                  files_received,
+                  bytes_received,
+                  bytes_received * 1.0 / h->stat_sample_freq,
                   the_mem_alloc,
-                  (int)(100 * ptFIFO_space_used(h->output_queue)));
+                  (int)(100 * ptFIFO_space_used(h->output_queue)),
+                  h->stat_files_in_flight,
+                  ack_latency_count ? (int)(ack_latency_sum / ack_latency_count) : 0,
+                  ack_latency_max,
+                  h->window);
           fclose(fp);
         }
       } else {
@@ -479,151 +654,178 @@ void TR_server_print_stats(TR_server_handle h, time_t new_time)
 				);
                                 */
       }
-      h->stat_bytes_received = 0;
-      h->stat_files_received = 0;
       h->stat_last_time = new_time;
     }
   }
 }
 
-/* state machine running in a separate thread */
-void* TR_server_state_machine(void* arg)
+/* compute window advertised to clients: free space in output queue, shared between clients */
+void TR_server_update_window(struct _TR_server* h)
 {
-  struct _TR_server* h; /**< Server handle */
+  int window;
 
-  fd_set select_read; /**< List of sockets to select */
-  int highest_sock;
-  struct timeval tv;
-  int result;
+  window = (int)((1.0 - ptFIFO_space_used(h->output_queue)) * h->output_queue_length);
+  if (h->stat_connected_clients > 1) {
+    window = window / h->stat_connected_clients;
+  }
+  if (window < TR_SERVER_WINDOW_MIN) {
+    window = TR_SERVER_WINDOW_MIN;
+  }
+  if (window > TR_SERVER_WINDOW_MAX) {
+    window = TR_SERVER_WINDOW_MAX;
+  }
+  h->window = window;
+}
 
+/* accept new connections, and assign them to a receiving thread */
+/* called by the first receiving thread only */
+void TR_server_accept(struct _TR_server* h)
+{
   int new_cl_sock;                /**< socket address for new client */
   struct sockaddr_in new_cl_addr; /**< address of new client */
   socklen_t cl_addr_len;          /**< address length */
+  struct _TR_data_connection* cx;
+  struct epoll_event ev;
+  int i, n;
 
-  int i;
+  /* listening socket is non-blocking: get all pending connections, up to backlog size */
+  for (n = 0; n < TR_SERVER_MAX_INCOMING_CONNECTIONS; n++) {
 
-  int abort_loop; /**< flag in case we want to abort current processes to check shutdown status */
+    cl_addr_len = sizeof(new_cl_addr);
+    new_cl_sock = accept(h->listen_sock, (struct sockaddr*)&new_cl_addr, &cl_addr_len);
 
-  time_t the_time, new_time; /**< A counter to measure time from loop to loop */
+    if (new_cl_sock < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "accept - %d", errno);
+      }
+      break;
+    }
 
-  h = (struct _TR_server*)arg;
-  the_time = 0;
+    slog(SLOG_INFO, TR_SERVER_LOG_HEADER "%s connected on port %d", inet_ntoa(new_cl_addr.sin_addr), new_cl_addr.sin_port);
 
-  for (;;) {
-    /*
-		printf(".\n");
-		fflush(stdout);
-		*/
+    /* find a free slot - a slot freed (socket = -1) by a receiving thread is not used by it any more */
+    cx = NULL;
+    for (i = 0; i < h->cx_table_size; i++) {
+      if (h->cx_table[i].socket == -1) {
+        cx = &h->cx_table[i];
 
-    abort_loop = 0;
+        pthread_mutex_lock(&cx->mutex);
 
-    /* create a 'select' list */
-    FD_ZERO(&select_read);
+        cx->socket = new_cl_sock;
+        cx->address = new_cl_addr;
 
-    /* first socket is the listening socket for new connections */
-    FD_SET(h->listen_sock, &select_read);
-    highest_sock = h->listen_sock;
+        cx->state = TR_SERVER_STATE_INIT;
+        cx->buffer_start = 0;
 
-    /* add the connected clients */
-    for (i = 0; i < h->cx_table_size; i++) {
-      if (h->cx_table[i].socket != -1) {
-        FD_SET(h->cx_table[i].socket, &select_read);
-        if (h->cx_table[i].socket > highest_sock) {
-          highest_sock = h->cx_table[i].socket;
-        }
-      }
-    }
+        cx->current_file = NULL;
 
-    /* timeout after a while to allow for server shutdown if needed */
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
-
-    /* wait events (read/errors) */
-    result = select(highest_sock + 1, &select_read, NULL, NULL, &tv);
+        cx->cx_id = h->cx_counter++;
+        cx->ack_file.minId = 0;
+        cx->ack_file.majId = 0;
+        cx->non_acknowledged = 0;
 
-    if (result < 0) {
+        cx->opt_window = 0;
+        cx->options = 0;
+        cx->client_window = 0;
+        cx->rx_unacked = 0;
 
-      /* an error occurred */
-      slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "select - error %d", errno);
+        pthread_mutex_unlock(&cx->mutex);
 
-    } else if (result > 0) {
+        break;
+      }
+    }
 
-      /* some sockets are ready */
+    /* check if a free slot was found */
+    if (cx == NULL) {
+      close(new_cl_sock);
+      slog(SLOG_WARNING, TR_SERVER_LOG_HEADER "no more clients allowed - disconnecting");
+      continue;
+    }
 
-      /* read from clients */
-      for (i = 0; i < h->cx_table_size; i++) {
-        if (h->cx_table[i].socket != -1) {
-          if (FD_ISSET(h->cx_table[i].socket, &select_read)) {
+    /* the connection is now handled by one of the receiving threads */
+    ev.events = EPOLLIN;
+    ev.data.ptr = cx;
+    if (epoll_ctl(h->rx_threads[(unsigned int)cx->cx_id % h->rx_threads_count].epoll_fd, EPOLL_CTL_ADD, new_cl_sock, &ev) < 0) {
+      slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "epoll_ctl - %d", errno);
+      TR_server_connection_close(cx);
+    }
+  }
+}
 
-            if (TR_server_connection_read(&h->cx_table[i]) != 0) {
-              /* abort if FIFO full to check if shutdown pending */
-              abort_loop = 1;
-              break;
-            }
-          }
-        }
-      }
+/* state machine running in a separate thread */
+/* there is one such thread for each receiving thread, each one reading from its own set of connections */
+void* TR_server_state_machine(void* arg)
+{
+  struct _TR_rx_thread* t; /**< Receiving thread */
+  struct _TR_server* h;    /**< Server handle */
 
-      /* update client list : accept new connections */
-      if ((!abort_loop) && (FD_ISSET(h->listen_sock, &select_read))) {
+  struct epoll_event events[TR_SERVER_EPOLL_EVENTS]; /**< List of sockets ready */
+  struct _TR_data_connection* cx;
+  int result;
 
-        cl_addr_len = sizeof(new_cl_addr);
-        new_cl_sock = accept(h->listen_sock, (struct sockaddr*)&new_cl_addr, &cl_addr_len);
+  int i;
 
-        if (new_cl_sock < 0) {
-          slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "accept - %d", errno);
-        } else {
-          slog(SLOG_INFO, TR_SERVER_LOG_HEADER "%s connected on port %d", inet_ntoa(new_cl_addr.sin_addr), new_cl_addr.sin_port);
+  struct timeval the_time, new_time; /**< To measure time from loop to loop */
+  int n_connected;
 
-          for (i = 0; i < h->cx_table_size; i++) {
-            if (h->cx_table[i].socket == -1) {
+  t = (struct _TR_rx_thread*)arg;
+  h = t->handle;
+  timerclear(&the_time);
 
-              pthread_mutex_lock(&h->cx_table[i].mutex);
+  for (;;) {
 
-              h->cx_table[i].socket = new_cl_sock;
-              h->cx_table[i].address = new_cl_addr;
+    /* wait events (read/errors) */
+    /* timeout after a while to allow for server shutdown if needed, or periodic tasks in first thread */
+    result = epoll_wait(t->epoll_fd, events, TR_SERVER_EPOLL_EVENTS, (t->index == 0) ? TR_SERVER_ACK_DELAY : 1000);
 
-              h->cx_table[i].state = TR_SERVER_STATE_INIT;
-              h->cx_table[i].buffer_start = 0;
+    if (result < 0) {
 
-              h->cx_table[i].current_file = NULL;
+      /* an error occurred */
+      if (errno != EINTR) {
+        slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "epoll_wait - error %d", errno);
+      }
 
-              h->cx_table[i].cx_id = h->cx_counter++;
-              h->cx_table[i].ack_file.minId = 0;
-              h->cx_table[i].ack_file.majId = 0;
-              h->cx_table[i].non_acknowledged = 0;
+    } else {
 
-              pthread_mutex_unlock(&h->cx_table[i].mutex);
+      /* some sockets are ready */
+      for (i = 0; i < result; i++) {
+        cx = (struct _TR_data_connection*)events[i].data.ptr;
 
-              break;
-            }
-          }
+        if (cx == NULL) {
+          /* update client list : accept new connections */
+          TR_server_accept(h);
+          continue;
+        }
 
-          /* check if a free slot was found */
-          if (i == h->cx_table_size) {
-            close(new_cl_sock);
-            slog(SLOG_WARNING, TR_SERVER_LOG_HEADER "no more clients allowed - disconnecting");
-          }
+        /* read from client */
+        if (TR_server_connection_read(cx) != 0) {
+          /* abort if FIFO full to check if shutdown pending */
+          break;
         }
       }
     }
 
-    /* To do once a second at most */
-    time(&new_time);
-    if (the_time != new_time) {
-      the_time = new_time;
+    /* To do every TR_SERVER_ACK_DELAY at most, by first thread */
+    if (t->index == 0) {
+      gettimeofday(&new_time, NULL);
+      if (TR_server_elapsed_ms(&the_time, &new_time) >= TR_SERVER_ACK_DELAY) {
+        the_time = new_time;
+
+        /* window depends on output queue usage */
+        TR_server_update_window(h);
 
-      /* acknowledge file received if needed - no minimum number of files*/
-      h->stat_connected_clients = 0;
-      for (i = 0; i < h->cx_table_size; i++) {
-        if (h->cx_table[i].socket != -1) {
-          h->stat_connected_clients++;
-          TR_server_acknowledge_files(&h->cx_table[i], 0);
+        /* acknowledge file received if needed - no minimum number of files*/
+        n_connected = 0;
+        for (i = 0; i < h->cx_table_size; i++) {
+          if (TR_server_acknowledge_files(&h->cx_table[i], 0) == 0) {
+            n_connected++;
+          }
         }
-      }
+        h->stat_connected_clients = n_connected;
 
-      /* issue server statistics when required */
-      TR_server_print_stats(h, new_time);
+        /* issue server statistics when required */
+        TR_server_print_stats(h, new_time.tv_sec);
+      }
     }
 
     /* shutdown requested? */
@@ -726,13 +928,12 @@ void* TR_UDP_server_state_machine(void* arg)
         new_file->id.sender = 0;
         new_file->id.sender_magic = NULL;
 
-        new_file->first = checked_malloc(sizeof(struct _TR_blob));
+        new_file->first = TR_blob_new(bytes_rcv);
         new_file->last = new_file->first;
         new_file->size = bytes_rcv;
-
-        new_file->first->size = bytes_rcv;
-        new_file->first->next = NULL;
-        new_file->first->value = checked_strdup(buf);
+        if (bytes_rcv > 0) {
+          memcpy(new_file->first->value, buf, bytes_rcv);
+        }
 
         /* insert in output queue */
         if (ptFIFO_write(h->output_queue, new_file, 0) == -1) {
@@ -794,6 +995,12 @@ TR_server_handle TR_server_start(TR_server_configuration* config)
   unsigned long ulSocketBufferSize;
   socklen_t opt_size;
 
+  /* TCP vars */
+  struct rlimit fd_limit;
+  struct epoll_event ev;
+  struct _TR_rx_thread* rx_threads = NULL;
+  int rx_threads_count = 0;
+
   if ((config->server_type != TR_SERVER_UDP) && (config->server_type != TR_SERVER_TCP)) {
     slog(SLOG_ERROR, "Bad server type");
     return NULL;
@@ -876,6 +1083,49 @@ TR_server_handle TR_server_start(TR_server_configuration* config)
       close(listen_sock);
       return NULL;
     }
+
+    /* new connections are accepted until none left */
+    fcntl(listen_sock, F_SETFL, fcntl(listen_sock, F_GETFL) | O_NONBLOCK);
+
+    /* make sure the process can open a socket for each client */
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0) {
+      if (fd_limit.rlim_cur < (rlim_t)config->max_clients + TR_SERVER_EXTRA_FILES) {
+        fd_limit.rlim_cur = (rlim_t)config->max_clients + TR_SERVER_EXTRA_FILES;
+        if (fd_limit.rlim_cur > fd_limit.rlim_max) {
+          fd_limit.rlim_cur = fd_limit.rlim_max;
+          slog(SLOG_WARNING, TR_SERVER_LOG_HEADER "open files limit %ld too low for %d clients", (long)fd_limit.rlim_max, config->max_clients);
+        }
+        setrlimit(RLIMIT_NOFILE, &fd_limit);
+      }
+    }
+
+    /* create an epoll instance for each receiving thread */
+    /* listening socket is handled by first thread - identified by NULL connection */
+    rx_threads_count = (config->rx_threads > 0) ? config->rx_threads : 1;
+    rx_threads = checked_malloc(sizeof(struct _TR_rx_thread) * rx_threads_count);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    for (i = 0; i < rx_threads_count; i++) {
+      rx_threads[i].index = i;
+      rx_threads[i].epoll_fd = epoll_create1(0);
+      if (rx_threads[i].epoll_fd < 0) {
+        slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "epoll_create - %d", errno);
+        break;
+      }
+      if ((i == 0) && (epoll_ctl(rx_threads[i].epoll_fd, EPOLL_CTL_ADD, listen_sock, &ev) < 0)) {
+        slog(SLOG_ERROR, TR_SERVER_LOG_HEADER "epoll_ctl - %d", errno);
+        close(rx_threads[i].epoll_fd);
+        break;
+      }
+    }
+    if (i != rx_threads_count) {
+      for (; i > 0; i--) {
+        close(rx_threads[i - 1].epoll_fd);
+      }
+      checked_free(rx_threads);
+      close(listen_sock);
+      return NULL;
+    }
   }
 
   /* now create the handle */
@@ -909,10 +1159,13 @@ TR_server_handle TR_server_start(TR_server_configuration* config)
 
   /* file queue */
   if (config->queue_length == 0) {
-    h->output_queue = ptFIFO_new(TR_SERVER_QUEUE_LENGTH);
+    h->output_queue_length = TR_SERVER_QUEUE_LENGTH;
   } else {
-    h->output_queue = ptFIFO_new(config->queue_length);
+    h->output_queue_length = config->queue_length;
   }
+  h->output_queue = ptFIFO_new(h->output_queue_length);
+  h->window = TR_SERVER_WINDOW_MIN;
+  h->options = TR_OPTION_BATCH | TR_OPTION_BINARY;
 
   /* statistics setup */
   h->stat_file = checked_strdup(getenv("TRANSPORT_SERVER_STAT_FILE"));
@@ -921,11 +1174,26 @@ TR_server_handle TR_server_start(TR_server_configuration* config)
   h->stat_files_received = 0;
   h->stat_bytes_received = 0;
   h->stat_connected_clients = 0;
+  h->stat_files_in_flight = 0;
+  pthread_mutex_init(&h->stat_mutex, NULL);
+  h->stat_ack_latency_sum = 0;
+  h->stat_ack_latency_count = 0;
+  h->stat_ack_latency_max = 0;
+  h->stat_ack_latency_sum_p = 0;
+  h->stat_ack_latency_count_p = 0;
+  h->stat_ack_latency_max_p = 0;
   sample_freq = getenv("TRANSPORT_SERVER_STAT_SAMPLING");
   if (sample_freq) {
     sscanf(sample_freq, "%d", &h->stat_sample_freq);
   }
 
+  /* receiving threads (TCP) */
+  h->rx_threads = rx_threads;
+  h->rx_threads_count = rx_threads_count;
+  for (i = 0; i < h->rx_threads_count; i++) {
+    h->rx_threads[i].handle = h;
+  }
+
   /* launch the thread for server */
   if (config->server_type == TR_SERVER_UDP) {
     /* UDP server */
@@ -934,7 +1202,12 @@ TR_server_handle TR_server_start(TR_server_configuration* config)
 
   else if (config->server_type == TR_SERVER_TCP) {
     /* TCP server */
-    pthread_create(&h->thread, NULL, TR_server_state_machine, (void*)h);
+    if (h->rx_threads_count > 1) {
+      slog(SLOG_INFO, TR_SERVER_LOG_HEADER "using %d receiving threads", h->rx_threads_count);
+    }
+    for (i = 0; i < h->rx_threads_count; i++) {
+      pthread_create(&h->rx_threads[i].thread, NULL, TR_server_state_machine, (void*)&h->rx_threads[i]);
+    }
   }
 
   return h;
@@ -958,7 +1231,14 @@ int TR_server_stop(TR_server_handle h)
 
   /* wait */
   slog(SLOG_INFO, TR_SERVER_LOG_HEADER "waiting state machine to stop");
-  pthread_join(h->thread, NULL);
+  if (h->server_type == TR_SERVER_UDP) {
+    pthread_join(h->thread, NULL);
+  } else {
+    for (i = 0; i < h->rx_threads_count; i++) {
+      pthread_join(h->rx_threads[i].thread, NULL);
+      close(h->rx_threads[i].epoll_fd);
+    }
+  }
 
   /* close listening connection */
   close(h->listen_sock);
@@ -982,7 +1262,9 @@ int TR_server_stop(TR_server_handle h)
 
   /* free memory */
   pthread_mutex_destroy(&h->shutdown_mutex);
+  pthread_mutex_destroy(&h->stat_mutex);
   checked_free(h->cx_table);
+  checked_free(h->rx_threads);
   checked_free(h->stat_file);
   checked_free(h);
 
@@ -1019,7 +1301,7 @@ int TR_server_ack_file(TR_server_handle h, TR_file_id* id)
       }
       pthread_mutex_unlock(&cx->mutex);
 
-      TR_server_acknowledge_files(cx, TR_SERVER_ACK_MAX_FILES);
+      TR_server_acknowledge_files(cx, -1);
     }
   }
 
@@ -1035,3 +1317,34 @@ TR_file* TR_server_get_file(TR_server_handle h, int timeout)
 
   return f;
 }
+
+/* Set protocol options which may be accepted from new clients */
+void TR_server_set_options(TR_server_handle h, int options)
+{
+  if (h == NULL) {
+    return;
+  }
+  h->options = options;
+}
+
+/* Get server statistics */
+int TR_server_get_stats(TR_server_handle h, TR_server_stats* stats)
+{
+  if ((h == NULL) || (stats == NULL)) {
+    return -1;
+  }
+
+  stats->connected_clients = h->stat_connected_clients;
+  stats->files_in_flight = h->stat_files_in_flight;
+  stats->window = h->window;
+
+  pthread_mutex_lock(&h->stat_mutex);
+  stats->ack_latency_avg_ms = h->stat_ack_latency_count ? (int)(h->stat_ack_latency_sum / h->stat_ack_latency_count) : 0;
+  stats->ack_latency_max_ms = h->stat_ack_latency_max;
+  h->stat_ack_latency_sum = 0;
+  h->stat_ack_latency_count = 0;
+  h->stat_ack_latency_max = 0;
+  pthread_mutex_unlock(&h->stat_mutex);
+
+  return 0;
+}
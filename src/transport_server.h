@@ -41,8 +41,18 @@ typedef struct {
   int max_clients;  /**< Maximum number of clients allowed */
   int queue_length; /**< Maximum number of files buffered */
   int server_type;  /**< The server type, one of TR_SERVER_UDP or TR_SERVER_TCP */
+  int rx_threads;   /**< Number of threads receiving data from clients (TCP only). Connections are shared between them. */
 } TR_server_configuration;
 
+/** Server statistics, see TR_server_get_stats() */
+typedef struct {
+  int connected_clients;  /**< Number of clients connected */
+  int files_in_flight;    /**< Number of files received and not acknowledged yet to clients */
+  int window;             /**< Number of files each client may send without acknowledgement (if client supports it) */
+  int ack_latency_avg_ms; /**< Average time between reception of a file and acknowledgement to client (milliseconds) */
+  int ack_latency_max_ms; /**< Maximum time between reception of a file and acknowledgement to client (milliseconds) */
+} TR_server_stats;
+
 /** Start a server with a given configuration.
   * @param config : server configuration.
   * @return	: a handle to the server connexion.
@@ -71,6 +81,24 @@ int TR_server_ack_file(TR_server_handle h, TR_file_id* id);
 */
 TR_file* TR_server_get_file(TR_server_handle h, int timeout);
 
+/** Set the protocol options which may be accepted from clients connecting from now on.
+  * By default, all are accepted (TR_OPTION_BATCH | TR_OPTION_BINARY).
+  * Files received are tagged with the options accepted on their connection (TR_file.options).
+  *
+  * @param h		: handle to server.
+  * @param options	: TR_OPTION_... flags.
+*/
+void TR_server_set_options(TR_server_handle h, int options);
+
+/** Get server statistics.
+  * Acknowledgement latency is computed since previous call.
+  *
+  * @param h		: handle to server.
+  * @param stats	: structure to be filled.
+  * @return		0 on success, -1 on error.
+*/
+int TR_server_get_stats(TR_server_handle h, TR_server_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,12 @@
 #include <sys/stat.h>
 #include <ctype.h>
 #include <time.h>
+#include <limits.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include "utility.h"
 //#include "simplelog.h"
@@ -48,8 +54,7 @@
 */
 
 /* Global variables */
-long checked_mem_count = 0;                                          /**< Number of currently allocated memory slots */
-pthread_mutex_t checked_mem_count_mutex = PTHREAD_MUTEX_INITIALIZER; /**< Exclusive access to checked_mem_count variable  */
+long checked_mem_count = 0; /**< Number of currently allocated memory slots. Updated atomically. */
 
 /* Memory allocation */
 void* checked_malloc(size_t size)
@@ -68,9 +73,7 @@ void* checked_malloc(size_t size)
   }
 
   /* increase counter*/
-  pthread_mutex_lock(&checked_mem_count_mutex);
-  checked_mem_count++;
-  pthread_mutex_unlock(&checked_mem_count_mutex);
+  __atomic_add_fetch(&checked_mem_count, 1, __ATOMIC_RELAXED);
 
 #ifdef DEBUG_ALLOC
   fp = fopen(DEBUG_ALLOC, "a");
@@ -101,9 +104,7 @@ char* checked_strdup(const char* s)
   }
 
   /* increase counter*/
-  pthread_mutex_lock(&checked_mem_count_mutex);
-  checked_mem_count++;
-  pthread_mutex_unlock(&checked_mem_count_mutex);
+  __atomic_add_fetch(&checked_mem_count, 1, __ATOMIC_RELAXED);
 
 #ifdef DEBUG_STRDUP
   fp = fopen(DEBUG_STRDUP, "a");
@@ -134,23 +135,14 @@ void checked_free(void* ptr)
     free(ptr);
 
     /* decrease counter*/
-    pthread_mutex_lock(&checked_mem_count_mutex);
-    checked_mem_count--;
-    pthread_mutex_unlock(&checked_mem_count_mutex);
+    __atomic_sub_fetch(&checked_mem_count, 1, __ATOMIC_RELAXED);
   }
 }
 
 /* Get statistics */
 long checked_memstat()
 {
-  long i;
-
-  /* retrieve counter */
-  pthread_mutex_lock(&checked_mem_count_mutex);
-  i = checked_mem_count;
-  pthread_mutex_unlock(&checked_mem_count_mutex);
-
-  return i;
+  return __atomic_load_n(&checked_mem_count, __ATOMIC_RELAXED);
 }
 
 /**************************/
@@ -561,35 +553,63 @@ int FIFO_get_total_files(struct FIFO* f)
 /* FIFO (thread safe)           */
 /********************************/
 
-/** implementation of a thread safe FIFO with wait / sync, storing pointers to void */
+/** implementation of a thread safe FIFO with wait / sync, storing pointers to void.
+  Lock-free bounded ring, multiple producers / multiple consumers.
+  Each slot has a sequence number telling whether it is ready to be written (seq == position)
+  or to be read (seq == position + 1). Writers and readers reserve a position with compare-and-swap
+  on head / tail counters, so that they never hold a lock during the handoff.
+  Threads waiting (timeout != 0) sleep on a futex word. Its lowest bit is set by a thread before going to sleep,
+  and the other side does the wake-up system call only when this bit is set.
+*/
+
+#define PTFIFO_CACHE_LINE 64
+
+struct ptFIFO_slot {
+  unsigned long seq; /* sequence number of the slot */
+  void* data;        /* item stored */
+};
 
 struct ptFIFO {
-  int size;
-  int index_start;
-  int index_end;
-  void** data;
+  int size;                  /* maximum number of items in FIFO */
+  unsigned long mask;        /* number of slots - 1 (number of slots is a power of 2 >= size) */
+  struct ptFIFO_slot* slots; /* the ring */
+
+  unsigned long head __attribute__((aligned(PTFIFO_CACHE_LINE))); /* next position to write */
+  unsigned long tail __attribute__((aligned(PTFIFO_CACHE_LINE))); /* next position to read */
 
-  pthread_mutex_t mutex;
-  pthread_cond_t cond;
+  uint32_t readers_wait __attribute__((aligned(PTFIFO_CACHE_LINE))); /* futex for readers waiting an item. Bit 0 set if some are sleeping. Unsigned, wraps around */
+  uint32_t writers_wait __attribute__((aligned(PTFIFO_CACHE_LINE))); /* futex for writers waiting a free slot. Bit 0 set if some are sleeping. Unsigned, wraps around */
 };
 
 /** Constructor */
 struct ptFIFO* ptFIFO_new(int size)
 {
   struct ptFIFO* new;
-  int i;
+  unsigned long n;
+  unsigned long i;
 
-  new = checked_malloc(sizeof(struct ptFIFO));
-  new->size = size;
-  new->data = checked_malloc(sizeof(void*) * (size + 1));
-  for (i = 0; i < size; i++) {
-    new->data[i] = NULL;
+  if (size < 1) {
+    size = 1;
   }
-  new->index_start = 0;
-  new->index_end = 0;
+  for (n = 1; n < (unsigned long)size; n <<= 1)
+    ;
 
-  pthread_mutex_init(&new->mutex, NULL);
-  pthread_cond_init(&new->cond, NULL);
+  new = NULL;
+  if (posix_memalign((void**)&new, PTFIFO_CACHE_LINE, sizeof(struct ptFIFO))) {
+    return NULL;
+  }
+  memset(new, 0, sizeof(struct ptFIFO));
+  new->size = size;
+  new->mask = n - 1;
+  new->slots = checked_malloc(sizeof(struct ptFIFO_slot) * n);
+  for (i = 0; i < n; i++) {
+    new->slots[i].seq = i;
+    new->slots[i].data = NULL;
+  }
+  new->head = 0;
+  new->tail = 0;
+  new->readers_wait = 0;
+  new->writers_wait = 0;
 
   return new;
 }
@@ -601,15 +621,161 @@ void ptFIFO_destroy(struct ptFIFO* f)
     return;
 
   /* if not empty, warning */
-  if (f->index_start != f->index_end) {
+  if (f->head != f->tail) {
     //slog((SLOG_WARNING,"ptFIFO_destroy: not empty, possible memory leak");
   }
 
-  pthread_mutex_destroy(&f->mutex);
-  pthread_cond_destroy(&f->cond);
+  checked_free(f->slots);
+  free(f);
+}
 
-  checked_free(f->data);
-  checked_free(f);
+/* non-blocking write. Returns 0 on success, -1 if FIFO full */
+static int ptFIFO_try_write(struct ptFIFO* f, void* item)
+{
+  struct ptFIFO_slot* s;
+  unsigned long pos, seq;
+  long dif;
+
+  pos = __atomic_load_n(&f->head, __ATOMIC_RELAXED);
+  for (;;) {
+    s = &f->slots[pos & f->mask];
+    seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    dif = (long)(seq - pos);
+    if (dif == 0) {
+      /* slot free, but the ring may be bigger than the requested size */
+      if (pos - __atomic_load_n(&f->tail, __ATOMIC_ACQUIRE) >= (unsigned long)f->size) {
+        return -1;
+      }
+      if (__atomic_compare_exchange_n(&f->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+      /* pos updated by failed compare-and-swap */
+    } else if (dif < 0) {
+      /* slot not read yet: full */
+      return -1;
+    } else {
+      /* another writer took this position */
+      pos = __atomic_load_n(&f->head, __ATOMIC_RELAXED);
+    }
+  }
+  s->data = item;
+  __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/* non-blocking read. Returns item, or NULL if FIFO empty */
+static void* ptFIFO_try_read(struct ptFIFO* f)
+{
+  struct ptFIFO_slot* s;
+  unsigned long pos, seq;
+  long dif;
+  void* item;
+
+  pos = __atomic_load_n(&f->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    s = &f->slots[pos & f->mask];
+    seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    dif = (long)(seq - (pos + 1));
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&f->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      /* slot not written yet: empty */
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&f->tail, __ATOMIC_RELAXED);
+    }
+  }
+  item = s->data;
+  s->data = NULL;
+  __atomic_store_n(&s->seq, pos + f->mask + 1, __ATOMIC_RELEASE);
+  return item;
+}
+
+/* wake up all threads sleeping on a futex word, if any. To be called after FIFO update */
+static void ptFIFO_wake(uint32_t* w)
+{
+  uint32_t v;
+
+  /* FIFO update visible before the check of the sleeping bit */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  v = __atomic_load_n(w, __ATOMIC_RELAXED);
+  while (v & 1) {
+    /* clear sleeping bit and change value, so that threads about to sleep do not */
+    if (__atomic_compare_exchange_n(w, &v, v + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+#ifdef __linux__
+      syscall(SYS_futex, w, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+      break;
+    }
+  }
+}
+
+/* set the sleeping bit of a futex word, and store in value the word to wait for.
+  Returns 0 on success, or -1 if the word changed meanwhile */
+static int ptFIFO_prepare_wait(uint32_t* w, uint32_t* value)
+{
+  uint32_t v;
+
+  v = __atomic_load_n(w, __ATOMIC_RELAXED);
+  if (!(v & 1)) {
+    if (!__atomic_compare_exchange_n(w, &v, v | 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      return -1;
+    }
+    v |= 1;
+  }
+  /* sleeping bit visible before the FIFO is checked again */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  *value = v;
+  return 0;
+}
+
+/* sleep until futex word differs from value, or until deadline (if not NULL) is reached */
+static void ptFIFO_wait(uint32_t* w, uint32_t value, struct timespec* deadline)
+{
+  struct timespec now, t, *pt = NULL;
+
+  if (deadline != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    t.tv_sec = deadline->tv_sec - now.tv_sec;
+    t.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+    if (t.tv_nsec < 0) {
+      t.tv_nsec += 1000000000;
+      t.tv_sec--;
+    }
+    if (t.tv_sec < 0) {
+      return;
+    }
+    pt = &t;
+  }
+#ifdef __linux__
+  syscall(SYS_futex, w, FUTEX_WAIT_PRIVATE, value, pt, NULL, 0);
+#else
+  /* no futex: poll */
+  if (__atomic_load_n(w, __ATOMIC_SEQ_CST) == value) {
+    usleep(1000);
+  }
+  (void)pt;
+#endif
+}
+
+/* compute deadline for a timeout in seconds on first call. Returns 1 if reached already */
+static int ptFIFO_timeout_reached(struct timespec* deadline, int timeout, int* t_set)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!*t_set) {
+    deadline->tv_sec = now.tv_sec + timeout;
+    deadline->tv_nsec = now.tv_nsec;
+    *t_set = 1;
+    return 0;
+  }
+  if ((now.tv_sec > deadline->tv_sec) || ((now.tv_sec == deadline->tv_sec) && (now.tv_nsec >= deadline->tv_nsec))) {
+    return 1;
+  }
+  return 0;
 }
 
 /** Read FIFO 
@@ -620,75 +786,36 @@ void ptFIFO_destroy(struct ptFIFO* f)
 void* ptFIFO_read(struct ptFIFO* f, int timeout)
 {
   void* ret_val;
-  struct timeval now;
-  struct timezone tz;
   struct timespec t;
   int t_set = 0;
-  int retcode;
+  uint32_t v;
 
   if (f == NULL)
     return NULL;
 
-  pthread_mutex_lock(&f->mutex);
-
   /* wait for the FIFO to have something in */
-  while (f->index_start == f->index_end) {
-
-    /* nothing in the FIFO */
-
-    if (timeout == 0) {
-      /* no wait requested, return */
-      pthread_mutex_unlock(&f->mutex);
-      return NULL;
-
-    } else if (timeout > 0) {
-      /* timeout defined */
-      if (!t_set) {
-        gettimeofday(&now, &tz);
-        t.tv_sec = now.tv_sec + timeout;
-        t.tv_nsec = now.tv_usec * 1000;
-        t_set = 1;
-      }
-
-      /*
-      slog(SLOG_INFO,"FIFO wait");
-      */
-
-      retcode = pthread_cond_timedwait(&f->cond, &f->mutex, &t);
-
-      if (retcode == ETIMEDOUT) {
-        /*
-        slog(SLOG_INFO,"FIFO timeout");
-        */
-
-        /* timeout : return */
-        pthread_mutex_unlock(&f->mutex);
-        return NULL;
-      }
-
-      /*
-      slog(SLOG_INFO,"FIFO awaken");
-      */
-
-    } else {
-      /* wait forever */
-      pthread_cond_wait(&f->cond, &f->mutex);
+  for (;;) {
+    ret_val = ptFIFO_try_read(f);
+    if ((ret_val != NULL) || (timeout == 0)) {
+      break;
     }
-  }
-
-  /* get the first item from FIFO */
-  ret_val = f->data[f->index_start];
-  f->data[f->index_start] = NULL;
-  f->index_start++;
-  if (f->index_start > f->size) {
-    f->index_start = 0;
+    if ((timeout > 0) && (ptFIFO_timeout_reached(&t, timeout, &t_set))) {
+      break;
+    }
+    if (ptFIFO_prepare_wait(&f->readers_wait, &v)) {
+      continue;
+    }
+    ret_val = ptFIFO_try_read(f);
+    if (ret_val != NULL) {
+      break;
+    }
+    ptFIFO_wait(&f->readers_wait, v, (timeout > 0) ? &t : NULL);
   }
 
   /* notify FIFO update */
-  pthread_cond_broadcast(&f->cond);
-
-  pthread_mutex_unlock(&f->mutex);
-
+  if (ret_val != NULL) {
+    ptFIFO_wake(&f->writers_wait);
+  }
   return ret_val;
 }
 
@@ -700,11 +827,9 @@ void* ptFIFO_read(struct ptFIFO* f, int timeout)
 
 int ptFIFO_write(struct ptFIFO* f, void* item, int timeout)
 {
-  int new_index_end;
-  struct timeval now;
-  struct timezone tz;
   struct timespec t;
   int t_set = 0;
+  uint32_t v;
   int retcode;
 
   if (f == NULL)
@@ -712,97 +837,218 @@ int ptFIFO_write(struct ptFIFO* f, void* item, int timeout)
   if (item == NULL)
     return -1;
 
-  pthread_mutex_lock(&f->mutex);
-
   /* wait the FIFO has a free slot */
   for (;;) {
-    /* new end buffer position */
-    new_index_end = f->index_end;
-    new_index_end++;
-    if (new_index_end > f->size) {
-      new_index_end = 0;
+    retcode = ptFIFO_try_write(f, item);
+    if ((retcode == 0) || (timeout == 0)) {
+      break;
     }
-
-    /* append new item only if space left */
-    if (new_index_end != f->index_start) {
+    if ((timeout > 0) && (ptFIFO_timeout_reached(&t, timeout, &t_set))) {
       break;
     }
-
-    /* no space in FIFO */
-    if (timeout == 0) {
-      /* no wait requested, return */
-      pthread_mutex_unlock(&f->mutex);
-      return -1;
-
-    } else if (timeout > 0) {
-      /* timeout defined */
-      if (!t_set) {
-        gettimeofday(&now, &tz);
-        t.tv_sec = now.tv_sec + timeout;
-        t.tv_nsec = now.tv_usec * 1000;
-        t_set = 1;
-      }
-
-      retcode = pthread_cond_timedwait(&f->cond, &f->mutex, &t);
-      if (retcode == ETIMEDOUT) {
-        /* timeout : return */
-        pthread_mutex_unlock(&f->mutex);
-        return -1;
-      }
-
-    } else {
-      /* wait forever */
-      pthread_cond_wait(&f->cond, &f->mutex);
+    if (ptFIFO_prepare_wait(&f->writers_wait, &v)) {
+      continue;
     }
+    retcode = ptFIFO_try_write(f, item);
+    if (retcode == 0) {
+      break;
+    }
+    ptFIFO_wait(&f->writers_wait, v, (timeout > 0) ? &t : NULL);
   }
 
-  f->data[f->index_end] = item;
-  f->index_end = new_index_end;
-
   /* notify FIFO update */
-  pthread_cond_broadcast(&f->cond);
-
-  pthread_mutex_unlock(&f->mutex);
-
-  return 0;
+  if (retcode == 0) {
+    ptFIFO_wake(&f->readers_wait);
+  }
+  return retcode;
 }
 
 /** Get ratio of FIFO buffer used (0 to 1) */
 float ptFIFO_space_used(struct ptFIFO* f)
 {
-  int su, size;
+  unsigned long head, tail;
 
   if (f == NULL)
     return -1;
 
-  pthread_mutex_lock(&f->mutex);
-  su = f->index_end - f->index_start;
-  size = f->size;
-  if (f->index_end < f->index_start) {
-    su += f->size + 1;
+  tail = __atomic_load_n(&f->tail, __ATOMIC_ACQUIRE);
+  head = __atomic_load_n(&f->head, __ATOMIC_ACQUIRE);
+  if (head < tail) {
+    /* concurrent update between the two loads */
+    head = tail;
   }
-  pthread_mutex_unlock(&f->mutex);
 
-  return su * 1.0 / size;
+  return (head - tail) * 1.0 / f->size;
 }
 
 /** Is FIFO empty? */
 int ptFIFO_is_empty(struct ptFIFO* f)
 {
-  int empty = -1;
+  unsigned long head, tail;
 
   if (f == NULL)
     return -1;
 
-  pthread_mutex_lock(&f->mutex);
-  if (f->index_start == f->index_end) {
-    empty = 1;
-  } else {
-    empty = 0;
+  tail = __atomic_load_n(&f->tail, __ATOMIC_ACQUIRE);
+  head = __atomic_load_n(&f->head, __ATOMIC_ACQUIRE);
+  if (head == tail) {
+    return 1;
+  }
+  return 0;
+}
+
+/********************************/
+/* Memory pools                 */
+/********************************/
+
+/** Pool of memory blocks of a given size.
+  Released blocks are kept in a thread safe FIFO (lock-free), and reused by the next allocations,
+  whichever thread released them. Blocks are plain checked_malloc() slots, without header.
+*/
+struct mem_pool {
+  size_t blockSize;    /* size of blocks */
+  struct ptFIFO* free; /* released blocks, ready for reuse */
+};
+
+/* allocation counters, all pools */
+static long mem_pool_n_get = 0;    /* number of blocks given by mem_pool_get() and mem_buffer_get() */
+static long mem_pool_n_malloc = 0; /* number of them which could not reuse a released block */
+
+/** Constructor */
+struct mem_pool* mem_pool_new(size_t blockSize, int maxFree)
+{
+  struct mem_pool* p;
+
+  p = (struct mem_pool*)checked_malloc(sizeof(struct mem_pool));
+  if (p == NULL) {
+    return NULL;
   }
-  pthread_mutex_unlock(&f->mutex);
+  p->blockSize = blockSize;
+  p->free = ptFIFO_new(maxFree);
+  if (p->free == NULL) {
+    checked_free(p);
+    return NULL;
+  }
+  return p;
+}
 
-  return empty;
+/** Destructor */
+void mem_pool_destroy(struct mem_pool* p)
+{
+  void* block;
+
+  if (p == NULL)
+    return;
+
+  while ((block = ptFIFO_read(p->free, 0)) != NULL) {
+    checked_free(block);
+  }
+  ptFIFO_destroy(p->free);
+  checked_free(p);
+}
+
+/** Get a block */
+void* mem_pool_get(struct mem_pool* p)
+{
+  void* block;
+
+  __atomic_add_fetch(&mem_pool_n_get, 1, __ATOMIC_RELAXED);
+  block = ptFIFO_read(p->free, 0);
+  if (block == NULL) {
+    __atomic_add_fetch(&mem_pool_n_malloc, 1, __ATOMIC_RELAXED);
+    block = checked_malloc(p->blockSize);
+  }
+  return block;
+}
+
+/** Release a block */
+void mem_pool_release(struct mem_pool* p, void* block)
+{
+  if (block == NULL)
+    return;
+
+  /* keep it for reuse, unless enough are kept already */
+  if (ptFIFO_write(p->free, block, 0)) {
+    checked_free(block);
+  }
+}
+
+/* Buffers of variable size are taken from a pool per power of 2 */
+#define MEM_BUFFER_MIN_SHIFT 8                  /**< Smallest buffer class (256 bytes) */
+#define MEM_BUFFER_MAX_SHIFT 17                 /**< Biggest buffer class (128kB). Bigger buffers are not kept */
+#define MEM_BUFFER_CLASSES (MEM_BUFFER_MAX_SHIFT - MEM_BUFFER_MIN_SHIFT + 1)
+#define MEM_BUFFER_POOL_BYTES (2 * 1024 * 1024) /**< Maximum size of released buffers kept, per class */
+
+static struct mem_pool* mem_buffer_pools[MEM_BUFFER_CLASSES];
+static pthread_once_t mem_buffer_once = PTHREAD_ONCE_INIT;
+
+static void mem_buffer_init()
+{
+  int c;
+  size_t blockSize;
+
+  for (c = 0; c < MEM_BUFFER_CLASSES; c++) {
+    blockSize = ((size_t)1) << (c + MEM_BUFFER_MIN_SHIFT);
+    mem_buffer_pools[c] = mem_pool_new(blockSize, (int)(MEM_BUFFER_POOL_BYTES / blockSize));
+  }
+}
+
+/* buffer class for a given size, or -1 if too big (or pools not available) */
+static int mem_buffer_class(size_t size)
+{
+  int c;
+
+  for (c = 0; (((size_t)1) << (c + MEM_BUFFER_MIN_SHIFT)) < size; c++) {
+    if (c == MEM_BUFFER_CLASSES - 1) {
+      return -1;
+    }
+  }
+  pthread_once(&mem_buffer_once, mem_buffer_init);
+  if (mem_buffer_pools[c] == NULL) {
+    return -1;
+  }
+  return c;
+}
+
+/** Get a buffer */
+void* mem_buffer_get(size_t size)
+{
+  int c;
+
+  c = mem_buffer_class(size);
+  if (c < 0) {
+    __atomic_add_fetch(&mem_pool_n_get, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mem_pool_n_malloc, 1, __ATOMIC_RELAXED);
+    return checked_malloc(size);
+  }
+  return mem_pool_get(mem_buffer_pools[c]);
+}
+
+/** Release a buffer */
+void mem_buffer_release(void* buffer, size_t size)
+{
+  int c;
+
+  if (buffer == NULL)
+    return;
+
+  c = mem_buffer_class(size);
+  if (c < 0) {
+    checked_free(buffer);
+    return;
+  }
+  mem_pool_release(mem_buffer_pools[c], buffer);
+}
+
+/** Get statistics */
+void mem_pool_stats(long* n_get, long* n_malloc)
+{
+  if (n_get != NULL) {
+    *n_get = __atomic_load_n(&mem_pool_n_get, __ATOMIC_RELAXED);
+  }
+  if (n_malloc != NULL) {
+    *n_malloc = __atomic_load_n(&mem_pool_n_malloc, __ATOMIC_RELAXED);
+  }
 }
 
 /*************************/
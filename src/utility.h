@@ -154,6 +154,43 @@ float ptFIFO_space_used(struct ptFIFO*);
 /** Is FIFO empty? */
 int ptFIFO_is_empty(struct ptFIFO*);
 
+/********************************/
+/* Memory pools                 */
+/********************************/
+
+/** Pool of memory blocks of a given size, kept for reuse once released (thread safe).
+  * Meant for structures allocated and released at high rate, possibly by different threads.
+  * Blocks are allocated with checked_malloc(), without header: they can also be released with checked_free(),
+  * and a block allocated with checked_malloc() (of at least the pool block size) can be released to the pool.
+*/
+struct mem_pool;
+
+/** Constructor. At most maxFree released blocks are kept for reuse, the others are freed. */
+struct mem_pool* mem_pool_new(size_t blockSize, int maxFree);
+
+/** Destructor. Blocks kept for reuse are freed. */
+void mem_pool_destroy(struct mem_pool* p);
+
+/** Get a block (reused if possible, or allocated with checked_malloc()) */
+void* mem_pool_get(struct mem_pool* p);
+
+/** Release a block to the pool. NULL is ignored. */
+void mem_pool_release(struct mem_pool* p, void* block);
+
+/** Get a buffer of (at least) the given size, from pools of common buffer sizes.
+  * It must be released with mem_buffer_release() and the same size, or with checked_free().
+*/
+void* mem_buffer_get(size_t size);
+
+/** Release a buffer obtained with mem_buffer_get(). size must be the one given to mem_buffer_get(). NULL is ignored. */
+void mem_buffer_release(void* buffer, size_t size);
+
+/** Counts the number of blocks and buffers given by mem_pool_get() and mem_buffer_get() since startup (n_get),
+  * and how many of them could not reuse a released one and were allocated (n_malloc).
+  * NULL pointers are ignored.
+*/
+void mem_pool_stats(long* n_get, long* n_malloc);
+
 /*************************/
 /* Environment functions */
 /*************************/
@@ -93,6 +93,7 @@ int main()
 
   theLog.log(LogInfoDevel, "Test message with InfoLoggerMessageOption macro");
   theLog << LogInfoOps << "Test message with InfoLoggerMessageOption macro" << InfoLogger::endm;
+  InfoLoggerLogDeferred(theLog, LogInfoDevel, "Test message with deferred formatting: %d %s %.2f", 123, "text", 4.56);
   
   
   // local filtering of messages  
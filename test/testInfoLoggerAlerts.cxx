@@ -0,0 +1,202 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerAlerts.cxx
+/// \brief Benchmark of the alert rules evaluation of infoLoggerServer, with an increasing number of rules.
+///
+/// Usage: o2-infologger-test-alerts [-f rulesFile] [-n messages]
+/// Rules are generated, as found in o2-infologger-alert (detector, facility, error code, message pattern).
+/// If a rules file is given, it is loaded first, and all rules should compile.
+/// The evaluation time per message is reported, with and without candidate selection.
+/// Returns non-zero if the rules matched differ between the two.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "InfoLoggerAlertRules.h"
+#include "infoLoggerMessage.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* detectors[] = { "CTP", "EMC", "FDD", "FT0", "FV0", "HMP", "ITS", "MCH", "MFT", "MID", "TOF", "TPC", "TRD", "ZDC" };
+static const int nDetectors = sizeof(detectors) / sizeof(detectors[0]);
+
+// generate rules, similar to the ones of o2-infologger-alert
+static std::string generateRules(int nRules)
+{
+  std::string r;
+  for (int i = 0; i < nRules; i++) {
+    char rule[512];
+    const char* d = detectors[i % nDetectors];
+    switch (i % 4) {
+      case 0:
+        snprintf(rule, sizeof(rule), "registerAlarm %d \"rule %d\" \"doc\" {(\"$field(Detector)\" == \"%s\") && (\"$field(Facility)\" == \"readout\") && (\"$field(ErrCode)\" == %d) && ([string match \"Equipment * link %d is *\" \"$field(Message)\"])} \"\"\n", i + 1, i, d, 3000 + i % 10, i);
+        break;
+      case 1:
+        snprintf(rule, sizeof(rule), "registerAlarm %d \"rule %d\" \"doc\" {(\"$field(Severity)\" == \"E\") && (\"$field(Detector)\" == \"%s\") && ([string match \"*error %d in task*\" \"$field(Message)\"] || [string match \"*failure %d *\" \"$field(Message)\"])} \"\"\n", i + 1, i, d, i, i);
+        break;
+      case 2:
+        snprintf(rule, sizeof(rule), "registerAlarm %d \"rule %d\" \"doc\" {(\"$field(ErrCode)\" == \"%d\") && (\"$field(Level)\" <= 6)} \"\"\n", i + 1, i, 5000 + i);
+        break;
+      default:
+        snprintf(rule, sizeof(rule), "registerAlarm %d \"rule %d\" \"doc\" {(\"$field(Detector)\" == \"%s\") && (\"$field(System)\" == \"QC\") && (\"$field(Message)\" == \"task %d stopped\")} \"\"\n", i + 1, i, d, i);
+        break;
+    }
+    r += rule;
+  }
+  return r;
+}
+
+// a message with storage for its string fields
+struct TestMessage {
+  infoLog_msg_t msg;
+  std::vector<std::string> strings;
+};
+
+static void setString(TestMessage& m, const char* field, const std::string& value)
+{
+  int ix = infoLog_msg_findField(field);
+  m.strings[ix] = value;
+  m.msg.values[ix].value.vString = m.strings[ix].c_str();
+  m.msg.values[ix].isUndefined = 0;
+}
+
+static void setInt(TestMessage& m, const char* field, int value)
+{
+  int ix = infoLog_msg_findField(field);
+  m.msg.values[ix].value.vInt = value;
+  m.msg.values[ix].isUndefined = 0;
+}
+
+// generate messages, some of them matching the generated rules
+static void generateMessages(std::vector<TestMessage>& messages, int nMessages, int nRules)
+{
+  messages.resize(nMessages);
+  for (int i = 0; i < nMessages; i++) {
+    TestMessage& m = messages[i];
+    memset(&m.msg, 0, sizeof(m.msg));
+    m.strings.resize(INFOLOG_FIELDS_MAX);
+    for (int j = 0; j < INFOLOG_FIELDS_MAX; j++) {
+      m.msg.values[j].isUndefined = 1;
+    }
+    m.msg.protocol = &protocols[0];
+    int r = (i * 7) % (nRules + 1);
+    const char* d = detectors[r % nDetectors];
+    setString(m, "severity", (i % 3) ? "I" : "E");
+    setInt(m, "level", 1 + i % 11);
+    setString(m, "hostname", "alio2-cr1-flp" + std::to_string(i % 200));
+    setString(m, "detector", d);
+    setString(m, "facility", (i % 2) ? "readout" : "task");
+    setString(m, "system", (i % 5) ? "FLP" : "QC");
+    setInt(m, "errcode", (i % 4) ? 3000 + r % 10 : 5000 + r);
+    switch (i % 6) {
+      case 0:
+        setString(m, "message", "Equipment equipment-roc-1 : link " + std::to_string(r) + " is down");
+        break;
+      case 1:
+        setString(m, "message", "Unexpected error " + std::to_string(r) + " in task processing");
+        break;
+      case 2:
+        setString(m, "message", "task " + std::to_string(r) + " stopped");
+        break;
+      case 3:
+        setString(m, "message", "first line\fsecond line with failure " + std::to_string(r) + " here");
+        break;
+      default:
+        setString(m, "message", "Message " + std::to_string(i) + " - some text to have a typical size ...........................");
+        break;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string rulesFile = "";
+  int nMessages = 100000;
+
+  int option;
+  while ((option = getopt(argc, argv, "f:n:")) != -1) {
+    switch (option) {
+      case 'f':
+        rulesFile = optarg;
+        break;
+      case 'n':
+        nMessages = atoi(optarg);
+        break;
+    }
+  }
+  if (nMessages <= 0) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  if (infoLog_proto_init()) {
+    printf("Failed to initialize protocols\n");
+    return -1;
+  }
+
+  int err = 0;
+  InfoLoggerAlertRules rules;
+  std::vector<std::string> errors;
+
+  if (rulesFile.length()) {
+    int n = rules.loadFile(rulesFile, errors);
+    for (const auto& e : errors) {
+      printf("%s\n", e.c_str());
+    }
+    if ((n < 0) || (errors.size())) {
+      printf("Failed to load %s\n", rulesFile.c_str());
+      return -1;
+    }
+    printf("Loaded %d rules from %s\n", n, rulesFile.c_str());
+  }
+
+  for (int nRules = 10; nRules <= 1000; nRules *= 10) {
+    errors.clear();
+    if ((rules.load(generateRules(nRules), errors) != nRules) || (errors.size())) {
+      printf("Failed to load generated rules\n");
+      return -1;
+    }
+    std::vector<TestMessage> messages;
+    generateMessages(messages, nMessages, nRules);
+
+    double t[2];
+    unsigned long long nMatched[2];
+    std::vector<std::vector<int>> matched[2];
+    for (int indexed = 0; indexed < 2; indexed++) {
+      rules.setIndexing(indexed);
+      matched[indexed].resize(nMessages);
+      nMatched[indexed] = 0;
+      auto t0 = std::chrono::steady_clock::now();
+      for (int i = 0; i < nMessages; i++) {
+        rules.match(&messages[i].msg, matched[indexed][i]);
+      }
+      t[indexed] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      for (const auto& m : matched[indexed]) {
+        nMatched[indexed] += m.size();
+      }
+    }
+    if (matched[0] != matched[1]) {
+      err = __LINE__;
+    }
+    printf("%4d rules: %d messages, %llu matches, %8.0f ns/msg (all rules evaluated: %8.0f ns/msg)%s\n", nRules, nMessages, nMatched[1], t[1] * 1E9 / nMessages, t[0] * 1E9 / nMessages, (err) ? " - results differ" : "");
+    if (err) {
+      break;
+    }
+  }
+
+  return err;
+}
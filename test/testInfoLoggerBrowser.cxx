@@ -0,0 +1,234 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerBrowser.cxx
+/// \brief Benchmark of the infoLoggerServer online dispatch to infoBrowser clients, for an increasing number of clients.
+///
+/// Usage: o2-infologger-test-browser [-c maxClients] [-n numberOfFiles] [-m messagesPerFile] [-p port]
+/// Messages are dispatched to simulated infoBrowser clients connected locally, the number of clients being multiplied by 10 at each step.
+/// One more client is connected and never reads: it should not slow down the others.
+/// One more client sends a filter, selecting one message per file.
+/// It is checked that all the other clients receive all the messages (or those selected), and the dispatch rate is reported.
+/// Returns non-zero on error.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "InfoLoggerDispatch.h"
+#include "infoLoggerMessage.h"
+#include "utility.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// a file with messages, as received from infoLoggerD
+static TR_file* generateFile(int file, int nMessages)
+{
+  std::string b;
+  for (int j = 0; j < nMessages; j++) {
+    char msg[512];
+    int n = snprintf(msg, sizeof(msg), "*1.4#I#11#%.6lf#testhost#test#12345#flp#DAQ#test#####%d#%s#Message %d of file %d - some text to have a typical size ...........................",
+                     1600000000.123456 + file, 100 + j, "testInfoLoggerBrowser.cxx", j, file);
+    b.append(msg, n + 1); // NUL separated
+  }
+  TR_file* f = TR_file_new();
+  TR_blob* blob = TR_blob_new(b.size());
+  memcpy(blob->value, b.data(), b.size());
+  f->first = blob;
+  f->last = blob;
+  f->size = blob->size;
+  return f;
+}
+
+// connect a client to local port. Returns socket, or -1 on error
+static int connectClient(int port)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if ((fd >= 0) && (connect(fd, (struct sockaddr*)&addr, sizeof(addr)))) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+int main(int argc, char* argv[])
+{
+  int maxClients = 100; // max number of clients reading messages
+  int nFiles = 2000;    // number of files dispatched
+  int nMessages = 10;   // number of messages per file
+  int port = 16102;     // dispatch port
+
+  int option;
+  while ((option = getopt(argc, argv, "c:n:m:p:")) != -1) {
+    switch (option) {
+      case 'c':
+        maxClients = atoi(optarg);
+        break;
+      case 'n':
+        nFiles = atoi(optarg);
+        break;
+      case 'm':
+        nMessages = atoi(optarg);
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+    }
+  }
+  if ((maxClients <= 0) || (nFiles <= 0) || (nMessages <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  if (infoLog_proto_init()) {
+    printf("Failed to initialize protocols\n");
+    return -1;
+  }
+
+  // decoded messages, dispatched several times
+  std::vector<std::shared_ptr<InfoLoggerMessageList>> msgLists;
+  for (int i = 0; i < nFiles; i++) {
+    TR_file* f = generateFile(i, nMessages);
+    msgLists.push_back(std::make_shared<InfoLoggerMessageList>(f));
+    TR_file_destroy(f);
+  }
+
+  SimpleLog log;
+  int err = 0;
+  for (int nClients = 1; (nClients <= maxClients) && (!err); nClients *= 10) {
+    ConfigInfoLoggerServer config;
+    config.serverPortTx = port;
+    config.maxClientsTx = nClients + 2;
+    config.txBufferSize = 1024 * 1024;
+    std::unique_ptr<InfoLoggerDispatchOnlineBrowser> dispatch;
+    try {
+      dispatch = std::make_unique<InfoLoggerDispatchOnlineBrowser>(&config, &log);
+    } catch (...) {
+      printf("Failed to start dispatch\n");
+      return -1;
+    }
+
+    // connect clients, the first one does not read, the second one uses a filter
+    std::vector<int> fds;
+    for (int i = 0; i <= nClients + 1; i++) {
+      int fd = connectClient(port);
+      if (fd < 0) {
+        printf("Client %d: connect failed: %s\n", i, strerror(errno));
+        err = __LINE__;
+        break;
+      }
+      fds.push_back(fd);
+    }
+    const char* filter = "filter level=..20 message=Message\\ 0\\ of*\n";
+    if ((!err) && (write(fds[1], filter, strlen(filter)) != (ssize_t)strlen(filter))) {
+      err = __LINE__;
+    }
+    // let the dispatch thread accept them
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    // count lines received by each client
+    std::vector<unsigned long long> nExpected(fds.size(), (unsigned long long)nFiles * nMessages);
+    nExpected[1] = nFiles;
+    std::vector<std::atomic<unsigned long long>> nReceived(fds.size());
+    for (auto& n : nReceived) {
+      n = 0;
+    }
+    std::atomic<bool> shutdown(false);
+    std::thread reader([&] {
+      std::vector<struct pollfd> pfds(fds.size() - 1);
+      char buf[65536];
+      while (!shutdown) {
+        for (size_t i = 1; i < fds.size(); i++) {
+          pfds[i - 1].fd = (nReceived[i] < nExpected[i]) ? fds[i] : -1;
+          pfds[i - 1].events = POLLIN;
+          pfds[i - 1].revents = 0;
+        }
+        if (poll(pfds.data(), pfds.size(), 100) <= 0) {
+          continue;
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+          if (!(pfds[i - 1].revents & POLLIN)) {
+            continue;
+          }
+          ssize_t n = read(fds[i], buf, sizeof(buf));
+          for (ssize_t k = 0; k < n; k++) {
+            if (buf[k] == '\n') {
+              nReceived[i]++;
+            }
+          }
+        }
+      }
+    });
+
+    // dispatch messages
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; (i < nFiles) && (!err); i++) {
+      while (dispatch->pushMessage(msgLists[i])) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    // wait all messages received
+    double t = 0;
+    for (int iter = 0; (iter < 6000) && (!err); iter++) {
+      bool done = true;
+      for (size_t i = 1; i < fds.size(); i++) {
+        if (nReceived[i] < nExpected[i]) {
+          done = false;
+          break;
+        }
+      }
+      t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      if (done) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    shutdown = true;
+    reader.join();
+
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (nReceived[i] != nExpected[i]) {
+        printf("Client %d: %llu messages received, %llu expected\n", (int)i, (unsigned long long)nReceived[i], nExpected[i]);
+        err = __LINE__;
+        break;
+      }
+    }
+    if (!err) {
+      printf("%4d clients: %llu messages dispatched in %.3f s = %10.0f msg/s per client, %10.0f msg/s total\n", nClients, nExpected[2], t, nExpected[2] / t, nExpected[2] * nClients / t);
+    }
+    for (auto fd : fds) {
+      close(fd);
+    }
+    dispatch = nullptr;
+  }
+
+  if (!err) {
+    printf("Test completed\n");
+  }
+  return err;
+}
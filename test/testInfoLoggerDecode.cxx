@@ -0,0 +1,194 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerDecode.cxx
+/// \brief Benchmark of the infoLoggerServer decoding stage, with an increasing number of decoding threads.
+///
+/// Usage: o2-infologger-test-decode [-f msgDumpFile] [-t maxThreads] [-n rounds] [-s numberOfSources]
+/// Input data are read from a file created by infoLoggerServer with the msgDumpFile option.
+/// If none given, messages are generated.
+/// Files are created when pushed to the decoding pool, as done by the reception threads of the server.
+/// The number of allocations from memory pools is reported (files, blobs, messages and payload buffers), and how many of them could not reuse a released block.
+/// Returns non-zero if messages are lost or not returned in order for a given source.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "InfoLoggerDecodePool.h"
+#include "infoLoggerMessage.h"
+#include "utility.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// read a message dump file. Returns 0 on success, content of each file received in blobs
+static int readDumpFile(const char* path, std::vector<std::string>& blobs)
+{
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    printf("Failed to open %s\n", path);
+    return -1;
+  }
+  int err = 0;
+  char line[128];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    int size;
+    if ((sscanf(line, "*** begin: %d bytes", &size) != 1) || (size < 0)) {
+      err = -1;
+      break;
+    }
+    std::string b(size, 0);
+    if (fread(&b[0], size, 1, fp) != 1) {
+      err = -1;
+      break;
+    }
+    if ((fgets(line, sizeof(line), fp) == NULL) || (fgets(line, sizeof(line), fp) == NULL) || (strcmp(line, "*** end\n"))) {
+      err = -1;
+      break;
+    }
+    blobs.push_back(b);
+  }
+  fclose(fp);
+  if (err) {
+    printf("Invalid dump file %s\n", path);
+  }
+  return err;
+}
+
+// generate typical messages, grouped as sent by infoLoggerD
+static void generateData(std::vector<std::string>& blobs, int nBlobs, int msgPerBlob)
+{
+  for (int i = 0; i < nBlobs; i++) {
+    std::string b;
+    for (int j = 0; j < msgPerBlob; j++) {
+      char msg[512];
+      int n = snprintf(msg, sizeof(msg), "*1.4#I#11#%.6lf#alio2-cr1-flp001#readout#12345#flp#DAQ#readout#####%d#%s#Message %d of file %d - some text to have a typical size ...........................",
+                       1600000000.123456 + i, 100 + j, "readout.cxx", j, i);
+      b.append(msg, n + 1); // NUL separated
+    }
+    blobs.push_back(b);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string dumpFile = "";
+  int maxThreads = 8; // max number of decoding threads
+  int rounds = 10;    // number of times input data is replayed
+  int nSources = 64;  // number of clients data is distributed to
+
+  int option;
+  while ((option = getopt(argc, argv, "f:t:n:s:")) != -1) {
+    switch (option) {
+      case 'f':
+        dumpFile = optarg;
+        break;
+      case 't':
+        maxThreads = atoi(optarg);
+        break;
+      case 'n':
+        rounds = atoi(optarg);
+        break;
+      case 's':
+        nSources = atoi(optarg);
+        break;
+    }
+  }
+  if ((maxThreads <= 0) || (rounds <= 0) || (nSources <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  if (infoLog_proto_init()) {
+    printf("Failed to initialize protocols\n");
+    return -1;
+  }
+
+  std::vector<std::string> blobs;
+  if (dumpFile.length()) {
+    if (readDumpFile(dumpFile.c_str(), blobs)) {
+      return -1;
+    }
+    printf("Loaded %d files from %s\n", (int)blobs.size(), dumpFile.c_str());
+  } else {
+    generateData(blobs, 1000, 100);
+    printf("Generated %d files\n", (int)blobs.size());
+  }
+  if (blobs.size() == 0) {
+    return 0;
+  }
+
+  int err = 0;
+  double t1thread = 0;
+  for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+    long nAlloc0, nMalloc0;
+    mem_pool_stats(&nAlloc0, &nMalloc0);
+
+    // decode
+    size_t nFiles = blobs.size() * rounds;
+    std::vector<int> nextId(nSources, 0);
+    unsigned long long nMsg = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    {
+      InfoLoggerDecodePool pool(nThreads, 1000);
+      size_t ix = 0;
+      size_t nDone = 0;
+      while (nDone < nFiles) {
+        while ((ix < nFiles) && (!pool.isFull())) {
+          const std::string& data = blobs[ix % blobs.size()];
+          TR_file* f = TR_file_new();
+          TR_blob* b = TR_blob_new(data.size());
+          memcpy(b->value, data.data(), b->size);
+          f->first = b;
+          f->last = b;
+          f->size = b->size;
+          f->id.sender = ix % nSources;
+          f->id.sender_magic = NULL;
+          f->id.minId = ix / nSources; // sequence number for this source
+          f->id.majId = 0;
+          pool.push(f);
+          ix++;
+        }
+        InfoLoggerDecodePool::Result r;
+        while (!pool.pop(r, 1)) {
+          if (r.file->id.minId != nextId[r.file->id.sender]) {
+            err = __LINE__;
+          }
+          nextId[r.file->id.sender] = r.file->id.minId + 1;
+          if (r.msgList != nullptr) {
+            nMsg += r.msgList->size();
+          }
+          r.msgList = nullptr;
+          TR_file_destroy(r.file);
+          nDone++;
+        }
+      }
+    }
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (nThreads == 1) {
+      t1thread = t;
+    }
+    long nAlloc1, nMalloc1;
+    mem_pool_stats(&nAlloc1, &nMalloc1);
+
+    printf("%2d threads: %llu messages in %.3f s = %10.0f msg/s, speedup %.2f, %ld allocations, %ld from malloc\n", nThreads, nMsg, t, nMsg / t, t1thread / t, nAlloc1 - nAlloc0, nMalloc1 - nMalloc0);
+    if (err) {
+      printf("Files not returned in order\n");
+      break;
+    }
+  }
+
+  return err;
+}
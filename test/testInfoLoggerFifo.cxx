@@ -0,0 +1,212 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerFifo.cxx
+/// \brief Contention benchmark of the thread-safe FIFO (ptFIFO) used between the receiving threads and the decoding stage of infoLoggerServer.
+///
+/// Usage: o2-infologger-test-fifo [-p maxProducers] [-c maxConsumers] [-n itemsPerProducer] [-s fifoSize]
+/// Producer and consumer counts are increased by powers of 2 up to the given maximum.
+/// Each configuration is run with the ptFIFO, and with a reference mutex/condition variable queue
+/// equivalent to the previous ptFIFO implementation, to compare the cost of an item handoff.
+/// Producers write with a timeout (blocking when full), consumers read with a timeout, as done in the server.
+/// Returns non-zero if items are lost, duplicated, or not received in order for a given producer and consumer.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "utility.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// reference implementation: bounded queue protected by a mutex, with a condition variable
+class MutexFifo
+{
+ public:
+  MutexFifo(int s) : size(s) {}
+  int write(void* item, int timeout)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!cond.wait_for(lock, std::chrono::seconds(timeout), [&] { return (int)data.size() < size; })) {
+      return -1;
+    }
+    data.push_back(item);
+    cond.notify_all();
+    return 0;
+  }
+  void* read(int timeout)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!cond.wait_for(lock, std::chrono::seconds(timeout), [&] { return !data.empty(); })) {
+      return nullptr;
+    }
+    void* item = data.front();
+    data.pop_front();
+    cond.notify_all();
+    return item;
+  }
+
+ private:
+  int size;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<void*> data;
+};
+
+// items are encoded as (producer << 32) + sequence number, sequence starting at 1
+static inline void* encodeItem(int producer, int n) { return (void*)(((unsigned long)producer << 32) + n); }
+static inline int itemProducer(void* item) { return (int)((unsigned long)item >> 32); }
+static inline int itemNumber(void* item) { return (int)((unsigned long)item & 0xFFFFFFFF); }
+
+// run one configuration. Returns 0 on success, time spent in t (seconds)
+template <typename W, typename R>
+static int runTest(int nProducers, int nConsumers, int nItems, W write, R read, double& t)
+{
+  std::atomic<long> nReceived(0);
+  std::atomic<int> err(0);
+  std::vector<std::atomic<int>> count(nProducers); // items received per producer
+  for (auto& c : count) {
+    c = 0;
+  }
+  long nTotal = (long)nProducers * nItems;
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> consumers;
+  for (int i = 0; i < nConsumers; i++) {
+    consumers.push_back(std::thread([&] {
+      std::vector<int> last(nProducers, 0); // items from a given producer are seen in order by each consumer
+      for (;;) {
+        void* item = read(1);
+        if (item == nullptr) {
+          continue;
+        }
+        int p = itemProducer(item);
+        if (p == nProducers) {
+          // end of test
+          break;
+        }
+        int n = itemNumber(item);
+        if ((p < 0) || (p >= nProducers) || (n <= last[p]) || (n > nItems)) {
+          err = __LINE__;
+        } else {
+          last[p] = n;
+          count[p]++;
+        }
+        nReceived++;
+      }
+    }));
+  }
+  std::vector<std::thread> producers;
+  for (int i = 0; i < nProducers; i++) {
+    producers.push_back(std::thread([&, i] {
+      for (int n = 1; n <= nItems; n++) {
+        while (write(encodeItem(i, n), 1)) {
+        }
+      }
+    }));
+  }
+  for (auto& th : producers) {
+    th.join();
+  }
+  // one end marker per consumer, after all items
+  for (int i = 0; i < nConsumers; i++) {
+    while (write(encodeItem(nProducers, 1), 1)) {
+    }
+  }
+  for (auto& th : consumers) {
+    th.join();
+  }
+  t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  for (auto& c : count) {
+    if (c != nItems) {
+      err = __LINE__;
+    }
+  }
+  if ((nReceived != nTotal) || (err)) {
+    printf("%d producers, %d consumers: %ld items received, %ld expected, error line %d\n", nProducers, nConsumers, (long)nReceived, nTotal, (int)err);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  int maxProducers = 8; // max number of threads writing
+  int maxConsumers = 4; // max number of threads reading
+  int nItems = 200000;  // number of items written by each producer
+  int fifoSize = 10000; // FIFO capacity, as the server default queue length
+
+  int option;
+  while ((option = getopt(argc, argv, "p:c:n:s:")) != -1) {
+    switch (option) {
+      case 'p':
+        maxProducers = atoi(optarg);
+        break;
+      case 'c':
+        maxConsumers = atoi(optarg);
+        break;
+      case 'n':
+        nItems = atoi(optarg);
+        break;
+      case 's':
+        fifoSize = atoi(optarg);
+        break;
+    }
+  }
+  if ((maxProducers <= 0) || (maxConsumers <= 0) || (nItems <= 0) || (fifoSize <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  int err = 0;
+  printf("producers consumers      ptFIFO items/s  ns/item      mutex items/s  ns/item\n");
+  for (int nProducers = 1; (nProducers <= maxProducers) && (!err); nProducers *= 2) {
+    for (int nConsumers = 1; (nConsumers <= maxConsumers) && (!err); nConsumers *= 2) {
+      double t1, t2;
+      double nTotal = (double)nProducers * nItems;
+
+      struct ptFIFO* f = ptFIFO_new(fifoSize);
+      if (runTest(
+            nProducers, nConsumers, nItems,
+            [&](void* item, int timeout) { return ptFIFO_write(f, item, timeout); },
+            [&](int timeout) { return ptFIFO_read(f, timeout); }, t1)) {
+        err = __LINE__;
+      }
+      if (!ptFIFO_is_empty(f)) {
+        err = __LINE__;
+      }
+      ptFIFO_destroy(f);
+
+      MutexFifo m(fifoSize);
+      if (runTest(
+            nProducers, nConsumers, nItems,
+            [&](void* item, int timeout) { return m.write(item, timeout); },
+            [&](int timeout) { return m.read(timeout); }, t2)) {
+        err = __LINE__;
+      }
+
+      printf("%9d %9d %19.0f %8.1f %18.0f %8.1f\n", nProducers, nConsumers, nTotal / t1, t1 * 1e9 / nTotal, nTotal / t2, t2 * 1e9 / nTotal);
+    }
+  }
+
+  if (!err) {
+    printf("Test completed\n");
+  }
+  return err;
+}
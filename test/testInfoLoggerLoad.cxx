@@ -0,0 +1,265 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerLoad.cxx
+/// \brief Load generator for infoLoggerD: many concurrent clients sending messages on the local socket.
+///
+/// Usage: o2-infologger-test-load [-c numberOfClients] [-m messagesPerClient] [-t numberOfThreads] [-r reconnectInterval] [-s socketPath] [-p infoLoggerDPid]
+/// e.g. 2000 clients, each reconnecting after 10 messages (short-lived processes):
+///   o2-infologger-test-load -c 2000 -m 100 -r 10
+/// When the pid of infoLoggerD is given, its CPU usage is measured, and throughput reported per core (i.e. per second of CPU used).
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "infoLoggerDefaults.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// connect to infoLoggerD. Returns socket, or -1 on error
+static int connectClient(const std::string& socketPath)
+{
+  struct sockaddr_un socketAddress;
+  memset(&socketAddress, 0, sizeof(socketAddress));
+  socketAddress.sun_family = PF_LOCAL;
+  if (socketPath.length() + 2 > sizeof(socketAddress.sun_path)) {
+    return -1;
+  }
+  // same naming convention as InfoLoggerClient: abstract socket if not starting with '/'
+  if (socketPath[0] == '/') {
+    strncpy(&socketAddress.sun_path[0], socketPath.c_str(), socketPath.length());
+  } else {
+    strncpy(&socketAddress.sun_path[1], socketPath.c_str(), socketPath.length());
+  }
+  int s = socket(PF_LOCAL, SOCK_STREAM, 0);
+  if (s < 0) {
+    return -1;
+  }
+  if (connect(s, (struct sockaddr*)&socketAddress, sizeof(socketAddress))) {
+    close(s);
+    return -1;
+  }
+  return s;
+}
+
+// get CPU time (user+system) used so far by given process, in seconds. Returns -1 on error
+static double getProcessCpuTime(int pid)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  char buf[1024];
+  size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  buf[n] = 0;
+  // skip process name, which may contain spaces
+  char* ptr = strrchr(buf, ')');
+  if (ptr == NULL) {
+    return -1;
+  }
+  // utime and stime are fields 14 and 15, i.e. 11th and 12th after the state field
+  unsigned long utime, stime;
+  if (sscanf(ptr + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+    return -1;
+  }
+  return (utime + stime) / (double)sysconf(_SC_CLK_TCK);
+}
+
+// write buffer completely. Returns 0 on success
+static int writeAll(int s, const char* buf, size_t len)
+{
+  while (len > 0) {
+    ssize_t n = write(s, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  int nClients = 2000;          // number of concurrent clients
+  int nMessages = 100;          // number of messages per client
+  int nThreads = 8;             // number of threads used to drive the clients
+  int reconnectInterval = 0;    // if set, clients reconnect after this number of messages
+  std::string socketPath = INFOLOGGER_DEFAULT_LOCAL_SOCKET;
+  int pid = 0;                  // if set, pid of infoLoggerD, to measure its CPU usage
+
+  int option;
+  while ((option = getopt(argc, argv, "c:m:t:r:s:p:")) != -1) {
+    switch (option) {
+      case 'c':
+        nClients = atoi(optarg);
+        break;
+      case 'm':
+        nMessages = atoi(optarg);
+        break;
+      case 't':
+        nThreads = atoi(optarg);
+        break;
+      case 'r':
+        reconnectInterval = atoi(optarg);
+        break;
+      case 's':
+        socketPath = optarg;
+        break;
+      case 'p':
+        pid = atoi(optarg);
+        break;
+    }
+  }
+  if ((nClients <= 0) || (nMessages <= 0) || (nThreads <= 0) || (reconnectInterval < 0) || (socketPath.length() == 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+  if (nThreads > nClients) {
+    nThreads = nClients;
+  }
+
+  // write errors are reported by write() return value
+  signal(SIGPIPE, SIG_IGN);
+
+  // check infoLoggerD is there
+  int s = connectClient(socketPath);
+  if (s < 0) {
+    printf("Can not connect to infoLoggerD on %s: %s - skipping test\n", socketPath.c_str(), strerror(errno));
+    return 0;
+  }
+  close(s);
+
+  printf("Starting %d clients (%d threads), %d messages each, reconnect interval %d\n", nClients, nThreads, nMessages, reconnectInterval);
+
+  std::atomic<unsigned long long> nMsgSent(0);
+  std::atomic<unsigned long long> nBytesSent(0);
+  std::atomic<int> nErrors(0);
+  std::atomic<int> nConnected(0);
+  std::atomic<bool> allConnected(false);
+
+  auto clientsLoop = [&](int threadIx) {
+    // clients handled by this thread
+    std::vector<int> sockets;
+    for (int i = threadIx; i < nClients; i += nThreads) {
+      sockets.push_back(connectClient(socketPath));
+      if (sockets.back() < 0) {
+        nErrors++;
+      } else {
+        nConnected++;
+      }
+    }
+    // wait all clients are connected, to have them concurrent
+    while (!allConnected) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    char msg[256];
+    char host[128] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    for (int j = 0; j < nMessages; j++) {
+      for (size_t k = 0; k < sockets.size(); k++) {
+        int clientId = threadIx + k * nThreads;
+        if ((reconnectInterval) && (j) && ((j % reconnectInterval) == 0)) {
+          if (sockets[k] >= 0) {
+            close(sockets[k]);
+          }
+          sockets[k] = connectClient(socketPath);
+          if (sockets[k] < 0) {
+            nErrors++;
+          }
+        }
+        if (sockets[k] < 0) {
+          continue;
+        }
+        auto now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        int len = snprintf(msg, sizeof(msg), "*1.4#D#11#%.6lf#%s#loadTest#%d#%s#DAQ#test#####%d#%s#Message %d from client %d\n",
+                           now, host, (int)getpid(), "test", j, "testInfoLoggerLoad.cxx", j, clientId);
+        if (writeAll(sockets[k], msg, len)) {
+          nErrors++;
+          close(sockets[k]);
+          sockets[k] = -1;
+          continue;
+        }
+        nMsgSent++;
+        nBytesSent += len;
+      }
+    }
+    for (auto s : sockets) {
+      if (s >= 0) {
+        close(s);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nThreads; i++) {
+    threads.emplace_back(clientsLoop, i);
+  }
+  while (nConnected + nErrors < nClients) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  printf("%d clients connected, %d failed\n", (int)nConnected, (int)nErrors);
+  double cpu0 = 0;
+  if (pid) {
+    cpu0 = getProcessCpuTime(pid);
+    if (cpu0 < 0) {
+      printf("Can not get CPU usage of process %d\n", pid);
+      pid = 0;
+    }
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  allConnected = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  printf("Sent %llu messages (%.1f MB) in %.3f s: %.0f msg/s, %.1f MB/s, %d errors\n", nMsgSent.load(), nBytesSent.load() / (1024.0 * 1024.0), t,
+         nMsgSent.load() / t, nBytesSent.load() / (1024.0 * 1024.0 * t), (int)nErrors);
+
+  if (pid) {
+    // wait infoLoggerD is done with processing the data sent (CPU usage not increasing any more)
+    double cpu1 = getProcessCpuTime(pid);
+    for (int i = 0; i < 100; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      double cpu = getProcessCpuTime(pid);
+      if (cpu <= cpu1) {
+        break;
+      }
+      cpu1 = cpu;
+    }
+    double cpu = cpu1 - cpu0;
+    if (cpu > 0) {
+      printf("infoLoggerD used %.3f s CPU: %.0f msg/s per core, %.1f MB/s per core\n", cpu, nMsgSent.load() / cpu, nBytesSent.load() / (1024.0 * 1024.0 * cpu));
+    } else {
+      printf("infoLoggerD CPU usage too small to be measured\n");
+    }
+  }
+
+  return 0;
+}
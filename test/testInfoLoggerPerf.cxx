@@ -12,17 +12,37 @@
 /// \file testInfoLoggerPerf.cxx
 /// \brief infoLogger message generator for perf benchmarks
 ///
+/// Caller-side latency of sync/async modes can be compared with e.g.
+///   o2-infologger-test-perf -c 100000 -l -o outputMode=infoLoggerD
+///   o2-infologger-test-perf -c 100000 -l -o outputMode=infoLoggerD:async
+///
+/// Cost of log calls discarded by the local filters can be measured with e.g.
+///   o2-infologger-test-perf -f 10000000
+///
+/// Caller-side cost of log calls with deferred formatting can be compared to normal ones with e.g.
+///   o2-infologger-test-perf -c 0 -D 100000 -o outputMode=infoLoggerD:async,asyncQueueSize=200000
+///
+/// CPU cost of encoding messages for infoLoggerD, with all fields or with context fields encoded once, can be compared with e.g.
+///   o2-infologger-test-perf -c 0 -e 1000000
+///
 /// \author Sylvain Chapeland, CERN
 
 #include <InfoLogger/InfoLogger.hxx>
+#include <InfoLogger/InfoLoggerMacros.hxx>
 #include <Common/Timer.h>
+#include "InfoLoggerMessageHelper.h"
+#include "infoLoggerMessage.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
 
 using namespace AliceO2::InfoLogger;
 using namespace AliceO2::Common;
 
 int main(int argc, char* argv[])
 {
-  InfoLogger theLog;
   Timer theTimer;
 
   int maxMsgCount = 1000; // number of message to send
@@ -30,10 +50,15 @@ int main(int argc, char* argv[])
   int sizeIsRandom = 0;   // flag set to get a random message size (up to maxMsgSize)
   int noOutput = 0;       // when set, messages are created but not sent
   int delay = 0;          // delay in microseconds between messages
+  int latencyStats = 0;   // when set, time spent in each log call is measured
+  std::string options;    // options passed to InfoLogger constructor
+  int discardedCount = 0; // when set, number of discarded log calls to measure
+  int deferredCount = 0;  // when set, number of log calls to measure, with and without deferred formatting
+  int encodedCount = 0;   // when set, number of messages to encode, with and without context encoded once
   
   // parse command line parameters
   int option;
-  while ((option = getopt(argc, argv, "c:s:rnd:")) != -1) {
+  while ((option = getopt(argc, argv, "c:s:rnd:lo:f:D:e:")) != -1) {
     switch (option) {
       case 'c':
         maxMsgCount = atoi(optarg);
@@ -50,10 +75,125 @@ int main(int argc, char* argv[])
       case 'd':
         delay = atoi(optarg);
 	break;
+      case 'l':
+        latencyStats = 1;
+        break;
+      case 'o':
+        options = optarg;
+        break;
+      case 'f':
+        discardedCount = atoi(optarg);
+        break;
+      case 'D':
+        deferredCount = atoi(optarg);
+        break;
+      case 'e':
+        encodedCount = atoi(optarg);
+        break;
+    }
+  }
+
+  printf("Generating log messages: maxMsgCount=%d maxMsgSize=%d sizeIsRandom=%d delay=%d options=%s\n", maxMsgCount, maxMsgSize, sizeIsRandom, delay, options.c_str());
+
+  std::unique_ptr<InfoLogger> theLog = std::make_unique<InfoLogger>(options);
+
+  if (discardedCount > 0) {
+    // messages with trace level, discarded by local filter
+    theLog->filterDiscardLevel(InfoLogger::Level::Devel);
+    theTimer.reset();
+    for (int i = 0; i < discardedCount; i++) {
+      theLog->log(LogDebugTrace, "test message %09d %s %f", i, "some text", i * 0.5);
+    }
+    double t1 = theTimer.getTime();
+    theTimer.reset();
+    for (int i = 0; i < discardedCount; i++) {
+      InfoLoggerLog(*theLog, LogDebugTrace, "test message %09d %s %f", i, "some text", i * 0.5);
+    }
+    double t2 = theTimer.getTime();
+    printf("Discarded log calls: log() %.2lf ns/call, InfoLoggerLog() %.2lf ns/call\n", t1 * 1E9 / discardedCount, t2 * 1E9 / discardedCount);
+    theLog->filterReset();
+  }
+
+  if (deferredCount > 0) {
+    // same messages, formatted by the caller or deferred
+    theTimer.reset();
+    for (int i = 0; i < deferredCount; i++) {
+      theLog->log(LogInfoDevel, "test message %09d %s %f", i, "some text", i * 0.5);
+    }
+    double t1 = theTimer.getTime();
+    theTimer.reset();
+    for (int i = 0; i < deferredCount; i++) {
+      InfoLoggerLogDeferred(*theLog, LogInfoDevel, "test message %09d %s %f", i, "some text", i * 0.5);
+    }
+    double t2 = theTimer.getTime();
+    printf("Log calls: log() %.2lf ns/call, InfoLoggerLogDeferred() %.2lf ns/call\n", t1 * 1E9 / deferredCount, t2 * 1E9 / deferredCount);
+  }
+
+  if (encodedCount > 0) {
+    // messages with a typical context, encoded as done for each log call
+    InfoLoggerMessageHelper msgHelper;
+    infoLog_msg_t msg;
+    for (int i = 0; i < protocols[0].numberOfFields; i++) {
+      msg.values[i].isUndefined = 1;
+    }
+    msg.protocol = &protocols[0];
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_hostname, String, "alio2-cr1-flp001");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_rolename, String, "flp001");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_pid, Int, 12345);
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_username, String, "flp");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_system, String, "DAQ");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_facility, String, "readout");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_detector, String, "TPC");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_partition, String, "2mVPx4zYb9k");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_run, Int, 523456);
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_severity, String, "I");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_level, Int, 11);
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_errsource, String, "testInfoLoggerPerf.cxx");
+    InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_errline, Int, __LINE__);
+    std::string context = msgHelper.EncodeContext(&msg);
+
+    // a set of messages, with different texts and timestamps
+    std::vector<std::string> texts;
+    for (int i = 0; i < 1000; i++) {
+      texts.push_back("test message " + std::to_string(i) + " some text " + std::to_string(i * 0.5));
+    }
+    auto setMessage = [&](int i) {
+      InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_message, String, texts[i % texts.size()].c_str());
+      InfoLoggerMessageHelperSetValue(msg, msgHelper.ix_timestamp, Double, 1700000000.0 + i * 0.000173);
+    };
+
+    char buffer1[1024], buffer2[1024];
+    theTimer.reset();
+    for (int i = 0; i < encodedCount; i++) {
+      setMessage(i);
+      msgHelper.MessageToText(&msg, buffer1, sizeof(buffer1), InfoLoggerMessageHelper::Format::Encoded);
+    }
+    double t1 = theTimer.getTime();
+    theTimer.reset();
+    for (int i = 0; i < encodedCount; i++) {
+      setMessage(i);
+      msgHelper.EncodeWithContext(&msg, context.c_str(), context.length(), buffer2, sizeof(buffer2));
+    }
+    double t2 = theTimer.getTime();
+    int nDiff = 0;
+    for (int i = 0; i < (int)texts.size(); i++) {
+      setMessage(i);
+      msgHelper.MessageToText(&msg, buffer1, sizeof(buffer1), InfoLoggerMessageHelper::Format::Encoded);
+      msgHelper.EncodeWithContext(&msg, context.c_str(), context.length(), buffer2, sizeof(buffer2));
+      if (strcmp(buffer1, buffer2)) {
+        nDiff++;
+      }
+    }
+    printf("Encoding: all fields %.2lf ns/msg, context encoded once %.2lf ns/msg, %d differences\n", t1 * 1E9 / encodedCount, t2 * 1E9 / encodedCount, nDiff);
+    if (nDiff) {
+      return -1;
     }
   }
 
-  printf("Generating log messages: maxMsgCount=%d maxMsgSize=%d sizeIsRandom=%d delay=%d\n", maxMsgCount, maxMsgSize, sizeIsRandom, delay);
+  std::vector<double> latencies; // time spent in log calls, in microseconds
+  if (latencyStats) {
+    latencies.reserve(maxMsgCount);
+  }
 
   char* msgBuffer = (char*)malloc(maxMsgSize + 1);
   if (msgBuffer == nullptr)
@@ -80,7 +220,14 @@ int main(int argc, char* argv[])
     char cBak = msgBuffer[sz];
     msgBuffer[sz] = 0;
     if (!noOutput) {
-      theLog.log("%s", msgBuffer);
+      if (latencyStats) {
+        auto t0 = std::chrono::steady_clock::now();
+        theLog->log("%s", msgBuffer);
+        auto t1 = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+      } else {
+        theLog->log("%s", msgBuffer);
+      }
     }
     msgBuffer[sz] = cBak;
     if (delay > 0) {
@@ -90,6 +237,15 @@ int main(int argc, char* argv[])
   double t = theTimer.getTime();
   printf("Done in %lf seconds\n", t);
   printf("%.2lf msg/s\n", maxMsgCount / t);
+  if (latencies.size()) {
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[(size_t)(p * (latencies.size() - 1))]; };
+    printf("log() latency: p50=%.2lf us p99=%.2lf us max=%.2lf us\n", percentile(0.5), percentile(0.99), latencies.back());
+  }
+  // time to flush pending messages (in asynchronous mode)
+  theTimer.reset();
+  theLog = nullptr;
+  printf("Logger closed in %lf seconds\n", theTimer.getTime());
   if (msgBuffer != nullptr) {
     free(msgBuffer);
   }
@@ -0,0 +1,227 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerProtocol.cxx
+/// \brief Micro-benchmark of message encoding/decoding, text (1.4) vs binary (2.0) formats.
+///
+/// Usage: o2-infologger-test-protocol [-c msgCount] [-n rounds] [-s msgSize]
+/// Returns non-zero if a message is not decoded as encoded.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "infoLoggerMessage.h"
+#include "infoLoggerMessageDecode.h"
+#include "utility.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// fill a message with typical values
+static void fillMessage(infoLog_msg_t& msg, const std::string& txt, int i)
+{
+  memset(&msg, 0, sizeof(msg));
+  msg.protocol = &protocols[0];
+  for (int j = 0; j < INFOLOG_FIELDS_MAX; j++) {
+    msg.values[j].isUndefined = 1;
+  }
+  auto setString = [&](const char* field, const char* value) {
+    int ix = infoLog_msg_findField(field);
+    msg.values[ix].value.vString = value;
+    msg.values[ix].isUndefined = 0;
+  };
+  auto setInt = [&](const char* field, int value) {
+    int ix = infoLog_msg_findField(field);
+    msg.values[ix].value.vInt = value;
+    msg.values[ix].isUndefined = 0;
+  };
+  setString("severity", "I");
+  setInt("level", 11);
+  msg.values[infoLog_msg_findField("timestamp")].value.vDouble = 1600000000.123456 + i;
+  msg.values[infoLog_msg_findField("timestamp")].isUndefined = 0;
+  setString("hostname", "alio2-cr1-flp001");
+  setString("rolename", "readout");
+  setInt("pid", 12345);
+  setString("username", "flp");
+  setString("system", "DAQ");
+  setString("facility", "readout");
+  setInt("run", 500000 + i);
+  setString("message", txt.c_str());
+}
+
+// decode a buffer containing NUL-separated / length-prefixed records. Returns number of messages, list in msgs.
+static int decodeBuffer(const std::vector<char>& data, infoLog_msg_t** msgs)
+{
+  TR_blob b;
+  TR_file f;
+  memset(&f, 0, sizeof(f));
+  b.value = checked_malloc(data.size());
+  memcpy(b.value, data.data(), data.size());
+  b.size = data.size();
+  b.buffer_size = 0;
+  b.next = NULL;
+  f.first = &b;
+  f.last = &b;
+  f.size = b.size;
+  *msgs = infoLog_decode(&f);
+  int n = 0;
+  for (infoLog_msg_t* m = *msgs; m != NULL; m = m->next) {
+    n++;
+  }
+  return n;
+}
+
+// check decoded message matches original
+static int compareMessage(infoLog_msg_t& ref, infoLog_msg_t& m)
+{
+  for (int i = 0; i < protocols[0].numberOfFields; i++) {
+    if (ref.values[i].isUndefined != m.values[i].isUndefined) {
+      return __LINE__;
+    }
+    if (ref.values[i].isUndefined) {
+      continue;
+    }
+    switch (protocols[0].fields[i].type) {
+      case infoLog_msgField_def_t::ILOG_TYPE_STRING:
+        if (strcmp(ref.values[i].value.vString, m.values[i].value.vString)) {
+          return __LINE__;
+        }
+        break;
+      case infoLog_msgField_def_t::ILOG_TYPE_INT:
+        if (ref.values[i].value.vInt != m.values[i].value.vInt) {
+          return __LINE__;
+        }
+        break;
+      case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
+        // text format has microsecond resolution
+        if ((ref.values[i].value.vDouble - m.values[i].value.vDouble > 0.000001) || (m.values[i].value.vDouble - ref.values[i].value.vDouble > 0.000001)) {
+          return __LINE__;
+        }
+        break;
+      default:
+        return __LINE__;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  int msgCount = 1000; // number of messages per round
+  int rounds = 100;    // number of rounds
+  int msgSize = 100;   // size of message text
+
+  int option;
+  while ((option = getopt(argc, argv, "c:n:s:")) != -1) {
+    switch (option) {
+      case 'c':
+        msgCount = atoi(optarg);
+        break;
+      case 'n':
+        rounds = atoi(optarg);
+        break;
+      case 's':
+        msgSize = atoi(optarg);
+        break;
+    }
+  }
+  if ((msgCount <= 0) || (rounds <= 0) || (msgSize < 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  if (infoLog_proto_init()) {
+    printf("Failed to initialize protocols\n");
+    return -1;
+  }
+
+  std::string txt;
+  for (int i = 0; i < msgSize; i++) {
+    txt += (char)('a' + i % 26);
+  }
+  std::vector<infoLog_msg_t> msgs(msgCount);
+  for (int i = 0; i < msgCount; i++) {
+    fillMessage(msgs[i], txt, i);
+  }
+
+  int err = 0;
+  const int bufferSize = msgSize + 1024;
+  std::vector<char> buffer(bufferSize);
+
+  for (int binary = 0; binary <= 1; binary++) {
+    const char* format = binary ? "binary 2.0" : "text 1.4";
+    std::vector<char> data;
+    data.reserve((size_t)msgCount * bufferSize);
+
+    // encoding
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      data.clear();
+      for (int i = 0; i < msgCount; i++) {
+        int n;
+        if (binary) {
+          n = infoLog_msg_encode_binary(&msgs[i], buffer.data(), bufferSize);
+        } else {
+          n = -1;
+          if (infoLog_msg_encode(&msgs[i], buffer.data(), bufferSize, -1) == 0) {
+            n = strlen(buffer.data());
+            // same as infoLoggerD: one record per line, stored NUL-terminated
+            buffer[n - 1] = 0;
+          }
+        }
+        if (n <= 0) {
+          printf("%s: encoding failed\n", format);
+          return -1;
+        }
+        data.insert(data.end(), buffer.data(), buffer.data() + n);
+      }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double tEncode = std::chrono::duration<double>(t1 - t0).count();
+
+    // decoding
+    double tDecode = 0;
+    for (int r = 0; r < rounds; r++) {
+      infoLog_msg_t* decoded = NULL;
+      t0 = std::chrono::steady_clock::now();
+      int n = decodeBuffer(data, &decoded);
+      t1 = std::chrono::steady_clock::now();
+      tDecode += std::chrono::duration<double>(t1 - t0).count();
+      if (n != msgCount) {
+        printf("%s: %d / %d messages decoded\n", format, n, msgCount);
+        err = __LINE__;
+      }
+      if (r == 0) {
+        int i = 0;
+        for (infoLog_msg_t* m = decoded; (m != NULL) && (i < msgCount); m = m->next, i++) {
+          int cmp = compareMessage(msgs[i], *m);
+          if (cmp) {
+            printf("%s: message %d decoded with wrong content (%d)\n", format, i, cmp);
+            err = __LINE__;
+            break;
+          }
+        }
+      }
+      infoLog_msg_destroy(decoded);
+    }
+
+    double mb = (double)data.size() * rounds / (1024 * 1024);
+    double nmsg = (double)msgCount * rounds;
+    printf("%-10s : %6.1f bytes/msg   encode %8.1f MB/s %10.0f msg/s   decode %8.1f MB/s %10.0f msg/s\n", format,
+           (double)data.size() / msgCount, mb / tEncode, nmsg / tEncode, mb / tDecode, nmsg / tDecode);
+  }
+
+  return err;
+}
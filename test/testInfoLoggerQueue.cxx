@@ -0,0 +1,237 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerQueue.cxx
+/// \brief Crash-recovery test of the permanent FIFO used by infoLoggerD to queue messages on disk.
+///
+/// Usage: o2-infologger-test-queue [-n iterations] [-b batchSize] [-d directory]
+/// A child process writes numbered messages to the FIFO (and consumes some of them), and is killed at a random time.
+/// The FIFO is then opened again, and it is checked that no message flushed and not acknowledged is lost,
+/// that messages are still in order, and that acknowledged messages are not delivered again.
+/// Returns non-zero on error.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "permanentFIFO.h"
+#include "utility.h"
+
+#include <chrono>
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// progress reported by the writer process
+struct writerStatus {
+  long lastFlushed; // number of last message flushed to disk
+  long lastAcked;   // number of last message acknowledged
+};
+
+// get message number from FIFO item, or -1 if invalid
+static long getMessageNumber(struct FIFO_item& item)
+{
+  long n;
+  if ((item.size < 5) || (sscanf((char*)item.data, "msg %ld", &n) != 1)) {
+    return -1;
+  }
+  return n;
+}
+
+// writer process: write numbered messages by batches, starting from firstMessage, and consume some.
+// Progress is reported on fd. Runs until killed.
+static void writerLoop(const std::string& path, long firstMessage, int batchSize, int fd)
+{
+  struct permFIFO* f = permFIFO_new(batchSize * 2, (char*)path.c_str());
+  if (f == NULL) {
+    _exit(1);
+  }
+  struct writerStatus status = { firstMessage - 1, firstMessage - 1 };
+  char buffer[256];
+  std::string padding(100, '.');
+  const char** data = (const char**)malloc(sizeof(char*) * batchSize);
+  char* messages = (char*)malloc(sizeof(buffer) * batchSize);
+  int* sizes = (int*)malloc(sizeof(int) * batchSize);
+  if ((data == NULL) || (messages == NULL) || (sizes == NULL)) {
+    _exit(1);
+  }
+  for (long n = firstMessage;;) {
+    for (int i = 0; i < batchSize; i++, n++) {
+      data[i] = &messages[i * sizeof(buffer)];
+      sizes[i] = snprintf((char*)data[i], sizeof(buffer), "msg %ld %s", n, padding.c_str()) + 1;
+    }
+    if (permFIFO_write_copy(f, data, sizes, batchSize) != batchSize) {
+      _exit(1);
+    }
+    permFIFO_flush(f, 0);
+    status.lastFlushed = n - 1;
+    // consume less than written, so that a backlog builds up
+    for (int i = 0; i < batchSize / 2; i++) {
+      struct FIFO_item item;
+      if (permFIFO_read(f, &item, 0)) {
+        break;
+      }
+      long m = getMessageNumber(item);
+      permFIFO_ack(f, item.id);
+      checked_free(item.data);
+      status.lastAcked = m;
+    }
+    if (write(fd, &status, sizeof(status)) != sizeof(status)) {
+      _exit(1);
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int nIterations = 20; // number of crash/recovery cycles
+  int batchSize = 1000; // number of messages written at once
+  std::string directory = "/tmp";
+
+  int option;
+  while ((option = getopt(argc, argv, "n:b:d:")) != -1) {
+    switch (option) {
+      case 'n':
+        nIterations = atoi(optarg);
+        break;
+      case 'b':
+        batchSize = atoi(optarg);
+        break;
+      case 'd':
+        directory = optarg;
+        break;
+    }
+  }
+  if ((nIterations <= 0) || (batchSize <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  std::string path = directory + "/testInfoLoggerQueue." + std::to_string(getpid());
+  permFIFO_file_remove((char*)path.c_str());
+  srand(time(NULL));
+
+  int err = 0;
+  long nextMessage = 1; // number of next message expected
+  double maxRecoveryTime = 0;
+  for (int iteration = 0; (iteration < nIterations) && (!err); iteration++) {
+    int fds[2];
+    if (pipe(fds)) {
+      printf("pipe() failed: %s\n", strerror(errno));
+      return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      printf("fork() failed: %s\n", strerror(errno));
+      return -1;
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      writerLoop(path, nextMessage, batchSize, fds[1]);
+      _exit(0);
+    }
+    close(fds[1]);
+
+    // kill writer at random time
+    usleep(10000 + rand() % 100000);
+    kill(pid, SIGKILL);
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    if (!WIFSIGNALED(wstatus)) {
+      printf("Writer process failed\n");
+      return -1;
+    }
+    struct writerStatus status = { nextMessage - 1, nextMessage - 1 };
+    struct writerStatus s;
+    while (read(fds[0], &s, sizeof(s)) == sizeof(s)) {
+      status = s;
+    }
+    close(fds[0]);
+
+    // recover
+    auto t0 = std::chrono::steady_clock::now();
+    struct permFIFO* f = permFIFO_new(batchSize * 2, (char*)path.c_str());
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (f == NULL) {
+      printf("Failed to open FIFO\n");
+      return -1;
+    }
+    if (t > maxRecoveryTime) {
+      maxRecoveryTime = t;
+    }
+    long diskSize = (long)permFIFO_file_size((char*)path.c_str());
+
+    // read all pending messages
+    long first = -1, last = -1, count = 0;
+    for (;;) {
+      struct FIFO_item item;
+      if (permFIFO_read(f, &item, 0)) {
+        break;
+      }
+      long n = getMessageNumber(item);
+      permFIFO_ack(f, item.id);
+      checked_free(item.data);
+      if (first < 0) {
+        first = n;
+      } else if (n != last + 1) {
+        printf("Message %ld received after %ld\n", n, last);
+        err = __LINE__;
+        break;
+      }
+      last = n;
+      count++;
+    }
+    permFIFO_destroy(f);
+
+    printf("Iteration %d: flushed %ld, acked %ld, recovered %ld messages [%ld - %ld] from %ld bytes in %.3f ms\n", iteration, status.lastFlushed, status.lastAcked, count, first, last, diskSize, t * 1000);
+    if (err) {
+      break;
+    }
+    if (status.lastAcked < status.lastFlushed) {
+      // there should be pending messages
+      if ((count == 0) || (last < status.lastFlushed)) {
+        printf("Messages lost\n");
+        err = __LINE__;
+        break;
+      }
+    }
+    if (count) {
+      if (first <= status.lastAcked) {
+        printf("Acknowledged messages delivered again\n");
+        err = __LINE__;
+        break;
+      }
+      if (first < nextMessage) {
+        printf("Messages delivered again\n");
+        err = __LINE__;
+        break;
+      }
+    }
+
+    // continue numbering after what was written
+    if (last > status.lastFlushed) {
+      nextMessage = last + 1;
+    } else {
+      nextMessage = status.lastFlushed + 1;
+    }
+  }
+
+  permFIFO_file_remove((char*)path.c_str());
+  if (!err) {
+    printf("Test completed, max recovery time %.3f ms\n", maxRecoveryTime * 1000);
+  }
+  return err;
+}
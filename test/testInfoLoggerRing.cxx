@@ -0,0 +1,510 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerRing.cxx
+/// \brief Test of the transport from client to infoLoggerD: unix socket, or shared memory ring.
+///
+/// Usage: o2-infologger-test-ring [-n burstMessages] [-m pacedMessages] [-i pacedSleep] [-s ringSize]
+/// Messages are sent with InfoLoggerClient to a receiver thread of this process, which reads them as infoLoggerD does
+/// (on the socket, and on the ring when the client sets it up).
+/// For each mode, a burst of messages is sent as fast as possible, and then messages are sent with a sleep in between (microseconds).
+/// The system calls made by the client to send messages are counted (not including the sleeps),
+/// and the latency between send and reception is measured for paced messages.
+/// Then a client hands over a ring with a blocking eventfd attached (as an older ring setup did): it should be refused,
+/// and the messages sent on the socket afterwards received.
+/// Returns non-zero if messages are missing or out of order, if the ring is not used, or if the receiver blocks.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "InfoLoggerClient.h"
+#include "InfoLoggerRing.h"
+#include "infoLoggerDefaults.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// count of system calls made by the client to send data, in the current thread
+static thread_local unsigned long long syscalls = 0;
+
+extern "C" ssize_t send(int fd, const void* buf, size_t n, int flags)
+{
+  syscalls++;
+  return syscall(SYS_sendto, fd, buf, n, flags, nullptr, 0);
+}
+
+extern "C" ssize_t write(int fd, const void* buf, size_t n)
+{
+  syscalls++;
+  return syscall(SYS_write, fd, buf, n);
+}
+
+extern "C" int poll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+  syscalls++;
+  struct timespec ts;
+  ts.tv_sec = timeout / 1000;
+  ts.tv_nsec = (timeout % 1000) * 1000000L;
+  return syscall(SYS_ppoll, fds, nfds, (timeout >= 0) ? &ts : nullptr, nullptr, 0);
+}
+
+static unsigned long long getTime()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// receives messages from one client, as done by infoLoggerD
+// messages are lines "phase index timestamp text", phase being B (burst) or P (paced)
+class Receiver
+{
+ public:
+  Receiver(const std::string& socketName);
+  ~Receiver();
+  bool isOk() { return (listenSocket >= 0); }
+  void wait(); // wait until client disconnected
+
+  std::atomic<int> nBurst{ 0 };              // burst messages received
+  std::atomic<int> nPaced{ 0 };              // paced messages received
+  std::atomic<bool> isRingUsed{ false };     // set when client uses a ring
+  int nInvalid = 0;                          // messages invalid, or out of order
+  std::vector<unsigned long long> latencies; // latency of paced messages, in nanoseconds
+
+ private:
+  void run();
+  void readSocket();
+  void readRing();
+  void processData(int bytesRead);
+  void processLine(const char* line, int length);
+
+  int listenSocket = -1;         // socket for client connection
+  int clientSocket = -1;         // socket of connected client
+  int epollFd = -1;              // events on client socket
+  bool isClosed = false;         // set when client disconnected
+  std::vector<char> buffer;      // receiving buffer
+  int bufferUsed = 0;            // incomplete line at beginning of buffer
+  std::vector<int> receivedFds;  // file descriptors received from client
+  InfoLoggerRing ring;           // ring of client, if set up
+  std::thread thread;            // receiving thread
+};
+
+Receiver::Receiver(const std::string& socketName) : buffer(16384)
+{
+  listenSocket = socket(PF_LOCAL, SOCK_STREAM, 0);
+  struct sockaddr_un socketAddress;
+  bzero(&socketAddress, sizeof(socketAddress));
+  socketAddress.sun_family = PF_LOCAL;
+  strncpy(&socketAddress.sun_path[1], socketName.c_str(), sizeof(socketAddress.sun_path) - 2);
+  if ((listenSocket < 0) || (bind(listenSocket, (struct sockaddr*)&socketAddress, sizeof(socketAddress)) != 0) || (listen(listenSocket, 1) != 0)) {
+    if (listenSocket >= 0) {
+      close(listenSocket);
+    }
+    listenSocket = -1;
+    return;
+  }
+  thread = std::thread(&Receiver::run, this);
+}
+
+Receiver::~Receiver()
+{
+  wait();
+  if (listenSocket >= 0) {
+    close(listenSocket);
+  }
+}
+
+void Receiver::wait()
+{
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void Receiver::run()
+{
+  struct pollfd pfd;
+  pfd.fd = listenSocket;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 5000) != 1) {
+    return;
+  }
+  clientSocket = accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (clientSocket < 0) {
+    return;
+  }
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = clientSocket;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev);
+  while (!isClosed) {
+    struct epoll_event events[1];
+    int n = epoll_wait(epollFd, events, 1, 1000);
+    for (int i = 0; i < n; i++) {
+      readSocket();
+    }
+  }
+  // messages written in ring before disconnection
+  readRing();
+  close(clientSocket);
+  close(epollFd);
+  for (auto fd : receivedFds) {
+    close(fd);
+  }
+  ring.release();
+}
+
+void Receiver::readSocket()
+{
+  union {
+    char buffer[CMSG_SPACE(2 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  bool isRingSignaled = false;
+  for (;;) {
+    struct iovec iov;
+    iov.iov_base = &buffer[bufferUsed];
+    iov.iov_len = buffer.size() - 1 - bufferUsed;
+    struct msghdr msg;
+    bzero(&msg, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    int bytesRead = recvmsg(clientSocket, &msg, MSG_CMSG_CLOEXEC);
+    if ((bytesRead < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+      break;
+    }
+    if (bytesRead <= 0) {
+      isClosed = true;
+      return;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+        for (unsigned int i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++) {
+          int fd;
+          memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+          receivedFds.push_back(fd);
+        }
+      }
+    }
+    if (ring.isOk()) {
+      // wake-up bytes
+      isRingSignaled = true;
+      continue;
+    }
+    processData(bytesRead);
+  }
+  if (isRingSignaled) {
+    readRing();
+  }
+}
+
+void Receiver::readRing()
+{
+  if (!ring.isOk()) {
+    return;
+  }
+  for (;;) {
+    int bytesRead = ring.read(&buffer[bufferUsed], buffer.size() - 1 - bufferUsed);
+    if (bytesRead <= 0) {
+      if (bytesRead < 0) {
+        nInvalid++;
+      }
+      return;
+    }
+    processData(bytesRead);
+  }
+}
+
+void Receiver::processData(int bytesRead)
+{
+  char* startOfLine = buffer.data();
+  char* endOfData = &buffer[bufferUsed + bytesRead];
+  for (;;) {
+    char* endOfLine = (char*)memchr(startOfLine, '\n', endOfData - startOfLine);
+    if (endOfLine == nullptr) {
+      break;
+    }
+    *endOfLine = 0;
+    processLine(startOfLine, endOfLine - startOfLine);
+    startOfLine = endOfLine + 1;
+  }
+  bufferUsed = endOfData - startOfLine;
+  memmove(buffer.data(), startOfLine, bufferUsed);
+}
+
+void Receiver::processLine(const char* line, int length)
+{
+  if (InfoLoggerRing::isSetupLine(line, length)) {
+    char reply = '0';
+    if ((receivedFds.size() == 1) && (ring.attach(receivedFds[0], 1U << 30) == 0)) {
+      receivedFds.clear();
+      reply = '1';
+      isRingUsed = true;
+    }
+    for (auto fd : receivedFds) {
+      close(fd);
+    }
+    receivedFds.clear();
+    if (::send(clientSocket, &reply, 1, 0) != 1) {
+      nInvalid++;
+    }
+    return;
+  }
+  char phase = 0;
+  int index = -1;
+  unsigned long long t = 0;
+  if (sscanf(line, "%c %d %llu", &phase, &index, &t) != 3) {
+    nInvalid++;
+  } else if ((phase == 'B') && (index == nBurst)) {
+    nBurst++;
+  } else if ((phase == 'P') && (index == nPaced)) {
+    latencies.push_back(getTime() - t);
+    nPaced++;
+  } else {
+    nInvalid++;
+  }
+}
+
+// client handing over a valid ring, with a blocking eventfd attached
+// it should be refused, and then the messages are sent on the socket
+// returns 0 on success
+static int sendRingWithEventFd(const std::string& socketName, int nMessages)
+{
+  int err = 0;
+  int clientSocket = socket(PF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_un socketAddress;
+  bzero(&socketAddress, sizeof(socketAddress));
+  socketAddress.sun_family = PF_LOCAL;
+  strncpy(&socketAddress.sun_path[1], socketName.c_str(), sizeof(socketAddress.sun_path) - 2);
+  if ((clientSocket < 0) || (connect(clientSocket, (struct sockaddr*)&socketAddress, sizeof(socketAddress)) != 0)) {
+    printf("Failed to connect receiver\n");
+    if (clientSocket >= 0) {
+      close(clientSocket);
+    }
+    return __LINE__;
+  }
+  InfoLoggerRing ring;
+  int eventFd = eventfd(0, EFD_CLOEXEC); // blocking, never signaled
+  if ((ring.create(65536, clientSocket) != 0) || (eventFd < 0)) {
+    printf("Failed to create ring\n");
+    err = __LINE__;
+  }
+
+  if (!err) {
+    const char* line = InfoLoggerRing::getSetupLine();
+    struct iovec iov;
+    iov.iov_base = (void*)line;
+    iov.iov_len = strlen(line);
+    int fds[2] = { ring.getFd(), eventFd };
+    union {
+      char buffer[CMSG_SPACE(sizeof(fds))];
+      struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    bzero(&msg, sizeof(msg));
+    bzero(&control, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    struct pollfd pfd;
+    pfd.fd = clientSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    char reply = 0;
+    if ((sendmsg(clientSocket, &msg, 0) != (int)iov.iov_len) || (poll(&pfd, 1, 5000) != 1) || (recv(clientSocket, &reply, 1, 0) != 1)) {
+      printf("No reply to ring setup\n");
+      err = __LINE__;
+    } else if (reply != '0') {
+      printf("Ring with eventfd accepted\n");
+      err = __LINE__;
+    }
+  }
+
+  // messages on socket
+  for (int i = 0; (i < nMessages) && (!err); i++) {
+    char msg[256];
+    int n = snprintf(msg, sizeof(msg), "B %d %llu message after refused ring\n", i, getTime());
+    if (::send(clientSocket, msg, n, 0) != n) {
+      printf("Failed to send message\n");
+      err = __LINE__;
+    }
+  }
+
+  if (eventFd >= 0) {
+    close(eventFd);
+  }
+  ring.release();
+  close(clientSocket);
+  return err;
+}
+
+int main(int argc, char* argv[])
+{
+  int nBurst = 200000;    // number of messages sent as fast as possible
+  int nPaced = 20000;     // number of messages sent with a sleep in between
+  int interval = 20;      // sleep between paced messages (microseconds)
+  int ringSize = 1048576; // size of ring (bytes)
+
+  int option;
+  while ((option = getopt(argc, argv, "n:m:i:s:")) != -1) {
+    switch (option) {
+      case 'n':
+        nBurst = atoi(optarg);
+        break;
+      case 'm':
+        nPaced = atoi(optarg);
+        break;
+      case 'i':
+        interval = atoi(optarg);
+        break;
+      case 's':
+        ringSize = atoi(optarg);
+        break;
+    }
+  }
+  if ((nBurst <= 0) || (nPaced <= 0) || (interval < 0) || (ringSize <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  int err = 0;
+  std::string socketName = "infoLoggerTestRing-" + std::to_string(getpid());
+  std::string configPath = "/tmp/infoLoggerTestRing-" + std::to_string(getpid()) + ".cfg";
+  printf("mode    burst: ns/msg syscalls/msg   paced: syscalls/msg latency(us) avg  p50  p99  max\n");
+
+  for (int useRing = 0; useRing <= 1; useRing++) {
+    // client configuration
+    FILE* fp = fopen(configPath.c_str(), "w");
+    if (fp == nullptr) {
+      printf("Failed to create %s\n", configPath.c_str());
+      return -1;
+    }
+    fprintf(fp, "[" INFOLOGGER_CONFIG_SECTION_NAME_CLIENT "]\ntxSocketPath=%s\ntxRingSize=%d\n", socketName.c_str(), useRing ? ringSize : 0);
+    fclose(fp);
+    setenv(INFOLOGGER_ENV_CONFIG_PATH, ("file:" + configPath).c_str(), 1);
+
+    Receiver receiver(socketName);
+    if (!receiver.isOk()) {
+      printf("Failed to create receiver\n");
+      return -1;
+    }
+    double tBurst = 0;
+    unsigned long long syscallsBurst = 0, syscallsPaced = 0;
+    {
+      InfoLoggerClient client;
+      if (!client.isOk()) {
+        printf("Failed to connect client\n");
+        return -1;
+      }
+      char msg[256];
+      auto waitReceived = [&](std::atomic<int>& n, int expected) {
+        for (int i = 0; (n < expected) && (i < 10000); i++) {
+          usleep(1000);
+        }
+      };
+
+      // burst
+      unsigned long long s0 = syscalls;
+      auto t0 = std::chrono::steady_clock::now();
+      for (int i = 0; i < nBurst; i++) {
+        int n = snprintf(msg, sizeof(msg), "B %d %llu some text to have a typical message size ..........................................................................\n", i, getTime());
+        client.send(msg, n);
+      }
+      tBurst = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      syscallsBurst = syscalls - s0;
+      waitReceived(receiver.nBurst, nBurst);
+
+      // paced
+      s0 = syscalls;
+      for (int i = 0; i < nPaced; i++) {
+        int n = snprintf(msg, sizeof(msg), "P %d %llu some text to have a typical message size ..........................................................................\n", i, getTime());
+        client.send(msg, n);
+        if (interval) {
+          usleep(interval);
+        }
+      }
+      syscallsPaced = syscalls - s0;
+      waitReceived(receiver.nPaced, nPaced);
+    }
+    receiver.wait();
+
+    std::vector<unsigned long long>& l = receiver.latencies;
+    std::sort(l.begin(), l.end());
+    double avg = 0;
+    for (auto v : l) {
+      avg += v;
+    }
+    if (l.size()) {
+      avg /= l.size();
+    }
+    auto percentile = [&](double p) { return l.size() ? l[(size_t)(p * (l.size() - 1))] / 1000.0 : 0; };
+    printf("%-6s  %14.1f %12.3f   %20.3f %15.1f %4.1f %4.1f %4.0f\n", useRing ? "ring" : "socket", tBurst * 1E9 / nBurst, syscallsBurst * 1.0 / nBurst,
+           syscallsPaced * 1.0 / nPaced, avg / 1000.0, percentile(0.5), percentile(0.99), percentile(1));
+
+    if ((receiver.nBurst != nBurst) || (receiver.nPaced != nPaced) || (receiver.nInvalid)) {
+      printf("Messages missing or invalid: %d/%d burst, %d/%d paced, %d invalid\n", (int)receiver.nBurst, nBurst, (int)receiver.nPaced, nPaced, receiver.nInvalid);
+      err = __LINE__;
+    }
+    if ((bool)useRing != receiver.isRingUsed) {
+      printf("Ring %s\n", useRing ? "not used" : "used unexpectedly");
+      err = __LINE__;
+    }
+  }
+
+  unlink(configPath.c_str());
+
+  // ring with a blocking eventfd
+  {
+    const int nMessages = 1000;
+    Receiver receiver(socketName);
+    if (!receiver.isOk()) {
+      printf("Failed to create receiver\n");
+      return -1;
+    }
+    if (sendRingWithEventFd(socketName, nMessages)) {
+      err = __LINE__;
+    }
+    for (int i = 0; (receiver.nBurst < nMessages) && (i < 10000); i++) {
+      usleep(1000);
+    }
+    if ((receiver.nBurst != nMessages) || (receiver.isRingUsed)) {
+      // receiver may be blocked: do not wait for it
+      printf("Ring with eventfd: %d/%d messages received, ring %s\n", (int)receiver.nBurst, nMessages, receiver.isRingUsed ? "used" : "not used");
+      fflush(stdout);
+      _exit(1);
+    }
+    receiver.wait();
+    printf("ring with blocking eventfd refused, %d messages received on socket\n", nMessages);
+  }
+
+  return err;
+}
@@ -0,0 +1,296 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerServer.cxx
+/// \brief Test of the infoLoggerServer reception layer, with many simulated infoLoggerD clients connected locally.
+///
+/// Usage: o2-infologger-test-server [-c numberOfClients] [-t rxThreads] [-n filesPerClient] [-m messagesPerFile] [-p port] [-l logFile]
+/// Each client connects to the transport server, and sends numbered files as infoLoggerD does.
+/// It is checked that all files are received, in order and unmodified for each client, and acknowledged.
+/// The ingest rate is reported. The open files limit should allow 2 sockets per client (server and client side in the same process).
+/// Returns non-zero on error.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "transport_server.h"
+#include "simplelog.h"
+#include "utility.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// content of a file sent by a client
+static std::string generateFile(int client, int file, int nMessages)
+{
+  std::string b;
+  for (int j = 0; j < nMessages; j++) {
+    char msg[512];
+    int n = snprintf(msg, sizeof(msg), "*1.4#I#11#%.6lf#testhost%04d#test#12345#flp#DAQ#test#####%d#%s#Message %d of file %d - some text to have a typical size ...........................",
+                     1600000000.123456 + file, client, 100 + j, "testInfoLoggerServer.cxx", j, file);
+    b.append(msg, n + 1); // NUL separated
+  }
+  return b;
+}
+
+// send a buffer completely. Returns 0 on success
+static int sendAll(int fd, const char* data, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n <= 0) {
+      if ((n < 0) && (errno == EINTR)) {
+        continue;
+      }
+      return -1;
+    }
+    data += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// state of a simulated client
+struct client {
+  int fd = -1;            // socket
+  std::string rxBuffer;   // bytes received from server, not parsed yet
+  int lastAck = 0;        // last file acknowledged by server
+  int nextFileRx = 1;     // next file expected on server side
+  bool rxError = false;   // set if file received out of order or corrupted
+};
+
+int main(int argc, char* argv[])
+{
+  int nClients = 4000;   // number of simulated infoLoggerD
+  int rxThreads = 4;     // number of receiving threads of the server
+  int nFiles = 20;       // number of files sent by each client
+  int nMessages = 10;    // number of messages per file
+  int port = 16006;      // server port
+  std::string logFile = "/dev/null";
+
+  int option;
+  while ((option = getopt(argc, argv, "c:t:n:m:p:l:")) != -1) {
+    switch (option) {
+      case 'c':
+        nClients = atoi(optarg);
+        break;
+      case 't':
+        rxThreads = atoi(optarg);
+        break;
+      case 'n':
+        nFiles = atoi(optarg);
+        break;
+      case 'm':
+        nMessages = atoi(optarg);
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'l':
+        logFile = optarg;
+        break;
+    }
+  }
+  if ((nClients <= 0) || (rxThreads <= 0) || (nFiles <= 0) || (nMessages <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+  slog_set_file((char*)logFile.c_str(), 0);
+
+  // both ends of each connection are in this process
+  struct rlimit fdLimit;
+  if (getrlimit(RLIMIT_NOFILE, &fdLimit) == 0) {
+    fdLimit.rlim_cur = fdLimit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &fdLimit);
+    int maxClients = ((int)fdLimit.rlim_cur - 100) / 2;
+    if (nClients > maxClients) {
+      printf("Open files limit %ld too low, using %d clients instead of %d\n", (long)fdLimit.rlim_cur, maxClients, nClients);
+      nClients = maxClients;
+    }
+  }
+
+  TR_server_configuration cfg;
+  cfg.server_type = TR_SERVER_TCP;
+  cfg.server_port = port;
+  cfg.max_clients = nClients;
+  cfg.queue_length = 10000;
+  cfg.rx_threads = rxThreads;
+  TR_server_handle server = TR_server_start(&cfg);
+  if (server == NULL) {
+    printf("Failed to start server\n");
+    return -1;
+  }
+
+  // connect clients
+  std::vector<client> clients(nClients);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int err = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < nClients; i++) {
+    clients[i].fd = socket(AF_INET, SOCK_STREAM, 0);
+    if ((clients[i].fd < 0) || (connect(clients[i].fd, (struct sockaddr*)&addr, sizeof(addr)))) {
+      printf("Client %d: connect failed: %s\n", i, strerror(errno));
+      err = __LINE__;
+      break;
+    }
+    char ini[64];
+    snprintf(ini, sizeof(ini), "INI testhost%04d 0\n", i);
+    if (sendAll(clients[i].fd, ini, strlen(ini))) {
+      err = __LINE__;
+      break;
+    }
+  }
+  for (int i = 0; (i < nClients) && (!err); i++) {
+    char c = 0;
+    std::string reply;
+    while ((c != '\n') && (read(clients[i].fd, &c, 1) == 1)) {
+      reply += c;
+    }
+    if (reply.compare(0, 5, "READY")) {
+      printf("Client %d: unexpected reply: %s\n", i, reply.c_str());
+      err = __LINE__;
+    }
+  }
+  double tConnect = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  if (!err) {
+    printf("%d clients connected in %.3f s\n", nClients, tConnect);
+  }
+
+  // server side: check files as they come, and acknowledge them
+  unsigned long long nTotal = (unsigned long long)nClients * nFiles;
+  std::atomic<unsigned long long> nReceived(0);
+  std::atomic<unsigned long long> bytesReceived(0);
+  std::atomic<bool> shutdown(false);
+  std::thread reader([&] {
+    while (!shutdown) {
+      TR_file* f = TR_server_get_file(server, 1);
+      if (f == NULL) {
+        continue;
+      }
+      int ix = -1;
+      if ((f->id.source != NULL) && (sscanf(f->id.source, "testhost%d", &ix) == 1) && (ix >= 0) && (ix < nClients)) {
+        client& c = clients[ix];
+        std::string expected = generateFile(ix, f->id.minId, nMessages);
+        if ((f->id.minId != c.nextFileRx) || (f->first == NULL) || (f->first->size != (int)expected.size()) || (memcmp(f->first->value, expected.data(), expected.size()))) {
+          c.rxError = true;
+        }
+        c.nextFileRx = f->id.minId + 1;
+        bytesReceived += f->size;
+      }
+      TR_server_ack_file(server, &f->id);
+      TR_file_destroy(f);
+      nReceived++;
+    }
+  });
+
+  // send files, one per client at a time
+  t0 = std::chrono::steady_clock::now();
+  for (int n = 1; (n <= nFiles) && (!err); n++) {
+    for (int i = 0; i < nClients; i++) {
+      std::string data = generateFile(i, n, nMessages);
+      char header[128];
+      snprintf(header, sizeof(header), "File testhost%04d %d %d %d\n", i, n, 1, (int)data.size());
+      data = header + data + "END\n";
+      if (sendAll(clients[i].fd, data.data(), data.size())) {
+        printf("Client %d: send failed: %s\n", i, strerror(errno));
+        err = __LINE__;
+        break;
+      }
+    }
+  }
+
+  // wait all files received
+  for (int i = 0; (i < 100) && (nReceived < nTotal) && (!err); i++) {
+    usleep(100000);
+  }
+  double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  if ((!err) && (nReceived != nTotal)) {
+    printf("Received %llu files, %llu expected\n", (unsigned long long)nReceived, nTotal);
+    err = __LINE__;
+  }
+
+  // wait all files acknowledged (server sends acks at least once a second)
+  int nAcked = 0;
+  std::vector<struct pollfd> fds(nClients);
+  for (int iter = 0; (iter < 50) && (nAcked < nClients) && (!err); iter++) {
+    for (int i = 0; i < nClients; i++) {
+      fds[i].fd = (clients[i].lastAck == nFiles) ? -1 : clients[i].fd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    if (poll(fds.data(), fds.size(), 100) <= 0) {
+      continue;
+    }
+    for (int i = 0; i < nClients; i++) {
+      if (!(fds[i].revents & POLLIN)) {
+        continue;
+      }
+      char buf[1024];
+      ssize_t n = read(clients[i].fd, buf, sizeof(buf));
+      if (n <= 0) {
+        printf("Client %d: connection closed by server\n", i);
+        err = __LINE__;
+        break;
+      }
+      clients[i].rxBuffer.append(buf, n);
+      size_t eol;
+      while ((eol = clients[i].rxBuffer.find('\n')) != std::string::npos) {
+        int minId, majId;
+        if (sscanf(clients[i].rxBuffer.c_str(), "ACK %d %d", &minId, &majId) == 2) {
+          clients[i].lastAck = minId;
+          if (minId == nFiles) {
+            nAcked++;
+          }
+        }
+        clients[i].rxBuffer.erase(0, eol + 1);
+      }
+    }
+  }
+  if ((!err) && (nAcked != nClients)) {
+    printf("%d clients acknowledged, %d expected\n", nAcked, nClients);
+    err = __LINE__;
+  }
+
+  shutdown = true;
+  reader.join();
+  for (int i = 0; i < nClients; i++) {
+    if (clients[i].rxError) {
+      printf("Client %d: files received out of order or corrupted\n", i);
+      err = __LINE__;
+    }
+    if (clients[i].fd >= 0) {
+      close(clients[i].fd);
+    }
+  }
+  TR_server_stop(server);
+
+  printf("%d clients, %d receiving threads: %llu files (%llu messages, %.1f MB) in %.3f s = %.0f files/s, %.0f msg/s, %.1f MB/s\n", nClients, rxThreads, (unsigned long long)nReceived, (unsigned long long)nReceived * nMessages, bytesReceived / (1024.0 * 1024.0), t, nReceived / t, nReceived * nMessages / t, bytesReceived / (1024.0 * 1024.0 * t));
+  if (!err) {
+    printf("Test completed\n");
+  }
+  return err;
+}
@@ -0,0 +1,247 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerStats.cxx
+/// \brief Benchmark of the infoLoggerServer statistics counters.
+///
+/// Usage: o2-infologger-test-stats [-n numberOfFiles] [-m messagesPerFile] [-r rounds]
+/// Messages are counted with the indexes of InfoLoggerDispatchStats, and the rate is reported.
+/// For comparison, they are also counted as previously done by the server (message encoded, and strings built for each field combination).
+/// Messages are also counted with approximate indexes (count-min sketch and top keys), and the estimates are checked against the exact counts.
+/// Returns non-zero if counts differ, or if approximate counts are out of bounds.
+///
+/// \author Sylvain Chapeland, CERN
+
+#include "InfoLoggerMessageList.h"
+#include "InfoLoggerMessageStats.h"
+#include "infoLoggerMessage.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// the indexes defined by InfoLoggerDispatchStats
+static const std::vector<std::vector<std::string>> indexes = {
+  { "severity" }, { "level" }, { "hostname" }, { "rolename" }, { "hostname", "pid" }, { "system" }, { "facility" }, { "detector" }, { "partition" }, { "run" }, { "run", "detector", "severity", "level" }, { "run", "hostname", "severity", "level" }, { "run", "hostname", "facility" }, { "errcode" }, { "errsource", "errline" }, { "hostname", "pid", "errsource", "errline" }
+};
+
+// a file with messages, as received from infoLoggerD
+static TR_file* generateFile(int file, int nMessages)
+{
+  static const char* severities = "IIIIWWEF";
+  static const char* detectors[] = { "TPC", "ITS", "MFT", "TOF", "" };
+  static const char* facilities[] = { "readout", "stfb", "task/ITSFEE", "readout-proxy", "ctp-proxy", "odc" };
+  std::string b;
+  for (int j = 0; j < nMessages; j++) {
+    char msg[512];
+    int k = file * nMessages + j;
+    int n = snprintf(msg, sizeof(msg), "*1.4#%c#%d#%.6lf#alio2-cr1-flp%03d#readout#%d#flp#DAQ#%s#%s#PHYSICS_1#%d#%d#%d#%s#Message %d of file %d - some text to have a typical size ...........................",
+                     severities[k % 8], 1 + k % 21, 1600000000.123456 + file, k % 200, 10000 + k % 1000, facilities[k % 6], detectors[k % 5], 500000 + k % 3, 3000 + k % 50, 100 + k % 300, "readout.cxx", j, file);
+    b.append(msg, n + 1); // NUL separated
+  }
+  TR_file* f = TR_file_new();
+  TR_blob* blob = TR_blob_new(b.size());
+  memcpy(blob->value, b.data(), b.size());
+  f->first = blob;
+  f->last = blob;
+  f->size = blob->size;
+  return f;
+}
+
+// string value of a field, empty if undefined
+static std::string getStringValue(infoLog_msg_t* m, int i)
+{
+  if (m->values[i].isUndefined) {
+    return "";
+  }
+  switch (m->protocol->fields[i].type) {
+    case infoLog_msgField_def_t::ILOG_TYPE_STRING:
+      return m->values[i].value.vString;
+    case infoLog_msgField_def_t::ILOG_TYPE_INT:
+      return std::to_string(m->values[i].value.vInt);
+    case infoLog_msgField_def_t::ILOG_TYPE_DOUBLE:
+      return std::to_string(m->values[i].value.vDouble);
+    default:
+      break;
+  }
+  return "";
+}
+
+int main(int argc, char* argv[])
+{
+  int nFiles = 1000;  // number of files
+  int nMessages = 100; // number of messages per file
+  int rounds = 10;    // number of times messages are counted
+
+  int option;
+  while ((option = getopt(argc, argv, "n:m:r:")) != -1) {
+    switch (option) {
+      case 'n':
+        nFiles = atoi(optarg);
+        break;
+      case 'm':
+        nMessages = atoi(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+    }
+  }
+  if ((nFiles <= 0) || (nMessages <= 0) || (rounds <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  if (infoLog_proto_init()) {
+    printf("Failed to initialize protocols\n");
+    return -1;
+  }
+
+  // decoded messages
+  std::vector<std::shared_ptr<InfoLoggerMessageList>> msgLists;
+  for (int i = 0; i < nFiles; i++) {
+    TR_file* f = generateFile(i, nMessages);
+    msgLists.push_back(std::make_shared<InfoLoggerMessageList>(f));
+    TR_file_destroy(f);
+  }
+  unsigned long long nMsg = (unsigned long long)nFiles * nMessages * rounds;
+
+  // count with interned values
+  InfoLoggerMessageStats stats;
+  for (const auto& ix : indexes) {
+    if (stats.addIndex(ix)) {
+      printf("Failed to define index\n");
+      return -1;
+    }
+  }
+  stats.startWindow(1600000000, 60, 600);
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const auto& l : msgLists) {
+      for (infoLog_msg_t* m = l->msg; m != NULL; m = m->next) {
+        stats.count(m);
+      }
+    }
+  }
+  double t1 = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // count with strings
+  std::vector<std::vector<int>> fields;
+  for (const auto& ix : indexes) {
+    std::vector<int> l;
+    for (const auto& name : ix) {
+      l.push_back(infoLog_msg_findField(name.c_str()));
+    }
+    fields.push_back(l);
+  }
+  std::vector<std::unordered_map<std::string, uint64_t>> counts(indexes.size());
+  std::vector<char> encoded(32768);
+  t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const auto& l : msgLists) {
+      for (infoLog_msg_t* m = l->msg; m != NULL; m = m->next) {
+        if (infoLog_msg_encode(m, encoded.data(), encoded.size(), -1)) {
+          continue;
+        }
+        for (size_t i = 0; i < fields.size(); i++) {
+          std::string v;
+          bool incomplete = false;
+          for (size_t j = 0; j < fields[i].size(); j++) {
+            if (j) {
+              v += "-";
+            }
+            std::string fv = getStringValue(m, fields[i][j]);
+            if (fv == "") {
+              incomplete = true;
+              break;
+            }
+            v += fv;
+          }
+          if (!incomplete) {
+            counts[i][v]++;
+          }
+        }
+      }
+    }
+  }
+  double t2 = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // count with approximate indexes
+  InfoLoggerMessageStats sketchStats;
+  for (const auto& ix : indexes) {
+    sketchStats.addIndex(ix, 100);
+  }
+  sketchStats.startWindow(1600000000, 60, 600);
+  t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const auto& l : msgLists) {
+      for (infoLog_msg_t* m = l->msg; m != NULL; m = m->next) {
+        sketchStats.count(m);
+      }
+    }
+  }
+  double t3 = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // compare
+  int err = 0;
+  size_t nKeys = 0;
+  for (size_t i = 0; i < indexes.size(); i++) {
+    std::map<std::string, uint64_t> c;
+    stats.getCounts(i, c);
+    std::map<std::string, uint64_t> ref(counts[i].begin(), counts[i].end());
+    if (c != ref) {
+      printf("Counts differ for index %s\n", stats.getIndexName(i).c_str());
+      err = __LINE__;
+    }
+    nKeys += c.size();
+
+    // estimates are never below exact counts, and their average error is within bounds
+    uint64_t distinct, distinctError, countError;
+    if (sketchStats.getSketchInfo(i, distinct, distinctError, countError)) {
+      err = __LINE__;
+      continue;
+    }
+    sketchStats.getCounts(i, c);
+    uint64_t totalError = 0;
+    for (const auto& it : c) {
+      auto itRef = ref.find(it.first);
+      if ((itRef == ref.end()) || (it.second < itRef->second)) {
+        printf("Approximate count invalid for index %s key %s\n", stats.getIndexName(i).c_str(), it.first.c_str());
+        err = __LINE__;
+        break;
+      }
+      totalError += it.second - itRef->second;
+    }
+    if (((c.size() != std::min(ref.size(), (size_t)100))) || (totalError > countError * c.size())) {
+      printf("Approximate counts out of bounds for index %s\n", stats.getIndexName(i).c_str());
+      err = __LINE__;
+    }
+    if ((distinct + 3 * distinctError < ref.size()) || (distinct > ref.size() + 3 * distinctError)) {
+      printf("Approximate distinct count out of bounds for index %s: %llu +/- %llu, expected %d\n", stats.getIndexName(i).c_str(), (unsigned long long)distinct, (unsigned long long)distinctError, (int)ref.size());
+      err = __LINE__;
+    }
+  }
+
+  printf("%llu messages, %d indexes, %d keys, %d values\n", nMsg, (int)indexes.size(), (int)nKeys, (int)stats.getNumberOfValues());
+  printf("interned values: %.3f s = %10.0f msg/s\n", t1, nMsg / t1);
+  printf("previous method: %.3f s = %10.0f msg/s\n", t2, nMsg / t2);
+  printf("approximate:     %.3f s = %10.0f msg/s\n", t3, nMsg / t3);
+  return err;
+}
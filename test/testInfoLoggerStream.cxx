@@ -0,0 +1,182 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+/// \file testInfoLoggerStream.cxx
+/// \brief Test of messages built with the << operator, from concurrent threads.
+///
+/// Usage: o2-infologger-test-stream [-t threads] [-m messagesPerThread] [-n benchmarkMessages]
+/// Each thread builds messages with << on the same logger, and the messages kept in history are checked
+/// (each one complete, not mixed with others, and in order for a given thread).
+/// Then the cost of << messages is measured, in time and memory allocations per message, and compared
+/// to the previous method (arguments converted with boost::lexical_cast) and to log() with the same text.
+/// Returns non-zero if a message is invalid, or if << allocates more memory than log().
+///
+/// \author Sylvain Chapeland, CERN
+
+#include <InfoLogger/InfoLogger.hxx>
+#include <InfoLogger/InfoLoggerMacros.hxx>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace AliceO2::InfoLogger;
+
+// count of memory allocations in the process
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(size_t size)
+{
+  allocations++;
+  void* p = malloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+// floating point values used in messages, and their expected text
+static const double values[] = { 0, 0.25, 0.5, 0.75, 1, 1.25, 1.5, 1.75 };
+static const char* valuesText[] = { "0", "0.25", "0.5", "0.75", "1", "1.25", "1.5", "1.75" };
+
+int main(int argc, char* argv[])
+{
+  int nThreads = 8;            // number of threads logging concurrently
+  int nMessagesPerThread = 10000; // number of messages logged by each thread
+  int nBenchmark = 100000;     // number of messages for benchmark
+
+  int option;
+  while ((option = getopt(argc, argv, "t:m:n:")) != -1) {
+    switch (option) {
+      case 't':
+        nThreads = atoi(optarg);
+        break;
+      case 'm':
+        nMessagesPerThread = atoi(optarg);
+        break;
+      case 'n':
+        nBenchmark = atoi(optarg);
+        break;
+    }
+  }
+  if ((nThreads <= 0) || (nMessagesPerThread <= 0) || (nBenchmark <= 0)) {
+    printf("Invalid parameters\n");
+    return -1;
+  }
+
+  int err = 0;
+  InfoLogger theLog("outputMode=none,floodProtection=0");
+
+  // concurrent messages, kept in history
+  theLog.historyReset(nThreads * nMessagesPerThread + 1, false, InfoLogger::Severity::Debug, InfoLogger::Level::Trace);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < nMessagesPerThread; i++) {
+        theLog << LogInfoOps << "thread " << t << " message " << i << " " << values[i % 8] << ' ' << true << ' ' << -i << ' ' << std::string("s") << std::string_view("v") << InfoLogger::endm;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  std::vector<std::string> summary;
+  theLog.historyGetSummary(summary);
+  std::vector<int> nextMessage(nThreads, 0);
+  int nInvalid = 0;
+  for (const auto& s : summary) {
+    int t = -1, i = -1;
+    size_t ix = s.find("thread ");
+    if ((ix == std::string::npos) || (sscanf(&s[ix], "thread %d message %d", &t, &i) != 2) || (t < 0) || (t >= nThreads) || (i != nextMessage[t])) {
+      nInvalid++;
+      continue;
+    }
+    std::string expected = "thread " + std::to_string(t) + " message " + std::to_string(i) + " " + valuesText[i % 8] + " 1 " + std::to_string(-i) + " sv";
+    if (s.substr(ix) != expected) {
+      nInvalid++;
+      continue;
+    }
+    nextMessage[t]++;
+  }
+  for (int t = 0; t < nThreads; t++) {
+    if (nextMessage[t] != nMessagesPerThread) {
+      nInvalid++;
+    }
+  }
+  printf("%d threads, %d messages, %d invalid\n", nThreads, (int)summary.size(), nInvalid);
+  if (nInvalid) {
+    err = __LINE__;
+  }
+
+  // long message, truncated as with log()
+  std::string longText(2000, 'x');
+  theLog.historyReset(1, false, InfoLogger::Severity::Debug, InfoLogger::Level::Trace);
+  theLog << LogInfoOps << longText << longText << InfoLogger::endm;
+  theLog.historyGetSummary(summary);
+  if ((summary.size() != 1) || (summary[0].find(std::string(1023, 'x')) == std::string::npos) || (summary[0].find(std::string(1024, 'x')) != std::string::npos)) {
+    printf("Long message not truncated as expected\n");
+    err = __LINE__;
+  }
+  theLog.historyReset();
+
+  // cost per message, after first one (buffers allocated)
+  auto measure = [&](const char* name, auto logMessage) {
+    logMessage(0);
+    unsigned long long a0 = allocations.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nBenchmark; i++) {
+      logMessage(i);
+    }
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    double a = (allocations.load() - a0) * 1.0 / nBenchmark;
+    printf("%-16s %8.2f ns/msg %6.2f allocations/msg\n", name, t * 1E9 / nBenchmark, a);
+    return a;
+  };
+  double aStream = measure("<< operator:", [&](int i) {
+    theLog << LogInfoOps << "message " << i << " value " << values[i % 8] << " count " << (unsigned long)i * 1000 << InfoLogger::endm;
+  });
+  measure("previous method:", [&](int i) {
+    std::string message;
+    message.append("message ");
+    message.append(boost::lexical_cast<std::string>(i));
+    message.append(" value ");
+    message.append(boost::lexical_cast<std::string>(values[i % 8]));
+    message.append(" count ");
+    message.append(boost::lexical_cast<std::string>((unsigned long)i * 1000));
+    theLog.log(LogInfoOps, "%s", message.c_str());
+  });
+  double aLog = measure("log():", [&](int i) {
+    theLog.log(LogInfoOps, "message %d value %s count %lu", i, valuesText[i % 8], (unsigned long)i * 1000);
+  });
+  if (aStream > aLog) {
+    printf("Memory allocated by << operator\n");
+    err = __LINE__;
+  }
+
+  return err;
+}